@@ -0,0 +1,95 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+/**
+ * @brief Recall and query time of the HNSW graph against the exact top-K
+ *        engine, for a few graph configurations (links per document, build
+ *        breadth) and query search breadths, on a synthetic corpus whose
+ *        documents are about topics. Choose the cheapest row that reaches
+ *        the recall you need
+ *
+ * Usage: annBench [-j threads] [-k neighbours] [-q queries] [-n words]
+ *                 [-v vocabulary] [-c topics] [-s topic share] [documents]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "annBench [-j threads] [-k neighbours] [-q queries] [-n words] "
+      "[-v vocabulary] [-c topics] [-s topic share] [documents]";
+  size_t threads = 1;
+  size_t k = 10;
+  size_t queries = 500;
+  size_t length = 150;
+  size_t vocabulary = 50000;
+  size_t topics = 200;
+  double share = 0.5;
+  size_t documents = 20000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else if (arg == "-q" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], queries, size_t{1});
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{2});
+    } else if (arg == "-c" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], topics);
+    } else if (arg == "-s" && i + 1 < argc) {
+      valid = ParseReal(argv[++i], share, 0.0, 1.0);
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+
+  SyntheticCorpus generator("en", vocabulary);
+  generator.SetTopics(topics, share);
+  TemporaryCorpus corpus(generator, documents, length);
+  DocumentManager dm(corpus.paths(), generator.stopWordsFile(),
+                     generator.lemmasFile(), threads);
+
+  std::cout << "documents: " << documents << ", topics: " << topics
+            << ", words per document: " << length << ", k: " << k
+            << ", queries: " << queries << "\n\n"
+            << std::right << std::setw(6) << "links" << std::setw(10)
+            << "build ef" << std::setw(9) << "build s" << std::setw(6)
+            << "ef" << std::setw(9) << "recall" << std::setw(9) << "scored"
+            << std::setw(11) << "exact ms" << std::setw(10) << "HNSW ms"
+            << "\n"
+            << std::string(70, '-') << std::endl;
+  const std::pair<size_t, size_t> graphs[] = {{8, 64}, {16, 100}, {32, 200}};
+  const std::vector<size_t> breadths = {16, 32, 64, 128, 256};
+  for (const auto &graph : graphs) {
+    AnnParameters parameters;
+    parameters.links = graph.first;
+    parameters.buildBreadth = graph.second;
+    for (const RecallReport &report :
+         dm.EvaluateRecall(k, 0.0, parameters, breadths, queries)) {
+      double n = std::max<size_t>(report.queries, 1);
+      std::cout << std::setw(6) << graph.first << std::setw(10)
+                << graph.second << std::fixed << std::setprecision(2)
+                << std::setw(9) << report.buildSeconds << std::setw(6)
+                << report.searchBreadth << std::setprecision(4)
+                << std::setw(9) << report.recall << std::setprecision(0)
+                << std::setw(9) << report.scored << std::setprecision(3)
+                << std::setw(11) << report.exactSeconds * 1e3 / n
+                << std::setw(10) << report.approximateSeconds * 1e3 / n
+                << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef BENCH_ARGUMENTS_H_
+#define BENCH_ARGUMENTS_H_
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+/**
+ * @brief Parse an unsigned integer argument of a benchmark. The whole text
+ *        must be decimal digits, so "--help", "-1" or "10k" are rejected
+ *        instead of being read as 0 or truncated
+ * @param text Argument
+ * @param value Set to the parsed number
+ * @param minimum Smallest value accepted
+ * @return Whether the argument is a number of at least minimum that fits
+ */
+template <typename T>
+bool ParseCount(const char *text, T &value, T minimum = 0) {
+  if (*text < '0' || *text > '9') return false;
+  errno = 0;
+  char *end = nullptr;
+  unsigned long long parsed = std::strtoull(text, &end, 10);
+  if (errno == ERANGE || *end != '\0' ||
+      parsed > std::numeric_limits<T>::max() || parsed < minimum) {
+    return false;
+  }
+  value = static_cast<T>(parsed);
+  return true;
+}
+
+/**
+ * @brief Parse a real argument of a benchmark, such as a threshold or a
+ *        fraction. The whole text must be a finite number
+ * @param text Argument
+ * @param value Set to the parsed number
+ * @param minimum Smallest value accepted
+ * @param maximum Largest value accepted
+ * @return Whether the argument is a number within the bounds
+ */
+inline bool ParseReal(const char *text, double &value, double minimum,
+                      double maximum) {
+  if (*text == '\0' || std::isspace(static_cast<unsigned char>(*text))) {
+    return false;
+  }
+  errno = 0;
+  char *end = nullptr;
+  double parsed = std::strtod(text, &end);
+  if (errno == ERANGE || *end != '\0' || !std::isfinite(parsed) ||
+      parsed < minimum || parsed > maximum) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+/**
+ * @brief Whether an argument asks for the usage of a benchmark
+ */
+inline bool IsHelp(const std::string &arg) {
+  return arg == "-h" || arg == "--help";
+}
+
+/**
+ * @brief Report an argument a benchmark cannot use, with its usage
+ * @param arg Unknown or invalid argument
+ * @param usage Usage line of the benchmark, without "Usage: "
+ * @return Exit status for main
+ */
+inline int InvalidArgument(const std::string &arg, const char *usage) {
+  std::cerr << "Error: invalid argument '" << arg << "'\nUsage: " << usage
+            << std::endl;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+/**
+ * @brief Write a synthetic corpus to a directory, to time the command line
+ *        program on corpora of any size. Prints the options to run it with
+ *
+ * Usage: corpusGenerator [-l en|es] [-n words] [-v vocabulary] [-s seed]
+ *                        directory documents
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "corpusGenerator [-l en|es] [-n words] [-v vocabulary] [-s seed] "
+      "directory documents";
+  std::string language = "en";
+  size_t length = 150;
+  size_t vocabulary = 50000;
+  uint64_t seed = 42;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-l" && i + 1 < argc) {
+      language = argv[++i];
+      valid = language == "en" || language == "es";
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-s" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], seed);
+    } else {
+      valid = arg.empty() || arg[0] != '-';
+      positional.push_back(arg);
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (positional.size() != 2) {
+    std::cerr << "Usage: " << usage << std::endl;
+    return 1;
+  }
+  size_t documents = 0;
+  if (!ParseCount(positional[1].c_str(), documents, size_t{1})) {
+    return InvalidArgument(positional[1], usage);
+  }
+  const std::string &directory = positional[0];
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "Error: Cannot create directory '" << directory << "'"
+              << std::endl;
+    return 1;
+  }
+
+  SyntheticCorpus corpus(language, vocabulary, seed);
+  corpus.WriteDocuments(directory, documents, length);
+  std::cout << "-d " << directory << "/*.txt -s " << corpus.stopWordsFile()
+            << " -l " << corpus.lemmasFile() << std::endl;
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+/**
+ * @brief Copy of a text with a share of its words replaced by other words
+ * @param text Original text
+ * @param filler Text the replacement words are taken from
+ * @param rate Share of words replaced
+ * @param random Random generator
+ * @return Edited text, one line
+ */
+std::string Edit(const std::string &text, const std::string &filler,
+                 double rate, std::mt19937_64 &random) {
+  std::istringstream words(text);
+  std::istringstream replacements(filler);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::string edited;
+  std::string word;
+  std::string replacement;
+  while (words >> word) {
+    if (coin(random) < rate && replacements >> replacement) word = replacement;
+    edited += word + ' ';
+  }
+  return edited;
+}
+
+}  // namespace
+
+/**
+ * @brief Quality and cost of the near-duplicate pass on a synthetic corpus
+ *        where some documents are edited copies of others. For every edit
+ *        rate, the copies found are those clustered with their original and
+ *        the false merges are documents clustered with one that is neither
+ *        their original nor a copy of it. The time is that of the detection
+ *        stage alone
+ *
+ * Usage: dedupBench [-j threads] [-t threshold] [-c copies] [-n words]
+ *                   [documents]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "dedupBench [-j threads] [-t threshold] [-c copies] [-n words] "
+      "[documents]";
+  size_t threads = 1;
+  double threshold = 0.8;
+  size_t copies = 1000;
+  size_t length = 300;
+  size_t documents = 10000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-t" && i + 1 < argc) {
+      valid = ParseReal(argv[++i], threshold, 0.0, 1.0);
+    } else if (arg == "-c" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], copies);
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  copies = std::min(copies, documents);
+
+  SyntheticCorpus generator("en", 20000);
+  char pattern[] = "/tmp/dedupBench-XXXXXX";
+  if (mkdtemp(pattern) == nullptr) {
+    std::cerr << "Error: Cannot create the benchmark corpus directory"
+              << std::endl;
+    exit(1);
+  }
+  std::string directory = pattern;
+  std::vector<std::string> texts;
+  for (size_t d = 0; d < documents; ++d) {
+    texts.push_back(generator.Text(length));
+  }
+  DeduplicationOptions options;
+  options.enabled = true;
+  options.threshold = threshold;
+
+  std::cout << "documents: " << documents << " + " << copies
+            << " edited copies, words per document: " << length
+            << ", threshold: " << threshold << "\n\n"
+            << std::right << std::setw(8) << "edited" << std::setw(10)
+            << "found" << std::setw(10) << "false" << std::setw(12)
+            << "detect ms" << std::setw(14) << "mean Jaccard" << "\n"
+            << std::string(54, '-') << std::endl;
+  std::mt19937_64 random(7);
+  for (double rate : {0.01, 0.05, 0.1, 0.2, 0.3}) {
+    std::vector<std::string> paths;
+    for (size_t d = 0; d < documents + copies; ++d) {
+      paths.push_back(directory + "/doc-" + std::to_string(d) + ".txt");
+      std::ofstream file(paths.back());
+      if (d < documents) {
+        file << texts[d];
+      } else {
+        file << Edit(texts[d - documents], generator.Text(length), rate,
+                     random);
+      }
+    }
+    DocumentManager dm(paths, generator.stopWordsFile(),
+                       generator.lemmasFile(), threads, false, options);
+    const DuplicateClusters &clusters = dm.duplicates();
+    size_t found = 0;
+    double jaccard = 0.0;
+    for (size_t c = 0; c < copies; ++c) {
+      size_t copy = documents + c;
+      if (clusters.representative[copy] == clusters.representative[c]) {
+        ++found;
+        jaccard += clusters.similarity[copy];
+      }
+    }
+    auto original = [&](size_t d) { return d < documents ? d : d - documents; };
+    size_t falseMerges = 0;
+    for (size_t d = 0; d < documents + copies; ++d) {
+      falseMerges += original(clusters.representative[d]) != original(d);
+    }
+    double seconds = 0.0;
+    for (const PipelineStats::Stage &stage : dm.stats().stages()) {
+      if (stage.name == "detect near-duplicates") seconds += stage.wallSeconds;
+    }
+    std::cout << std::setw(7) << std::fixed << std::setprecision(0)
+              << rate * 100 << "%" << std::setw(10) << found << std::setw(10)
+              << falseMerges << std::setprecision(1) << std::setw(12)
+              << seconds * 1e3 << std::setprecision(4) << std::setw(14)
+              << (found == 0 ? 0.0 : jaccard / found) << std::endl;
+  }
+  for (size_t d = 0; d < documents + copies; ++d) {
+    std::remove((directory + "/doc-" + std::to_string(d) + ".txt").c_str());
+  }
+  rmdir(directory.c_str());
+  return 0;
+}
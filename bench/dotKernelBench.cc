@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/dotKernels.h"
+#include "benchArguments.h"
+
+/**
+ * @brief Build a sparse vector holding each of vocabulary terms with the
+ *        given probability
+ */
+SparseVector<double> RandomSparse(std::mt19937_64 &random, uint32_t vocabulary,
+                                  double density) {
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  SparseVector<double> vector;
+  for (uint32_t t = 0; t < vocabulary; ++t) {
+    if (uniform(random) < density) vector.PushBack(t, uniform(random));
+  }
+  return vector;
+}
+
+/**
+ * @brief Microbenchmark of the dense and sparse dot-product kernels at every
+ *        SIMD level supported by the CPU
+ *
+ * Usage: dotKernelBench [repetitions]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage = "dotKernelBench [repetitions]";
+  size_t repetitions = 200000;
+  if (argc == 2 && IsHelp(argv[1])) {
+    std::cout << "Usage: " << usage << std::endl;
+    return 0;
+  }
+  if (argc > 2) return InvalidArgument(argv[2], usage);
+  if (argc == 2 && !ParseCount(argv[1], repetitions, size_t{1})) {
+    return InvalidArgument(argv[1], usage);
+  }
+  std::mt19937_64 random(7);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  std::vector<double> denseA(256), denseB(256);
+  for (size_t i = 0; i < denseA.size(); ++i) {
+    denseA[i] = uniform(random);
+    denseB[i] = uniform(random);
+  }
+  SparseVector<double> sparseA = RandomSparse(random, 20000, 0.01);
+  SparseVector<double> sparseB = RandomSparse(random, 20000, 0.01);
+
+  std::cout << "detected: " << SimdLevelName(DetectSimdLevel()) << "\n\n"
+            << std::left << std::setw(10) << "level" << std::setw(10)
+            << "kernel" << std::right << std::setw(14) << "ns/call"
+            << std::setw(22) << "result" << "\n"
+            << std::string(56, '-') << std::endl;
+
+  for (SimdLevel level :
+       {SimdLevel::kScalar, SimdLevel::kAvx2, SimdLevel::kAvx512}) {
+    if (static_cast<int>(level) > static_cast<int>(DetectSimdLevel())) break;
+    SetSimdLevel(level);
+
+    auto measure = [&](const std::string &kernel, auto &&call) {
+      double result = 0.0;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t r = 0; r < repetitions; ++r) result += call();
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      std::cout << std::left << std::setw(10) << SimdLevelName(level)
+                << std::setw(10) << kernel << std::right << std::fixed
+                << std::setprecision(2) << std::setw(14)
+                << seconds * 1e9 / static_cast<double>(repetitions)
+                << std::setw(22) << std::setprecision(6) << result
+                << std::endl;
+    };
+    measure("dense", [&] {
+      return DenseDot(denseA.data(), denseB.data(), denseA.size());
+    });
+    measure("sparse", [&] { return SparseDot(sparseA, sparseB); });
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/**
+ * @brief Check that two managers hold the same recommendations and the same
+ *        IDF for every term in use (term IDs may differ between them)
+ */
+bool SameResults(const DocumentManager &a, const DocumentManager &b) {
+  if (a.neighbours().size() != b.neighbours().size()) return false;
+  for (size_t i = 0; i < a.neighbours().size(); ++i) {
+    const std::vector<Neighbour> &x = a.neighbours()[i];
+    const std::vector<Neighbour> &y = b.neighbours()[i];
+    if (x.size() != y.size()) return false;
+    for (size_t r = 0; r < x.size(); ++r) {
+      if (x[r].document != y[r].document ||
+          std::fabs(x[r].similarity - y[r].similarity) > 1e-12) {
+        return false;
+      }
+    }
+  }
+  const TermDictionary &words = a.allWordsInCorpus();
+  for (uint32_t id = 0; id < words.size(); ++id) {
+    if (a.documentsOccurrences()[id] == 0) continue;
+    uint32_t other = b.allWordsInCorpus().Id(words.Term(id));
+    if (other == TermDictionary::kNotFound ||
+        a.documentsOccurrences()[id] != b.documentsOccurrences()[other] ||
+        std::fabs(a.IDF()[id] - b.IDF()[other]) > 1e-12) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Largest difference between the similarity matrices of two
+ *        managers, infinite if their sizes differ
+ */
+double MatrixDifference(const DocumentManager &a, const DocumentManager &b) {
+  const std::vector<std::vector<double>> &x = a.similarityMatrix();
+  const std::vector<std::vector<double>> &y = b.similarityMatrix();
+  if (x.size() != y.size()) return HUGE_VAL;
+  double largest = 0.0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    for (size_t j = 0; j < x.size(); ++j) {
+      largest = std::max(largest, std::fabs(x[i][j] - y[i][j]));
+    }
+  }
+  return largest;
+}
+
+}  // namespace
+
+/**
+ * @brief Compare incremental corpus updates against rebuilding the corpus:
+ *        adding a batch of documents to a top-K index, then removing some,
+ *        and check both give the same neighbours and IDF. Under weighting
+ *        schemes that use the IDF, updates reweigh the whole corpus. The
+ *        same updates are then checked in matrix mode on the first
+ *        kMatrixDocuments documents: new cells come from the row kernel
+ *        and the dense subspace of the blocked kernel depends on the
+ *        corpus, so the matrices must agree within kMatrixTolerance
+ *
+ * Usage: incrementalBench [-j threads] [-k neighbours] [-a added]
+ *                         [-r removed] [-n tokens] [-w scheme] [documents]
+ */
+int main(int argc, char *argv[]) {
+  constexpr size_t kMatrixDocuments = 1000;
+  constexpr double kMatrixTolerance = 1e-12;
+  const char *usage =
+      "incrementalBench [-j threads] [-k neighbours] [-a added] "
+      "[-r removed] [-n tokens] [-w scheme] [documents]";
+  size_t threads = 0;
+  size_t k = 10;
+  size_t added = 100;
+  size_t removed = 10;
+  size_t length = 150;
+  size_t documents = 5000;
+  WeightingOptions weighting;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else if (arg == "-a" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], added);
+    } else if (arg == "-r" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], removed);
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-w" && i + 1 < argc) {
+      valid = ParseWeightingScheme(argv[++i], weighting.scheme);
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (added > documents || removed > documents) {
+    std::cerr << "Error: -a and -r cannot exceed the number of documents"
+              << std::endl;
+    return 1;
+  }
+  SyntheticCorpus generator("en", 50000);
+  TemporaryCorpus corpus(generator, documents, length);
+  const std::vector<std::string> &paths = corpus.paths();
+  const std::string stopWords = generator.stopWordsFile();
+  const std::string lemmas = generator.lemmasFile();
+  std::vector<std::string> initial(paths.begin(), paths.end() - added);
+  std::vector<std::string> batch(paths.end() - added, paths.end());
+  std::vector<std::string> remaining(paths.begin() + removed, paths.end());
+
+  std::cout << "documents: " << documents << ", added: " << added
+            << ", removed: " << removed << ", k: " << k
+            << ", weighting: " << WeightingSchemeName(weighting.scheme)
+            << "\n\n"
+            << std::left << std::setw(28) << "operation" << std::right
+            << std::setw(12) << "seconds" << "\n"
+            << std::string(40, '-') << std::endl;
+  auto report = [](const char *operation, double seconds) {
+    std::cout << std::left << std::setw(28) << operation << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12)
+              << seconds << std::endl;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  DocumentManager rebuilt(paths, stopWords, lemmas, threads, false, {},
+                          weighting);
+  rebuilt.RecommendTopK(k);
+  report("rebuild after adding", Seconds(start));
+
+  DocumentManager incremental(initial, stopWords, lemmas, threads, false, {},
+                              weighting);
+  incremental.RecommendTopK(k);
+  start = std::chrono::steady_clock::now();
+  incremental.AddDocuments(batch);
+  report("add batch incrementally", Seconds(start));
+  bool addOk = SameResults(incremental, rebuilt);
+
+  start = std::chrono::steady_clock::now();
+  DocumentManager rebuiltAfterRemoval(remaining, stopWords, lemmas, threads,
+                                      false, {}, weighting);
+  rebuiltAfterRemoval.RecommendTopK(k);
+  report("rebuild after removing", Seconds(start));
+
+  start = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < removed; ++r) incremental.RemoveDocument(0);
+  report("remove incrementally", Seconds(start));
+  bool removeOk = SameResults(incremental, rebuiltAfterRemoval);
+
+  size_t matrixSize = std::min(documents, kMatrixDocuments);
+  size_t matrixAdded = std::min(added, matrixSize);
+  size_t matrixRemoved = std::min(removed, matrixSize - matrixAdded);
+  std::vector<std::string> matrixPaths(paths.begin(),
+                                       paths.begin() + matrixSize);
+  DocumentManager matrixRebuilt(matrixPaths, stopWords, lemmas, threads,
+                                false, {}, weighting);
+  matrixRebuilt.Recommend();
+  DocumentManager matrixIncremental(
+      std::vector<std::string>(matrixPaths.begin(),
+                               matrixPaths.end() - matrixAdded),
+      stopWords, lemmas, threads, false, {}, weighting);
+  matrixIncremental.Recommend();
+  start = std::chrono::steady_clock::now();
+  matrixIncremental.AddDocuments(std::vector<std::string>(
+      matrixPaths.end() - matrixAdded, matrixPaths.end()));
+  report("add batch to matrix", Seconds(start));
+  double addDifference = MatrixDifference(matrixIncremental, matrixRebuilt);
+
+  DocumentManager matrixRebuiltAfterRemoval(
+      std::vector<std::string>(matrixPaths.begin() + matrixRemoved,
+                               matrixPaths.end()),
+      stopWords, lemmas, threads, false, {}, weighting);
+  matrixRebuiltAfterRemoval.Recommend();
+  start = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < matrixRemoved; ++r) {
+    matrixIncremental.RemoveDocument(0);
+  }
+  report("remove from matrix", Seconds(start));
+  double removeDifference =
+      MatrixDifference(matrixIncremental, matrixRebuiltAfterRemoval);
+  bool matrixOk = addDifference <= kMatrixTolerance &&
+                  removeDifference <= kMatrixTolerance;
+
+  std::cout << "\nmatrix of " << matrixSize << " documents ("
+            << matrixRebuilt.BuildEngine().denseTerms().size()
+            << " dense terms), max |diff| after add: " << std::scientific
+            << std::setprecision(2) << addDifference
+            << ", after remove: " << removeDifference << std::fixed
+            << (matrixOk ? "" : " (above the tolerance)") << std::endl;
+  std::cout << "add: " << (addOk ? "same" : "DIFFERENT")
+            << ", remove: " << (removeOk ? "same" : "DIFFERENT")
+            << ", matrix: " << (matrixOk ? "within tolerance" : "DIFFERENT")
+            << std::endl;
+  return addOk && removeOk && matrixOk ? 0 : 1;
+}
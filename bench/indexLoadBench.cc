@@ -0,0 +1,225 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/**
+ * @brief Drop the pages of a file from the page cache, so the next load
+ *        reads it from disk as after a reboot. Needs no privileges: only
+ *        clean pages are dropped, so the file is synced first
+ * @param path Path to the file
+ * @return Whether the kernel accepted the request
+ */
+bool EvictFromPageCache(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  bool evicted = fdatasync(fd) == 0 &&
+                 posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  close(fd);
+  return evicted;
+}
+
+/**
+ * @brief Check that two managers hold the same top-K lists and the same
+ *        IDF for every term in use (term IDs may differ between them)
+ */
+bool SameResults(const DocumentManager &a, const DocumentManager &b) {
+  if (a.neighbours().size() != b.neighbours().size()) return false;
+  for (size_t i = 0; i < a.neighbours().size(); ++i) {
+    const std::vector<Neighbour> &x = a.neighbours()[i];
+    const std::vector<Neighbour> &y = b.neighbours()[i];
+    if (x.size() != y.size()) return false;
+    for (size_t r = 0; r < x.size(); ++r) {
+      if (x[r].document != y[r].document ||
+          std::fabs(x[r].similarity - y[r].similarity) > 1e-12) {
+        return false;
+      }
+    }
+  }
+  const TermDictionary &words = a.allWordsInCorpus();
+  for (uint32_t id = 0; id < words.size(); ++id) {
+    if (a.documentsOccurrences()[id] == 0) continue;
+    uint32_t other = b.allWordsInCorpus().Id(words.Term(id));
+    if (other == TermDictionary::kNotFound ||
+        a.documentsOccurrences()[id] != b.documentsOccurrences()[other] ||
+        std::fabs(a.IDF()[id] - b.IDF()[other]) > 1e-12) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+/**
+ * @brief Measure the start-up of a corpus loaded from an index against
+ *        building it from the texts, on synthetic corpora of growing size.
+ *        For each size the corpus is built with its top-K lists and saved,
+ *        the index is dropped from the page cache and loaded cold, then
+ *        loaded again warm. Each load is timed up to the first answer: the
+ *        manager, the stored top-K lists and the similarity engine a server
+ *        starts with. The warm corpus then takes its first update (a batch
+ *        of documents added and the first document removed), which copies
+ *        what the update writes out of the mapping, and the result is
+ *        checked against rebuilding the corpus
+ *
+ * Usage: indexLoadBench [-j threads] [-k neighbours] [-a added]
+ *                       [-n tokens] [-v vocabulary] [-w scheme] [sizes...]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "indexLoadBench [-j threads] [-k neighbours] [-a added] [-n tokens] "
+      "[-v vocabulary] [-w scheme] [sizes...]";
+  size_t threads = 0;
+  size_t k = 10;
+  size_t added = 10;
+  size_t length = 150;
+  size_t vocabulary = 50000;
+  WeightingOptions weighting;
+  std::vector<size_t> sizes;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else if (arg == "-a" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], added, size_t{1});
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-w" && i + 1 < argc) {
+      valid = ParseWeightingScheme(argv[++i], weighting.scheme);
+    } else {
+      sizes.emplace_back();
+      valid = ParseCount(argv[i], sizes.back(), size_t{2});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (sizes.empty()) sizes = {5000, 20000, 50000};
+
+  char pattern[] = "/tmp/indexLoadBench-XXXXXX";
+  int fd = mkstemp(pattern);
+  if (fd < 0) {
+    std::cerr << "Error: Cannot create the benchmark index file"
+              << std::endl;
+    return 1;
+  }
+  close(fd);
+  const std::string indexFile = pattern;
+
+  std::cout << "k: " << k << ", tokens per document: " << length
+            << ", weighting: " << WeightingSchemeName(weighting.scheme)
+            << ", first update: " << added << " added, 1 removed\n\n"
+            << std::setw(9) << "documents" << std::setw(10) << "index MB"
+            << std::setw(10) << "build s" << std::setw(10) << "cold s"
+            << std::setw(10) << "warm s" << std::setw(10) << "load s"
+            << std::setw(10) << "lists s" << std::setw(10) << "engine s"
+            << std::setw(10) << "update s" << "  result\n"
+            << std::string(97, '-') << std::endl;
+
+  bool allSame = true;
+  bool allEvicted = true;
+  for (size_t documents : sizes) {
+    SyntheticCorpus generator("en", vocabulary);
+    TemporaryCorpus corpus(generator, documents + added, length);
+    const std::vector<std::string> &paths = corpus.paths();
+    std::vector<std::string> initial(paths.begin(), paths.end() - added);
+    std::vector<std::string> batch(paths.end() - added, paths.end());
+    const std::string stopWords = generator.stopWordsFile();
+    const std::string lemmas = generator.lemmasFile();
+
+    auto start = std::chrono::steady_clock::now();
+    double build = 0.0;
+    {
+      DocumentManager built(initial, stopWords, lemmas, threads, false, {},
+                            weighting);
+      built.RecommendTopK(k);
+      built.BuildEngine();
+      build = Seconds(start);
+      built.SaveIndex(indexFile);
+    }
+    std::ifstream sized(indexFile, std::ios::binary | std::ios::ate);
+    double megabytes = static_cast<double>(sized.tellg()) / (1 << 20);
+
+    // Up to the first answer: manager, stored lists and engine.
+    auto startUp = [&](DocumentManager &manager, double &lists,
+                       double &engine) {
+      auto phase = std::chrono::steady_clock::now();
+      manager.RecommendTopK(k);
+      lists = Seconds(phase);
+      phase = std::chrono::steady_clock::now();
+      manager.BuildEngine();
+      engine = Seconds(phase);
+    };
+    double lists = 0.0;
+    double engine = 0.0;
+    allEvicted = EvictFromPageCache(indexFile) && allEvicted;
+    double coldStart = 0.0;
+    start = std::chrono::steady_clock::now();
+    {
+      DocumentManager cold(indexFile, threads);
+      startUp(cold, lists, engine);
+      coldStart = Seconds(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    DocumentManager warm(indexFile, threads);
+    double load = Seconds(start);
+    startUp(warm, lists, engine);
+    double warmStart = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    warm.AddDocuments(batch);
+    warm.RemoveDocument(0);
+    double update = Seconds(start);
+    DocumentManager rebuilt(
+        std::vector<std::string>(paths.begin() + 1, paths.end()), stopWords,
+        lemmas, threads, false, {}, weighting);
+    rebuilt.RecommendTopK(k);
+    bool same = SameResults(warm, rebuilt);
+    allSame = allSame && same;
+
+    std::cout << std::fixed << std::setprecision(3) << std::setw(9)
+              << documents << std::setw(10) << std::setprecision(1)
+              << megabytes << std::setprecision(3) << std::setw(10) << build
+              << std::setw(10) << coldStart << std::setw(10) << warmStart
+              << std::setw(10) << load << std::setw(10) << lists << std::setw(10) << engine
+              << std::setw(10) << update << "  "
+              << (same ? "same" : "DIFFERENT") << std::endl;
+  }
+  std::remove(indexFile.c_str());
+  std::cout << "\nbuild: from the texts, with top-K lists and engine; cold, "
+               "warm: index load to engine;\nload, lists, engine: parts of "
+               "the warm start; update: first add and remove"
+            << std::endl;
+  if (!allEvicted) {
+    std::cout << "(the index could not be dropped from the page cache, so "
+                 "cold starts read it from memory)"
+              << std::endl;
+  }
+  return allSame ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../include/corpusContext.h"
+#include "benchArguments.h"
+
+namespace {
+
+/**
+ * @brief The JSON loader as it was before the streaming one: the file is
+ *        concatenated line by line and scanned with find and substr
+ */
+LemmaTable LoadByLines(const std::string &path) {
+  LemmaTable lemmaMap;
+  std::ifstream file(path);
+  std::string content;
+  std::string line;
+  while (std::getline(file, line)) {
+    content += line;
+  }
+  size_t pos = content.find('{');
+  while (pos != std::string::npos && pos < content.length()) {
+    size_t keyStart = content.find('"', pos);
+    if (keyStart == std::string::npos) break;
+    size_t keyEnd = content.find('"', keyStart + 1);
+    pos = content.find('"', content.find(':', keyEnd));
+    size_t valueEnd = content.find('"', pos + 1);
+    std::string key = content.substr(keyStart + 1, keyEnd - keyStart - 1);
+    std::string value = content.substr(pos + 1, valueEnd - pos - 1);
+    std::transform(key.begin(), key.end(), key.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    lemmaMap.Insert(key, value);
+    pos = valueEnd + 1;
+  }
+  lemmaMap.Freeze();
+  return lemmaMap;
+}
+
+/**
+ * @brief Random lower-case word of 4 to 12 letters
+ */
+std::string Word(std::mt19937_64 &random) {
+  std::uniform_int_distribution<size_t> length(4, 12);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::string word(length(random), 'a');
+  for (char &c : word) c = static_cast<char>(letter(random));
+  return word;
+}
+
+/**
+ * @brief Seconds since a time point
+ */
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+/**
+ * @brief Time to load a large synthetic lemma dictionary with the line by
+ *        line loader, the streaming JSON loader and the binary format, and
+ *        check that the three tables agree. Every word maps to one of a
+ *        quarter as many lemmas, as in a full-morphology dictionary
+ *
+ * Usage: lemmaLoadBench [words]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage = "lemmaLoadBench [words]";
+  size_t words = 2000000;
+  if (argc == 2 && IsHelp(argv[1])) {
+    std::cout << "Usage: " << usage << std::endl;
+    return 0;
+  }
+  if (argc > 2) return InvalidArgument(argv[2], usage);
+  if (argc == 2 && !ParseCount(argv[1], words, size_t{1})) {
+    return InvalidArgument(argv[1], usage);
+  }
+  std::mt19937_64 random(3);
+  std::vector<std::string> lemmas(std::max<size_t>(words / 4, 1));
+  for (std::string &lemma : lemmas) lemma = Word(random);
+
+  char pattern[] = "/tmp/lemmaLoadBench-XXXXXX";
+  if (mkdtemp(pattern) == nullptr) {
+    std::cerr << "Error: Cannot create the benchmark directory" << std::endl;
+    exit(1);
+  }
+  std::string directory = pattern;
+  std::string json = directory + "/lemmas.json";
+  std::string binary = directory + "/lemmas.bin";
+  {
+    std::ofstream file(json);
+    std::uniform_int_distribution<size_t> pick(0, lemmas.size() - 1);
+    file << "{\n";
+    for (size_t w = 0; w < words; ++w) {
+      file << (w == 0 ? "" : ",\n") << "    \"" << Word(random)
+           << "\": \"" << lemmas[pick(random)] << "\"";
+    }
+    file << "\n}\n";
+  }
+  std::ifstream sizeProbe(json, std::ios::binary | std::ios::ate);
+  double megabytes = static_cast<double>(sizeProbe.tellg()) / 1e6;
+
+  std::cout << "words: " << words << ", lemmas: " << lemmas.size()
+            << ", JSON MB: " << std::fixed << std::setprecision(1)
+            << megabytes << "\n\n"
+            << std::left << std::setw(24) << "loader" << std::right
+            << std::setw(12) << "ms" << std::setw(12) << "MB/s" << "\n"
+            << std::string(48, '-') << std::endl;
+  auto report = [&](const char *name, double seconds) {
+    std::cout << std::left << std::setw(24) << name << std::right
+              << std::setprecision(1) << std::setw(12) << seconds * 1e3
+              << std::setw(12) << megabytes / seconds << std::endl;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  LemmaTable byLines = LoadByLines(json);
+  report("line by line", Since(start));
+  start = std::chrono::steady_clock::now();
+  LemmaTable streamed = LoadLemmatizationRules(json);
+  report("streaming JSON", Since(start));
+  start = std::chrono::steady_clock::now();
+  streamed.SaveBinary(binary);
+  report("save binary", Since(start));
+  start = std::chrono::steady_clock::now();
+  LemmaTable mapped = LoadLemmatizationRules(binary);
+  report("map binary", Since(start));
+
+  bool same = byLines.size() == streamed.size() &&
+              byLines.size() == mapped.size() &&
+              byLines.lemmaCount() == mapped.lemmaCount();
+  byLines.ForEach([&](std::string_view word, std::string_view lemma) {
+    uint32_t a = streamed.Find(word);
+    uint32_t b = mapped.Find(word);
+    same = same && a != LemmaTable::kNotFound && b != LemmaTable::kNotFound &&
+           streamed.Lemma(a) == lemma && mapped.Lemma(b) == lemma;
+  });
+  std::remove(json.c_str());
+  std::remove(binary.c_str());
+  rmdir(directory.c_str());
+  if (!same) {
+    std::cerr << "Error: loaders disagree" << std::endl;
+    return 1;
+  }
+  std::cout << "\ntables: same" << std::endl;
+  return 0;
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../include/normalizer.h"
+#include "benchArguments.h"
+
+namespace {
+
+using StopWordSet = std::set<std::string, std::less<>>;
+using LemmaMap = std::map<std::string, std::string, std::less<>>;
+
+/**
+ * @brief Lemmatization through a std::map, as before the hash tables
+ */
+class MapLemmatizeStage : public NormalizationStage {
+ public:
+  explicit MapLemmatizeStage(const LemmaMap &lemmas) : lemmas_(lemmas) {}
+  const char *name() const override { return "lemmatize-map"; }
+  Result Apply(Token &token, std::string &) const override {
+    auto it = lemmas_.find(token.text);
+    if (it != lemmas_.end()) token.text = it->second;
+    return token.text.empty() ? Result::kBlank : Result::kKeep;
+  }
+
+ private:
+  const LemmaMap &lemmas_;
+};
+
+/**
+ * @brief Stop-word filter through a std::set, as before the hash tables
+ */
+class SetStopWordStage : public NormalizationStage {
+ public:
+  explicit SetStopWordStage(const StopWordSet &stopWords)
+      : stopWords_(stopWords) {}
+  const char *name() const override { return "stop-words-set"; }
+  Result Apply(Token &token, std::string &) const override {
+    return stopWords_.count(token.text) ? Result::kBlank : Result::kKeep;
+  }
+
+ private:
+  const StopWordSet &stopWords_;
+};
+
+/**
+ * @brief Read the "key": "value" pairs of a flat JSON object, lowercased
+ */
+std::vector<std::pair<std::string, std::string>> ReadLemmas(
+    const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << path << std::endl;
+    exit(1);
+  }
+  std::string content((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+  std::vector<std::pair<std::string, std::string>> pairs;
+  size_t pos = content.find('{');
+  while (pos != std::string::npos) {
+    size_t keyStart = content.find('"', pos);
+    if (keyStart == std::string::npos) break;
+    size_t keyEnd = content.find('"', keyStart + 1);
+    size_t valueStart = content.find('"', content.find(':', keyEnd));
+    size_t valueEnd = content.find('"', valueStart + 1);
+    if (keyEnd == std::string::npos || valueEnd == std::string::npos) break;
+    std::string key = content.substr(keyStart + 1, keyEnd - keyStart - 1);
+    std::string value =
+        content.substr(valueStart + 1, valueEnd - valueStart - 1);
+    for (char &c : key) c = static_cast<char>(std::tolower(c));
+    for (char &c : value) c = static_cast<char>(std::tolower(c));
+    pairs.emplace_back(key, value);
+    pos = valueEnd + 1;
+  }
+  return pairs;
+}
+
+}  // namespace
+
+/**
+ * @brief Microbenchmark of the normalization pipeline with the tree-based
+ *        stop-word set and lemma map against the hash tables
+ *
+ * Usage: normalizationBench [-s stopWords] [-l lemmas] [-t tokens] [texts...]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "normalizationBench [-s stopWords] [-l lemmas] [-t tokens] [texts...]";
+  std::string stopWordsFile = "stop-words/stop-words-en.txt";
+  std::string lemmasFile = "lemmatization/corpus-en.json";
+  size_t targetTokens = 5000000;
+  std::vector<std::string> texts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-s" && i + 1 < argc) {
+      stopWordsFile = argv[++i];
+    } else if (arg == "-l" && i + 1 < argc) {
+      lemmasFile = argv[++i];
+    } else if (arg == "-t" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], targetTokens, size_t{1});
+    } else {
+      valid = arg.empty() || arg[0] != '-';
+      texts.push_back(arg);
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (texts.empty()) {
+    for (int i = 1; i <= 10; ++i) {
+      texts.push_back("documents/document-" + std::string(i < 10 ? "0" : "") +
+                      std::to_string(i) + ".txt");
+    }
+  }
+
+  StopWordSet stopWordSet;
+  StopWordTable stopWordTable;
+  std::ifstream stopWordsStream(stopWordsFile);
+  if (!stopWordsStream.is_open()) {
+    std::cerr << "Error: Cannot open " << stopWordsFile << std::endl;
+    return 1;
+  }
+  std::string word;
+  while (stopWordsStream >> word) {
+    stopWordSet.insert(word);
+    stopWordTable.Insert(word);
+  }
+  LemmaMap lemmaMap;
+  LemmaTable lemmaTable;
+  for (const auto &pair : ReadLemmas(lemmasFile)) {
+    lemmaMap[pair.first] = pair.second;
+    lemmaTable.Insert(pair.first, pair.second);
+  }
+  lemmaTable.Freeze();
+
+  std::vector<std::string> sample;
+  for (const std::string &text : texts) {
+    std::ifstream stream(text);
+    if (!stream.is_open()) {
+      std::cerr << "Error: Cannot open " << text << std::endl;
+      return 1;
+    }
+    while (stream >> word) sample.push_back(word);
+  }
+  if (sample.empty()) {
+    std::cerr << "Error: no tokens to normalize" << std::endl;
+    return 1;
+  }
+  std::vector<std::string_view> tokens;
+  while (tokens.size() < targetTokens) {
+    for (const std::string &token : sample) tokens.push_back(token);
+  }
+
+  Normalizer before;
+  before.AddStage(std::make_unique<CleanStage>())
+      .AddStage(std::make_unique<LowercaseStage>())
+      .AddStage(std::make_unique<MapLemmatizeStage>(lemmaMap))
+      .AddStage(std::make_unique<SetStopWordStage>(stopWordSet));
+  Normalizer after = Normalizer::Default(lemmaTable, stopWordTable);
+
+  std::cout << "stop words: " << stopWordTable.size()
+            << ", lemma rules: " << lemmaMap.size()
+            << ", tokens: " << tokens.size() << "\n\n"
+            << std::left << std::setw(16) << "lookups" << std::right
+            << std::setw(12) << "seconds" << std::setw(16) << "Mtokens/s"
+            << std::setw(12) << "kept" << "\n"
+            << std::string(56, '-') << std::endl;
+
+  std::vector<std::string> results[2];
+  const Normalizer *pipelines[2] = {&before, &after};
+  const char *names[2] = {"set + map", "hash tables"};
+  for (int p = 0; p < 2; ++p) {
+    std::string buffer;
+    size_t kept = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::string_view text : tokens) {
+      Token token{text};
+      if (pipelines[p]->Normalize(token, buffer) ==
+          NormalizationStage::Result::kKeep) {
+        ++kept;
+        if (results[p].size() < sample.size()) {
+          results[p].emplace_back(token.text);
+        }
+      }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    std::cout << std::left << std::setw(16) << names[p] << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12)
+              << seconds << std::setw(16)
+              << static_cast<double>(tokens.size()) / seconds / 1e6
+              << std::setw(12) << kept << std::endl;
+  }
+  if (results[0] != results[1]) {
+    std::cerr << "Error: pipelines disagree" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "../include/resultWriter.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+/**
+ * @brief Stream buffer that discards what is written and counts the bytes,
+ *        so only the cost of formatting is measured
+ */
+class CountingBuffer : public std::streambuf {
+ public:
+  size_t bytes() const { return bytes_; }
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) ++bytes_;
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    bytes_ += static_cast<size_t>(n);
+    return n;
+  }
+
+ private:
+  size_t bytes_ = 0;
+};
+
+/**
+ * @brief The term tables and matrix as printed with iostream manipulators
+ *        and a lookup per term and document, before ResultWriter
+ */
+void WriteIostreamTables(std::ostream &os, const DocumentManager &dm) {
+  const TermDictionary &dictionary = dm.allWordsInCorpus();
+  for (const Document &doc : dm.documents()) {
+    os << "\n=========================== " << doc.documentName()
+       << " ==========================\n\n";
+    os << std::left << std::setw(30) << "Term" << std::right << std::setw(12)
+       << "TF" << std::setw(12) << "IDF" << std::setw(12) << "TFIDF"
+       << std::setw(15) << "Index" << "\n";
+    os << std::string(90, '-') << "\n";
+    for (uint32_t id : dictionary.SortedIds()) {
+      if (dm.documentsOccurrences()[id] == 0) continue;
+      std::pair<int, int> termIndex =
+          doc.termIndices().Find(id, std::make_pair(-1, -1));
+      os << std::left << std::setw(30) << dictionary.Term(id) << std::right
+         << std::setw(12) << std::fixed << std::setprecision(6)
+         << doc.TF().Find(id, 0.0) << std::setw(12) << dm.IDF()[id]
+         << std::setw(12) << doc.TFNormalized().Find(id, 0.0);
+      if (termIndex.first == -1) {
+        os << std::setw(15) << "N/A";
+      } else {
+        std::ostringstream indexStr;
+        indexStr << termIndex.first << ", " << termIndex.second;
+        os << std::setw(15) << indexStr.str();
+      }
+      os << "\n";
+    }
+    os << "\n";
+  }
+  const std::vector<std::vector<double>> &matrix = dm.similarityMatrix();
+  for (size_t i = 0; i < matrix.size(); ++i) {
+    os << std::setw(10) << "Doc " << i + 1 << ": ";
+    for (double similarity : matrix[i]) {
+      os << std::setw(12) << std::fixed << std::setprecision(6) << similarity;
+    }
+    os << std::endl;
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Cost of writing the results of a synthetic corpus: the former
+ *        iostream tables against ResultWriter in every format, with all
+ *        corpus terms and with only the non-zero ones
+ *
+ * Usage: outputBench [-j threads] [-n tokens] [documents]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "outputBench [-j threads] [-n tokens] [documents]";
+  size_t threads = 0;
+  size_t length = 150;
+  size_t documents = 200;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+
+  SyntheticCorpus generator("en", 50000);
+  DocumentManager dm(TemporaryCorpus(generator, documents, length).paths(),
+                     generator.stopWordsFile(), generator.lemmasFile(),
+                     threads);
+  dm.Recommend();
+
+  std::cout << "documents: " << documents << ", terms: "
+            << dm.allWordsInCorpus().size() << "\n\n"
+            << std::left << std::setw(24) << "output" << std::right
+            << std::setw(10) << "seconds" << std::setw(10) << "MB"
+            << std::setw(10) << "MB/s" << "\n"
+            << std::string(54, '-') << std::endl;
+  auto run = [&](const char *name, auto write) {
+    CountingBuffer counter;
+    std::ostream os(&counter);
+    auto start = std::chrono::steady_clock::now();
+    write(os);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    double megabytes = counter.bytes() / 1e6;
+    std::cout << std::left << std::setw(24) << name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(10)
+              << seconds << std::setprecision(1) << std::setw(10)
+              << megabytes << std::setw(10) << megabytes / seconds
+              << std::endl;
+  };
+  auto writer = [&](OutputFormat format, bool nonZeroOnly) {
+    return [&dm, format, nonZeroOnly](std::ostream &os) {
+      OutputOptions options;
+      options.format = format;
+      options.nonZeroOnly = nonZeroOnly;
+      ResultWriter(os, options).Write(dm);
+    };
+  };
+
+  run("iostream table", [&](std::ostream &os) { WriteIostreamTables(os, dm); });
+  run("table", writer(OutputFormat::kTable, false));
+  run("csv", writer(OutputFormat::kCsv, false));
+  run("jsonl", writer(OutputFormat::kJsonLines, false));
+  run("binary", writer(OutputFormat::kBinary, false));
+  run("table --nonzero", writer(OutputFormat::kTable, true));
+  run("csv --nonzero", writer(OutputFormat::kCsv, true));
+  run("jsonl --nonzero", writer(OutputFormat::kJsonLines, true));
+  return 0;
+}
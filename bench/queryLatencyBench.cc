@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/similarityEngine.h"
+#include "../include/threadPool.h"
+#include "benchArguments.h"
+
+/**
+ * @brief Generate normalized sparse document vectors whose terms follow a
+ *        Zipfian distribution, weighted like Document::CalculateWeights
+ * @param documents Number of documents
+ * @param vocabulary Number of distinct terms
+ * @param length Number of tokens per document
+ * @param seed Random seed
+ * @return One sparse vector per document
+ */
+std::vector<SparseVector<double>> GenerateVectors(size_t documents,
+                                                  size_t vocabulary,
+                                                  size_t length,
+                                                  uint64_t seed) {
+  std::vector<double> cdf(vocabulary);
+  double total = 0.0;
+  for (size_t t = 0; t < vocabulary; ++t) {
+    total += 1.0 / std::pow(static_cast<double>(t + 1), 1.1);
+    cdf[t] = total;
+  }
+  std::mt19937_64 random(seed);
+  std::uniform_real_distribution<double> uniform(0.0, total);
+
+  std::vector<SparseVector<double>> vectors(documents);
+  std::vector<uint32_t> tokens(length);
+  for (SparseVector<double> &vector : vectors) {
+    for (uint32_t &token : tokens) {
+      token = static_cast<uint32_t>(
+          std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) -
+          cdf.begin());
+    }
+    std::sort(tokens.begin(), tokens.end());
+    double sumSquares = 0.0;
+    for (size_t i = 0; i < tokens.size();) {
+      size_t j = i;
+      while (j < tokens.size() && tokens[j] == tokens[i]) ++j;
+      double tf = 1 + std::log10(static_cast<double>(j - i));
+      vector.PushBack(tokens[i], tf);
+      sumSquares += tf * tf;
+      i = j;
+    }
+    for (double &value : vector.values()) value /= std::sqrt(sumSquares);
+  }
+  return vectors;
+}
+
+/**
+ * @brief Latency of top-K queries by vector against an indexed corpus, as
+ *        answered by the recommendation server: one at a time (percentiles)
+ *        and as a parallel batch (throughput)
+ *
+ * Usage: queryLatencyBench [-j threads] [-k neighbours] [-q queries]
+ *                          [-v vocabulary] [-n tokens] [documents]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "queryLatencyBench [-j threads] [-k neighbours] [-q queries] "
+      "[-v vocabulary] [-n tokens] [documents]";
+  size_t threads = 0;
+  size_t k = 10;
+  size_t queries = 2000;
+  size_t vocabulary = 100000;
+  size_t length = 150;
+  size_t documents = 100000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else if (arg == "-q" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], queries, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+
+  std::vector<SparseVector<double>> corpus =
+      GenerateVectors(documents, vocabulary, length, 42);
+  std::vector<SparseVector<double>> requests =
+      GenerateVectors(queries, vocabulary, length, 7);
+  std::vector<const SparseVector<double> *> pointers;
+  for (const SparseVector<double> &vector : corpus) pointers.push_back(&vector);
+  SimilarityEngine engine(pointers, vocabulary);
+  ThreadPool pool(threads);
+
+  std::vector<double> latencies;
+  SimilarityEngine::RowBuffer buffer;
+  for (const SparseVector<double> &query : requests) {
+    auto start = std::chrono::steady_clock::now();
+    engine.TopK(query, k, 0.0, buffer);
+    latencies.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              static_cast<size_t>(p * latencies.size()))];
+  };
+
+  std::vector<SimilarityEngine::RowBuffer> buffers(pool.size());
+  auto start = std::chrono::steady_clock::now();
+  pool.ParallelFor(requests.size(), [&](size_t i, size_t worker) {
+    engine.TopK(requests[i], k, 0.0, buffers[worker]);
+  });
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::cout << "documents: " << documents << ", queries: " << queries
+            << ", k: " << k << ", threads: " << pool.size() << "\n\n"
+            << std::fixed << std::setprecision(3)
+            << "latency p50 (ms):   " << percentile(0.50) << "\n"
+            << "latency p90 (ms):   " << percentile(0.90) << "\n"
+            << "latency p99 (ms):   " << percentile(0.99) << "\n"
+            << "latency max (ms):   " << latencies.back() << "\n"
+            << std::setprecision(0)
+            << "batch (queries/s):  " << requests.size() / seconds
+            << std::endl;
+  return 0;
+}
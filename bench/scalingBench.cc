@@ -0,0 +1,219 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> allocatedBytes{0};
+
+// Documents of the load-only run, above the default vm.max_map_count
+// (65530), so a loader that keeps every file mapped at once fails it.
+constexpr size_t kManyDocuments = 70000;
+// Words per document of the load-only run, to keep the corpus small.
+constexpr size_t kManyDocumentsLength = 20;
+
+/**
+ * @brief Measurements of one end-to-end run, sent from the child process
+ */
+struct RunResult {
+  double loadSeconds;
+  double recommendSeconds;
+  size_t allocations;
+  size_t allocatedBytes;
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/**
+ * @brief Process a corpus end to end in a child process, so its peak RSS is
+ *        the run's own
+ * @param paths Documents
+ * @param stopWords Stop-word file
+ * @param lemmas Lemmatization file
+ * @param threads Number of worker threads
+ * @param k Number of neighbours per document, or 0 to only load
+ * @param result Output, timings and allocations
+ * @param peakKilobytes Output, peak resident set size of the run
+ * @return Whether the run succeeded
+ */
+bool RunIsolated(const std::vector<std::string> &paths,
+                 const std::string &stopWords, const std::string &lemmas,
+                 size_t threads, size_t k, RunResult &result,
+                 long &peakKilobytes) {
+  int channel[2];
+  if (pipe(channel) != 0) return false;
+  pid_t child = fork();
+  if (child < 0) return false;
+  if (child == 0) {
+    close(channel[0]);
+    allocations = 0;
+    allocatedBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    DocumentManager dm(paths, stopWords, lemmas, threads);
+    result.loadSeconds = Seconds(start);
+    start = std::chrono::steady_clock::now();
+    if (k > 0) dm.RecommendTopK(k);
+    result.recommendSeconds = Seconds(start);
+    result.allocations = allocations;
+    result.allocatedBytes = allocatedBytes;
+    bool sent = write(channel[1], &result, sizeof(result)) == sizeof(result);
+    _exit(sent ? 0 : 1);
+  }
+  close(channel[1]);
+  bool received = read(channel[0], &result, sizeof(result)) == sizeof(result);
+  close(channel[0]);
+  int status = 0;
+  rusage usage{};
+  if (wait4(child, &status, 0, &usage) != child) return false;
+  peakKilobytes = usage.ru_maxrss;
+  return received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}  // namespace
+
+/**
+ * @brief Count every allocation made through operator new, so runs report
+ *        how many allocations they make
+ */
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size == 0 ? 1 : size)) return memory;
+  throw std::bad_alloc();
+}
+
+// GCC flags free() in a replacement operator delete as mismatched with new.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *memory) noexcept { std::free(memory); }
+#pragma GCC diagnostic pop
+
+void operator delete(void *memory, size_t) noexcept {
+  operator delete(memory);
+}
+
+/**
+ * @brief End-to-end scaling runs on synthetic English and Spanish corpora of
+ *        growing size: loading and normalization, then top-K
+ *        recommendations. Reports throughput, peak RSS and allocations per
+ *        run; each run is a separate process. A final run only loads more
+ *        documents than the kernel allows mappings by default
+ *
+ * Usage: scalingBench [-l en|es] [-n words] [-v vocabulary] [-j threads]
+ *                     [-k neighbours] [sizes...]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "scalingBench [-l en|es] [-n words] [-v vocabulary] [-j threads] "
+      "[-k neighbours] [sizes...]";
+  std::vector<std::string> languages;
+  size_t length = 300;
+  size_t vocabulary = 50000;
+  size_t threads = 1;
+  size_t k = 10;
+  std::vector<size_t> sizes;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-l" && i + 1 < argc) {
+      languages.push_back(argv[++i]);
+      valid = languages.back() == "en" || languages.back() == "es";
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else {
+      size_t size = 0;
+      valid = ParseCount(argv[i], size, size_t{1});
+      sizes.push_back(size);
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (languages.empty()) languages = {"en", "es"};
+  if (sizes.empty()) sizes = {1000, 2000, 4000, 8000};
+
+  std::cout << "words per document: " << length << ", k: " << k
+            << ", threads: " << threads << "\n\n"
+            << std::left << std::setw(6) << "lang" << std::right
+            << std::setw(8) << "docs" << std::setw(9) << "load s"
+            << std::setw(9) << "top-K s" << std::setw(10) << "docs/s"
+            << std::setw(8) << "MB/s" << std::setw(10) << "peak MB"
+            << std::setw(12) << "allocs" << std::setw(10) << "alloc MB"
+            << "\n"
+            << std::string(82, '-') << std::endl;
+  for (const std::string &language : languages) {
+    for (size_t documents : sizes) {
+      SyntheticCorpus generator(language, vocabulary);
+      TemporaryCorpus corpus(generator, documents, length);
+      double megabytes = 0.0;
+      for (const std::string &path : corpus.paths()) {
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0) megabytes += info.st_size / 1e6;
+      }
+
+      RunResult result{};
+      long peakKilobytes = 0;
+      if (!RunIsolated(corpus.paths(), generator.stopWordsFile(),
+                       generator.lemmasFile(), threads, k, result,
+                       peakKilobytes)) {
+        std::cerr << "Error: run with " << documents << " " << language
+                  << " documents failed" << std::endl;
+        return 1;
+      }
+      double seconds = result.loadSeconds + result.recommendSeconds;
+      std::cout << std::left << std::setw(6) << language << std::right
+                << std::setw(8) << documents << std::fixed
+                << std::setprecision(3) << std::setw(9) << result.loadSeconds
+                << std::setw(9) << result.recommendSeconds
+                << std::setprecision(0) << std::setw(10)
+                << documents / seconds << std::setprecision(1)
+                << std::setw(8) << megabytes / seconds << std::setw(10)
+                << peakKilobytes / 1024.0 << std::setw(12)
+                << result.allocations << std::setw(10)
+                << result.allocatedBytes / 1e6 << std::endl;
+    }
+  }
+
+  SyntheticCorpus generator(languages.front(), vocabulary);
+  TemporaryCorpus corpus(generator, kManyDocuments, kManyDocumentsLength);
+  RunResult result{};
+  long peakKilobytes = 0;
+  if (!RunIsolated(corpus.paths(), generator.stopWordsFile(),
+                   generator.lemmasFile(), threads, 0, result,
+                   peakKilobytes)) {
+    std::cerr << "Error: loading " << kManyDocuments << " "
+              << languages.front() << " documents failed" << std::endl;
+    return 1;
+  }
+  std::cout << "\nload only, " << kManyDocuments << " "
+            << languages.front() << " documents of " << kManyDocumentsLength
+            << " words: " << std::fixed << std::setprecision(3)
+            << result.loadSeconds << " s, peak " << std::setprecision(1)
+            << peakKilobytes / 1024.0 << " MB" << std::endl;
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/similarityEngine.h"
+#include "../include/sparseMatrix.h"
+#include "../include/threadPool.h"
+#include "benchArguments.h"
+
+/**
+ * @brief Generate normalized sparse document vectors whose terms follow a
+ *        Zipfian distribution, weighted like Document::CalculateWeights
+ * @param documents Number of documents
+ * @param vocabulary Number of distinct terms
+ * @param length Number of tokens per document
+ * @return One sparse vector per document
+ */
+std::vector<SparseVector<double>> GenerateVectors(size_t documents,
+                                                  size_t vocabulary,
+                                                  size_t length) {
+  std::vector<double> cdf(vocabulary);
+  double total = 0.0;
+  for (size_t t = 0; t < vocabulary; ++t) {
+    total += 1.0 / std::pow(static_cast<double>(t + 1), 1.1);
+    cdf[t] = total;
+  }
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> uniform(0.0, total);
+
+  std::vector<SparseVector<double>> vectors(documents);
+  std::vector<uint32_t> tokens(length);
+  for (SparseVector<double> &vector : vectors) {
+    for (uint32_t &token : tokens) {
+      token = static_cast<uint32_t>(
+          std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) -
+          cdf.begin());
+    }
+    std::sort(tokens.begin(), tokens.end());
+    double sumSquares = 0.0;
+    for (size_t i = 0; i < tokens.size();) {
+      size_t j = i;
+      while (j < tokens.size() && tokens[j] == tokens[i]) ++j;
+      double tf = 1 + std::log10(static_cast<double>(j - i));
+      vector.PushBack(tokens[i], tf);
+      sumSquares += tf * tf;
+      i = j;
+    }
+    for (double &value : vector.values()) value /= std::sqrt(sumSquares);
+  }
+  return vectors;
+}
+
+/**
+ * @brief Compare the all-pairs similarity kernels: the serial row-by-row
+ *        inverted index walk against the parallel cache-blocked tiles, with
+ *        scalar and SIMD dense-subspace kernels, and the blocked kernel with
+ *        the weights stored in float, int16 and int8 (at the detected SIMD
+ *        level; their checksums show the accumulated error), and the SpGEMM
+ *        product D * D^T with dense and hash accumulators. SpGEMM computes
+ *        both triangles, in slabs of rows so the product never has to fit
+ *        in memory whole; the checksums cover the upper triangle. SpGEMM
+ *        sums every term in ID order, while the blocked kernel scores the
+ *        dense subspace with the SIMD dot product first, so on the first
+ *        kSpGemmCheckDocuments documents of each size the largest
+ *        difference between both matrices is checked against
+ *        kSpGemmTolerance; the exit status is 1 if it is exceeded
+ *
+ * Usage: similarityBench [-j threads] [-v vocabulary] [-n tokens] [sizes...]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "similarityBench [-j threads] [-v vocabulary] [-n tokens] [sizes...]";
+  constexpr size_t kSpGemmCheckDocuments = 2000;
+  constexpr double kSpGemmTolerance = 1e-12;
+  size_t threads = 0;
+  size_t vocabulary = 100000;
+  size_t length = 150;
+  std::vector<size_t> sizes;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else {
+      size_t size = 0;
+      valid = ParseCount(argv[i], size, size_t{1});
+      sizes.push_back(size);
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+  if (sizes.empty()) sizes = {1000, 10000, 50000};
+
+  ThreadPool pool(threads);
+  std::cout << "threads: " << pool.size() << ", vocabulary: " << vocabulary
+            << ", tokens/document: " << length << "\n\n";
+  std::cout << std::left << std::setw(12) << "documents" << std::setw(16)
+            << "kernel" << std::right << std::setw(12) << "seconds"
+            << std::setw(16) << "Mpairs/s" << std::setw(18) << "checksum"
+            << "\n"
+            << std::string(74, '-') << std::endl;
+
+  for (size_t n : sizes) {
+    std::vector<SparseVector<double>> vectors =
+        GenerateVectors(n, vocabulary, length);
+    std::vector<const SparseVector<double> *> pointers;
+    for (const SparseVector<double> &vector : vectors) {
+      pointers.push_back(&vector);
+    }
+    SimilarityEngine engine(pointers, vocabulary);
+    double pairs = static_cast<double>(n) * static_cast<double>(n + 1) / 2;
+
+    auto report = [&](const std::string &kernel, double seconds,
+                      double checksum) {
+      std::cout << std::left << std::setw(12) << n << std::setw(16) << kernel
+                << std::right << std::fixed << std::setprecision(3)
+                << std::setw(12) << seconds << std::setw(16)
+                << pairs / seconds / 1e6 << std::setw(18)
+                << std::setprecision(6) << checksum << std::endl;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> scores;
+    double rowChecksum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      engine.AccumulateRow(i, i, scores);
+      for (size_t j = i; j < n; ++j) rowChecksum += scores[j];
+    }
+    report("row-wise", std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+           rowChecksum);
+
+    auto blocked = [&](const SimilarityEngine &blockedEngine,
+                       const std::string &kernel) {
+      auto begin = std::chrono::steady_clock::now();
+      std::vector<double> partial(pool.size(), 0.0);
+      blockedEngine.ForEachTile(
+          pool,
+          [&partial](const SimilarityEngine::Tile &tile, size_t worker) {
+            for (size_t i = tile.rowBegin; i < tile.rowEnd; ++i) {
+              for (size_t j = std::max(i, tile.columnBegin);
+                   j < tile.columnEnd; ++j) {
+                partial[worker] += tile.Score(i, j);
+              }
+            }
+          });
+      double blockedChecksum = 0.0;
+      for (double value : partial) blockedChecksum += value;
+      report(kernel,
+             std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           begin)
+                 .count(),
+             blockedChecksum);
+    };
+
+    SimdLevel detected = DetectSimdLevel();
+    for (SimdLevel level : {SimdLevel::kScalar, detected}) {
+      SetSimdLevel(level);
+      blocked(engine, std::string("blocked-") + SimdLevelName(level));
+      if (level == detected) break;
+    }
+    for (StoragePrecision precision :
+         {StoragePrecision::kFloat, StoragePrecision::kInt16,
+          StoragePrecision::kInt8}) {
+      blocked(SimilarityEngine(pointers, vocabulary, precision),
+              std::string("blocked-") + StoragePrecisionName(precision));
+    }
+
+    constexpr size_t kSlabRows = 512;
+    for (SpGemmAccumulator accumulator :
+         {SpGemmAccumulator::kDense, SpGemmAccumulator::kHash}) {
+      auto begin = std::chrono::steady_clock::now();
+      CsrMatrix terms = CsrMatrix::FromRows(pointers, vocabulary).Transpose();
+      double productChecksum = 0.0;
+      for (size_t first = 0; first < n; first += kSlabRows) {
+        size_t last = std::min(n, first + kSlabRows);
+        std::vector<const SparseVector<double> *> slab(
+            pointers.begin() + first, pointers.begin() + last);
+        CsrMatrix product = SpGemm(CsrMatrix::FromRows(slab, vocabulary),
+                                   terms, pool, {accumulator});
+        for (size_t r = 0; r < product.rows(); ++r) {
+          for (size_t p = product.offsets()[r]; p < product.offsets()[r + 1];
+               ++p) {
+            if (product.indices()[p] >= first + r) {
+              productChecksum += product.values()[p];
+            }
+          }
+        }
+      }
+      report(std::string("spgemm-") + SpGemmAccumulatorName(accumulator),
+             std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           begin)
+                 .count(),
+             productChecksum);
+    }
+
+    std::vector<const SparseVector<double> *> checked(
+        pointers.begin(),
+        pointers.begin() + std::min(n, kSpGemmCheckDocuments));
+    SimilarityEngine checkEngine(checked, vocabulary);
+    std::vector<std::vector<double>> blockedMatrix =
+        checkEngine.ComputeMatrix(pool);
+    CsrMatrix documents = CsrMatrix::FromRows(checked, vocabulary);
+    std::vector<std::vector<double>> productMatrix =
+        SpGemm(documents, documents.Transpose(), pool).ToDense();
+    double largest = 0.0;
+    for (size_t i = 0; i < checked.size(); ++i) {
+      for (size_t j = 0; j < checked.size(); ++j) {
+        largest = std::max(largest, std::fabs(productMatrix[i][j] -
+                                              blockedMatrix[i][j]));
+      }
+    }
+    std::cout << std::left << std::setw(12) << n << "spgemm vs blocked on "
+              << checked.size() << " documents ("
+              << checkEngine.denseTerms().size()
+              << " dense terms): max |diff| " << std::scientific
+              << std::setprecision(2) << largest << std::fixed << std::endl;
+    if (largest > kSpGemmTolerance) {
+      std::cerr << "Error: SpGEMM differs from the blocked kernel by more "
+                   "than "
+                << kSpGemmTolerance << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../include/documentManager.h"
+#include "benchArguments.h"
+#include "syntheticCorpus.h"
+
+namespace {
+
+/**
+ * @brief Time a stage and print one line of the report
+ * @param name Stage name
+ * @param items Number of items (tokens, documents, terms) the stage handles
+ * @param run Runs the stage once
+ */
+template <typename Run>
+void Measure(const std::string &name, size_t items, Run run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << std::left << std::setw(30) << name << std::right << std::fixed
+            << std::setprecision(4) << std::setw(10) << seconds
+            << std::setw(12) << items << std::setprecision(1)
+            << std::setw(12) << seconds * 1e9 / std::max<size_t>(items, 1)
+            << std::endl;
+}
+
+/**
+ * @brief Log TF weights of a document the way they were calculated before
+ *        the fused pass: a TF vector, then its length, then the normalized
+ *        vector, each a pass of its own
+ * @param doc Document with its term counts
+ * @param tf Set to the TF vector
+ * @param normalized Set to the normalized vector
+ */
+void WeighInThreePasses(const Document &doc, SparseVector<double> &tf,
+                        SparseVector<double> &normalized) {
+  const SparseVector<uint32_t> &counts = doc.termCounts();
+  tf.Clear();
+  tf.Reserve(counts.size());
+  for (size_t i = 0; i < counts.size(); ++i) {
+    tf.PushBack(counts.ids()[i],
+                1 + log10(static_cast<double>(counts.values()[i])));
+  }
+  double sumSquares = 0.0;
+  for (double value : tf.values()) sumSquares += value * value;
+  double length = std::sqrt(sumSquares);
+  normalized.Clear();
+  normalized.Reserve(tf.size());
+  for (size_t i = 0; i < tf.size(); ++i) {
+    normalized.PushBack(tf.ids()[i], tf.values()[i] / length);
+  }
+}
+
+/**
+ * @brief Token as it reaches a pipeline stage: its text and lemma ID
+ */
+struct StageInput {
+  std::string text;
+  uint32_t lemma;
+};
+
+}  // namespace
+
+/**
+ * @brief Microbenchmarks of every processing stage on a synthetic corpus,
+ *        each timed on its own: document loading, every normalization stage
+ *        and the whole fused pipeline, the weight calculations, the IDF, the
+ *        similarity index and the cosine similarity matrix and top-K lists
+ *
+ * Usage: stageBench [-l en|es] [-n words] [-v vocabulary] [-j threads]
+ *                   [-k neighbours] [documents]
+ */
+int main(int argc, char *argv[]) {
+  const char *usage =
+      "stageBench [-l en|es] [-n words] [-v vocabulary] [-j threads] "
+      "[-k neighbours] [documents]";
+  std::string language = "en";
+  size_t length = 300;
+  size_t vocabulary = 50000;
+  size_t threads = 1;
+  size_t k = 10;
+  size_t documents = 2000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (IsHelp(arg)) {
+      std::cout << "Usage: " << usage << std::endl;
+      return 0;
+    } else if (arg == "-l" && i + 1 < argc) {
+      language = argv[++i];
+      valid = language == "en" || language == "es";
+    } else if (arg == "-n" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], length, size_t{1});
+    } else if (arg == "-v" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], vocabulary, size_t{1});
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], threads);
+    } else if (arg == "-k" && i + 1 < argc) {
+      valid = ParseCount(argv[++i], k, size_t{1});
+    } else {
+      valid = ParseCount(argv[i], documents, size_t{1});
+    }
+    if (!valid) return InvalidArgument(argv[i], usage);
+  }
+
+  SyntheticCorpus generator(language, vocabulary);
+  TemporaryCorpus corpus(generator, documents, length);
+  const std::vector<std::string> &paths = corpus.paths();
+  DocumentManager dm(paths, generator.stopWordsFile(), generator.lemmasFile(),
+                     threads);
+  std::shared_ptr<const CorpusContext> context = dm.context();
+  ThreadPool pool(threads);
+
+  std::cout << "language: " << language << ", documents: " << documents
+            << ", words per document: " << length
+            << ", terms: " << dm.allWordsInCorpus().size() << "\n\n"
+            << std::left << std::setw(30) << "stage" << std::right
+            << std::setw(10) << "seconds" << std::setw(12) << "items"
+            << std::setw(12) << "ns/item" << "\n"
+            << std::string(64, '-') << std::endl;
+
+  std::vector<Document> loaded;
+  loaded.reserve(paths.size());
+  Measure("Document constructor", paths.size(), [&] {
+    for (const std::string &path : paths) loaded.emplace_back(path, context);
+  });
+
+  // Every stage runs over the tokens that reach it, as produced by the
+  // stages before it.
+  std::vector<StageInput> inputs;
+  for (const std::string &path : paths) {
+    std::ifstream file(path);
+    std::string word;
+    while (file >> word) inputs.push_back({word, Token::kNoLemma});
+  }
+  std::string buffer;
+  for (const auto &stage : context->normalizer().stages()) {
+    std::vector<StageInput> outputs;
+    outputs.reserve(inputs.size());
+    size_t kept = 0;
+    Measure(std::string("stage: ") + stage->name(), inputs.size(), [&] {
+      for (const StageInput &input : inputs) {
+        Token token{input.text, input.lemma};
+        kept += stage->Apply(token, buffer) ==
+                NormalizationStage::Result::kKeep;
+      }
+    });
+    for (const StageInput &input : inputs) {
+      Token token{input.text, input.lemma};
+      if (stage->Apply(token, buffer) == NormalizationStage::Result::kKeep) {
+        outputs.push_back({std::string(token.text), token.lemma});
+      }
+    }
+    if (kept != outputs.size()) {
+      std::cerr << "Error: stage " << stage->name() << " is not deterministic"
+                << std::endl;
+      return 1;
+    }
+    inputs.swap(outputs);
+  }
+
+  size_t tokens = 0;
+  Measure("Normalize (fused pipeline)", loaded.size(), [&] {
+    for (Document &doc : loaded) doc.Normalize();
+  });
+  for (const Document &doc : loaded) tokens += doc.tokens().size();
+  Measure("CalculateTermIndices", tokens, [&] {
+    for (Document &doc : loaded) doc.CalculateTermIndices();
+  });
+  Measure("CalculateTermCounts", tokens, [&] {
+    for (Document &doc : loaded) doc.CalculateTermCounts();
+  });
+  size_t entries = 0;
+  for (const Document &doc : loaded) entries += doc.termCounts().size();
+  std::vector<SparseVector<double>> tf(loaded.size());
+  std::vector<SparseVector<double>> normalized(loaded.size());
+  Measure("Weights in three passes", entries, [&] {
+    for (size_t d = 0; d < loaded.size(); ++d) {
+      WeighInThreePasses(loaded[d], tf[d], normalized[d]);
+    }
+  });
+  Measure("CalculateWeights (fused)", entries, [&] {
+    for (Document &doc : loaded) doc.CalculateWeights();
+  });
+
+  const TermDictionary &terms = dm.allWordsInCorpus();
+  std::vector<std::pair<std::string_view, int>> counts;
+  for (uint32_t id = 0; id < terms.size(); ++id) {
+    counts.emplace_back(terms.Term(id), dm.documentsOccurrences()[id]);
+  }
+  std::sort(counts.begin(), counts.end());
+  CorpusContext frequencies(StopWordTable(), LemmaTable(), false);
+  frequencies.BuildVocabulary(counts, documents, tokens);
+  Measure("CalculateIDF", counts.size(),
+          [&] { frequencies.CalculateIDF(); });
+
+  // Weigh the documents first, so only the index is timed.
+  dm.BuildEngine();
+  std::unique_ptr<SimilarityEngine> engine;
+  Measure("SimilarityEngine index", entries, [&] {
+    engine = std::make_unique<SimilarityEngine>(dm.BuildEngine());
+  });
+  Measure("CalculateCosineSimilarity", documents * documents,
+          [&] { engine->ComputeMatrix(pool); });
+  std::vector<SimilarityEngine::RowBuffer> buffers(pool.size());
+  Measure("TopK (k = " + std::to_string(k) + ")", documents, [&] {
+    pool.ParallelFor(documents, [&](size_t i, size_t worker) {
+      engine->TopK(i, k, 0.0, buffers[worker]);
+    });
+  });
+  return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef SYNTHETIC_CORPUS_H_
+#define SYNTHETIC_CORPUS_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief Generator of synthetic English or Spanish text for the benchmarks.
+ *        The vocabulary is ranked stop words first, then the words of the
+ *        lemmatization rules, then made-up words, and tokens are drawn from
+ *        it with a Zipfian distribution, so normalization sees a realistic
+ *        mix of stop words, inflected forms and rare terms. Sentences are
+ *        capitalized and punctuated to exercise the cleaning stages.
+ *        Optionally, documents are about topics: part of their words come
+ *        from a Zipfian distribution of their own topic, so documents of the
+ *        same topic are more similar than the rest, as in a real corpus.
+ */
+class SyntheticCorpus {
+ public:
+  /**
+   * @brief Constructor for SyntheticCorpus
+   * @param language "en" or "es"; selects the stop-word and lemma files
+   * @param vocabulary Number of distinct words
+   * @param seed Random seed; the same seed gives the same corpus
+   * @param exponent Exponent of the Zipfian distribution
+   */
+  SyntheticCorpus(const std::string &language, size_t vocabulary,
+                  uint64_t seed = 42, double exponent = 1.1)
+      : language_(language), random_(seed) {
+    std::mt19937_64 shuffle(seed);
+    std::vector<std::string> stopWords;
+    std::ifstream stream(stopWordsFile());
+    std::string word;
+    while (stream >> word) stopWords.push_back(word);
+    std::vector<std::string> lemmaWords = ReadLemmaWords(lemmasFile());
+    if (stopWords.empty() || lemmaWords.empty()) {
+      std::cerr << "Error: Cannot read the " << language
+                << " stop-word and lemma files" << std::endl;
+      exit(1);
+    }
+    std::shuffle(stopWords.begin(), stopWords.end(), shuffle);
+    std::shuffle(lemmaWords.begin(), lemmaWords.end(), shuffle);
+    for (std::vector<std::string> *words : {&stopWords, &lemmaWords}) {
+      for (std::string &w : *words) {
+        if (words_.size() == vocabulary) break;
+        words_.push_back(std::move(w));
+      }
+    }
+    for (size_t made = 0; words_.size() < vocabulary; ++made) {
+      std::string word = "q";
+      for (size_t rest = made;; rest /= 26) {
+        word += static_cast<char>('a' + rest % 26);
+        if (rest < 26) break;
+      }
+      words_.push_back(word);
+    }
+
+    cdf_.resize(words_.size());
+    double total = 0.0;
+    for (size_t t = 0; t < cdf_.size(); ++t) {
+      total += 1.0 / std::pow(static_cast<double>(t + 1), exponent);
+      cdf_[t] = total;
+    }
+    uniform_ = std::uniform_real_distribution<double>(0.0, total);
+  }
+
+  /**
+   * @brief Path of the stop-word file of the language
+   */
+  std::string stopWordsFile() const {
+    return "stop-words/stop-words-" + language_ + ".txt";
+  }
+  /**
+   * @brief Path of the lemmatization file of the language
+   */
+  std::string lemmasFile() const {
+    return "lemmatization/corpus-" + language_ + ".json";
+  }
+  /**
+   * @brief Number of distinct words
+   */
+  size_t vocabulary() const { return words_.size(); }
+
+  /**
+   * @brief Give every following document a random topic out of `topics`.
+   *        A topic ranks the vocabulary rotated by a random offset, so each
+   *        topic has its own frequent words
+   * @param topics Number of topics (0 for none)
+   * @param share Fraction of the words drawn from the topic
+   */
+  void SetTopics(size_t topics, double share) {
+    topicOffsets_.clear();
+    for (size_t t = 0; t < topics; ++t) {
+      topicOffsets_.push_back(1 + random_() % (words_.size() - 1));
+    }
+    topicShare_ = share;
+  }
+
+  /**
+   * @brief Generate the text of one document
+   * @param length Number of words
+   * @return Text with sentences of 5 to 20 words and lines of 12 words
+   */
+  std::string Text(size_t length) {
+    std::string text;
+    size_t sentenceLeft = 0;
+    size_t offset = 0;
+    if (!topicOffsets_.empty()) {
+      offset = topicOffsets_[random_() % topicOffsets_.size()];
+    }
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    for (size_t w = 0; w < length; ++w) {
+      size_t rank = static_cast<size_t>(
+          std::lower_bound(cdf_.begin(), cdf_.end(), uniform_(random_)) -
+          cdf_.begin());
+      rank = std::min(rank, words_.size() - 1);
+      if (offset != 0 && coin(random_) < topicShare_) {
+        rank = (rank + offset) % words_.size();
+      }
+      std::string word = words_[rank];
+      if (sentenceLeft == 0) {
+        sentenceLeft = 5 + random_() % 16;
+        // Only ASCII letters: the lemma files may start words with UTF-8.
+        if (std::islower(static_cast<unsigned char>(word[0]))) {
+          word[0] = static_cast<char>(std::toupper(word[0]));
+        }
+      }
+      text += word;
+      if (--sentenceLeft == 0 || w + 1 == length) {
+        text += '.';
+      } else if (random_() % 12 == 0) {
+        text += ',';
+      }
+      text += (w + 1) % 12 == 0 ? '\n' : ' ';
+    }
+    return text;
+  }
+
+  /**
+   * @brief Write documents into a directory
+   * @param directory Existing directory
+   * @param documents Number of documents
+   * @param length Number of words per document
+   * @return Paths of the documents
+   */
+  std::vector<std::string> WriteDocuments(const std::string &directory,
+                                          size_t documents, size_t length) {
+    std::vector<std::string> paths;
+    for (size_t d = 0; d < documents; ++d) {
+      paths.push_back(directory + "/doc-" + std::to_string(d) + ".txt");
+      std::ofstream file(paths.back());
+      file << Text(length);
+      if (!file) {
+        std::cerr << "Error: Cannot write '" << paths.back() << "'"
+                  << std::endl;
+        exit(1);
+      }
+    }
+    return paths;
+  }
+
+ private:
+  std::string language_;
+  std::vector<std::string> words_;
+  std::vector<double> cdf_;
+  std::mt19937_64 random_;
+  std::uniform_real_distribution<double> uniform_;
+  std::vector<size_t> topicOffsets_;
+  double topicShare_ = 0.0;
+
+  /**
+   * @brief Read the keys of a flat JSON object of lemmatization rules
+   * @param path Path to the JSON file
+   * @return Inflected words, in file order
+   */
+  static std::vector<std::string> ReadLemmaWords(const std::string &path) {
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    std::vector<std::string> words;
+    size_t pos = content.find('{');
+    while (pos != std::string::npos) {
+      size_t keyStart = content.find('"', pos);
+      if (keyStart == std::string::npos) break;
+      size_t keyEnd = content.find('"', keyStart + 1);
+      size_t colon = content.find(':', keyEnd);
+      size_t valueStart = content.find('"', colon);
+      size_t valueEnd = content.find('"', valueStart + 1);
+      if (keyEnd == std::string::npos || valueEnd == std::string::npos) break;
+      if (keyEnd > keyStart + 1) {
+        words.push_back(content.substr(keyStart + 1, keyEnd - keyStart - 1));
+      }
+      pos = valueEnd + 1;
+    }
+    return words;
+  }
+};
+
+/**
+ * @brief Temporary directory of synthetic documents, removed with its files
+ *        when it goes out of scope
+ */
+class TemporaryCorpus {
+ public:
+  /**
+   * @brief Write a corpus into a new directory under /tmp
+   * @param corpus Generator
+   * @param documents Number of documents
+   * @param length Number of words per document
+   */
+  TemporaryCorpus(SyntheticCorpus &corpus, size_t documents, size_t length) {
+    char pattern[] = "/tmp/syntheticCorpus-XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+      std::cerr << "Error: Cannot create the benchmark corpus directory"
+                << std::endl;
+      exit(1);
+    }
+    directory_ = pattern;
+    paths_ = corpus.WriteDocuments(directory_, documents, length);
+  }
+  ~TemporaryCorpus() {
+    for (const std::string &path : paths_) std::remove(path.c_str());
+    rmdir(directory_.c_str());
+  }
+  TemporaryCorpus(const TemporaryCorpus &) = delete;
+  TemporaryCorpus &operator=(const TemporaryCorpus &) = delete;
+
+  /**
+   * @brief Paths of the documents
+   */
+  const std::vector<std::string> &paths() const { return paths_; }
+
+ private:
+  std::string directory_;
+  std::vector<std::string> paths_;
+};
+
+#endif
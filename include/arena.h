@@ -0,0 +1,77 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Bump allocator handing out memory from large chunks. Allocations
+ *        never move and are only released all at once, when the arena is
+ *        destroyed.
+ */
+class Arena {
+ public:
+  explicit Arena(size_t chunkSize = 64 * 1024);
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  char *Allocate(size_t bytes);
+  char *AllocateAligned(size_t bytes, size_t alignment);
+  void Reserve(size_t bytes);
+  std::string_view Store(std::string_view text);
+
+  /**
+   * @brief Allocate an uninitialized array. Nothing is ever destroyed, so
+   *        only trivially destructible types are allowed
+   * @param count Number of elements
+   * @return Pointer to the first element, valid until the arena is destroyed
+   */
+  template <typename T>
+  T *AllocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena arrays are never destroyed");
+    return reinterpret_cast<T *>(
+        AllocateAligned(count * sizeof(T), alignof(T)));
+  }
+
+  /**
+   * @brief Total bytes handed out by the arena
+   */
+  size_t bytesUsed() const { return bytesUsed_; }
+
+ private:
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t chunkSize_;
+  char *cursor_ = nullptr;
+  size_t remaining_ = 0;
+  size_t bytesUsed_ = 0;
+};
+
+/**
+ * @brief View of an array allocated in an arena. It owns nothing: it is
+ *        valid as long as the arena that holds the elements
+ */
+template <typename T>
+class ArenaArray {
+ public:
+  ArenaArray() = default;
+  ArenaArray(T *data, size_t size) : data_(data), size_(size) {}
+
+  T *begin() { return data_; }
+  T *end() { return data_ + size_; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  T &operator[](size_t i) { return data_[i]; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef CORPUS_CONTEXT_H_
+#define CORPUS_CONTEXT_H_
+
+#include <cmath>
+#include <iostream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "indexFile.h"
+#include "mappableArray.h"
+#include "normalizer.h"
+#include "stringTable.h"
+#include "termDictionary.h"
+#include "weighting.h"
+
+/**
+ * @brief Feature selection applied when the vocabulary is built from the
+ *        document frequencies, or the hashing trick instead of a dictionary
+ */
+struct VocabularyOptions {
+  // Terms in fewer documents are left out.
+  int minDocumentFrequency = 1;
+  // Terms in a larger fraction of the documents are left out.
+  double maxDocumentFraction = 1.0;
+  // Only the terms in most documents are kept; 0 keeps every term.
+  size_t maxTerms = 0;
+  // Terms are hashed into 2^hashBits IDs without a dictionary; 0 for none.
+  unsigned hashBits = 0;
+
+  /**
+   * @brief Whether any term can be left out of the vocabulary
+   */
+  bool Prunes() const {
+    return minDocumentFrequency > 1 || maxDocumentFraction < 1.0 ||
+           maxTerms > 0;
+  }
+};
+
+/**
+ * @brief How much of the corpus the vocabulary options eliminated
+ */
+struct VocabularyReport {
+  // Distinct terms of the corpus (not counted with hashing).
+  uint64_t terms = 0;
+  // Terms kept in the vocabulary, or hash buckets in use.
+  uint64_t keptTerms = 0;
+  // Hash buckets; 0 without hashing.
+  uint64_t buckets = 0;
+  // Distinct terms summed over the documents, and the non-zero weights
+  // left of them.
+  uint64_t entries = 0;
+  uint64_t keptEntries = 0;
+
+  void Print(std::ostream &os) const;
+};
+
+/**
+ * @brief Corpus-wide state shared by the manager and every document: the
+ *        stop-word and lemma tables, the normalization pipeline built on
+ *        them, the vocabulary, and the document frequency and IDF of every
+ *        term, indexed by term ID, with the weighting scheme that uses
+ *        them. It is stored once and documents hold a
+ *        const reference to it, so nothing is copied per document. Only the
+ *        DocumentManager that owns it updates the vocabulary and weights.
+ *        Every change to the corpus bumps a version counter; the IDF is
+ *        recomputed lazily when its version falls behind. A context loaded
+ *        from an index views its terms, frequencies and IDF in the mapping,
+ *        and copies the frequencies and IDF when the corpus first changes.
+ */
+class CorpusContext {
+ public:
+  CorpusContext(StopWordTable stopWords, LemmaTable lemmas, bool stem,
+                WeightingOptions weighting = {},
+                VocabularyOptions vocabulary = {});
+  explicit CorpusContext(std::shared_ptr<const IndexFile> index);
+  // The normalizer refers to the tables by address.
+  CorpusContext(const CorpusContext &) = delete;
+  CorpusContext &operator=(const CorpusContext &) = delete;
+
+  /**
+   * @brief Getter for stop words table
+   * @return Hash table of stop words
+   */
+  const StopWordTable &stopWords() const { return stopWords_; }
+  /**
+   * @brief Getter for lemmatization table
+   * @return Hash table of words to their lemmas
+   */
+  const LemmaTable &lemmas() const { return lemmas_; }
+  /**
+   * @brief Whether the pipeline stems terms
+   */
+  bool stemmed() const { return stem_; }
+  /**
+   * @brief Getter for the weighting scheme
+   * @return Scheme and BM25 parameters the document weights use
+   */
+  const WeightingOptions &weighting() const { return weighting_; }
+  /**
+   * @brief Getter for the normalization pipeline
+   * @return Pipeline built on the stop-word and lemma tables
+   */
+  const Normalizer &normalizer() const { return normalizer_; }
+  /**
+   * @brief Getter for the corpus vocabulary
+   * @return Dictionary of all unique terms in the corpus and their term IDs
+   */
+  const TermDictionary &vocabulary() const { return vocabulary_; }
+  /**
+   * @brief Getter for the feature selection options
+   * @return Options the vocabulary is built with
+   */
+  const VocabularyOptions &vocabularyOptions() const {
+    return vocabularyOptions_;
+  }
+  /**
+   * @brief Whether terms outside the vocabulary are left out of documents
+   *        added later instead of joining it, because the vocabulary was
+   *        pruned
+   */
+  bool frozenVocabulary() const { return frozen_; }
+  /**
+   * @brief Getter for document frequencies
+   * @return Number of documents each term appears in, indexed by term ID
+   */
+  const MappableArray<int> &documentFrequency() const {
+    return documentFrequency_;
+  }
+  /**
+   * @brief Getter for Inverse Document Frequencies
+   * @return IDF of each term, indexed by term ID
+   */
+  const MappableArray<double> &IDF() const { return IDF_; }
+  /**
+   * @brief Number of documents the frequencies are counted over
+   */
+  size_t documentCount() const { return documentCount_; }
+  /**
+   * @brief Mean number of term tokens per document, the BM25 avgdl
+   */
+  double averageLength() const {
+    return documentCount_ > 0 ? static_cast<double>(totalLength_) /
+                                    static_cast<double>(documentCount_)
+                              : 0.0;
+  }
+  /**
+   * @brief Version of the corpus, increased by every change to it
+   */
+  uint64_t version() const { return version_; }
+  /**
+   * @brief Whether the IDF was calculated before the last corpus change
+   */
+  bool IDFStale() const { return IDFVersion_ != version_; }
+
+  void BuildVocabulary(
+      const std::vector<std::pair<std::string_view, int>> &counts,
+      size_t documents, uint64_t termTokens);
+  void AddDocumentTerms(const std::vector<std::string_view> &terms,
+                        size_t termTokens);
+  void RemoveDocumentTerms(const std::vector<std::string_view> &terms,
+                           size_t termTokens);
+  void RemoveDocumentTerms(ArrayView<uint32_t> ids, size_t termTokens);
+  void CalculateIDF();
+  double UnseenIDF() const;
+  void DistinctTermIds(const std::vector<std::string_view> &terms,
+                       std::vector<uint32_t> &ids) const;
+
+ private:
+  StopWordTable stopWords_;
+  LemmaTable lemmas_;
+  bool stem_;
+  WeightingOptions weighting_;
+  Normalizer normalizer_;
+  // Index file the vocabulary, frequencies and IDF were loaded from, kept
+  // mapped as long as they view it.
+  std::shared_ptr<const IndexFile> index_;
+  TermDictionary vocabulary_;
+  VocabularyOptions vocabularyOptions_;
+  bool frozen_ = false;
+  MappableArray<int> documentFrequency_;
+  MappableArray<double> IDF_;
+  size_t documentCount_ = 0;
+  uint64_t totalLength_ = 0;
+  uint64_t version_ = 0;
+  uint64_t IDFVersion_ = 0;
+};
+
+StopWordTable LoadStopWords(const std::string &stopWordsFile);
+LemmaTable LoadLemmatizationRules(const std::string &lemmatizationFile);
+
+#endif
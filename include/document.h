@@ -1,74 +1,152 @@
 #ifndef DOCUMENT_H_
 #define DOCUMENT_H_
 
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
+#include <string_view>
 #include <vector>
 
+#include "arena.h"
+#include "corpusContext.h"
+#include "indexFile.h"
+#include "mappedFile.h"
+#include "sparseVector.h"
+
 class Document {
  public:
-  Document(const std::string &inputDocument);
+  /**
+   * @brief Token of the normalized text that keeps its position but is not
+   *        a term (a stop word)
+   */
+  static constexpr uint32_t kBlankToken = UINT32_MAX;
+  /**
+   * @brief Documents read and normalized together when loading files. A
+   *        file stays mapped from the constructor until Normalize, so the
+   *        batch bounds the live mappings, which the kernel limits per
+   *        process (vm.max_map_count, 65530 by default)
+   */
+  static constexpr size_t kLoadBatch = 4096;
+
+  Document(const std::string &inputDocument,
+           std::shared_ptr<const CorpusContext> context);
+  Document(const std::string &documentName, std::string_view text,
+           std::shared_ptr<const CorpusContext> context);
+  Document(std::shared_ptr<const IndexFile> index, size_t document,
+           std::shared_ptr<const CorpusContext> context);
 
   /**
    * @brief Getter for document name
    * @return Document name as a string
    */
   std::string documentName() const { return documentName_; }
-  const std::vector<std::vector<std::string>> &originalText() const;
-  const std::vector<std::vector<std::string>> &simplifiedText() const;
   /**
-   * @brief Getter for Term Frequency (TF) map
-   * @return Map of terms to their TF values
+   * @brief Getter for the distinct normalized terms of the document
+   * @return Terms indexed by document-local term ID (empty for a document
+   *         loaded from an index, which only has the term IDs of its
+   *         vectors)
+   */
+  const std::vector<std::string_view> &terms() const { return terms_; }
+  /**
+   * @brief Getter for the normalized text
+   * @return Local term ID (or kBlankToken) of every position, line after line
+   *         (empty once the working memory is released)
+   */
+  const ArenaArray<uint32_t> &tokens() const { return tokens_; }
+  /**
+   * @brief Getter for the number of tokens of the normalized text, which
+   *        outlives the tokens themselves
    */
-  const std::map<std::string, double> &TF() const { return TF_; }
-  const std::map<std::string, double> &TFNormalized() const;
+  size_t tokenCount() const { return tokenCount_; }
+  /**
+   * @brief Getter for the number of term tokens, the tokens that are
+   *        neither dropped nor blanked, which BM25 takes as the length
+   */
+  size_t termTokenCount() const { return termTokens_; }
+  /**
+   * @brief Getter for the term counts
+   * @return Sparse vector of term IDs to their number of occurrences
+   */
+  const SparseVector<uint32_t> &termCounts() const { return termCounts_; }
+  /**
+   * @brief Getter for Term Frequency (TF) vector
+   * @return Sparse vector of term IDs to the TF component of their weights
+   */
+  const SparseVector<double> &TF() const { return TF_; }
+  const SparseVector<double> &TFNormalized() const;
   /**
    * @brief Getter for term indices
-   * @return Map of terms to their first occurrence position (row, column)
+   * @return Sparse vector of term IDs to their first occurrence position
+   *         (row, column)
    */
-  const std::map<std::string, std::pair<int, int>> &termIndices() const { return termIndices_; }
+  const SparseVector<std::pair<int, int>> &termIndices() const { return termIndices_; }
   /**
    * @brief Getter for vector length
-   * @return Length of the TF vector
+   * @return Length of the weight vector before normalization
    */
   double vectorLength() const { return vectorLength_; }
   /**
-   * @brief Setter for all words in corpus
-   * @param allWordsInCorpus Set of all unique words in the corpus
+   * @brief Getter for the shared corpus context
+   * @return Context the document normalizes and resolves its terms with
    */
-  void setAllWordsInCorpus(const std::set<std::string> &allWordsInCorpus);
+  const CorpusContext &context() const { return *context_; }
   /**
-   * @brief Setter for lemmatization map
-   * @param lemmatizationMap Map of words to their lemmas
+   * @brief Getter for the size of the raw text
+   * @return Bytes of the file or text the document was read from (0 for a
+   *         document loaded from an index)
    */
-  void setLemmatizationMap(const std::map<std::string, std::string> &lemmatizationMap);
+  size_t textSize() const { return textSize_; }
 
-  void CleanTokens();
-  void RemoveStopWords(const std::set<std::string> &stopWords);
-  void Lemmatization(
-      const std::map<std::string, std::string> &lemmatizationMap);
-  void CalculateTF();
+  void Normalize();
   void CalculateTermIndices();
-  void CalculateVectorLength();
-  void CalculateTFNormalized();
+  void CalculateTermCounts();
+  void CalculateWeights();
+  SparseVector<double> QueryVector() const;
+  void ReleaseWorkingMemory();
 
  private:
   std::string documentName_;
-  std::vector<std::vector<std::string>> originalText_;
-  std::vector<std::vector<std::string>> simplifiedText_;
-  std::map<std::string, double> TF_;
-  std::map<std::string, double> TFNormalized_;
-  std::map<std::string, std::pair<int, int>> termIndices_;
-  std::set<std::string> allWordsInCorpus_;
-  std::map<std::string, std::string> lemmatizationMap_;
-  double vectorLength_;
+  std::shared_ptr<const CorpusContext> context_;
+  std::shared_ptr<const MappedFile> file_;
+  // Index file the vectors of a loaded document view, kept mapped as long
+  // as they do.
+  std::shared_ptr<const IndexFile> index_;
+  // Distinct normalized terms, kept as long as the document.
+  std::shared_ptr<Arena> arena_;
+  // Raw text, tokens and scratch tables, released once the weights are
+  // calculated.
+  std::shared_ptr<Arena> workspace_;
+  std::string_view text_;
+  std::vector<std::string_view> terms_;
+  ArenaArray<uint32_t> tokens_;
+  ArenaArray<uint32_t> rowOffsets_;
+  size_t tokenCount_ = 0;
+  size_t termTokens_ = 0;
+  SparseVector<uint32_t> termCounts_;
+  SparseVector<double> TF_;
+  SparseVector<double> TFNormalized_;
+  SparseVector<std::pair<int, int>> termIndices_;
+  double vectorLength_ = 0.0;
+  size_t textSize_ = 0;
+
+  /**
+   * @brief Document-local term and its corpus term ID
+   */
+  struct ResolvedTerm {
+    uint32_t id;
+    uint32_t local;
+  };
 
-  std::string ToLowerCase(const std::string &str) const;
-  std::string CleanToken(const std::string &token) const;
+  Arena &Workspace();
+  ArenaArray<uint32_t> CountTerms(Arena &arena) const;
+  ArenaArray<ResolvedTerm> ResolveTerms(Arena &arena) const;
+  template <typename Policy>
+  void Weigh(const Policy &policy);
 };
 
 std::ostream &operator<<(std::ostream &os, const Document &doc);
@@ -3,56 +3,189 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <memory>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 #include "document.h"
+#include "hnswIndex.h"
+#include "nearDuplicates.h"
+#include "pipelineStats.h"
+#include "similarityEngine.h"
+#include "sparseMatrix.h"
+#include "threadPool.h"
 
 class DocumentManager {
  public:
   DocumentManager(const std::vector<std::string>& documents,
                   const std::string& stopWordsFile,
-                  const std::string& lemmatizationFile);
+                  const std::string& lemmatizationFile, size_t threads = 1,
+                  bool stem = false,
+                  const DeduplicationOptions& deduplication = {},
+                  const WeightingOptions& weighting = {},
+                  const VocabularyOptions& vocabulary = {});
+  explicit DocumentManager(const std::string& indexFile, size_t threads = 1);
 
   /**
    * @brief Getter for all documents in corpus
    * @return Vector of Document objects
    */
-  std::vector<Document> documents() const { return documents_; }
+  const std::vector<Document>& documents() const { return documents_; }
   /**
-   * @brief Getter for stop words set
-   * @return Set of stop words
+   * @brief Getter for the corpus context shared with every document
+   * @return Context holding the tables, vocabulary and IDF of the corpus
    */
-  std::set<std::string> stopWords() const { return stopWords_; }
+  std::shared_ptr<const CorpusContext> context() const { return context_; }
+  /**
+   * @brief Getter for stop words table
+   * @return Hash table of stop words
+   */
+  const StopWordTable& stopWords() const { return context_->stopWords(); }
   /**
    * @brief Getter for all words in corpus
-   * @return Set of all unique words in the corpus
+   * @return Dictionary of all unique words in the corpus and their term IDs
+   */
+  const TermDictionary& allWordsInCorpus() const {
+    return context_->vocabulary();
+  }
+  /**
+   * @brief Getter for IDF values
+   * @return IDF of each term, indexed by term ID
+   */
+  const MappableArray<double>& IDF() const;
+  /**
+   * @brief Version of the corpus, increased by every added or removed
+   *        document
+   */
+  uint64_t version() const { return context_->version(); }
+  const MappableArray<int>& documentsOccurrences() const;
+  const LemmaTable& lemmatizationMap() const;
+
+  /**
+   * @brief Getter for the cosine similarity matrix
+   * @return Similarity of every pair of documents (empty unless Recommend
+   *         was called)
+   */
+  const std::vector<std::vector<double>>& similarityMatrix() const {
+    return similarityMatrix_;
+  }
+  /**
+   * @brief Getter for the sparse similarity matrix
+   * @return Similarities above the threshold of every document (empty
+   *         unless RecommendSpGemm was called with a sparse result)
    */
-  std::set<std::string> allWordsInCorpus() const { return allWordsInCorpus_; }
+  const CsrMatrix& sparseSimilarities() const { return sparseSimilarities_; }
   /**
-   * @brief Getter for IDF map
-   * @return Map of terms to their IDF values
+   * @brief Getter for the top-K neighbour lists
+   * @return For every document, its most similar documents (empty unless
+   *         RecommendTopK was called)
    */
-  std::map<std::string, double> IDF() const { return IDF_; }
-  std::map<std::string, int> documentsOccurrences() const;
-  std::map<std::string, std::string> lemmatizationMap() const;
+  const std::vector<std::vector<Neighbour>>& neighbours() const {
+    return neighbours_;
+  }
+  /**
+   * @brief Getter for the precision the similarity engines store weights in
+   */
+  StoragePrecision storagePrecision() const { return precision_; }
 
+  /**
+   * @brief Getter for the near-duplicate clusters found while loading
+   * @return Cluster of every input document (empty unless detection was
+   *         enabled)
+   */
+  const DuplicateClusters& duplicates() const { return duplicates_; }
+  /**
+   * @brief Getter for what the vocabulary options eliminated when the
+   *        corpus was built
+   * @return Terms and non-zero entries kept (all zero unless the
+   *         vocabulary was pruned or hashed)
+   */
+  const VocabularyReport& vocabularyReport() const {
+    return vocabularyReport_;
+  }
+
+  /**
+   * @brief Getter for the timings and counters of the pipeline stages run so
+   *        far
+   * @return Statistics of the manager
+   */
+  const PipelineStats& stats() const { return stats_; }
+  /**
+   * @brief Mutable getter for the statistics, so callers can measure their
+   *        own stages (such as writing the results) alongside the pipeline
+   * @return Statistics of the manager
+   */
+  PipelineStats& stats() { return stats_; }
+
+  void SetStoragePrecision(StoragePrecision precision);
   void Recommend();
+  void RecommendTopK(size_t k, double threshold = 0.0);
+  void RecommendSpGemm(const SpGemmOptions& options, bool sparse = false);
+  void RecommendApproximate(size_t k, double threshold,
+                            const AnnParameters& parameters);
+  std::vector<RecallReport> EvaluateRecall(
+      size_t k, double threshold, const AnnParameters& parameters,
+      const std::vector<size_t>& searchBreadths, size_t queries = 1000);
+  PrecisionReport EvaluatePrecision(size_t k, double threshold,
+                                    StoragePrecision precision,
+                                    size_t queries = 1000);
   void PrintSimilarityMatrix() const;
+  void PrintNeighbours() const;
+
+  SimilarityEngine BuildEngine();
+  SimilarityEngine BuildEngine(StoragePrecision precision);
+  HnswIndex BuildAnnIndex(const AnnParameters& parameters);
+  void SaveIndex(const std::string& indexFile) const;
+  void AddDocument(const std::string& document);
+  void AddDocuments(const std::vector<std::string>& documents);
+  void RemoveDocument(size_t index);
 
  private:
+  /**
+   * @brief Which result the last recommendation produced, and so which one
+   *        corpus updates have to keep current. kProduct is a matrix
+   *        computed as a sparse product, which updates recompute whole
+   */
+  enum class Mode { kNone, kMatrix, kTopK, kProduct };
+
   std::vector<Document> documents_;
-  std::set<std::string> stopWords_;
-  std::map<std::string, std::string> lemmatizationMap_;
-  std::map<std::string, int> documentsOccurrences_;
-  std::set<std::string> allWordsInCorpus_;
-  std::map<std::string, double> IDF_;
+  std::shared_ptr<CorpusContext> context_;
   std::vector<std::vector<double>> similarityMatrix_;
+  CsrMatrix sparseSimilarities_;
+  std::vector<std::vector<Neighbour>> neighbours_;
+  // Index the corpus was loaded from, and whether its top-K lists still
+  // describe the corpus without having been taken into neighbours_.
+  std::shared_ptr<const IndexFile> index_;
+  bool storedNeighbours_ = false;
+  DuplicateClusters duplicates_;
+  VocabularyReport vocabularyReport_;
+  ThreadPool pool_;
+  StoragePrecision precision_ = StoragePrecision::kDouble;
+  Mode mode_ = Mode::kNone;
+  size_t topK_ = 0;
+  double threshold_ = 0.0;
+  bool approximate_ = false;
+  SpGemmOptions product_;
+  bool sparseProduct_ = false;
+  size_t counted_ = 0;
+  size_t weighted_ = 0;
+  uint64_t weightsVersion_ = 0;
+  mutable PipelineStats stats_;
 
-  std::map<std::string, std::string> LoadLemmatizationRules(
-      const std::string& lemmatizationFile);
+  void LoadDocuments(const std::vector<std::string>& documents);
+  void CollapseDuplicates();
   void CountDocumentsOccurrences();
-  void CalculateIDF();
+  void ReportVocabulary();
+  void CalculateWeights();
+  void CalculateTopK();
+  void TakeStoredNeighbours();
+  void SettleStoredNeighbours();
+  void RecalculateRecommendations();
+  std::vector<const SparseVector<double>*> WeightVectors() const;
   void CalculateCosineSimilarity();
+  void CalculateProduct();
+  void UpdateCounters();
 };
 
 std::ostream& operator<<(std::ostream& os, const DocumentManager& dm);
@@ -0,0 +1,29 @@
+#ifndef DOT_KERNELS_H_
+#define DOT_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sparseVector.h"
+
+/**
+ * @brief Instruction set used by the dot-product kernels. The best level the
+ *        CPU supports is selected at startup; lower levels can be forced for
+ *        benchmarking
+ */
+enum class SimdLevel { kScalar, kAvx2, kAvx512 };
+
+SimdLevel DetectSimdLevel();
+SimdLevel ActiveSimdLevel();
+void SetSimdLevel(SimdLevel level);
+const char *SimdLevelName(SimdLevel level);
+
+double DenseDot(const double *a, const double *b, size_t n);
+float DenseDot(const float *a, const float *b, size_t n);
+int64_t DenseDot(const int16_t *a, const int16_t *b, size_t n);
+int64_t DenseDot(const int8_t *a, const int8_t *b, size_t n);
+double SparseDot(const uint32_t *idsA, const double *valuesA, size_t sizeA,
+                 const uint32_t *idsB, const double *valuesB, size_t sizeB);
+double SparseDot(const SparseVector<double> &a, const SparseVector<double> &b);
+
+#endif
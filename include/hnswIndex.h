@@ -0,0 +1,144 @@
+#ifndef HNSW_INDEX_H_
+#define HNSW_INDEX_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "similarityEngine.h"
+#include "sparseVector.h"
+
+/**
+ * @brief Parameters of the HNSW index. More links and a wider build search
+ *        give a better graph, slower to build; a wider query search raises
+ *        the recall and the query time
+ */
+struct AnnParameters {
+  size_t links = 16;
+  size_t buildBreadth = 100;
+  size_t searchBreadth = 64;
+  uint64_t seed = 42;
+};
+
+/**
+ * @brief Recall of the approximate top-K lists against the exact ones, and
+ *        the time each took, over a sample of query documents
+ */
+struct RecallReport {
+  size_t queries = 0;
+  size_t k = 0;
+  size_t searchBreadth = 0;
+  double recall = 0.0;
+  double scored = 0.0;
+  double exactSeconds = 0.0;
+  double approximateSeconds = 0.0;
+  double buildSeconds = 0.0;
+};
+
+/**
+ * @brief Approximate nearest-neighbour index over normalized sparse vectors:
+ *        a hierarchical navigable small world graph (HNSW). Every document
+ *        is linked to similar documents on layer 0 and, with geometrically
+ *        decreasing probability, on sparser layers above; a query descends
+ *        greedily from the top layer and then explores layer 0 best-first,
+ *        so it scores a number of documents that grows slowly with the
+ *        corpus instead of every document sharing a term with it.
+ *        The graph is walked with float copies of the vectors, packed one
+ *        after another so a document is one contiguous read, and with the
+ *        query scattered into a dense array, so scoring a document only
+ *        reads its own entries. The neighbours returned are rescored with
+ *        SparseDot, so their similarities are exactly those of the exact
+ *        engine.
+ */
+class HnswIndex {
+ public:
+  /**
+   * @brief Scratch buffers reused across queries: the query scattered by
+   *        term ID, when each document was last visited, the search heaps
+   *        and the number of documents scored by the last query
+   */
+  struct QueryBuffer {
+    std::vector<float> dense;
+    std::vector<uint32_t> visited;
+    uint32_t stamp = 0;
+    std::vector<std::pair<float, uint32_t>> candidates;
+    std::vector<std::pair<float, uint32_t>> results;
+    size_t evaluated = 0;
+  };
+
+  HnswIndex(const std::vector<const SparseVector<double> *> &vectors,
+            size_t vocabularySize, const AnnParameters &parameters);
+
+  /**
+   * @brief Number of documents indexed
+   */
+  size_t size() const { return vectors_.size(); }
+  /**
+   * @brief Getter for the parameters the index was built with
+   */
+  const AnnParameters &parameters() const { return parameters_; }
+  /**
+   * @brief Change how many documents query searches keep; the graph does
+   *        not depend on it
+   * @param breadth New search breadth
+   */
+  void SetSearchBreadth(size_t breadth) {
+    parameters_.searchBreadth = breadth;
+  }
+
+  std::vector<Neighbour> TopK(size_t document, size_t k, double threshold,
+                              QueryBuffer &buffer) const;
+  std::vector<Neighbour> TopK(const SparseVector<double> &vector, size_t k,
+                              double threshold, QueryBuffer &buffer,
+                              size_t exclude = SIZE_MAX) const;
+
+ private:
+  using Scored = std::pair<float, uint32_t>;
+
+  /**
+   * @brief Entry of a packed vector
+   */
+  struct Entry {
+    uint32_t id;
+    float weight;
+  };
+
+  std::vector<const SparseVector<double> *> vectors_;
+  // Vector of document d: entries_[offsets_[d], offsets_[d + 1]).
+  std::vector<size_t> offsets_;
+  std::vector<Entry> entries_;
+  size_t vocabularySize_;
+  AnnParameters parameters_;
+  // Layer 0: for every document, the number of its links and then
+  // layer0Capacity_ slots.
+  size_t layer0Capacity_;
+  std::vector<uint32_t> layer0_;
+  // Layers above: for every document, one block of the same layout per
+  // layer it is on, lowest first.
+  std::vector<std::vector<uint32_t>> upper_;
+  uint32_t entry_ = 0;
+  size_t topLayer_ = 0;
+
+  uint32_t *Links(uint32_t document, size_t layer);
+  const uint32_t *Links(uint32_t document, size_t layer) const;
+  size_t Capacity(size_t layer) const;
+  float Dot(const std::vector<float> &dense, uint32_t document) const;
+  void Scatter(const SparseVector<double> &vector,
+               std::vector<float> &dense) const;
+  void Clear(const SparseVector<double> &vector,
+             std::vector<float> &dense) const;
+  void Scatter(uint32_t document, std::vector<float> &dense) const;
+  void Clear(uint32_t document, std::vector<float> &dense) const;
+  uint32_t Descend(QueryBuffer &buffer, uint32_t start, size_t layer) const;
+  void SearchLayer(QueryBuffer &buffer, uint32_t start, size_t breadth,
+                   size_t layer) const;
+  std::vector<uint32_t> SelectNeighbours(std::vector<Scored> candidates,
+                                         size_t count,
+                                         std::vector<float> &other) const;
+  void Link(uint32_t from, uint32_t to, size_t layer,
+            std::vector<float> &other);
+  void Insert(uint32_t document, size_t layer, QueryBuffer &buffer,
+              std::vector<float> &other);
+};
+
+#endif
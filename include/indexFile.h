@@ -0,0 +1,262 @@
+#ifndef INDEX_FILE_H_
+#define INDEX_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "mappedFile.h"
+#include "weighting.h"
+
+/**
+ * @brief Read-only view of a contiguous array inside a mapped file
+ */
+template <typename T>
+class ArrayView {
+ public:
+  ArrayView() = default;
+  ArrayView(const T *data, size_t size) : data_(data), size_(size) {}
+
+  const T *data() const { return data_; }
+  size_t size() const { return size_; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+
+ private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+ * @brief Read-only view of a list of strings inside a mapped file: a count,
+ *        count + 1 byte offsets and the characters of every string
+ */
+class StringListView {
+ public:
+  StringListView() = default;
+  StringListView(const uint64_t *offsets, const char *chars, size_t size)
+      : offsets_(offsets), chars_(chars), size_(size) {}
+
+  size_t size() const { return size_; }
+  std::string_view operator[](size_t i) const {
+    return std::string_view(chars_ + offsets_[i],
+                            offsets_[i + 1] - offsets_[i]);
+  }
+
+ private:
+  const uint64_t *offsets_ = nullptr;
+  const char *chars_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+ * @brief Persistent binary index of a processed corpus. The file is a fixed
+ *        header followed by 64-byte aligned sections of plain arrays in
+ *        native byte order, so it is used straight from the memory mapping:
+ *        opening it validates the header and checksum and parses nothing.
+ *        The file only offers views; a corpus loaded from it keeps them and
+ *        copies each array only when it writes to it (see
+ *        DocumentManager(const std::string&, size_t)).
+ *
+ * Per-document arrays are concatenated and indexed by an offsets section
+ * (documentCount + 1 entries); the TF, normalized TF and first-occurrence
+ * sections share the term IDs of the vectorIds section.
+ */
+class IndexFile {
+ public:
+  static constexpr uint32_t kFormatVersion = 3;
+  static constexpr uint32_t kHasNeighbours = 1;
+  static constexpr uint32_t kStemmed = 2;
+  static constexpr uint32_t kFrozenVocabulary = 4;
+
+  enum Section {
+    kTerms,                   // string list, indexed by term ID
+    kDocumentFrequency,       // int32 per term
+    kIDF,                     // double per term
+    kDocumentNames,           // string list, indexed by document
+    kVectorLengths,           // double per document
+    kVectorOffsets,           // uint64, documentCount + 1
+    kVectorIds,               // uint32 term IDs, sorted per document
+    kTF,                      // double
+    kTFNormalized,            // double
+    kTermPositions,           // int32 (row, column) of the first occurrence
+    kNeighbourOffsets,        // uint64, documentCount + 1
+    kNeighbourDocuments,      // uint32
+    kNeighbourSimilarities,   // double
+    kStopWords,               // string list
+    kLemmaWords,              // string list
+    kLemmas,                  // string list, lemma of each lemma word
+    kTermCounts,              // uint32 occurrences, parallel to kVectorIds
+    kSectionCount
+  };
+
+  /**
+   * @brief Fixed-size file header
+   */
+  struct Header {
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t flags;
+    uint64_t checksum;
+    uint64_t fileSize;
+    uint64_t documentCount;
+    uint64_t termCount;
+    uint64_t corpusVersion;
+    uint64_t topK;
+    double threshold;
+    uint32_t weighting;
+    uint32_t reserved;
+    double bm25K1;
+    double bm25B;
+    uint64_t offsets[kSectionCount];
+    uint64_t sizes[kSectionCount];
+  };
+
+  /**
+   * @brief Sparse vector of one document, as stored in the index
+   */
+  struct Vector {
+    ArrayView<uint32_t> ids;
+    ArrayView<uint32_t> counts;
+    ArrayView<double> TF;
+    ArrayView<double> TFNormalized;
+    ArrayView<std::pair<int32_t, int32_t>> positions;
+    double length;
+  };
+
+  /**
+   * @brief Neighbour list of one document, as stored in the index
+   */
+  struct NeighbourList {
+    ArrayView<uint32_t> documents;
+    ArrayView<double> similarities;
+  };
+
+  explicit IndexFile(const std::string &path);
+
+  /**
+   * @brief Number of documents in the index
+   */
+  size_t documentCount() const { return header_->documentCount; }
+  /**
+   * @brief Number of terms in the index vocabulary
+   */
+  size_t termCount() const { return header_->termCount; }
+  /**
+   * @brief Version of the corpus when the index was written
+   */
+  uint64_t corpusVersion() const { return header_->corpusVersion; }
+  /**
+   * @brief Whether terms were stemmed when the corpus was normalized
+   */
+  bool stemmed() const { return header_->flags & kStemmed; }
+  /**
+   * @brief Whether the vocabulary was pruned, so it takes no new terms
+   */
+  bool frozenVocabulary() const { return header_->flags & kFrozenVocabulary; }
+  /**
+   * @brief Weighting scheme the stored weights were calculated with
+   */
+  WeightingOptions weighting() const {
+    return {static_cast<WeightingScheme>(header_->weighting),
+            header_->bm25K1, header_->bm25B};
+  }
+  /**
+   * @brief Whether the index holds top-K neighbour lists
+   */
+  bool hasNeighbours() const { return header_->flags & kHasNeighbours; }
+  /**
+   * @brief Number of neighbours per document the lists were computed with
+   */
+  size_t topK() const { return header_->topK; }
+  /**
+   * @brief Similarity threshold the lists were computed with
+   */
+  double threshold() const { return header_->threshold; }
+
+  StringListView Strings(Section section) const;
+  template <typename T>
+  ArrayView<T> Array(Section section) const;
+  Vector DocumentVector(size_t document) const;
+  NeighbourList Neighbours(size_t document) const;
+
+ private:
+  MappedFile file_;
+  const Header *header_ = nullptr;
+
+  void Validate(const std::string &path) const;
+};
+
+/**
+ * @brief Typed view of a whole section
+ * @param section Section to view
+ * @return Array over the section bytes
+ */
+template <typename T>
+ArrayView<T> IndexFile::Array(Section section) const {
+  return ArrayView<T>(
+      reinterpret_cast<const T *>(file_.data() + header_->offsets[section]),
+      header_->sizes[section] / sizeof(T));
+}
+
+/**
+ * @brief Streaming writer of an index file. Sections are written one after
+ *        the other, each possibly in several pieces; Finish() fills in the
+ *        header, including the checksum of everything after it.
+ */
+class IndexWriter {
+ public:
+  explicit IndexWriter(const std::string &path);
+
+  void BeginSection(IndexFile::Section section);
+  void Append(const void *data, size_t bytes);
+  /**
+   * @brief Append the elements of a contiguous container
+   */
+  template <typename Container>
+  void AppendArray(const Container &values) {
+    Append(values.data(), values.size() * sizeof(values[0]));
+  }
+  template <typename Strings>
+  void WriteStrings(IndexFile::Section section, const Strings &strings);
+  void Finish(IndexFile::Header header);
+
+ private:
+  std::string path_;
+  std::ofstream stream_;
+  uint64_t position_ = 0;
+  int current_ = -1;
+  uint64_t offsets_[IndexFile::kSectionCount] = {};
+  uint64_t sizes_[IndexFile::kSectionCount] = {};
+
+  void EndSection();
+};
+
+/**
+ * @brief Write a whole string-list section
+ * @param section Section to write
+ * @param strings Strings, anything convertible to std::string_view
+ */
+template <typename Strings>
+void IndexWriter::WriteStrings(IndexFile::Section section,
+                               const Strings &strings) {
+  BeginSection(section);
+  uint64_t count = strings.size();
+  Append(&count, sizeof(count));
+  uint64_t offset = 0;
+  Append(&offset, sizeof(offset));
+  for (const auto &text : strings) {
+    offset += std::string_view(text).size();
+    Append(&offset, sizeof(offset));
+  }
+  for (const auto &text : strings) {
+    std::string_view view(text);
+    Append(view.data(), view.size());
+  }
+}
+
+#endif
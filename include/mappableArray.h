@@ -0,0 +1,61 @@
+#ifndef MAPPABLE_ARRAY_H_
+#define MAPPABLE_ARRAY_H_
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Array that either owns its elements or views them in a mapped
+ *        file. Writing to a mapped array first copies it
+ */
+template <typename T>
+class MappableArray {
+ public:
+  /**
+   * @brief Getter for the elements
+   */
+  const T *data() const {
+    return mapped_ != nullptr ? mapped_ : owned_.data();
+  }
+  /**
+   * @brief Number of elements
+   */
+  size_t size() const {
+    return mapped_ != nullptr ? mappedSize_ : owned_.size();
+  }
+  bool empty() const { return size() == 0; }
+  const T &operator[](size_t i) const { return data()[i]; }
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + size(); }
+  const T &back() const { return data()[size() - 1]; }
+  /**
+   * @brief Whether the elements are viewed in a mapped file
+   */
+  bool mapped() const { return mapped_ != nullptr; }
+  /**
+   * @brief Getter for the owned elements, copying mapped ones first
+   */
+  std::vector<T> &owned() {
+    if (mapped_ != nullptr) {
+      owned_.assign(mapped_, mapped_ + mappedSize_);
+      mapped_ = nullptr;
+    }
+    return owned_;
+  }
+  /**
+   * @brief View elements owned by someone else, who must keep them alive
+   */
+  void Map(const T *data, size_t size) {
+    owned_.clear();
+    owned_.shrink_to_fit();
+    mapped_ = data;
+    mappedSize_ = size;
+  }
+
+ private:
+  std::vector<T> owned_;
+  const T *mapped_ = nullptr;
+  size_t mappedSize_ = 0;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Read-only memory mapping of a whole file. The mapping stays at the
+ *        same address for the lifetime of the object, so views into it stay
+ *        valid until it is destroyed.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * @brief Whether the file could be opened and mapped
+   */
+  bool is_open() const { return open_; }
+  /**
+   * @brief Getter for the mapped bytes
+   * @return Pointer to the first byte (nullptr for empty files)
+   */
+  const char *data() const { return data_; }
+  /**
+   * @brief Size of the file in bytes
+   */
+  size_t size() const { return size_; }
+  /**
+   * @brief Getter for the whole content as a view
+   */
+  std::string_view view() const { return std::string_view(data_, size_); }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef NEAR_DUPLICATES_H_
+#define NEAR_DUPLICATES_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "threadPool.h"
+
+/**
+ * @brief Settings of the near-duplicate pass. Two documents are near
+ *        duplicates when the Jaccard similarity of their sets of shingles
+ *        (runs of `shingle` consecutive normalized terms) is at least
+ *        `threshold`, as estimated from `hashes` MinHash values
+ */
+struct DeduplicationOptions {
+  bool enabled = false;
+  bool collapse = false;
+  double threshold = 0.8;
+  size_t shingle = 3;
+  size_t hashes = 128;
+  // Rows per LSH band; 0 chooses them from the threshold.
+  size_t rows = 0;
+  uint64_t seed = 42;
+};
+
+/**
+ * @brief Near-duplicate clusters among the documents of a corpus, in input
+ *        order. The representative of a cluster is its first document
+ */
+struct DuplicateClusters {
+  std::vector<std::string> names;
+  // Index in names of the representative of every document.
+  std::vector<uint32_t> representative;
+  // Estimated Jaccard similarity of every document with its representative.
+  std::vector<double> similarity;
+  bool collapsed = false;
+
+  size_t Duplicates() const;
+  size_t Clusters() const;
+  void Print(std::ostream &os) const;
+};
+
+DuplicateClusters FindNearDuplicates(const std::vector<Document> &documents,
+                                     const DeduplicationOptions &options,
+                                     ThreadPool &pool);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef NORMALIZER_H_
+#define NORMALIZER_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stringTable.h"
+
+/**
+ * @brief Token flowing through the normalization pipeline: its current text
+ *        and, when known, the ID of that text in the lemma table
+ */
+struct Token {
+  static constexpr uint32_t kNoLemma = LemmaTable::kNotFound;
+
+  std::string_view text;
+  uint32_t lemma = kNoLemma;
+};
+
+/**
+ * @brief One step of the token normalization pipeline. A stage rewrites a
+ *        single token and decides whether it survives.
+ */
+class NormalizationStage {
+ public:
+  /**
+   * @brief Outcome of a stage: keep the token, drop it entirely (it takes no
+   *        position in its line) or blank it (it keeps its position but is
+   *        not a term)
+   */
+  enum class Result { kKeep, kDrop, kBlank };
+
+  virtual ~NormalizationStage() = default;
+  virtual const char *name() const = 0;
+  /**
+   * @brief Apply the stage to a token. Stages that rewrite the text must
+   *        reset its lemma ID
+   * @param token Token to rewrite; its text may be repointed to buffer or to
+   *        data owned by the stage
+   * @param buffer Scratch buffer shared by the stages of one pipeline run
+   * @return Whether the token is kept, dropped or blanked
+   */
+  virtual Result Apply(Token &token, std::string &buffer) const = 0;
+};
+
+/**
+ * @brief Remove every non-alphanumeric character; tokens left empty are
+ *        dropped
+ */
+class CleanStage : public NormalizationStage {
+ public:
+  const char *name() const override { return "clean"; }
+  Result Apply(Token &token, std::string &buffer) const override;
+};
+
+/**
+ * @brief Convert the token to lowercase
+ */
+class LowercaseStage : public NormalizationStage {
+ public:
+  const char *name() const override { return "lowercase"; }
+  Result Apply(Token &token, std::string &buffer) const override;
+};
+
+/**
+ * @brief Replace the token by its lemma, if it has one, and tag it with the
+ *        lemma ID. An empty lemma blanks the token
+ */
+class LemmatizeStage : public NormalizationStage {
+ public:
+  explicit LemmatizeStage(const LemmaTable &lemmas) : lemmas_(lemmas) {}
+  const char *name() const override { return "lemmatize"; }
+  Result Apply(Token &token, std::string &buffer) const override;
+
+ private:
+  const LemmaTable &lemmas_;
+};
+
+/**
+ * @brief Blank stop words, keeping their position. When built with the lemma
+ *        table, whether each lemma is a stop word is computed up front, so
+ *        lemmatized tokens are checked by ID without hashing
+ */
+class StopWordStage : public NormalizationStage {
+ public:
+  explicit StopWordStage(const StopWordTable &stopWords,
+                         const LemmaTable *lemmas = nullptr);
+  const char *name() const override { return "stop-words"; }
+  Result Apply(Token &token, std::string &buffer) const override;
+
+ private:
+  const StopWordTable &stopWords_;
+  std::vector<bool> stopLemmas_;
+};
+
+/**
+ * @brief English S-stemmer (Harman, 1991): folds regular plurals, e.g.
+ *        "queries" -> "query", "houses" -> "house", "cats" -> "cat"
+ */
+class StemStage : public NormalizationStage {
+ public:
+  const char *name() const override { return "stem"; }
+  Result Apply(Token &token, std::string &buffer) const override;
+};
+
+/**
+ * @brief Fused normalization pipeline: every token flows through all the
+ *        stages once, with no intermediate copy of the text.
+ */
+class Normalizer {
+ public:
+  static Normalizer Default(const LemmaTable &lemmas,
+                            const StopWordTable &stopWords, bool stem = false);
+
+  Normalizer &AddStage(std::unique_ptr<NormalizationStage> stage);
+  NormalizationStage::Result Normalize(Token &token, std::string &buffer) const;
+  /**
+   * @brief Getter for the stages, in application order
+   */
+  const std::vector<std::unique_ptr<NormalizationStage>> &stages() const {
+    return stages_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<NormalizationStage>> stages_;
+};
+
+#endif
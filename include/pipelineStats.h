@@ -0,0 +1,88 @@
+#ifndef PIPELINE_STATS_H_
+#define PIPELINE_STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Lightweight instrumentation of the processing pipeline: wall and
+ *        CPU time and heap growth of every stage, plus named counters
+ *        (documents, tokens, vocabulary size...). A stage costs a few clock
+ *        reads and one heap query, so it is always enabled. Stages measured
+ *        several times, such as loading on every AddDocuments, are summed.
+ *
+ * CPU time is the time of the whole process, so it includes the worker
+ * threads of a parallel stage. Heap growth is the change in bytes in use
+ * by malloc, so it is what the stage left allocated, not its peak.
+ */
+class PipelineStats {
+ public:
+  /**
+   * @brief Accumulated measurements of one stage
+   */
+  struct Stage {
+    std::string name;
+    size_t calls = 0;
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    int64_t heapBytes = 0;
+  };
+
+  /**
+   * @brief Measures a stage from its construction to its destruction
+   */
+  class Scope {
+   public:
+    Scope(PipelineStats &stats, std::string_view name);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    PipelineStats &stats_;
+    std::string_view name_;
+    std::chrono::steady_clock::time_point wallStart_;
+    double cpuStart_;
+    int64_t heapStart_;
+  };
+
+  /**
+   * @brief Start measuring a stage; it ends when the returned scope does
+   * @param name Stage name, which must outlive the scope
+   */
+  Scope Measure(std::string_view name) { return Scope(*this, name); }
+  void SetCounter(std::string_view name, uint64_t value);
+  uint64_t counter(std::string_view name) const;
+  /**
+   * @brief Getter for the stages, in the order they first ran
+   */
+  const std::vector<Stage> &stages() const { return stages_; }
+  /**
+   * @brief Getter for the counters, in the order they were first set
+   */
+  const std::vector<std::pair<std::string, uint64_t>> &counters() const {
+    return counters_;
+  }
+  void Reset();
+
+  void Print(std::ostream &os) const;
+  void PrintJson(std::ostream &os) const;
+
+  static double CpuSeconds();
+  static int64_t HeapBytes();
+  static uint64_t PeakResidentBytes();
+
+ private:
+  std::vector<Stage> stages_;
+  std::vector<std::pair<std::string, uint64_t>> counters_;
+
+  void Record(std::string_view name, double wallSeconds, double cpuSeconds,
+              int64_t heapBytes);
+};
+
+#endif
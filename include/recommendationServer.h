@@ -0,0 +1,84 @@
+#ifndef RECOMMENDATION_SERVER_H_
+#define RECOMMENDATION_SERVER_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "documentManager.h"
+#include "similarityEngine.h"
+#include "threadPool.h"
+
+/**
+ * @brief Long-lived query server over a loaded corpus. Requests and
+ *        responses are JSON objects, one per line:
+ *
+ *   {"id": 1, "text": "free text to recommend for", "k": 5}
+ *   {"id": 2, "document": 3, "threshold": 0.1}
+ *   -> {"id": 1, "results": [{"document": 3, "name": "...",
+ *                             "similarity": 0.512345}, ...]}
+ *   -> {"id": 2, "error": "..."}
+ *
+ * Documents are numbered from 1, as in the printed tables. "k" and
+ * "threshold" default to the server settings. Text queries go through the
+ * corpus normalization pipeline and are weighted like corpus documents.
+ * Every line that is ready when the server wakes up, from every client,
+ * is answered in one parallel batch; responses keep the order of each
+ * client's requests. A request line longer than kMaxRequestBytes gets an
+ * error response and is dropped up to its newline. Socket clients are
+ * non-blocking: responses a client does not read yet wait in its own
+ * buffer, so one slow reader never stalls the others, and its requests
+ * are not read while more than kMaxUnsentBytes are waiting.
+ */
+class RecommendationServer {
+ public:
+  static constexpr size_t kMaxRequestBytes = 1 << 20;
+  static constexpr size_t kMaxUnsentBytes = 4 << 20;
+
+  RecommendationServer(DocumentManager &manager, size_t k, double threshold,
+                       size_t threads = 1);
+
+  void ServeStdin();
+  void ServeSocket(const std::string &path);
+  std::string Answer(std::string_view request,
+                     SimilarityEngine::RowBuffer &buffer) const;
+
+ private:
+  /**
+   * @brief Connection the server reads requests from and answers to
+   */
+  struct Client {
+    int input;
+    int output;
+    std::string pending;
+    // Responses not written yet; only non-blocking outputs keep any.
+    std::string unsent;
+    // Dropping the rest of an overlong request line, up to its newline.
+    bool discarding = false;
+    // No more requests: the input ended or the output failed. The client
+    // is dropped once its unsent responses are written.
+    bool closed = false;
+  };
+  /**
+   * @brief Complete request line of a client, or the mark of an overlong
+   *        one, which is answered with an error
+   */
+  struct Request {
+    size_t client;
+    std::string text;
+    bool overlong = false;
+  };
+
+  const DocumentManager &manager_;
+  SimilarityEngine engine_;
+  size_t k_;
+  double threshold_;
+  ThreadPool pool_;
+  std::vector<SimilarityEngine::RowBuffer> buffers_;
+
+  void Serve(int listener, std::vector<Client> &clients);
+  void AnswerBatch(std::vector<Client> &clients,
+                   const std::vector<Request> &requests);
+};
+
+#endif
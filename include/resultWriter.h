@@ -0,0 +1,105 @@
+#ifndef RESULT_WRITER_H_
+#define RESULT_WRITER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "documentManager.h"
+
+/**
+ * @brief Layout of the results written by ResultWriter
+ */
+enum class OutputFormat { kTable, kCsv, kTsv, kJsonLines, kBinary };
+
+/**
+ * @brief What ResultWriter writes and how
+ */
+struct OutputOptions {
+  OutputFormat format = OutputFormat::kTable;
+  // Only the terms each document contains, instead of every corpus term,
+  // and only the non-zero similarities.
+  bool nonZeroOnly = false;
+  // Skip the term tables.
+  bool similaritiesOnly = false;
+};
+
+bool ParseOutputFormat(std::string_view name, OutputFormat &format);
+void AppendJsonString(std::string_view text, std::string &out);
+
+/**
+ * @brief Writes the term tables and similarities of a corpus in one of the
+ *        OutputFormat layouts. Everything is formatted into a large buffer
+ *        with std::to_chars and handed to the stream in big blocks, so the
+ *        cost is the bytes written rather than per-field stream formatting.
+ *
+ * Similarities are the full matrix, or the top-K lists or sparse matrix
+ * when the manager holds them. CSV and TSV output is a terms section and a
+ * similarities section, each starting with its header line, separated by a
+ * blank line.
+ * JSON Lines output is one object per document. The binary layout is
+ * described in WriteBinary(). Top-K lists computed outside a manager, such
+ * as those of a ShardedCorpus, can be streamed one document at a time with
+ * BeginNeighbourLists() and WriteNeighbourList(), in the same layouts
+ * without the term tables.
+ */
+class ResultWriter {
+ public:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  ResultWriter(std::ostream &os, OutputOptions options = {});
+  ~ResultWriter();
+  ResultWriter(const ResultWriter &) = delete;
+  ResultWriter &operator=(const ResultWriter &) = delete;
+
+  void Write(const DocumentManager &dm);
+  void WriteTermTables(const DocumentManager &dm);
+  void WriteSimilarityMatrix(const DocumentManager &dm);
+  void WriteSparseSimilarities(const DocumentManager &dm);
+  void WriteNeighbours(const DocumentManager &dm);
+  void BeginNeighbourLists(size_t documents, size_t terms);
+  void WriteNeighbourList(size_t document,
+                          const std::vector<std::string> &names,
+                          const std::vector<Neighbour> &neighbours);
+  void Flush();
+
+ private:
+  static constexpr uint32_t kAbsent = UINT32_MAX;
+
+  std::ostream &os_;
+  OutputOptions options_;
+  std::string buffer_;
+  // Alphabetical order of the vocabulary and the rank of each term ID in
+  // it, built on first use.
+  std::vector<uint32_t> sortedIds_;
+  std::vector<uint32_t> alphabeticalRank_;
+  // Position of each term ID in the document being written, or kAbsent.
+  std::vector<uint32_t> positions_;
+  // Name of the bucket being written, for hashed vocabularies.
+  std::string label_;
+
+  void WriteDelimited(const DocumentManager &dm);
+  void WriteJsonLines(const DocumentManager &dm);
+  void WriteBinary(const DocumentManager &dm);
+  template <typename Name>
+  void AppendNeighbourBlock(size_t document,
+                            const std::vector<Neighbour> &neighbours,
+                            Name name);
+  template <typename Row>
+  void ForEachTerm(const DocumentManager &dm, const Document &doc, Row row);
+  std::vector<Neighbour> Similarities(const DocumentManager &dm,
+                                      size_t document) const;
+
+  void Append(std::string_view text);
+  void Append(char c);
+  void AppendInteger(long long value, size_t width = 0);
+  void AppendFixed(double value, size_t width = 0);
+  void AppendPadded(std::string_view text, size_t width, bool left = false);
+  void AppendField(std::string_view text);
+  template <typename T>
+  void AppendRaw(const T &value);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SHARDED_CORPUS_H_
+#define SHARDED_CORPUS_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "corpusContext.h"
+#include "document.h"
+#include "pipelineStats.h"
+#include "similarityEngine.h"
+#include "sparseVector.h"
+#include "threadPool.h"
+
+/**
+ * @brief Settings of the sharded mode
+ */
+struct ShardOptions {
+  // Documents per shard; 0 keeps the whole corpus in memory instead.
+  size_t documents = 0;
+  // Directory the shard files are written to; empty for a temporary
+  // directory under /tmp.
+  std::string directory;
+};
+
+/**
+ * @brief Top-K recommendations over a corpus larger than memory. Documents
+ *        are streamed in shards of a fixed number of documents and never
+ *        kept resident: a first pass counts the document frequencies and
+ *        builds the vocabulary, and a second pass weights every shard again
+ *        and spills its normalized sparse vectors to a shard file. Top-K
+ *        lists are then computed one row shard at a time, against every
+ *        column shard in turn, merging the exact lists of each column shard.
+ *        Memory holds the vocabulary, the document names, two shards of
+ *        vectors with the similarity index of one, and the lists of one
+ *        shard. The lists are those DocumentManager::RecommendTopK gives.
+ */
+class ShardedCorpus {
+ public:
+  /**
+   * @brief Receives the neighbour list of every document, in document order
+   */
+  using NeighbourSink = std::function<void(
+      size_t document, const std::vector<Neighbour> &neighbours)>;
+
+  ShardedCorpus(const std::vector<std::string> &documents,
+                const std::string &stopWordsFile,
+                const std::string &lemmatizationFile,
+                const ShardOptions &options, size_t threads = 1,
+                bool stem = false, const WeightingOptions &weighting = {},
+                const VocabularyOptions &vocabulary = {});
+  ~ShardedCorpus();
+  ShardedCorpus(const ShardedCorpus &) = delete;
+  ShardedCorpus &operator=(const ShardedCorpus &) = delete;
+
+  /**
+   * @brief Number of documents in the corpus
+   */
+  size_t size() const { return names_.size(); }
+  /**
+   * @brief Getter for the document names
+   * @return File name of every document, in document order
+   */
+  const std::vector<std::string> &names() const { return names_; }
+  /**
+   * @brief Number of shard files
+   */
+  size_t shardCount() const { return shards_.size(); }
+  /**
+   * @brief Getter for the corpus context
+   * @return Context holding the tables, vocabulary and IDF of the corpus
+   */
+  std::shared_ptr<const CorpusContext> context() const { return context_; }
+  /**
+   * @brief Getter for the timings and counters of the passes run so far
+   * @return Statistics of the corpus
+   */
+  const PipelineStats &stats() const { return stats_; }
+  /**
+   * @brief Getter for what the vocabulary options eliminated
+   * @return Terms and non-zero entries kept
+   */
+  const VocabularyReport &vocabularyReport() const { return report_; }
+
+  void RecommendTopK(size_t k, double threshold, const NeighbourSink &sink,
+                     StoragePrecision precision = StoragePrecision::kDouble);
+
+ private:
+  /**
+   * @brief Shard file and the range of documents it holds
+   */
+  struct Shard {
+    std::string path;
+    size_t first;
+    size_t documents;
+  };
+
+  std::vector<std::string> names_;
+  std::shared_ptr<CorpusContext> context_;
+  std::vector<Shard> shards_;
+  size_t shardSize_;
+  std::string directory_;
+  bool temporaryDirectory_ = false;
+  ThreadPool pool_;
+  PipelineStats stats_;
+  VocabularyReport report_;
+
+  std::vector<Document> LoadShard(size_t first, size_t count);
+  void CountDocumentFrequencies();
+  void WriteShards();
+  void WriteShard(const Shard &shard, const std::vector<Document> &documents);
+  std::vector<SparseVector<double>> ReadShard(const Shard &shard);
+};
+
+#endif
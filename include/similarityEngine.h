@@ -0,0 +1,215 @@
+#ifndef SIMILARITY_ENGINE_H_
+#define SIMILARITY_ENGINE_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "dotKernels.h"
+#include "sparseVector.h"
+#include "threadPool.h"
+
+/**
+ * @brief A recommended document and its similarity to the query document
+ */
+struct Neighbour {
+  uint32_t document;
+  double similarity;
+};
+
+/**
+ * @brief Precision the engine stores the document weights in. Reduced
+ *        precisions stream fewer bytes per posting and accumulate scores in
+ *        float; int16 and int8 quantize the weights of every document to
+ *        32767 and 127 steps of its largest weight
+ */
+enum class StoragePrecision { kDouble, kFloat, kInt16, kInt8 };
+
+bool ParseStoragePrecision(const std::string &name,
+                           StoragePrecision &precision);
+const char *StoragePrecisionName(StoragePrecision precision);
+
+/**
+ * @brief Accuracy of a reduced storage precision against double, measured
+ *        by DocumentManager::EvaluatePrecision over a sample of documents
+ */
+struct PrecisionReport {
+  StoragePrecision precision = StoragePrecision::kDouble;
+  size_t queries = 0;
+  size_t k = 0;
+  // Absolute similarity errors over every pair of a sampled document; the
+  // mean is taken over the pairs with a non-zero similarity.
+  double maxError = 0.0;
+  double meanError = 0.0;
+  // Fraction of the exact top-K lists found by the reduced precision.
+  double overlap = 0.0;
+  // Bytes of posting weights held by each engine.
+  size_t weightBytes = 0;
+  size_t exactWeightBytes = 0;
+  double exactSeconds = 0.0;
+  double reducedSeconds = 0.0;
+};
+
+/**
+ * @brief Cosine similarity engine over normalized sparse document vectors.
+ *        Builds a term -> postings inverted index so dot products are only
+ *        accumulated over the terms two documents share.
+ */
+class SimilarityEngine {
+ public:
+  /**
+   * @brief Scratch buffers reused across rows: a dense score accumulator and
+   *        the list of documents it touched
+   */
+  struct RowBuffer {
+    std::vector<float> scores;
+    std::vector<uint32_t> touched;
+  };
+
+  /**
+   * @brief Block of similarity scores between documents [rowBegin, rowEnd)
+   *        and [columnBegin, columnEnd), stored row-major. On diagonal tiles
+   *        (rowBegin == columnBegin) only entries with column >= row are set.
+   *        Double engines fill scores, reduced precisions floatScores; the
+   *        other pointer is null
+   */
+  struct Tile {
+    size_t rowBegin;
+    size_t rowEnd;
+    size_t columnBegin;
+    size_t columnEnd;
+    const double *scores;
+    const float *floatScores;
+
+    /**
+     * @brief Score of a cell, whichever precision the tile holds
+     * @param i Row document
+     * @param j Column document
+     */
+    double Score(size_t i, size_t j) const {
+      size_t cell = (i - rowBegin) * (columnEnd - columnBegin) + j -
+                    columnBegin;
+      return scores != nullptr ? scores[cell] : floatScores[cell];
+    }
+  };
+
+  SimilarityEngine(const std::vector<const SparseVector<double> *> &vectors,
+                   size_t vocabularySize,
+                   StoragePrecision precision = StoragePrecision::kDouble);
+
+  /**
+   * @brief Number of documents indexed by the engine
+   */
+  size_t size() const { return vectors_.size(); }
+  /**
+   * @brief Getter for the dense subspace used by the blocked kernel
+   * @return Term IDs packed densely in every block, sorted
+   */
+  const std::vector<uint32_t> &denseTerms() const { return denseTerms_; }
+  /**
+   * @brief Getter for the precision the weights are stored in
+   */
+  StoragePrecision precision() const { return precision_; }
+  size_t weightBytes() const;
+  /**
+   * @brief Cosine similarity of a single pair of documents, always from the
+   *        double vectors whatever the storage precision
+   * @param a Index of the first document
+   * @param b Index of the second document
+   * @return Dot product of their normalized vectors
+   */
+  double Similarity(size_t a, size_t b) const {
+    return SparseDot(*vectors_[a], *vectors_[b]);
+  }
+
+  void AccumulateRow(size_t document, size_t first,
+                     std::vector<double> &scores) const;
+  std::vector<std::vector<double>> ComputeMatrix() const;
+  std::vector<std::vector<double>> ComputeMatrix(ThreadPool &pool) const;
+  void ForEachTile(
+      ThreadPool &pool,
+      const std::function<void(const Tile &tile, size_t worker)> &sink,
+      size_t blockBytes = 0) const;
+  std::vector<Neighbour> TopK(size_t document, size_t k, double threshold,
+                              RowBuffer &buffer) const;
+  std::vector<Neighbour> TopK(const SparseVector<double> &vector, size_t k,
+                              double threshold, RowBuffer &buffer,
+                              size_t exclude = SIZE_MAX) const;
+
+ private:
+  /**
+   * @brief Type scores are accumulated in for weights stored as W: double
+   *        for double weights, float for every reduced precision
+   */
+  template <typename W>
+  using Score = std::conditional_t<std::is_same_v<W, double>, double, float>;
+
+  /**
+   * @brief Inverted index restricted to a contiguous range of documents:
+   *        the postings of terms[t] are [offsets[t], offsets[t + 1]) of the
+   *        parallel documents and weights arrays. Dense-subspace terms are
+   *        kept out of the postings and packed in dense, one row of
+   *        denseTerms_.size() weights per document
+   */
+  template <typename W>
+  struct Block {
+    size_t begin;
+    size_t end;
+    std::vector<uint32_t> terms;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> documents;
+    std::vector<W> weights;
+    std::vector<W> dense;
+  };
+
+  std::vector<const SparseVector<double> *> vectors_;
+  StoragePrecision precision_;
+  // Global postings, split in parallel arrays so that a scan reads only the
+  // fields it needs. Only the weights of the storage precision are kept;
+  // double engines keep them rounded to float as well, for the approximate
+  // pass of TopK.
+  std::vector<size_t> offsets_;
+  std::vector<uint32_t> postingDocuments_;
+  std::vector<double> postingWeights_;
+  std::vector<float> approximateWeights_;
+  std::vector<int16_t> int16Weights_;
+  std::vector<int8_t> int8Weights_;
+  // Quantization step of every document, for the integer precisions.
+  std::vector<double> steps_;
+  std::vector<uint32_t> denseTerms_;
+  std::vector<int32_t> denseSlot_;
+
+  void BuildIndex(size_t vocabularySize);
+  void SelectDenseTerms(size_t vocabularySize);
+  template <typename W>
+  const W *Weights() const;
+  template <typename W>
+  void AccumulateRowAs(size_t document, size_t first,
+                       std::vector<double> &scores) const;
+  template <typename W>
+  double ScatterScores(const SparseVector<double> &vector,
+                       RowBuffer &buffer) const;
+  std::vector<Neighbour> ExactTopK(const SparseVector<double> &vector,
+                                   size_t k, double threshold,
+                                   RowBuffer &buffer, size_t exclude) const;
+  template <typename W>
+  std::vector<Neighbour> ReducedTopK(const SparseVector<double> &vector,
+                                     size_t k, double threshold,
+                                     RowBuffer &buffer, size_t exclude) const;
+  template <typename W>
+  void ForEachTileAs(
+      ThreadPool &pool,
+      const std::function<void(const Tile &tile, size_t worker)> &sink,
+      size_t blockBytes) const;
+  template <typename W>
+  std::vector<Block<W>> PartitionBlocks(size_t blockBytes) const;
+  template <typename W>
+  void BuildBlock(Block<W> &block) const;
+  template <typename W>
+  void ComputeTile(const Block<W> &rows, const Block<W> &columns,
+                   std::vector<Score<W>> &scores) const;
+};
+
+#endif
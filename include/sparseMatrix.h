@@ -0,0 +1,86 @@
+#ifndef SPARSE_MATRIX_H_
+#define SPARSE_MATRIX_H_
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "sparseVector.h"
+#include "threadPool.h"
+
+/**
+ * @brief Sparse matrix in compressed sparse row (CSR) layout: the entries of
+ *        row r are [offsets()[r], offsets()[r + 1]) of the parallel indices
+ *        and values arrays, sorted by column. The CSR layout of the
+ *        transpose of a matrix is its compressed sparse column (CSC) layout.
+ */
+class CsrMatrix {
+ public:
+  CsrMatrix() = default;
+  CsrMatrix(size_t columns, std::vector<size_t> offsets,
+            std::vector<uint32_t> indices, std::vector<double> values);
+  static CsrMatrix FromRows(
+      const std::vector<const SparseVector<double> *> &rows, size_t columns);
+
+  /**
+   * @brief Number of rows
+   */
+  size_t rows() const { return offsets_.size() - 1; }
+  /**
+   * @brief Number of columns
+   */
+  size_t columns() const { return columns_; }
+  /**
+   * @brief Number of stored entries
+   */
+  size_t nonZeros() const { return indices_.size(); }
+  bool empty() const { return rows() == 0; }
+  /**
+   * @brief Getter for the row offsets
+   * @return rows() + 1 positions into indices() and values()
+   */
+  const std::vector<size_t> &offsets() const { return offsets_; }
+  /**
+   * @brief Getter for the column of every entry, sorted within each row
+   */
+  const std::vector<uint32_t> &indices() const { return indices_; }
+  /**
+   * @brief Getter for the value of every entry, parallel to indices()
+   */
+  const std::vector<double> &values() const { return values_; }
+
+  CsrMatrix Transpose() const;
+  std::vector<std::vector<double>> ToDense() const;
+
+ private:
+  size_t columns_ = 0;
+  std::vector<size_t> offsets_ = std::vector<size_t>(1, 0);
+  std::vector<uint32_t> indices_;
+  std::vector<double> values_;
+};
+
+/**
+ * @brief Where SpGemm sums the products of an output row: a dense array as
+ *        wide as the output, a hash table sized to the products of the row,
+ *        or whichever suits each row (dense for rows with many products)
+ */
+enum class SpGemmAccumulator { kAuto, kDense, kHash };
+
+bool ParseSpGemmAccumulator(const std::string &name,
+                            SpGemmAccumulator &accumulator);
+const char *SpGemmAccumulatorName(SpGemmAccumulator accumulator);
+
+/**
+ * @brief Options of SpGemm
+ */
+struct SpGemmOptions {
+  SpGemmAccumulator accumulator = SpGemmAccumulator::kAuto;
+  // Entries that are not strictly above it are left out of the product.
+  double threshold = -std::numeric_limits<double>::infinity();
+};
+
+CsrMatrix SpGemm(const CsrMatrix &a, const CsrMatrix &b, ThreadPool &pool,
+                 const SpGemmOptions &options = {});
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef SPARSE_VECTOR_H_
+#define SPARSE_VECTOR_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "mappableArray.h"
+
+/**
+ * @brief Sparse vector indexed by corpus term ID. Entries are stored as two
+ *        parallel arrays kept sorted by ID, so lookups are binary searches and
+ *        two vectors can be intersected with a linear merge. The arrays may
+ *        view a mapped index file instead of owning their entries; changing
+ *        the vector copies them first.
+ */
+template <typename T>
+class SparseVector {
+ public:
+  /**
+   * @brief Getter for the sorted term IDs
+   * @return Term IDs with a non-default value
+   */
+  const MappableArray<uint32_t> &ids() const { return ids_; }
+  /**
+   * @brief Getter for the values, parallel to ids()
+   * @return Values of the entries
+   */
+  const MappableArray<T> &values() const { return values_; }
+  /**
+   * @brief Mutable getter for the values, copying mapped entries first
+   * @return Owned values of the entries
+   */
+  std::vector<T> &values() { return values_.owned(); }
+  /**
+   * @brief Number of stored (non-default) entries
+   */
+  size_t size() const { return ids_.size(); }
+  bool empty() const { return ids_.empty(); }
+
+  void Clear() {
+    ids_.owned().clear();
+    values_.owned().clear();
+  }
+
+  void Reserve(size_t n) {
+    ids_.owned().reserve(n);
+    values_.owned().reserve(n);
+  }
+
+  /**
+   * @brief Take the IDs of another vector, with every value set to T(), so
+   *        the values can be written in place through values()
+   * @param ids Sorted term IDs
+   */
+  void AssignIds(const MappableArray<uint32_t> &ids) {
+    ids_.owned().assign(ids.begin(), ids.end());
+    values_.owned().assign(ids.size(), T());
+  }
+
+  /**
+   * @brief View entries stored elsewhere, such as in a mapped index file,
+   *        instead of copying them. The owner must keep them alive
+   * @param ids Sorted term IDs
+   * @param values Values, parallel to ids
+   * @param size Number of entries
+   */
+  void Map(const uint32_t *ids, const T *values, size_t size) {
+    ids_.Map(ids, size);
+    values_.Map(values, size);
+  }
+
+  /**
+   * @brief Append an entry. IDs must be pushed in strictly increasing order
+   * @param id Term ID
+   * @param value Value stored for the term
+   */
+  void PushBack(uint32_t id, const T &value) {
+    ids_.owned().push_back(id);
+    values_.owned().push_back(value);
+  }
+
+  /**
+   * @brief Look up the value stored for a term
+   * @param id Term ID
+   * @param notFound Value returned when the term is not present
+   * @return Stored value or notFound
+   */
+  T Find(uint32_t id, const T &notFound) const {
+    auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+    if (it == ids_.end() || *it != id) return notFound;
+    return values_[it - ids_.begin()];
+  }
+
+ private:
+  MappableArray<uint32_t> ids_;
+  MappableArray<T> values_;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef STRING_TABLE_H_
+#define STRING_TABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mappableArray.h"
+#include "mappedFile.h"
+
+/**
+ * @brief Open-addressing hash table from strings to uint32 values, built
+ *        once at load time and looked up with string views. Keys live in a
+ *        single contiguous pool and slots hold their hash, so a lookup
+ *        usually touches one slot and compares one key.
+ */
+class StringTable {
+ public:
+  static constexpr uint32_t kNotFound = UINT32_MAX;
+
+  void Insert(std::string_view key, uint32_t value);
+  uint32_t Intern(std::string_view key);
+  uint32_t Find(std::string_view key) const;
+  void Reserve(size_t keys);
+  /**
+   * @brief Number of keys in the table
+   */
+  size_t size() const { return size_; }
+  /**
+   * @brief Call fn(key, value) for every key in the table
+   */
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      const Slot &slot = slots_[i];
+      if (slot.offset == kEmpty) continue;
+      fn(std::string_view(keys_.data() + slot.offset, slot.length),
+         slot.value);
+    }
+  }
+
+ private:
+  friend class LemmaTable;
+  struct Slot {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t value;
+  };
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  MappableArray<Slot> slots_;
+  MappableArray<char> keys_;
+  size_t size_ = 0;
+
+  size_t Probe(std::string_view key, uint32_t hash) const;
+  void Grow();
+  void Rehash(size_t slots);
+};
+
+uint64_t HashString(std::string_view text);
+
+/**
+ * @brief Set of stop words
+ */
+class StopWordTable {
+ public:
+  /**
+   * @brief Add a stop word
+   */
+  void Insert(std::string_view word) { table_.Insert(word, 0); }
+  /**
+   * @brief Whether a word is a stop word
+   */
+  bool Contains(std::string_view word) const {
+    return table_.Find(word) != StringTable::kNotFound;
+  }
+  /**
+   * @brief Number of stop words
+   */
+  size_t size() const { return table_.size(); }
+  /**
+   * @brief Call fn(word) for every stop word
+   */
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    table_.ForEach([&](std::string_view word, uint32_t) { fn(word); });
+  }
+
+ private:
+  StringTable table_;
+};
+
+/**
+ * @brief Lemma dictionary. Every distinct lemma is interned once and gets a
+ *        dense lemma ID; words map straight to the ID of their lemma. After
+ *        Freeze() every lemma also maps to itself, so any token that is a
+ *        lemma is recognized by ID, and the lemma texts are those of the
+ *        word keys. A frozen table can be saved in a binary file that is
+ *        later mapped and used in place, without rebuilding it.
+ */
+class LemmaTable {
+ public:
+  static constexpr uint32_t kNotFound = StringTable::kNotFound;
+
+  void Insert(std::string_view word, std::string_view lemma);
+  /**
+   * @brief Make room for a number of words, so loading does not rehash
+   */
+  void Reserve(size_t words) { words_.Reserve(words); }
+  void Freeze();
+  void SaveBinary(const std::string &path) const;
+  static bool IsBinary(const MappedFile &file);
+  static LemmaTable MapBinary(std::shared_ptr<const MappedFile> file,
+                              const std::string &path);
+  /**
+   * @brief Look up the lemma of a word
+   * @param word Word to look up
+   * @return Lemma ID or kNotFound
+   */
+  uint32_t Find(std::string_view word) const { return words_.Find(word); }
+  /**
+   * @brief Getter for the text of a lemma
+   * @param id Lemma ID
+   */
+  std::string_view Lemma(uint32_t id) const {
+    const Span &span = spans_[id];
+    return std::string_view(words_.keys_.data() + span.offset, span.length);
+  }
+  /**
+   * @brief Number of distinct lemmas
+   */
+  size_t lemmaCount() const { return spans_.size(); }
+  /**
+   * @brief Number of words with a lemma, counting lemmas after Freeze()
+   */
+  size_t size() const { return words_.size(); }
+  /**
+   * @brief Call fn(word, lemma) for every word with a lemma
+   */
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    words_.ForEach(
+        [&](std::string_view word, uint32_t id) { fn(word, Lemma(id)); });
+  }
+
+ private:
+  /**
+   * @brief Position of a lemma text among the word keys
+   */
+  struct Span {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  StringTable words_;
+  // Lemma IDs while loading; Freeze() moves the lemmas to spans_.
+  StringTable lemmaIds_;
+  MappableArray<Span> spans_;
+  // Binary file the tables are mapped from, if any.
+  std::shared_ptr<const MappedFile> file_;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef TERM_DICTIONARY_H_
+#define TERM_DICTIONARY_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Corpus-wide dictionary mapping each term to a dense uint32 ID.
+ *        IDs are assigned in insertion order. Terms are stored once in a deque
+ *        (stable addresses), or left where they are when inserted as views
+ *        of a mapped index, and the term table and hash index keys are views.
+ *        A hashed dictionary (the hashing trick) stores no terms: the ID of
+ *        a term is its hash modulo a power of two, so different terms may
+ *        share an ID, and every ID up to that power is valid.
+ */
+class TermDictionary {
+ public:
+  static constexpr uint32_t kNotFound = UINT32_MAX;
+
+  TermDictionary() = default;
+  TermDictionary(const TermDictionary &other);
+  TermDictionary &operator=(const TermDictionary &other);
+  TermDictionary(TermDictionary &&) = default;
+  TermDictionary &operator=(TermDictionary &&) = default;
+
+  static TermDictionary Hashed(unsigned bits);
+
+  uint32_t Insert(std::string_view term);
+  uint32_t InsertView(std::string_view term);
+  void Reserve(size_t terms);
+  uint32_t Id(std::string_view term) const;
+  /**
+   * @brief Getter for the term with a given ID (not for hashed
+   *        dictionaries, see Label)
+   * @param id Term ID
+   * @return The term, valid as long as the dictionary
+   */
+  std::string_view Term(uint32_t id) const { return terms_[id]; }
+  std::string_view Label(uint32_t id, std::string &buffer) const;
+  /**
+   * @brief Number of terms in the dictionary, or of buckets if it is hashed
+   */
+  size_t size() const {
+    return hashBits_ > 0 ? size_t{1} << hashBits_ : terms_.size();
+  }
+  /**
+   * @brief Whether the dictionary is hashed
+   */
+  bool hashed() const { return hashBits_ > 0; }
+  std::vector<uint32_t> SortedIds() const;
+
+ private:
+  std::deque<std::string> owned_;
+  std::vector<std::string_view> terms_;
+  std::unordered_map<std::string_view, uint32_t> ids_;
+  unsigned hashBits_ = 0;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads running parallel loops. The
+ *        calling thread takes part in every loop as worker 0, so a pool of
+ *        one thread runs everything inline with no synchronization.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Number of threads taking part in a loop, including the caller
+   */
+  size_t size() const { return workers_.size() + 1; }
+
+  void ParallelFor(size_t count,
+                   const std::function<void(size_t index, size_t worker)> &task);
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(size_t, size_t)> *task_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_{0};
+  size_t generation_ = 0;
+  size_t active_ = 0;
+  bool stop_ = false;
+
+  void WorkerLoop(size_t worker);
+  void RunTasks(size_t worker);
+};
+
+#endif
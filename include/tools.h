@@ -3,16 +3,53 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <vector>
 
+#include "hnswIndex.h"
+#include "nearDuplicates.h"
+#include "resultWriter.h"
+#include "shardedCorpus.h"
+#include "weighting.h"
+
+/**
+ * @brief How --stats reports the pipeline statistics on standard error
+ */
+enum class StatsFormat { kNone, kText, kJson };
+
 struct CommandLineArgs {
   std::vector<std::string> textFiles;
   std::string stopWordsFile;
   std::string lemmatizationFile;
+  size_t topK = 0;
+  double threshold = 0.0;
+  size_t threads = 1;
+  bool stem = false;
+  std::string buildIndexFile;
+  std::string loadIndexFile;
+  bool serve = false;
+  std::string socketFile;
+  OutputOptions output;
+  StatsFormat stats = StatsFormat::kNone;
+  bool approximate = false;
+  AnnParameters ann;
+  size_t recallQueries = 0;
+  StoragePrecision precision = StoragePrecision::kDouble;
+  size_t precisionQueries = 0;
+  bool spGemm = false;
+  SpGemmOptions product;
+  bool sparseMatrix = false;
+  DeduplicationOptions deduplication;
+  ShardOptions shards;
+  std::string compileLemmasFile;
+  WeightingOptions weighting;
+  VocabularyOptions vocabulary;
 };
 
 void ErrorOutput();
 void HelpOutput();
+long ParseIntegerOption(const std::string &option, const char *value);
+double ParseRealOption(const std::string &option, const char *value);
 CommandLineArgs CheckArguments(int argc, char *argv[]);
 
 #endif
\ No newline at end of file
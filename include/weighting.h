@@ -0,0 +1,126 @@
+#ifndef WEIGHTING_H_
+#define WEIGHTING_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Term weighting schemes. The weight of a term in a document is a
+ *        term-frequency component times an inverse-document-frequency
+ *        component, and document vectors are normalized to unit length, so
+ *        similarities are cosines whatever the scheme
+ */
+enum class WeightingScheme {
+  kLogTF,      // 1 + log10(tf), without IDF
+  kTfIdf,      // (1 + log10(tf)) * log10(N / df)
+  kAugmented,  // (0.5 + 0.5 * tf / max tf) * log10(N / df)
+  kBM25,       // tf * (k1 + 1) / (tf + k1 * (1 - b + b * dl / avgdl)) *
+               // ln(1 + (N - df + 0.5) / (df + 0.5))
+};
+
+/**
+ * @brief Weighting scheme of a corpus and the parameters of BM25
+ */
+struct WeightingOptions {
+  WeightingScheme scheme = WeightingScheme::kLogTF;
+  double k1 = 1.2;
+  double b = 0.75;
+
+  /**
+   * @brief Whether the weights depend on the rest of the corpus (the IDF or
+   *        the average document length), so they change with it
+   */
+  bool UsesCorpus() const { return scheme != WeightingScheme::kLogTF; }
+};
+
+bool ParseWeightingScheme(const std::string &name, WeightingScheme &scheme);
+const char *WeightingSchemeName(WeightingScheme scheme);
+double InverseDocumentFrequency(WeightingScheme scheme, size_t documents,
+                                int documentFrequency);
+
+/**
+ * @brief What the term-frequency components need to know about a document
+ *        besides the count of the term
+ */
+struct DocumentShape {
+  // Number of term tokens in the document.
+  double length = 0.0;
+  // Largest count of a term in the document.
+  uint32_t maxCount = 0;
+};
+
+/**
+ * @brief Weighting policies: TF(count, shape) and IDF(id) of one scheme,
+ *        inlined into the weighting loops by WithWeightingPolicy so they run
+ *        without virtual dispatch. kNeedsShape tells whether TF() reads the
+ *        shape, which otherwise is not computed
+ */
+struct LogTfPolicy {
+  static constexpr bool kNeedsShape = false;
+  double TF(uint32_t count, const DocumentShape &) const {
+    return 1 + log10(static_cast<double>(count));
+  }
+  double IDF(uint32_t) const { return 1.0; }
+};
+
+struct TfIdfPolicy {
+  static constexpr bool kNeedsShape = false;
+  const double *idf;
+  double TF(uint32_t count, const DocumentShape &) const {
+    return 1 + log10(static_cast<double>(count));
+  }
+  double IDF(uint32_t id) const { return idf[id]; }
+};
+
+struct AugmentedPolicy {
+  static constexpr bool kNeedsShape = true;
+  const double *idf;
+  double TF(uint32_t count, const DocumentShape &shape) const {
+    return 0.5 + 0.5 * count / shape.maxCount;
+  }
+  double IDF(uint32_t id) const { return idf[id]; }
+};
+
+struct BM25Policy {
+  static constexpr bool kNeedsShape = true;
+  const double *idf;
+  double k1;
+  double b;
+  double averageLength;
+  double TF(uint32_t count, const DocumentShape &shape) const {
+    double norm = averageLength > 0 ? shape.length / averageLength : 1.0;
+    return count * (k1 + 1) / (count + k1 * (1 - b + b * norm));
+  }
+  double IDF(uint32_t id) const { return idf[id]; }
+};
+
+/**
+ * @brief Call fn with the policy of a weighting scheme, so fn is
+ *        instantiated once per scheme and the choice is made once per call
+ * @param options Scheme and BM25 parameters
+ * @param idf IDF of every term, indexed by term ID
+ * @param averageLength Mean number of term tokens per document
+ * @param fn Generic callable taking the policy
+ */
+template <typename Fn>
+void WithWeightingPolicy(const WeightingOptions &options, const double *idf,
+                         double averageLength, Fn &&fn) {
+  switch (options.scheme) {
+    case WeightingScheme::kLogTF:
+      fn(LogTfPolicy{});
+      break;
+    case WeightingScheme::kTfIdf:
+      fn(TfIdfPolicy{idf});
+      break;
+    case WeightingScheme::kAugmented:
+      fn(AugmentedPolicy{idf});
+      break;
+    case WeightingScheme::kBM25:
+      fn(BM25Policy{idf, options.k1, options.b, averageLength});
+      break;
+  }
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "../include/arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Constructor for Arena
+ * @param chunkSize Size of every chunk; larger requests get their own chunk
+ */
+Arena::Arena(size_t chunkSize) : chunkSize_(std::max<size_t>(chunkSize, 1)) {}
+
+/**
+ * @brief Allocate bytes of uninitialized, unaligned memory
+ * @param bytes Number of bytes
+ * @return Pointer to the memory, valid until the arena is destroyed
+ */
+char *Arena::Allocate(size_t bytes) {
+  Reserve(bytes);
+  char *result = cursor_;
+  cursor_ += bytes;
+  remaining_ -= bytes;
+  bytesUsed_ += bytes;
+  return result;
+}
+
+/**
+ * @brief Allocate uninitialized memory aligned for a type. Chunks come from
+ *        operator new[], aligned for any fundamental type, so only the
+ *        cursor needs padding
+ * @param bytes Number of bytes
+ * @param alignment Required alignment, a power of two
+ * @return Pointer to the memory, valid until the arena is destroyed
+ */
+char *Arena::AllocateAligned(size_t bytes, size_t alignment) {
+  size_t padding = (alignment - reinterpret_cast<uintptr_t>(cursor_) %
+                                    alignment) % alignment;
+  if (padding + bytes > remaining_) {
+    Reserve(bytes);
+    padding = 0;
+  }
+  Allocate(padding);
+  return Allocate(bytes);
+}
+
+/**
+ * @brief Make sure the next allocations, up to bytes in total, fit in the
+ *        current chunk, starting a chunk of at least that size otherwise.
+ *        Reserving everything a task needs up front makes it one allocation
+ * @param bytes Number of bytes
+ */
+void Arena::Reserve(size_t bytes) {
+  if (bytes <= remaining_) return;
+  size_t size = std::max(chunkSize_, bytes);
+  chunks_.emplace_back(new char[size]);
+  cursor_ = chunks_.back().get();
+  remaining_ = size;
+}
+
+/**
+ * @brief Copy a string into the arena
+ * @param text Text to copy
+ * @return View of the copy
+ */
+std::string_view Arena::Store(std::string_view text) {
+  if (text.empty()) return std::string_view();
+  char *copy = Allocate(text.size());
+  std::memcpy(copy, text.data(), text.size());
+  return std::string_view(copy, text.size());
+}
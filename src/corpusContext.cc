@@ -0,0 +1,526 @@
+#include "../include/corpusContext.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include "../include/mappedFile.h"
+
+namespace {
+
+/**
+ * @brief Single-pass reader of the JSON object of the lemmatization files,
+ *        whose members map words to lemmas. Both are lower-cased (ASCII).
+ *        Strings without escapes or upper-case letters are views into the
+ *        text; the others are decoded into a buffer reused for every member
+ */
+class LemmaJsonReader {
+ public:
+  LemmaJsonReader(std::string_view text, const std::string &path)
+      : text_(text), path_(path) {}
+
+  /**
+   * @brief Insert every member of the object into a table
+   * @param table Lemma table to fill
+   */
+  void Read(LemmaTable &table) {
+    // Every member has one colon outside its strings.
+    table.Reserve(std::count(text_.begin(), text_.end(), ':'));
+    std::string wordBuffer;
+    std::string lemmaBuffer;
+    SkipSpace();
+    Expect('{', "expected '{'");
+    SkipSpace();
+    if (pos_ < text_.size() && text_[pos_] == '}') {
+      ++pos_;
+    } else {
+      while (true) {
+        std::string_view word = String(wordBuffer);
+        SkipSpace();
+        Expect(':', "expected ':' after a word");
+        SkipSpace();
+        std::string_view lemma = String(lemmaBuffer);
+        table.Insert(word, lemma);
+        SkipSpace();
+        if (pos_ == text_.size()) Fail("unterminated object");
+        char c = text_[pos_++];
+        if (c == '}') break;
+        if (c != ',') Fail("expected ',' or '}'");
+        SkipSpace();
+      }
+    }
+    SkipSpace();
+    if (pos_ != text_.size()) Fail("unexpected text after the object");
+  }
+
+ private:
+  std::string_view text_;
+  const std::string &path_;
+  size_t pos_ = 0;
+
+  [[noreturn]] void Fail(const char *reason) const {
+    size_t line = 1 + std::count(text_.begin(), text_.begin() + pos_, '\n');
+    std::cerr << "Error: Malformed JSON in lemmatization file '" << path_
+              << "' at line " << line << ": " << reason << std::endl;
+    exit(1);
+  }
+
+  void SkipSpace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\n' ||
+            text_[pos_] == '\r' || text_[pos_] == '\t')) {
+      ++pos_;
+    }
+  }
+
+  void Expect(char c, const char *reason) {
+    if (pos_ == text_.size() || text_[pos_] != c) Fail(reason);
+    ++pos_;
+  }
+
+  /**
+   * @brief Read a string, lower-cased
+   * @param buffer Storage for strings that have to be decoded
+   * @return The string, valid until the next call with the same buffer
+   */
+  std::string_view String(std::string &buffer) {
+    Expect('"', "expected a string");
+    size_t start = pos_;
+    while (pos_ < text_.size()) {
+      char c = text_[pos_];
+      if (c == '"' || c == '\\' || (c >= 'A' && c <= 'Z')) break;
+      if (static_cast<unsigned char>(c) < 0x20) {
+        Fail("control character in a string");
+      }
+      ++pos_;
+    }
+    if (pos_ == text_.size()) Fail("unterminated string");
+    if (text_[pos_] == '"') {
+      return text_.substr(start, pos_++ - start);
+    }
+
+    buffer.assign(text_.data() + start, pos_ - start);
+    while (true) {
+      if (pos_ == text_.size()) Fail("unterminated string");
+      char c = text_[pos_++];
+      if (c == '"') return buffer;
+      if (c == '\\') {
+        Escape(buffer);
+      } else if (c >= 'A' && c <= 'Z') {
+        buffer += static_cast<char>(c - 'A' + 'a');
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        Fail("control character in a string");
+      } else {
+        buffer += c;
+      }
+    }
+  }
+
+  /**
+   * @brief Decode the escape sequence after a backslash, appending the
+   *        character it stands for, in UTF-8
+   */
+  void Escape(std::string &buffer) {
+    if (pos_ == text_.size()) Fail("unterminated string");
+    char c = text_[pos_++];
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        buffer += c;
+        return;
+      case 'b':
+        buffer += '\b';
+        return;
+      case 'f':
+        buffer += '\f';
+        return;
+      case 'n':
+        buffer += '\n';
+        return;
+      case 'r':
+        buffer += '\r';
+        return;
+      case 't':
+        buffer += '\t';
+        return;
+      case 'u':
+        break;
+      default:
+        Fail("invalid escape sequence");
+    }
+    uint32_t code = HexQuad();
+    if (code >= 0xDC00 && code < 0xE000) Fail("unpaired surrogate");
+    if (code >= 0xD800 && code < 0xDC00) {
+      if (text_.substr(pos_, 2) != "\\u") Fail("unpaired surrogate");
+      pos_ += 2;
+      uint32_t low = HexQuad();
+      if (low < 0xDC00 || low >= 0xE000) Fail("unpaired surrogate");
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+    if (code < 0x80) {
+      if (code >= 'A' && code <= 'Z') code += 'a' - 'A';
+      buffer += static_cast<char>(code);
+    } else if (code < 0x800) {
+      buffer += static_cast<char>(0xC0 | (code >> 6));
+      buffer += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      buffer += static_cast<char>(0xE0 | (code >> 12));
+      buffer += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      buffer += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      buffer += static_cast<char>(0xF0 | (code >> 18));
+      buffer += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      buffer += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      buffer += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  /**
+   * @brief Read the four hexadecimal digits of a Unicode escape
+   */
+  uint32_t HexQuad() {
+    if (text_.size() - pos_ < 4) Fail("truncated \\u escape");
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = text_[pos_++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        Fail("invalid \\u escape");
+      }
+    }
+    return code;
+  }
+};
+
+/**
+ * @brief Rebuild the stop-word table stored in an index file
+ */
+StopWordTable ReadStopWords(const IndexFile &index) {
+  StopWordTable stopWords;
+  StringListView words = index.Strings(IndexFile::kStopWords);
+  for (size_t i = 0; i < words.size(); ++i) stopWords.Insert(words[i]);
+  return stopWords;
+}
+
+/**
+ * @brief Rebuild the lemma table stored in an index file
+ */
+LemmaTable ReadLemmas(const IndexFile &index) {
+  LemmaTable lemmas;
+  StringListView words = index.Strings(IndexFile::kLemmaWords);
+  StringListView values = index.Strings(IndexFile::kLemmas);
+  for (size_t i = 0; i < words.size(); ++i) lemmas.Insert(words[i], values[i]);
+  lemmas.Freeze();
+  return lemmas;
+}
+
+/**
+ * @brief Select the terms of the vocabulary: those whose document frequency
+ *        is within the bounds and, with a cap, the ones in most documents
+ *        (ties by term)
+ * @param counts (term, document frequency) pairs sorted by term
+ * @param documents Number of documents the frequencies were counted over
+ * @param options Bounds and cap
+ * @return Indices of the selected pairs, in term order
+ */
+std::vector<size_t> SelectTerms(
+    const std::vector<std::pair<std::string_view, int>> &counts,
+    size_t documents, const VocabularyOptions &options) {
+  double maxFrequency =
+      options.maxDocumentFraction * static_cast<double>(documents);
+  std::vector<size_t> kept;
+  kept.reserve(counts.size());
+  for (size_t i = 0; i < counts.size(); ++i) {
+    int frequency = counts[i].second;
+    if (frequency >= options.minDocumentFrequency &&
+        frequency <= maxFrequency) {
+      kept.push_back(i);
+    }
+  }
+  if (options.maxTerms > 0 && kept.size() > options.maxTerms) {
+    std::nth_element(kept.begin(), kept.begin() + options.maxTerms,
+                     kept.end(), [&](size_t a, size_t b) {
+                       if (counts[a].second != counts[b].second) {
+                         return counts[a].second > counts[b].second;
+                       }
+                       return a < b;
+                     });
+    kept.resize(options.maxTerms);
+    std::sort(kept.begin(), kept.end());
+  }
+  return kept;
+}
+
+}  // namespace
+
+/**
+ * @brief Print the terms and non-zero entries the vocabulary options
+ *        eliminated, as lines of the input summary
+ * @param os Output stream
+ */
+void VocabularyReport::Print(std::ostream &os) const {
+  auto percent = [](uint64_t kept, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * static_cast<double>(total - kept) /
+                                  static_cast<double>(total);
+  };
+  std::ios_base::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision(1);
+  if (buckets > 0) {
+    os << "•Vocabulary: " << keptTerms << " of " << buckets
+       << " hash buckets in use" << std::endl;
+  } else {
+    os << "•Vocabulary: kept " << keptTerms << " of " << terms
+       << " terms (" << percent(keptTerms, terms) << "% eliminated)"
+       << std::endl;
+  }
+  os << "•Non-zero entries: kept " << keptEntries << " of " << entries
+     << " (" << percent(keptEntries, entries) << "% eliminated)"
+     << std::endl;
+  os.flags(flags);
+}
+
+/**
+ * @brief Constructor for CorpusContext
+ * @param stopWords Table of stop words
+ * @param lemmas Frozen table of words to their lemmas
+ * @param stem Whether the pipeline stems terms after the stop-word filter
+ * @param weighting Weighting scheme of the document vectors
+ * @param vocabulary Feature selection or hashing of the vocabulary
+ */
+CorpusContext::CorpusContext(StopWordTable stopWords, LemmaTable lemmas,
+                             bool stem, WeightingOptions weighting,
+                             VocabularyOptions vocabulary)
+    : stopWords_(std::move(stopWords)),
+      lemmas_(std::move(lemmas)),
+      stem_(stem),
+      weighting_(weighting),
+      vocabularyOptions_(vocabulary) {
+  normalizer_ = Normalizer::Default(lemmas_, stopWords_, stem);
+}
+
+/**
+ * @brief Constructor for a context stored in an index file. The stop-word
+ *        and lemma tables are rebuilt from the stored strings and the term
+ *        index is hashed again, over views of the stored terms. The
+ *        document frequencies and IDF stay in the mapping until the corpus
+ *        changes; term IDs, frequencies, IDF and weighting scheme are taken
+ *        as stored
+ * @param index Index file, kept mapped as long as the context
+ */
+CorpusContext::CorpusContext(std::shared_ptr<const IndexFile> index)
+    : CorpusContext(ReadStopWords(*index), ReadLemmas(*index),
+                    index->stemmed(), index->weighting()) {
+  index_ = std::move(index);
+  StringListView terms = index_->Strings(IndexFile::kTerms);
+  vocabulary_.Reserve(terms.size());
+  for (size_t id = 0; id < terms.size(); ++id) {
+    vocabulary_.InsertView(terms[id]);
+  }
+  if (vocabulary_.size() != terms.size()) {
+    std::cerr << "Error: Invalid index file: repeated terms" << std::endl;
+    exit(1);
+  }
+  ArrayView<int32_t> frequency =
+      index_->Array<int32_t>(IndexFile::kDocumentFrequency);
+  documentFrequency_.Map(frequency.data(), frequency.size());
+  ArrayView<double> idf = index_->Array<double>(IndexFile::kIDF);
+  IDF_.Map(idf.data(), idf.size());
+  documentCount_ = index_->documentCount();
+  frozen_ = index_->frozenVocabulary();
+  for (uint32_t count : index_->Array<uint32_t>(IndexFile::kTermCounts)) {
+    totalLength_ += count;
+  }
+  version_ = index_->corpusVersion();
+  IDFVersion_ = version_;
+}
+
+/**
+ * @brief Replace the vocabulary with the given terms, or those the
+ *        vocabulary options select. Inserting them in sorted order makes
+ *        term IDs follow alphabetical order. A pruned vocabulary is frozen.
+ *        A hashed vocabulary takes no counts: it starts with every document
+ *        frequency at zero, to be counted with AddDocumentTerms
+ * @param counts (term, document frequency) pairs sorted by term
+ * @param documents Number of documents the frequencies were counted over
+ * @param termTokens Number of term tokens in those documents
+ */
+void CorpusContext::BuildVocabulary(
+    const std::vector<std::pair<std::string_view, int>> &counts,
+    size_t documents, uint64_t termTokens) {
+  std::vector<int> &frequency = documentFrequency_.owned();
+  frequency.clear();
+  if (vocabularyOptions_.hashBits > 0) {
+    vocabulary_ = TermDictionary::Hashed(vocabularyOptions_.hashBits);
+    frequency.assign(vocabulary_.size(), 0);
+  } else {
+    vocabulary_ = TermDictionary();
+    std::vector<size_t> kept =
+        SelectTerms(counts, documents, vocabularyOptions_);
+    frequency.reserve(kept.size());
+    for (size_t i : kept) {
+      vocabulary_.Insert(counts[i].first);
+      frequency.push_back(counts[i].second);
+    }
+    frozen_ = vocabularyOptions_.Prunes();
+  }
+  IDF_.owned().assign(frequency.size(), 0.0);
+  documentCount_ = documents;
+  totalLength_ = termTokens;
+  ++version_;
+}
+
+/**
+ * @brief Count a new document. Terms not yet in the vocabulary get the next
+ *        free IDs, so existing term IDs never change, unless the vocabulary
+ *        is frozen or hashed
+ * @param terms Distinct normalized terms of the document
+ * @param termTokens Number of term tokens in the document
+ */
+void CorpusContext::AddDocumentTerms(
+    const std::vector<std::string_view> &terms, size_t termTokens) {
+  std::vector<int> &frequency = documentFrequency_.owned();
+  if (frozen_ || vocabulary_.hashed()) {
+    std::vector<uint32_t> ids;
+    DistinctTermIds(terms, ids);
+    for (uint32_t id : ids) ++frequency[id];
+  } else {
+    for (std::string_view term : terms) {
+      uint32_t id = vocabulary_.Insert(term);
+      if (id >= frequency.size()) {
+        frequency.resize(id + 1, 0);
+        IDF_.owned().resize(id + 1, 0.0);
+      }
+      ++frequency[id];
+    }
+  }
+  ++documentCount_;
+  totalLength_ += termTokens;
+  ++version_;
+}
+
+/**
+ * @brief Stop counting a document. Terms left in no document stay in the
+ *        vocabulary with a document frequency of zero
+ * @param terms Distinct normalized terms of the document
+ * @param termTokens Number of term tokens in the document
+ */
+void CorpusContext::RemoveDocumentTerms(
+    const std::vector<std::string_view> &terms, size_t termTokens) {
+  std::vector<uint32_t> ids;
+  DistinctTermIds(terms, ids);
+  RemoveDocumentTerms(ArrayView<uint32_t>(ids.data(), ids.size()),
+                      termTokens);
+}
+
+/**
+ * @brief Stop counting a document given by the term IDs of its vector,
+ *        such as a document loaded from an index, which keeps no terms
+ * @param ids Distinct term IDs of the document
+ * @param termTokens Number of term tokens in the document
+ */
+void CorpusContext::RemoveDocumentTerms(ArrayView<uint32_t> ids,
+                                        size_t termTokens) {
+  std::vector<int> &frequency = documentFrequency_.owned();
+  for (uint32_t id : ids) {
+    if (frequency[id] > 0) --frequency[id];
+  }
+  --documentCount_;
+  totalLength_ -= std::min<uint64_t>(totalLength_, termTokens);
+  ++version_;
+}
+
+/**
+ * @brief Calculate Inverse Document Frequency (IDF) for all terms, in the
+ *        form the weighting scheme uses, and mark it current for this
+ *        version of the corpus
+ */
+void CorpusContext::CalculateIDF() {
+  std::vector<double> &idf = IDF_.owned();
+  idf.resize(documentFrequency_.size());
+  for (size_t id = 0; id < documentFrequency_.size(); ++id) {
+    idf[id] = InverseDocumentFrequency(weighting_.scheme, documentCount_,
+                                       documentFrequency_[id]);
+  }
+  IDFVersion_ = version_;
+}
+
+/**
+ * @brief IDF of a term outside the vocabulary, as if it were in one
+ *        document, so query terms the corpus lacks still weigh the most
+ * @return IDF of a term with a document frequency of one (1 for schemes
+ *         without IDF)
+ */
+double CorpusContext::UnseenIDF() const {
+  if (!weighting_.UsesCorpus()) return 1.0;
+  return InverseDocumentFrequency(weighting_.scheme,
+                                  std::max<size_t>(documentCount_, 1), 1);
+}
+
+/**
+ * @brief Term IDs of the terms of a document that are in the vocabulary,
+ *        each once even if several terms share it (hashing)
+ * @param terms Distinct normalized terms
+ * @param ids Set to the sorted distinct term IDs
+ */
+void CorpusContext::DistinctTermIds(const std::vector<std::string_view> &terms,
+                                    std::vector<uint32_t> &ids) const {
+  ids.clear();
+  for (std::string_view term : terms) {
+    uint32_t id = vocabulary_.Id(term);
+    if (id != TermDictionary::kNotFound) ids.push_back(id);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+/**
+ * @brief Load stop words from a file of whitespace-separated words
+ * @param stopWordsFile Path to the file
+ * @return Table of stop words
+ */
+StopWordTable LoadStopWords(const std::string &stopWordsFile) {
+  StopWordTable stopWords;
+  std::ifstream stopWordsStream{stopWordsFile};
+  if (!stopWordsStream.is_open()) {
+    std::cerr << "Error opening stop words file: " << stopWordsFile
+              << std::endl;
+    exit(1);
+  }
+  std::string word;
+  while (stopWordsStream >> word) {
+    stopWords.Insert(word);
+  }
+  return stopWords;
+}
+
+/**
+ * @brief Load lemmatization rules into a hash table, frozen once every rule
+ *        is read. A JSON file is parsed in one pass over its mapping; a file
+ *        in the binary lemma format (see LemmaTable::SaveBinary) is used in
+ *        place, without parsing
+ * @param lemmatizationFile Path to the JSON or binary file
+ * @return Table of words to their lemmas
+ */
+LemmaTable LoadLemmatizationRules(const std::string &lemmatizationFile) {
+  auto file = std::make_shared<const MappedFile>(lemmatizationFile);
+  if (!file->is_open()) {
+    std::cerr << "Error: Cannot open lemmatization file '" << lemmatizationFile
+              << "'." << std::endl;
+    exit(1);
+  }
+  if (LemmaTable::IsBinary(*file)) {
+    return LemmaTable::MapBinary(std::move(file), lemmatizationFile);
+  }
+  LemmaTable lemmaMap;
+  LemmaJsonReader(file->view(), lemmatizationFile).Read(lemmaMap);
+  lemmaMap.Freeze();
+  return lemmaMap;
+}
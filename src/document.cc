@@ -1,232 +1,429 @@
 #include "../include/document.h"
 
+#include <cctype>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
 /**
- * @brief Constructor for Document class
- * @param inputDocument Path to the input document file
+ * @brief Chunk size of a document workspace: small documents fit in one
+ *        chunk, larger ones reserve exactly what each pass needs
  */
-Document::Document(const std::string &inputDocument)
-    : documentName_(inputDocument) {
-  std::ifstream file{inputDocument};
-  if (!file.is_open()) {
-    std::cerr << "Error opening document: " << inputDocument << std::endl;
-    exit(1);
-  }
-  std::string line;
-  while (std::getline(file, line)) {
-    if (line.empty()) continue;
-    std::vector<std::string> row;
-    std::string value;
-    std::istringstream ss(line);
-    while (ss >> value) {
-      row.push_back(value);
-    }
-    originalText_.push_back(row);
-  }
-  file.close();
+constexpr size_t kWorkspaceChunk = 4096;
 
-  simplifiedText_ = originalText_;
-}
+constexpr uint32_t kEmptySlot = UINT32_MAX;
 
 /**
- * @brief Remove stop words from the document
- * @param stopWords Set of stop words to remove
+ * @brief First occurrence of a term in the normalized text
  */
-void Document::RemoveStopWords(const std::set<std::string> &stopWords) {
-  std::vector<std::vector<std::string>> filtered;
+struct Position {
+  int row;
+  int column;
+};
 
-  for (const auto &line : simplifiedText_) {
-    std::vector<std::string> processedLine;
-    for (const auto &word : line) {
-      if (stopWords.find(word) == stopWords.end()) {
-        processedLine.push_back(word);
-      } else {
-        processedLine.push_back("");
+/**
+ * @brief Call a function with every non-empty line of a text, split into
+ *        whitespace-separated tokens the way getline and operator>> would.
+ *        Lines made only of whitespace count, with no tokens
+ * @param text Text to split
+ * @param onToken Called with every token, as a view into the text
+ * @param onLineEnd Called at the end of every non-empty line
+ */
+template <typename TokenFunction, typename LineFunction>
+void SplitLines(std::string_view text, TokenFunction onToken,
+                LineFunction onLineEnd) {
+  const char *cursor = text.data();
+  const char *end = cursor + text.size();
+  while (cursor < end) {
+    const char *lineEnd = static_cast<const char *>(
+        std::memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+    if (lineEnd == nullptr) lineEnd = end;
+    if (lineEnd != cursor) {
+      const char *p = cursor;
+      while (p < lineEnd) {
+        while (p < lineEnd && std::isspace(static_cast<unsigned char>(*p))) {
+          ++p;
+        }
+        const char *tokenStart = p;
+        while (p < lineEnd && !std::isspace(static_cast<unsigned char>(*p))) {
+          ++p;
+        }
+        if (p != tokenStart) {
+          onToken(std::string_view(tokenStart,
+                                   static_cast<size_t>(p - tokenStart)));
+        }
       }
+      onLineEnd();
     }
-    filtered.push_back(processedLine);
+    cursor = lineEnd + 1;
   }
-  simplifiedText_ = filtered;
 }
 
+}  // namespace
+
 /**
- * @brief Clean tokens in the document by removing non-alphanumeric characters
- *        and converting to lowercase
+ * @brief Constructor for Document class. The file is memory-mapped and only
+ *        read when the document is normalized, so loading allocates nothing
+ *        per token. It is unmapped as soon as it is normalized
+ * @param inputDocument Path to the input document file
+ * @param context Corpus context shared by all documents
  */
-void Document::CleanTokens() {
-  std::vector<std::vector<std::string>> cleanedText;
-  cleanedText.reserve(simplifiedText_.size());
-  for (const auto &line : simplifiedText_) {
-    std::vector<std::string> cleanedLine;
-    cleanedLine.reserve(line.size());
-    for (const auto &word : line) {
-      std::string cleaned = CleanToken(word);
-      if (!cleaned.empty()) cleanedLine.push_back(cleaned);
-    }
-    cleanedText.push_back(std::move(cleanedLine));
+Document::Document(const std::string &inputDocument,
+                   std::shared_ptr<const CorpusContext> context)
+    : documentName_(inputDocument), context_(std::move(context)) {
+  auto file = std::make_shared<MappedFile>(inputDocument);
+  if (!file->is_open()) {
+    std::cerr << "Error opening document: " << inputDocument << std::endl;
+    exit(1);
   }
-  simplifiedText_ = std::move(cleanedText);
+  file_ = file;
+  textSize_ = file_->size();
+  text_ = std::string_view(file_->data(), file_->size());
+  // Only the distinct normalized terms are stored, never more than the raw
+  // text, so one chunk usually holds the whole document.
+  arena_ = std::make_shared<Arena>(
+      std::min<size_t>(file_->size() + 1, 64 * 1024));
 }
 
 /**
- * @brief Clean a single token by removing non-alphanumeric characters
- *        and converting to lowercase
- * @param token The input token to clean
- * @return The cleaned token
+ * @brief Constructor for a document given as text, such as a query. The
+ *        text is copied into the document workspace
+ * @param documentName Name of the document
+ * @param text Content of the document
+ * @param context Corpus context shared by all documents
  */
-std::string Document::CleanToken(const std::string &token) const {
-  std::string result;
-  result.reserve(token.size());
-  for (unsigned char c : token) {
-    if (std::isalnum(c)) {
-      result.push_back(static_cast<char>(std::tolower(c)));
-    }
-  }
-  return result;
+Document::Document(const std::string &documentName, std::string_view text,
+                   std::shared_ptr<const CorpusContext> context)
+    : documentName_(documentName), context_(std::move(context)) {
+  arena_ = std::make_shared<Arena>(
+      std::min<size_t>(text.size() + 1, 64 * 1024));
+  workspace_ = std::make_shared<Arena>(
+      std::max<size_t>(text.size(), kWorkspaceChunk));
+  text_ = workspace_->Store(text);
+  textSize_ = text.size();
+}
+
+/**
+ * @brief Constructor for a document stored in an index file. Its vectors
+ *        view the index instead of being calculated or copied, and are only
+ *        copied when they are reweighted; the original text and terms are
+ *        not kept
+ * @param index Index file, kept mapped as long as the document views it
+ * @param document Index of the document in the file
+ * @param context Corpus context loaded from the same index
+ */
+Document::Document(std::shared_ptr<const IndexFile> index, size_t document,
+                   std::shared_ptr<const CorpusContext> context)
+    : documentName_(index->Strings(IndexFile::kDocumentNames)[document]),
+      context_(std::move(context)),
+      index_(std::move(index)) {
+  IndexFile::Vector vector = index_->DocumentVector(document);
+  size_t size = vector.ids.size();
+  termCounts_.Map(vector.ids.data(), vector.counts.data(), size);
+  TF_.Map(vector.ids.data(), vector.TF.data(), size);
+  TFNormalized_.Map(vector.ids.data(), vector.TFNormalized.data(), size);
+  termIndices_.Map(vector.ids.data(), vector.positions.data(), size);
+  for (uint32_t count : vector.counts) termTokens_ += count;
+  vectorLength_ = vector.length;
 }
 
 /**
- * @brief Perform lemmatization on the document using the provided lemma map
- * @param lemmaMap Map of words to their lemmas
- */
-void Document::Lemmatization(
-    const std::map<std::string, std::string> &lemmaMap) {
-  std::vector<std::vector<std::string>> lemmatized;
-  for (const auto &line : simplifiedText_) {
-    std::vector<std::string> lemmatizedLine;
-    for (const auto &word : line) {
-      auto it = lemmaMap.find(word);
-      if (it != lemmaMap.end()) {
-        lemmatizedLine.push_back(it->second);
-      } else {
-        lemmatizedLine.push_back(word);
+ * @brief Normalize the document: every token of the raw text runs once
+ *        through the pipeline and goes straight to a document-local term ID.
+ *        Each distinct term is stored once in the document arena. The words
+ *        and lines are counted first, so the tokens, the line offsets and
+ *        the table of local IDs come from a single workspace reservation.
+ *        The raw text is not needed afterwards, so a mapped file is unmapped
+ */
+void Document::Normalize() {
+  const Normalizer &normalizer = context_->normalizer();
+  terms_.clear();
+  termTokens_ = 0;
+
+  size_t words = 0;
+  size_t lines = 0;
+  SplitLines(text_, [&](std::string_view) { ++words; }, [&] { ++lines; });
+  size_t capacity = 2;
+  while (capacity < 2 * words) capacity *= 2;
+  size_t mask = capacity - 1;
+
+  Arena &workspace = Workspace();
+  workspace.Reserve((words + lines + 1 + capacity) * sizeof(uint32_t) +
+                    3 * alignof(uint32_t));
+  uint32_t *tokens = workspace.AllocateArray<uint32_t>(words);
+  uint32_t *rowOffsets = workspace.AllocateArray<uint32_t>(lines + 1);
+  uint32_t *slots = workspace.AllocateArray<uint32_t>(capacity);
+  std::fill(slots, slots + capacity, kEmptySlot);
+
+  size_t count = 0;
+  size_t rows = 0;
+  rowOffsets[rows++] = 0;
+  std::string buffer;
+  auto onToken = [&](std::string_view word) {
+    Token token{word};
+    switch (normalizer.Normalize(token, buffer)) {
+      case NormalizationStage::Result::kDrop:
+        break;
+      case NormalizationStage::Result::kBlank:
+        tokens[count++] = kBlankToken;
+        break;
+      case NormalizationStage::Result::kKeep: {
+        size_t slot = HashString(token.text) & mask;
+        while (slots[slot] != kEmptySlot && terms_[slots[slot]] != token.text) {
+          slot = (slot + 1) & mask;
+        }
+        if (slots[slot] == kEmptySlot) {
+          slots[slot] = static_cast<uint32_t>(terms_.size());
+          terms_.push_back(arena_->Store(token.text));
+        }
+        tokens[count++] = slots[slot];
+        ++termTokens_;
+        break;
       }
     }
-    lemmatized.push_back(lemmatizedLine);
+  };
+  SplitLines(text_, onToken,
+             [&] { rowOffsets[rows++] = static_cast<uint32_t>(count); });
+  tokens_ = ArenaArray<uint32_t>(tokens, count);
+  rowOffsets_ = ArenaArray<uint32_t>(rowOffsets, rows);
+  tokenCount_ = count;
+  if (file_) {
+    text_ = std::string_view();
+    file_.reset();
   }
-  simplifiedText_ = lemmatized;
 }
 
 /**
- * @brief Getter for original text
- * @return Reference to the original text vector
+ * @brief Release the raw text, the tokens and the scratch tables of the
+ *        weighting passes, all at once, keeping only the terms and the
+ *        sparse vectors. Call it after the weights are calculated
  */
-const std::vector<std::vector<std::string>> &Document::originalText() const {
-  return originalText_;
+void Document::ReleaseWorkingMemory() {
+  tokens_ = ArenaArray<uint32_t>();
+  rowOffsets_ = ArenaArray<uint32_t>();
+  text_ = std::string_view();
+  workspace_.reset();
+  file_.reset();
 }
 
 /**
- * @brief Getter for simplified text
- * @return Reference to the simplified text vector
+ * @brief Workspace of the document, created on first use
+ * @return Arena for the working memory of the document
  */
-const std::vector<std::vector<std::string>> &Document::simplifiedText() const {
-  return simplifiedText_;
+Arena &Document::Workspace() {
+  if (!workspace_) workspace_ = std::make_shared<Arena>(kWorkspaceChunk);
+  return *workspace_;
 }
 
 /**
- * @brief Getter for Term Frequency Normalized (TFNormalized) map
- * @return Map of terms to their normalized TF values
+ * @brief Getter for Term Frequency Normalized (TFNormalized) vector
+ * @return Sparse vector of term IDs to their normalized TF values
  */
-const std::map<std::string, double> &Document::TFNormalized() const {
+const SparseVector<double> &Document::TFNormalized() const {
   return TFNormalized_;
 }
 
 /**
- * @brief Setter for all words in corpus
- * @param allWordsInCorpus Set of all unique words in the corpus
+ * @brief Map the document-local terms that are in the corpus vocabulary to
+ *        their corpus term IDs
+ * @param arena Arena the result is allocated in
+ * @return Resolved terms sorted by corpus ID
  */
-void Document::setAllWordsInCorpus(
-    const std::set<std::string> &allWordsInCorpus) {
-  allWordsInCorpus_ = allWordsInCorpus;
+ArenaArray<Document::ResolvedTerm> Document::ResolveTerms(
+    Arena &arena) const {
+  const TermDictionary &dictionary = context_->vocabulary();
+  ResolvedTerm *resolved = arena.AllocateArray<ResolvedTerm>(terms_.size());
+  size_t count = 0;
+  for (uint32_t local = 0; local < terms_.size(); ++local) {
+    uint32_t id = dictionary.Id(terms_[local]);
+    if (id != TermDictionary::kNotFound) resolved[count++] = {id, local};
+  }
+  std::sort(resolved, resolved + count,
+            [](const ResolvedTerm &a, const ResolvedTerm &b) {
+              return a.id < b.id;
+            });
+  return ArenaArray<ResolvedTerm>(resolved, count);
 }
 
 /**
- * @brief Setter for lemmatization map
- * @param lemmatizationMap Map of words to their lemmas
+ * @brief Count the occurrences of every document-local term
+ * @param arena Arena the result is allocated in
+ * @return Number of tokens of each local term ID
  */
-void Document::setLemmatizationMap(
-    const std::map<std::string, std::string> &lemmatizationMap) {
-  lemmatizationMap_ = lemmatizationMap;
+ArenaArray<uint32_t> Document::CountTerms(Arena &arena) const {
+  uint32_t *counts = arena.AllocateArray<uint32_t>(terms_.size());
+  std::fill(counts, counts + terms_.size(), 0);
+  for (uint32_t token : tokens_) {
+    if (token != kBlankToken) ++counts[token];
+  }
+  return ArenaArray<uint32_t>(counts, terms_.size());
 }
 
 /**
- * @brief Convert a string to lowercase
- * @param str Input string
- * @return Lowercase version of the input string
+ * @brief Count the occurrences of the terms present in the document. Only
+ *        terms that occur are stored, sorted by term ID. The scratch tables
+ *        come from one workspace reservation
  */
-std::string Document::ToLowerCase(const std::string &str) const {
-  std::string result = str;
-  for (size_t i = 0; i < result.length(); i++) {
-    result[i] = std::tolower(static_cast<unsigned char>(result[i]));
+void Document::CalculateTermCounts() {
+  Arena &workspace = Workspace();
+  workspace.Reserve(terms_.size() * (sizeof(uint32_t) + sizeof(ResolvedTerm)) +
+                    alignof(uint32_t) + alignof(ResolvedTerm));
+  ArenaArray<uint32_t> counts = CountTerms(workspace);
+
+  termCounts_.Clear();
+  termCounts_.Reserve(terms_.size());
+  for (const ResolvedTerm &term : ResolveTerms(workspace)) {
+    // Terms hashed to the same ID add up their counts.
+    if (!termCounts_.empty() && termCounts_.ids().back() == term.id) {
+      termCounts_.values().back() += counts[term.local];
+    } else {
+      termCounts_.PushBack(term.id, counts[term.local]);
+    }
   }
-  return result;
 }
 
 /**
- * @brief Calculate Term Frequency (TF) for all terms in the document
+ * @brief Calculate the weights of the document under the weighting scheme
+ *        of the corpus, from its term counts, in one fused pass: the TF
+ *        component, the weight and the vector length are computed together
+ *        and the weights are then normalized in place. Schemes that use the
+ *        IDF need it current
  */
-void Document::CalculateTF() {
-  TF_.clear();
-  for (const std::string &word : allWordsInCorpus_) {
-    TF_[word] = 0.0;
-  }
-  for (const std::vector<std::string> &line : simplifiedText_) {
-    for (const std::string &word : line) {
-      if (!word.empty()) {
-        TF_[word] += 1.0;
-      }
-    }
-  }
-  for (auto &termFreq : TF_) {
-    if (termFreq.second > 0) {
-      termFreq.second = 1 + log10(termFreq.second);
-    } else {
-      termFreq.second = 0.0;
-    }
-  }
+void Document::CalculateWeights() {
+  const CorpusContext &context = *context_;
+  WithWeightingPolicy(context.weighting(), context.IDF().data(),
+                      context.averageLength(),
+                      [this](const auto &policy) { Weigh(policy); });
 }
 
 /**
- * @brief Calculate the index of the first occurrence of each term in the simplified text
+ * @brief Fused weighting pass of CalculateWeights for one scheme
+ * @param policy TF and IDF components of the scheme
  */
-void Document::CalculateTermIndices() {
-  termIndices_.clear();
-  
-  for (const std::string &word : allWordsInCorpus_) {
-    termIndices_[word] = std::make_pair(-1, -1);
-  }
-  
-  for (size_t row = 0; row < simplifiedText_.size(); ++row) {
-    for (size_t col = 0; col < simplifiedText_[row].size(); ++col) {
-      const std::string &term = simplifiedText_[row][col];
-      if (term.empty()) {
-        continue;
-      }
-      if (allWordsInCorpus_.find(term) != allWordsInCorpus_.end() && 
-          termIndices_[term].first == -1) {
-        termIndices_[term] = std::make_pair(static_cast<int>(row), static_cast<int>(col));
-      }
+template <typename Policy>
+void Document::Weigh(const Policy &policy) {
+  const SparseVector<uint32_t> &termCounts = termCounts_;
+  const MappableArray<uint32_t> &ids = termCounts.ids();
+  const MappableArray<uint32_t> &counts = termCounts.values();
+  DocumentShape shape;
+  if constexpr (Policy::kNeedsShape) {
+    shape.length = static_cast<double>(termTokens_);
+    for (uint32_t count : counts) {
+      shape.maxCount = std::max(shape.maxCount, count);
     }
   }
+
+  TF_.AssignIds(ids);
+  TFNormalized_.AssignIds(ids);
+  double *tf = TF_.values().data();
+  double *weights = TFNormalized_.values().data();
+  double sumSquares = 0.0;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    tf[i] = policy.TF(counts[i], shape);
+    weights[i] = tf[i] * policy.IDF(ids[i]);
+    sumSquares += weights[i] * weights[i];
+  }
+  vectorLength_ = std::sqrt(sumSquares);
+  // A document whose terms all have a zero IDF keeps zero weights.
+  if (vectorLength_ > 0) {
+    for (size_t i = 0; i < ids.size(); ++i) weights[i] /= vectorLength_;
+  }
 }
 
 /**
- * @brief Calculate the length of the TF vector
+ * @brief Normalized weight vector of a document that is not part of the
+ *        corpus, over the corpus vocabulary. Terms the corpus does not know
+ *        are left out of the vector but still count in its length, weighted
+ *        as if they were in one document, so its similarity to a corpus
+ *        document is the one it would have once added
+ * @return Sparse vector of corpus term IDs to their normalized weights
  */
-void Document::CalculateVectorLength() {
-  double sumSquares = 0.0;
-  for (const auto &termFreq : TF_) {
-    sumSquares += termFreq.second * termFreq.second;
+SparseVector<double> Document::QueryVector() const {
+  Arena scratch(terms_.size() * (2 * sizeof(uint32_t) + sizeof(ResolvedTerm)) +
+                2 * alignof(uint32_t) + alignof(ResolvedTerm));
+  ArenaArray<uint32_t> counts = CountTerms(scratch);
+  ArenaArray<ResolvedTerm> resolved = ResolveTerms(scratch);
+  uint32_t *ids = scratch.AllocateArray<uint32_t>(terms_.size());
+  std::fill(ids, ids + terms_.size(), TermDictionary::kNotFound);
+  for (const ResolvedTerm &term : resolved) ids[term.local] = term.id;
+  // Terms hashed to the same ID count as one: the first of them takes the
+  // counts of the others, which drop to zero.
+  for (size_t i = 1, head = 0; i < resolved.size(); ++i) {
+    if (resolved[i].id != resolved[head].id) {
+      head = i;
+      continue;
+    }
+    counts[resolved[head].local] += counts[resolved[i].local];
+    counts[resolved[i].local] = 0;
   }
-  vectorLength_ = std::sqrt(sumSquares);
+
+  const CorpusContext &context = *context_;
+  double unseenIDF = context.UnseenIDF();
+  SparseVector<double> vector;
+  WithWeightingPolicy(
+      context.weighting(), context.IDF().data(), context.averageLength(),
+      [&](const auto &policy) {
+        using Policy = std::decay_t<decltype(policy)>;
+        DocumentShape shape;
+        if constexpr (Policy::kNeedsShape) {
+          shape.length = static_cast<double>(termTokens_);
+          for (uint32_t count : counts) {
+            shape.maxCount = std::max(shape.maxCount, count);
+          }
+        }
+        double sumSquares = 0.0;
+        for (uint32_t local = 0; local < terms_.size(); ++local) {
+          if (counts[local] == 0) continue;
+          double idf = ids[local] == TermDictionary::kNotFound
+                           ? unseenIDF
+                           : policy.IDF(ids[local]);
+          double weight = policy.TF(counts[local], shape) * idf;
+          sumSquares += weight * weight;
+        }
+        double length = std::sqrt(sumSquares);
+        if (length == 0) return;
+        for (const ResolvedTerm &term : resolved) {
+          if (counts[term.local] == 0) continue;
+          vector.PushBack(term.id, policy.TF(counts[term.local], shape) *
+                                       policy.IDF(term.id) / length);
+        }
+      });
+  return vector;
 }
 
 /**
- * @brief Calculate Normalized Term Frequency (TFNormalized) for all terms
+ * @brief Calculate the index of the first occurrence of each term in the
+ *        normalized text. Columns count blanked stop words but not tokens
+ *        dropped by cleaning
  */
-void Document::CalculateTFNormalized() {
-  TFNormalized_.clear();
-  for (const auto &termFreq : TF_) {
-    TFNormalized_[termFreq.first] = termFreq.second / vectorLength_;
+void Document::CalculateTermIndices() {
+  Arena &workspace = Workspace();
+  workspace.Reserve(terms_.size() * (sizeof(Position) + sizeof(ResolvedTerm)) +
+                    alignof(Position) + alignof(ResolvedTerm));
+  Position *first = workspace.AllocateArray<Position>(terms_.size());
+  std::fill(first, first + terms_.size(), Position{-1, -1});
+  for (size_t row = 0; row + 1 < rowOffsets_.size(); ++row) {
+    for (uint32_t t = rowOffsets_[row]; t < rowOffsets_[row + 1]; ++t) {
+      uint32_t token = tokens_[t];
+      if (token != kBlankToken && first[token].row == -1) {
+        first[token] = {static_cast<int>(row),
+                        static_cast<int>(t - rowOffsets_[row])};
+      }
+    }
+  }
+
+  termIndices_.Clear();
+  termIndices_.Reserve(terms_.size());
+  for (const ResolvedTerm &term : ResolveTerms(workspace)) {
+    std::pair<int, int> index(first[term.local].row, first[term.local].column);
+    // Terms hashed to the same ID keep the earliest occurrence.
+    if (!termIndices_.empty() && termIndices_.ids().back() == term.id) {
+      termIndices_.values().back() =
+          std::min(termIndices_.values().back(), index);
+    } else {
+      termIndices_.PushBack(term.id, index);
+    }
   }
 }
 
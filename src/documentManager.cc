@@ -1,326 +1,1148 @@
 #include "../include/documentManager.h"
 
+#include <chrono>
+#include <cmath>
+#include <optional>
+
+#include "../include/resultWriter.h"
+
+namespace {
+
+/**
+ * @brief Insert a candidate into a top-K list sorted by decreasing
+ *        similarity (ties by document index), keeping at most k entries
+ * @param list Neighbour list
+ * @param candidate Candidate neighbour
+ * @param k Maximum number of neighbours
+ */
+void OfferNeighbour(std::vector<Neighbour>& list, const Neighbour& candidate,
+                    size_t k) {
+  auto better = [](const Neighbour& a, const Neighbour& b) {
+    if (a.similarity != b.similarity) return a.similarity > b.similarity;
+    return a.document < b.document;
+  };
+  auto position = std::upper_bound(list.begin(), list.end(), candidate, better);
+  if (static_cast<size_t>(position - list.begin()) >= k) return;
+  list.insert(position, candidate);
+  if (list.size() > k) list.pop_back();
+}
+
+}  // namespace
+
 /**
  * @brief Constructor for DocumentManager
  * @param documents Vector of document file names
  * @param stopWordsFile File name containing stop words
  * @param lemmatizationFile File name containing lemmatization rules
+ * @param threads Number of worker threads (0 means one per hardware thread)
+ * @param stem Whether to stem terms after the stop-word filter
+ * @param deduplication Whether to detect near-duplicate documents, and to
+ *        keep only the representative of each cluster
+ * @param weighting Weighting scheme of the document vectors
+ * @param vocabulary Feature selection or hashing of the vocabulary
  */
 DocumentManager::DocumentManager(const std::vector<std::string>& documents,
                                  const std::string& stopWordsFile,
-                                 const std::string& lemmatizationFile) {
-  std::ifstream stopWordsStream{stopWordsFile};
-  if (!stopWordsStream.is_open()) {
-    std::cerr << "Error opening stop words file: " << stopWordsFile
-              << std::endl;
-    exit(1);
+                                 const std::string& lemmatizationFile,
+                                 size_t threads, bool stem,
+                                 const DeduplicationOptions& deduplication,
+                                 const WeightingOptions& weighting,
+                                 const VocabularyOptions& vocabulary)
+    : pool_(threads) {
+  StopWordTable stopWords;
+  {
+    auto scope = stats_.Measure("load stop words");
+    stopWords = LoadStopWords(stopWordsFile);
   }
-  std::string word;
-  while (stopWordsStream >> word) {
-    stopWords_.insert(word);
-  }
-  stopWordsStream.close();
-  lemmatizationMap_ = LoadLemmatizationRules(lemmatizationFile);
-
-  for (const auto& document : documents) {
-    Document doc{document};
-    doc.CleanTokens();
-    doc.Lemmatization(lemmatizationMap_);
-    doc.RemoveStopWords(stopWords_);
-    documents_.push_back(doc);
-    for (const auto& line : doc.simplifiedText()) {
-      for (const auto& word : line) {
-        if (!word.empty()) {
-          allWordsInCorpus_.insert(word);
-        }
-      }
+  LemmaTable lemmas;
+  {
+    auto scope = stats_.Measure("load lemmatization rules");
+    lemmas = LoadLemmatizationRules(lemmatizationFile);
+  }
+  {
+    auto scope = stats_.Measure("build corpus context");
+    context_ = std::make_shared<CorpusContext>(
+        std::move(stopWords), std::move(lemmas), stem, weighting,
+        vocabulary);
+  }
+
+  LoadDocuments(documents);
+  if (deduplication.enabled) {
+    {
+      auto scope = stats_.Measure("detect near-duplicates");
+      duplicates_ = FindNearDuplicates(documents_, deduplication, pool_);
     }
+    stats_.SetCounter("nearDuplicates", duplicates_.Duplicates());
+    if (deduplication.collapse) CollapseDuplicates();
   }
+  CountDocumentsOccurrences();
+  UpdateCounters();
+}
 
-  for (Document& doc : documents_) {
-    doc.setAllWordsInCorpus(allWordsInCorpus_);
-    doc.setLemmatizationMap(lemmatizationMap_);
+/**
+ * @brief Constructor for a DocumentManager over a corpus stored with
+ *        SaveIndex. Nothing is parsed, normalized or copied: the document
+ *        vectors, frequencies and IDF are views of the mapped index, so
+ *        recommendations are available at once. Only the stop-word and
+ *        lemma tables and the term index are rebuilt, and the file is
+ *        validated, in one pass over it. Stored top-K lists are copied
+ *        when RecommendTopK asks for the same lists (see
+ *        TakeStoredNeighbours). Views are copied into owned storage only
+ *        when they are written: the frequencies and any top-K lists on the
+ *        first AddDocuments or RemoveDocument, and the weights of a
+ *        document when it is reweighted. The file stays mapped as long as
+ *        anything views it
+ * @param indexFile Path to the index file
+ * @param threads Number of worker threads (0 means one per hardware thread)
+ */
+DocumentManager::DocumentManager(const std::string& indexFile, size_t threads)
+    : pool_(threads) {
+  {
+    auto scope = stats_.Measure("read index");
+    index_ = std::make_shared<const IndexFile>(indexFile);
+    context_ = std::make_shared<CorpusContext>(index_);
   }
 
-  CountDocumentsOccurrences();
+  size_t n = index_->documentCount();
+  {
+    auto scope = stats_.Measure("load documents from index");
+    std::vector<std::unique_ptr<Document>> loaded(n);
+    pool_.ParallelFor(n, [&](size_t i, size_t) {
+      loaded[i] = std::make_unique<Document>(index_, i, context_);
+    });
+    documents_.reserve(n);
+    for (std::unique_ptr<Document>& doc : loaded) {
+      documents_.push_back(std::move(*doc));
+    }
+  }
+  counted_ = n;
+  weighted_ = n;
+  weightsVersion_ = context_->version();
+  storedNeighbours_ = index_->hasNeighbours();
+  UpdateCounters();
+}
+
+/**
+ * @brief Load and normalize documents in parallel, each token going once
+ *        through the normalization pipeline, and append them to the corpus.
+ *        Documents keep the order of the input file names. Reading and
+ *        normalizing are two parallel passes, so each is measured on its own,
+ *        run over batches of Document::kLoadBatch documents so only one batch
+ *        of files is mapped at a time
+ * @param documents Vector of document file names
+ */
+void DocumentManager::LoadDocuments(const std::vector<std::string>& documents) {
+  std::vector<std::unique_ptr<Document>> loaded(documents.size());
+  for (size_t first = 0; first < documents.size();
+       first += Document::kLoadBatch) {
+    size_t count = std::min(Document::kLoadBatch, documents.size() - first);
+    {
+      auto scope = stats_.Measure("read documents");
+      pool_.ParallelFor(count, [&](size_t i, size_t) {
+        loaded[first + i] =
+            std::make_unique<Document>(documents[first + i], context_);
+      });
+    }
+    {
+      auto scope = stats_.Measure("normalize documents");
+      pool_.ParallelFor(count, [&](size_t i, size_t) {
+        loaded[first + i]->Normalize();
+      });
+    }
+  }
+
+  documents_.reserve(documents_.size() + loaded.size());
+  for (std::unique_ptr<Document>& doc : loaded) {
+    documents_.push_back(std::move(*doc));
+  }
+}
+
+/**
+ * @brief Keep only the representative of every near-duplicate cluster, so
+ *        duplicates weigh neither on the document frequencies nor on the
+ *        recommendations. Runs before the vocabulary is built
+ */
+void DocumentManager::CollapseDuplicates() {
+  std::vector<Document> kept;
+  kept.reserve(documents_.size() - duplicates_.Duplicates());
+  for (size_t d = 0; d < documents_.size(); ++d) {
+    if (duplicates_.representative[d] == d) {
+      kept.push_back(std::move(documents_[d]));
+    }
+  }
+  documents_ = std::move(kept);
+  duplicates_.collapsed = true;
+}
+
+/**
+ * @brief Getter for documents occurrences
+ * @return Number of documents each term appears in, indexed by term ID
+ */
+const MappableArray<int>& DocumentManager::documentsOccurrences() const {
+  return context_->documentFrequency();
 }
 
 /**
- * @brief Getter for documents occurrences map
- * @return Map of terms to the number of documents they appear in
+ * @brief Getter for IDF values. The IDF is recomputed here if documents were
+ *        added or removed since it was last calculated, so this must not run
+ *        concurrently with other calls on the manager
+ * @return IDF of each term, indexed by term ID
  */
-std::map<std::string, int> DocumentManager::documentsOccurrences() const {
-  return documentsOccurrences_;
+const MappableArray<double>& DocumentManager::IDF() const {
+  if (context_->IDFStale()) context_->CalculateIDF();
+  return context_->IDF();
 }
 
 /**
- * @brief Getter for lemmatization map
- * @return Map of words to their lemmas
+ * @brief Getter for lemmatization table
+ * @return Hash table of words to their lemmas
  */
-std::map<std::string, std::string> DocumentManager::lemmatizationMap() const {
-  return lemmatizationMap_;
+const LemmaTable& DocumentManager::lemmatizationMap() const {
+  return context_->lemmas();
+}
+
+/**
+ * @brief Choose the precision the similarity engines store the document
+ *        weights in. Results computed at another precision are dropped, so
+ *        the next recommendation recomputes them
+ * @param precision Storage precision
+ */
+void DocumentManager::SetStoragePrecision(StoragePrecision precision) {
+  if (precision == precision_) return;
+  precision_ = precision;
+  mode_ = Mode::kNone;
+  storedNeighbours_ = false;
+  similarityMatrix_.clear();
+  sparseSimilarities_ = CsrMatrix();
+  neighbours_.clear();
+  UpdateCounters();
 }
 
 /**
  * @brief Main method to perform recommendation calculations
  */
 void DocumentManager::Recommend() {
-  for (Document& doc : documents_) {
-    doc.CalculateTermIndices();
-    doc.CalculateTF();
-    doc.CalculateVectorLength();
-    doc.CalculateTFNormalized();
-  }
-  CalculateIDF();
+  mode_ = Mode::kMatrix;
+  approximate_ = false;
+  CalculateWeights();
   CalculateCosineSimilarity();
+  UpdateCounters();
 }
 
 /**
- * @brief Load lemmatization rules from a JSON file
- * @return Map of words to their lemmas
+ * @brief Recommendation mode that keeps only the k most similar documents of
+ *        each document instead of the full similarity matrix. Memory is
+ *        O(N * k) instead of O(N^2)
+ * @param k Maximum number of neighbours per document
+ * @param threshold Only neighbours with similarity strictly above it are kept
  */
-std::map<std::string, std::string> DocumentManager::LoadLemmatizationRules(
-    const std::string& lemmatizationFile) {
-  std::map<std::string, std::string> lemmaMap;
-  std::ifstream file(lemmatizationFile);
-
-  if (!file.is_open()) {
-    std::cerr << "Error: Cannot open lemmatization file '" << lemmatizationFile
-              << "'." << std::endl;
-    exit(1);
+void DocumentManager::RecommendTopK(size_t k, double threshold) {
+  // Lists loaded from an index or kept current by corpus updates are reused.
+  if (storedNeighbours_ && index_->topK() == k &&
+      index_->threshold() == threshold) {
+    TakeStoredNeighbours();
+  }
+  if (mode_ == Mode::kTopK && !approximate_ && topK_ == k &&
+      threshold_ == threshold && neighbours_.size() == documents_.size()) {
+    return;
   }
+  mode_ = Mode::kTopK;
+  approximate_ = false;
+  topK_ = k;
+  threshold_ = threshold;
+  similarityMatrix_.clear();
+  sparseSimilarities_ = CsrMatrix();
+  CalculateTopK();
+}
 
-  std::string content;
-  std::string line;
+/**
+ * @brief Compute the exact top-K list of every document with the settings
+ *        of the last RecommendTopK
+ */
+void DocumentManager::CalculateTopK() {
+  SimilarityEngine engine = BuildEngine();
 
-  while (std::getline(file, line)) {
-    content += line;
+  {
+    auto scope = stats_.Measure("top-K neighbours");
+    neighbours_.assign(documents_.size(), {});
+    std::vector<SimilarityEngine::RowBuffer> buffers(pool_.size());
+    pool_.ParallelFor(documents_.size(), [&](size_t i, size_t worker) {
+      neighbours_[i] = engine.TopK(i, topK_, threshold_, buffers[worker]);
+    });
   }
-  file.close();
-  size_t pos = 0;
-  bool inObject = false;
-  while (pos < content.length()) {
-    char c = content[pos];
-    if (c == '{') {
-      inObject = true;
-      pos++;
-      continue;
+  UpdateCounters();
+}
+
+/**
+ * @brief Copy the top-K lists stored in the index into neighbour lists,
+ *        which then stand for an exact RecommendTopK with the parameters
+ *        they were computed with
+ */
+void DocumentManager::TakeStoredNeighbours() {
+  {
+    auto scope = stats_.Measure("load neighbour lists");
+    neighbours_.assign(documents_.size(), {});
+    for (size_t i = 0; i < documents_.size(); ++i) {
+      IndexFile::NeighbourList list = index_->Neighbours(i);
+      neighbours_[i].reserve(list.documents.size());
+      for (size_t r = 0; r < list.documents.size(); ++r) {
+        neighbours_[i].push_back({list.documents[r], list.similarities[r]});
+      }
     }
-    if (c == '}') {
-      break;
+  }
+  mode_ = Mode::kTopK;
+  approximate_ = false;
+  topK_ = index_->topK();
+  threshold_ = index_->threshold();
+  similarityMatrix_.clear();
+  sparseSimilarities_ = CsrMatrix();
+  storedNeighbours_ = false;
+  UpdateCounters();
+}
+
+/**
+ * @brief Before the corpus changes, take the top-K lists stored in the
+ *        index if nothing was recommended since it was loaded, so the
+ *        update keeps them current like lists computed here; otherwise
+ *        they stop describing the corpus and are dropped
+ */
+void DocumentManager::SettleStoredNeighbours() {
+  if (!storedNeighbours_) return;
+  if (mode_ == Mode::kNone) TakeStoredNeighbours();
+  storedNeighbours_ = false;
+}
+
+/**
+ * @brief Top-K recommendations from an HNSW graph instead of the exact
+ *        engine: each document scores a number of others that grows slowly
+ *        with the corpus, at the cost of missing some neighbours (see
+ *        EvaluateRecall to choose the parameters). The similarities of the
+ *        neighbours found are exact. Documents added later get exact lists
+ * @param k Maximum number of neighbours per document
+ * @param threshold Only neighbours with similarity strictly above it are kept
+ * @param parameters Links, search breadths and seed of the graph
+ */
+void DocumentManager::RecommendApproximate(size_t k, double threshold,
+                                           const AnnParameters& parameters) {
+  mode_ = Mode::kTopK;
+  approximate_ = true;
+  topK_ = k;
+  threshold_ = threshold;
+  similarityMatrix_.clear();
+  sparseSimilarities_ = CsrMatrix();
+
+  HnswIndex index = BuildAnnIndex(parameters);
+  {
+    auto scope = stats_.Measure("approximate top-K neighbours");
+    neighbours_.assign(documents_.size(), {});
+    std::vector<HnswIndex::QueryBuffer> buffers(pool_.size());
+    pool_.ParallelFor(documents_.size(), [&](size_t i, size_t worker) {
+      neighbours_[i] = index.TopK(i, k, threshold, buffers[worker]);
+    });
+  }
+  UpdateCounters();
+}
+
+/**
+ * @brief Measure the recall of HNSW top-K lists against the exact ones over
+ *        a sample of documents, evenly spaced through the corpus, and the
+ *        time both take. The graph is built once and searched with every
+ *        given breadth. A neighbour found counts as a hit when it is at
+ *        least as similar as the exact k-th neighbour, so ties do not count
+ *        as misses. The recommendations already made are left untouched
+ * @param k Number of neighbours per query
+ * @param threshold Only neighbours with similarity strictly above it count
+ * @param parameters Parameters of the graph under test
+ * @param searchBreadths Query search breadths to evaluate
+ * @param queries Maximum number of sampled query documents
+ * @return One report per search breadth: recall, mean documents scored per
+ *         query and timings
+ */
+std::vector<RecallReport> DocumentManager::EvaluateRecall(
+    size_t k, double threshold, const AnnParameters& parameters,
+    const std::vector<size_t>& searchBreadths, size_t queries) {
+  RecallReport base;
+  base.k = k;
+  CalculateWeights();
+  size_t n = documents_.size();
+  base.queries = std::min(queries, n);
+  std::vector<RecallReport> reports;
+  if (base.queries == 0 || k == 0) {
+    for (size_t breadth : searchBreadths) {
+      reports.push_back(base);
+      reports.back().searchBreadth = breadth;
     }
-    if (inObject && c == '"') {
-      size_t keyStart = pos + 1;
-      size_t keyEnd = content.find('"', keyStart);
-      if (keyEnd == std::string::npos) {
-        std::cerr << "Error: Malformed JSON in lemmatization file" << std::endl;
-        exit(1);
-      }
-      std::string key = content.substr(keyStart, keyEnd - keyStart);
-      pos = content.find(':', keyEnd);
-      if (pos == std::string::npos) {
-        std::cerr << "Error: Malformed JSON - missing colon" << std::endl;
-        exit(1);
-      }
-      pos = content.find('"', pos);
-      if (pos == std::string::npos) {
-        std::cerr << "Error: Malformed JSON - missing value quote" << std::endl;
-        exit(1);
-      }
-      size_t valueStart = pos + 1;
-      size_t valueEnd = content.find('"', valueStart);
-      if (valueEnd == std::string::npos) {
-        std::cerr << "Error: Malformed JSON - missing closing value quote"
-                  << std::endl;
-        exit(1);
+    return reports;
+  }
+  std::vector<size_t> sample(base.queries);
+  for (size_t i = 0; i < sample.size(); ++i) sample[i] = i * n / sample.size();
+
+  auto seconds = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+  auto start = std::chrono::steady_clock::now();
+  HnswIndex index = BuildAnnIndex(parameters);
+  base.buildSeconds = seconds(start);
+  SimilarityEngine engine = BuildEngine();
+
+  auto scope = stats_.Measure("evaluate recall");
+  std::vector<std::vector<Neighbour>> exact(sample.size());
+  std::vector<SimilarityEngine::RowBuffer> rowBuffers(pool_.size());
+  start = std::chrono::steady_clock::now();
+  pool_.ParallelFor(sample.size(), [&](size_t i, size_t worker) {
+    exact[i] = engine.TopK(sample[i], k, threshold, rowBuffers[worker]);
+  });
+  base.exactSeconds = seconds(start);
+
+  std::vector<std::vector<Neighbour>> approximate(sample.size());
+  std::vector<size_t> scored(sample.size());
+  std::vector<HnswIndex::QueryBuffer> queryBuffers(pool_.size());
+  for (size_t breadth : searchBreadths) {
+    RecallReport report = base;
+    report.searchBreadth = breadth;
+    index.SetSearchBreadth(breadth);
+    start = std::chrono::steady_clock::now();
+    pool_.ParallelFor(sample.size(), [&](size_t i, size_t worker) {
+      approximate[i] =
+          index.TopK(sample[i], k, threshold, queryBuffers[worker]);
+      scored[i] = queryBuffers[worker].evaluated;
+    });
+    report.approximateSeconds = seconds(start);
+
+    size_t expected = 0;
+    size_t hits = 0;
+    size_t evaluated = 0;
+    for (size_t i = 0; i < sample.size(); ++i) {
+      evaluated += scored[i];
+      if (exact[i].empty()) continue;
+      expected += exact[i].size();
+      double last = exact[i].back().similarity;
+      size_t found = 0;
+      for (const Neighbour& neighbour : approximate[i]) {
+        if (neighbour.similarity >= last) ++found;
       }
-      std::string value = content.substr(valueStart, valueEnd - valueStart);
-      std::transform(key.begin(), key.end(), key.begin(),
-                     [](unsigned char c) { return std::tolower(c); });
-      std::transform(value.begin(), value.end(), value.begin(),
-                     [](unsigned char c) { return std::tolower(c); });
-
-      lemmaMap[key] = value;
-      pos = valueEnd + 1;
-    } else {
-      pos++;
+      hits += std::min(found, exact[i].size());
     }
+    report.recall =
+        expected == 0 ? 1.0 : static_cast<double>(hits) / expected;
+    report.scored = static_cast<double>(evaluated) / sample.size();
+    reports.push_back(report);
   }
+  return reports;
+}
+
+/**
+ * @brief Measure the accuracy of a reduced storage precision against double
+ *        over a sample of documents, evenly spaced through the corpus: the
+ *        absolute error of every similarity of a sampled document, and the
+ *        overlap of its top-K lists with the exact ones, where a neighbour
+ *        counts as found when its exact similarity is at least the exact
+ *        k-th one, as in EvaluateRecall. The recommendations already made
+ *        are left untouched
+ * @param k Number of neighbours per query
+ * @param threshold Only neighbours with similarity strictly above it count
+ * @param precision Storage precision under test
+ * @param queries Maximum number of sampled query documents
+ * @return Errors, overlap, weight bytes and top-K timings of both engines
+ */
+PrecisionReport DocumentManager::EvaluatePrecision(size_t k, double threshold,
+                                                   StoragePrecision precision,
+                                                   size_t queries) {
+  PrecisionReport report;
+  report.precision = precision;
+  report.k = k;
+  SimilarityEngine exactEngine = BuildEngine(StoragePrecision::kDouble);
+  SimilarityEngine reducedEngine = BuildEngine(precision);
+  report.exactWeightBytes = exactEngine.weightBytes();
+  report.weightBytes = reducedEngine.weightBytes();
+  size_t n = documents_.size();
+  report.queries = std::min(queries, n);
+  if (report.queries == 0) return report;
+  std::vector<size_t> sample(report.queries);
+  for (size_t i = 0; i < sample.size(); ++i) sample[i] = i * n / sample.size();
+
+  auto scope = stats_.Measure("evaluate precision");
+  auto seconds = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+  std::vector<std::vector<Neighbour>> exact(sample.size());
+  std::vector<std::vector<Neighbour>> reduced(sample.size());
+  std::vector<SimilarityEngine::RowBuffer> buffers(pool_.size());
+  auto start = std::chrono::steady_clock::now();
+  pool_.ParallelFor(sample.size(), [&](size_t i, size_t worker) {
+    exact[i] = exactEngine.TopK(sample[i], k, threshold, buffers[worker]);
+  });
+  report.exactSeconds = seconds(start);
+  start = std::chrono::steady_clock::now();
+  pool_.ParallelFor(sample.size(), [&](size_t i, size_t worker) {
+    reduced[i] = reducedEngine.TopK(sample[i], k, threshold, buffers[worker]);
+  });
+  report.reducedSeconds = seconds(start);
+
+  // Per worker: largest error, sum of errors and pairs, expected and found
+  // neighbours.
+  struct Partial {
+    double maxError = 0.0;
+    double errorSum = 0.0;
+    size_t pairs = 0;
+    size_t expected = 0;
+    size_t hits = 0;
+  };
+  std::vector<Partial> partials(pool_.size());
+  std::vector<std::vector<double>> exactRows(pool_.size());
+  std::vector<std::vector<double>> reducedRows(pool_.size());
+  pool_.ParallelFor(sample.size(), [&](size_t i, size_t worker) {
+    Partial& partial = partials[worker];
+    std::vector<double>& exactRow = exactRows[worker];
+    std::vector<double>& reducedRow = reducedRows[worker];
+    exactEngine.AccumulateRow(sample[i], 0, exactRow);
+    reducedEngine.AccumulateRow(sample[i], 0, reducedRow);
+    for (size_t j = 0; j < n; ++j) {
+      if (exactRow[j] == 0.0 && reducedRow[j] == 0.0) continue;
+      double error = std::abs(exactRow[j] - reducedRow[j]);
+      partial.maxError = std::max(partial.maxError, error);
+      partial.errorSum += error;
+      ++partial.pairs;
+    }
+    if (exact[i].empty()) return;
+    partial.expected += exact[i].size();
+    double last = exact[i].back().similarity;
+    size_t found = 0;
+    for (const Neighbour& neighbour : reduced[i]) {
+      if (exactRow[neighbour.document] >= last) ++found;
+    }
+    partial.hits += std::min(found, exact[i].size());
+  });
 
-  return lemmaMap;
+  size_t pairs = 0;
+  size_t expected = 0;
+  size_t hits = 0;
+  for (const Partial& partial : partials) {
+    report.maxError = std::max(report.maxError, partial.maxError);
+    report.meanError += partial.errorSum;
+    pairs += partial.pairs;
+    expected += partial.expected;
+    hits += partial.hits;
+  }
+  if (pairs > 0) report.meanError /= static_cast<double>(pairs);
+  report.overlap =
+      expected == 0 ? 1.0 : static_cast<double>(hits) / expected;
+  return report;
 }
 
 /**
- * @brief Count the number of documents each term appears in
+ * @brief Calculate the corpus IDF if it is stale and then, in parallel, the
+ *        weights of the documents that do not have them yet. The term
+ *        indices and counts of a document are taken once, after which its
+ *        working memory is released. Weights that depend on the corpus are
+ *        recalculated for every document whenever the corpus has changed
+ *        since they were calculated
  */
-void DocumentManager::CountDocumentsOccurrences() {
-  documentsOccurrences_.clear();
+void DocumentManager::CalculateWeights() {
+  if (context_->IDFStale()) {
+    auto scope = stats_.Measure("calculate IDF");
+    context_->CalculateIDF();
+  }
+  if (context_->weighting().UsesCorpus() &&
+      weightsVersion_ != context_->version()) {
+    weighted_ = 0;
+  }
+  size_t first = std::min(weighted_, counted_);
+  if (first != documents_.size()) {
+    auto scope = stats_.Measure("calculate weights");
+    size_t counted = counted_;
+    pool_.ParallelFor(documents_.size() - first,
+                      [this, first, counted](size_t i, size_t) {
+                        Document& doc = documents_[first + i];
+                        if (first + i >= counted) {
+                          doc.CalculateTermIndices();
+                          doc.CalculateTermCounts();
+                          doc.ReleaseWorkingMemory();
+                        }
+                        doc.CalculateWeights();
+                      });
+    counted_ = documents_.size();
+    weighted_ = documents_.size();
+  }
+  weightsVersion_ = context_->version();
+}
 
-  for (const Document& doc : documents_) {
-    std::set<std::string> uniqueTerms;
+/**
+ * @brief Build the similarity engine over the corpus at the storage
+ *        precision of the manager
+ * @return Engine indexing every document
+ */
+SimilarityEngine DocumentManager::BuildEngine() {
+  return BuildEngine(precision_);
+}
 
-    const std::vector<std::vector<std::string>>& simplifiedText =
-        doc.simplifiedText();
+/**
+ * @brief Build the similarity engine over the corpus, weighting first the
+ *        documents that are not weighted yet. The engine points into the
+ *        documents, so it is only valid until the corpus changes
+ * @param precision Precision the engine stores the weights in
+ * @return Engine indexing every document
+ */
+SimilarityEngine DocumentManager::BuildEngine(StoragePrecision precision) {
+  CalculateWeights();
+  auto scope = stats_.Measure("build similarity index");
+  return SimilarityEngine(WeightVectors(), allWordsInCorpus().size(),
+                          precision);
+}
 
-    for (const std::vector<std::string>& line : simplifiedText) {
-      for (const std::string& word : line) {
-        if (!word.empty()) {
-          uniqueTerms.insert(word);
-        }
+/**
+ * @brief Build an HNSW graph over the corpus, weighting first the documents
+ *        that are not weighted yet. Like the engine, it points into the
+ *        documents and is only valid until the corpus changes
+ * @param parameters Links, search breadths and seed
+ * @return Graph of every document
+ */
+HnswIndex DocumentManager::BuildAnnIndex(const AnnParameters& parameters) {
+  CalculateWeights();
+  auto scope = stats_.Measure("build HNSW index");
+  return HnswIndex(WeightVectors(), allWordsInCorpus().size(), parameters);
+}
+
+/**
+ * @brief Normalized weight vector of every document, in corpus order
+ * @return Pointers into the documents
+ */
+std::vector<const SparseVector<double>*> DocumentManager::WeightVectors()
+    const {
+  std::vector<const SparseVector<double>*> vectors;
+  vectors.reserve(documents_.size());
+  for (const Document& doc : documents_) {
+    vectors.push_back(&doc.TFNormalized());
+  }
+  return vectors;
+}
+
+/**
+ * @brief Count the number of documents each term appears in and build the
+ *        corpus dictionary. Every worker counts its documents into private
+ *        maps split in shards by term hash; the shards are then merged in
+ *        parallel, one shard per task, so no map is ever shared between
+ *        threads
+ */
+void DocumentManager::CountDocumentsOccurrences() {
+  const VocabularyOptions& options = context_->vocabularyOptions();
+  if (options.hashBits > 0) {
+    {
+      auto scope = stats_.Measure("count document frequencies");
+      context_->BuildVocabulary({}, 0, 0);
+      for (const Document& doc : documents_) {
+        context_->AddDocumentTerms(doc.terms(), doc.termTokenCount());
       }
     }
+    ReportVocabulary();
+    return;
+  }
+
+  auto scope = stats_.Measure("count document frequencies");
+  constexpr size_t kShards = 64;
+  using Counts = std::unordered_map<std::string_view, int>;
+  std::hash<std::string_view> hasher;
+
+  std::vector<std::vector<Counts>> local(pool_.size(),
+                                         std::vector<Counts>(kShards));
+  pool_.ParallelFor(documents_.size(), [&](size_t d, size_t worker) {
+    for (std::string_view term : documents_[d].terms()) {
+      ++local[worker][hasher(term) % kShards][term];
+    }
+  });
+
+  uint64_t termTokens = 0;
+  for (const Document& doc : documents_) termTokens += doc.termTokenCount();
 
-    for (const std::string& term : uniqueTerms) {
-      ++documentsOccurrences_[term];
+  std::vector<std::vector<std::pair<std::string_view, int>>> shards(kShards);
+  pool_.ParallelFor(kShards, [&](size_t shard, size_t) {
+    Counts merged;
+    for (std::vector<Counts>& workerCounts : local) {
+      for (const auto& termCount : workerCounts[shard]) {
+        merged[termCount.first] += termCount.second;
+      }
+      Counts().swap(workerCounts[shard]);
     }
+    shards[shard].assign(merged.begin(), merged.end());
+  });
+
+  std::vector<std::pair<std::string_view, int>> counts;
+  for (const auto& shard : shards) {
+    counts.insert(counts.end(), shard.begin(), shard.end());
+  }
+  std::sort(counts.begin(), counts.end());
+  context_->BuildVocabulary(counts, documents_.size(), termTokens);
+  if (options.Prunes()) {
+    vocabularyReport_.terms = counts.size();
+    ReportVocabulary();
   }
 }
 
 /**
- * @brief Calculate Inverse Document Frequency (IDF) for all terms
+ * @brief Fill the vocabulary report: the terms (or hash buckets) kept and
+ *        the distinct terms of every document against the distinct term IDs
+ *        it keeps, counted in parallel
  */
-void DocumentManager::CalculateIDF() {
-  for (const std::string& word : allWordsInCorpus_) {
-    int docCount = documentsOccurrences_[word];
-    if (docCount > 0) {
-      IDF_[word] = log10(static_cast<double>(documents_.size()) /
-                         static_cast<double>(docCount));
-    } else {
-      IDF_[word] = 0.0;
-    }
+void DocumentManager::ReportVocabulary() {
+  auto scope = stats_.Measure("vocabulary report");
+  const TermDictionary& vocabulary = allWordsInCorpus();
+  VocabularyReport& report = vocabularyReport_;
+  if (vocabulary.hashed()) {
+    const MappableArray<int>& frequency = documentsOccurrences();
+    report.buckets = vocabulary.size();
+    report.keptTerms = static_cast<uint64_t>(
+        std::count_if(frequency.begin(), frequency.end(),
+                      [](int documents) { return documents > 0; }));
+  } else {
+    report.keptTerms = vocabulary.size();
+  }
+
+  std::vector<uint64_t> entries(pool_.size(), 0);
+  std::vector<uint64_t> kept(pool_.size(), 0);
+  std::vector<std::vector<uint32_t>> ids(pool_.size());
+  pool_.ParallelFor(documents_.size(), [&](size_t d, size_t worker) {
+    const std::vector<std::string_view>& terms = documents_[d].terms();
+    context_->DistinctTermIds(terms, ids[worker]);
+    entries[worker] += terms.size();
+    kept[worker] += ids[worker].size();
+  });
+  report.entries = 0;
+  report.keptEntries = 0;
+  for (size_t worker = 0; worker < pool_.size(); ++worker) {
+    report.entries += entries[worker];
+    report.keptEntries += kept[worker];
+  }
+  if (!vocabulary.hashed()) {
+    stats_.SetCounter("eliminatedTerms", report.terms - report.keptTerms);
   }
+  stats_.SetCounter("eliminatedEntries",
+                    report.entries - report.keptEntries);
 }
 
 /**
- * @brief Calculate cosine similarity matrix for all documents
+ * @brief Calculate cosine similarity matrix for all documents, with the
+ *        parallel cache-blocked kernel
  */
 void DocumentManager::CalculateCosineSimilarity() {
-  int n = documents_.size();
-  similarityMatrix_.clear();
-  similarityMatrix_.resize(n, std::vector<double>(n, 0.0));
-
-  for (int i = 0; i < n; ++i) {
-    for (int j = 0; j < n; ++j) {
-      double dotProduct = 0.0;
-      const std::map<std::string, double>& tfNorm_i =
-          documents_[i].TFNormalized();
-      const std::map<std::string, double>& tfNorm_j =
-          documents_[j].TFNormalized();
-
-      for (const std::string& word : allWordsInCorpus_) {
-        double tf_i = 0.0;
-        double tf_j = 0.0;
-
-        auto it_i = tfNorm_i.find(word);
-        if (it_i != tfNorm_i.end()) {
-          tf_i = it_i->second;
-        }
+  SimilarityEngine engine = BuildEngine();
+  auto scope = stats_.Measure("cosine similarity matrix");
+  similarityMatrix_ = engine.ComputeMatrix(pool_);
+  sparseSimilarities_ = CsrMatrix();
+  neighbours_.clear();
+}
 
-        auto it_j = tfNorm_j.find(word);
-        if (it_j != tfNorm_j.end()) {
-          tf_j = it_j->second;
-        }
+/**
+ * @brief Recommendation mode that computes the similarity matrix as the
+ *        sparse product D * D^T of the document-term matrix D, whose rows
+ *        are the normalized document vectors, with a row-parallel SpGEMM.
+ *        Each entry is summed in the same order as the rows of the engine,
+ *        so it may differ from Recommend() in the last bits where the
+ *        blocked kernel uses its dense subspace (within 1e-12, see
+ *        similarityBench). Pruning at a threshold keeps the result
+ *        sparse. Corpus updates recompute the whole product. The product
+ *        always uses the double weights, whatever the storage precision
+ * @param options Accumulator and threshold: only similarities strictly
+ *        above it are kept
+ * @param sparse Keep the result in sparseSimilarities() instead of
+ *        expanding it to the dense similarityMatrix()
+ */
+void DocumentManager::RecommendSpGemm(const SpGemmOptions& options,
+                                      bool sparse) {
+  mode_ = Mode::kProduct;
+  approximate_ = false;
+  product_ = options;
+  sparseProduct_ = sparse;
+  CalculateProduct();
+  UpdateCounters();
+}
 
-        dotProduct += tf_i * tf_j;
-      }
+/**
+ * @brief Compute the sparse product with the settings of the last
+ *        RecommendSpGemm
+ */
+void DocumentManager::CalculateProduct() {
+  CalculateWeights();
+  CsrMatrix documents;
+  CsrMatrix terms;
+  {
+    auto scope = stats_.Measure("assemble CSR matrices");
+    documents = CsrMatrix::FromRows(WeightVectors(),
+                                    allWordsInCorpus().size());
+    terms = documents.Transpose();
+  }
+  CsrMatrix product;
+  {
+    auto scope = stats_.Measure("SpGEMM similarity matrix");
+    product = SpGemm(documents, terms, pool_, product_);
+  }
+  neighbours_.clear();
+  if (sparseProduct_) {
+    similarityMatrix_.clear();
+    sparseSimilarities_ = std::move(product);
+  } else {
+    similarityMatrix_ = product.ToDense();
+    sparseSimilarities_ = CsrMatrix();
+  }
+}
 
-      similarityMatrix_[i][j] = dotProduct;
+/**
+ * @brief Update the corpus counters of the statistics: documents, bytes of
+ *        input text, tokens, vocabulary terms, non-zero weights and stored
+ *        similarities. One pass over the documents, not over their tokens
+ */
+void DocumentManager::UpdateCounters() {
+  uint64_t inputBytes = 0;
+  uint64_t tokens = 0;
+  uint64_t nonZeroEntries = 0;
+  for (const Document& doc : documents_) {
+    inputBytes += doc.textSize();
+    tokens += doc.tokenCount();
+    nonZeroEntries += doc.TF().size();
+  }
+  uint64_t similarityEntries = 0;
+  if (mode_ == Mode::kMatrix ||
+      (mode_ == Mode::kProduct && !sparseProduct_)) {
+    similarityEntries = similarityMatrix_.size() * similarityMatrix_.size();
+  } else if (mode_ == Mode::kProduct) {
+    similarityEntries = sparseSimilarities_.nonZeros();
+  } else if (mode_ == Mode::kTopK) {
+    for (const std::vector<Neighbour>& list : neighbours_) {
+      similarityEntries += list.size();
     }
+  } else if (storedNeighbours_) {
+    similarityEntries =
+        index_->Array<uint32_t>(IndexFile::kNeighbourDocuments).size();
   }
+  stats_.SetCounter("documents", documents_.size());
+  stats_.SetCounter("inputBytes", inputBytes);
+  stats_.SetCounter("tokens", tokens);
+  stats_.SetCounter("vocabularyTerms", allWordsInCorpus().size());
+  stats_.SetCounter("nonZeroEntries", nonZeroEntries);
+  stats_.SetCounter("similarityEntries", similarityEntries);
 }
 
 /**
- * @brief Print the cosine similarity matrix to the console
+ * @brief Save the processed corpus to a binary index file: the vocabulary,
+ *        document frequencies and IDF, every document vector with its
+ *        weights, the normalization tables and, in top-K mode, the neighbour
+ *        lists. The weights must have been calculated (Recommend or
+ *        RecommendTopK)
+ * @param indexFile Path to the index file
  */
-void DocumentManager::PrintSimilarityMatrix() const {
-  int n = documents_.size();
+void DocumentManager::SaveIndex(const std::string& indexFile) const {
+  if (weighted_ != documents_.size()) {
+    std::cerr << "Error: the corpus must be weighted before saving an index"
+              << std::endl;
+    exit(1);
+  }
+  auto scope = stats_.Measure("write index");
+  const TermDictionary& dictionary = allWordsInCorpus();
+  IndexWriter writer(indexFile);
 
-  std::cout << "\n=========================== COSINE SIMILARITY MATRIX "
-               "===========================\n"
-            << std::endl;
+  std::vector<std::string_view> strings;
+  for (uint32_t id = 0; id < dictionary.size(); ++id) {
+    strings.push_back(dictionary.Term(id));
+  }
+  writer.WriteStrings(IndexFile::kTerms, strings);
+  writer.BeginSection(IndexFile::kDocumentFrequency);
+  writer.AppendArray(documentsOccurrences());
+  writer.BeginSection(IndexFile::kIDF);
+  writer.AppendArray(IDF());
 
-  std::cout << std::setw(10) << " ";
-  for (int i = 0; i < n; ++i) {
-    std::cout << std::setw(11) << "Doc " << i + 1;
+  std::vector<std::string> names;
+  std::vector<double> lengths;
+  std::vector<uint64_t> offsets(1, 0);
+  for (const Document& doc : documents_) {
+    names.push_back(doc.documentName());
+    lengths.push_back(doc.vectorLength());
+    offsets.push_back(offsets.back() + doc.TF().size());
+  }
+  writer.WriteStrings(IndexFile::kDocumentNames, names);
+  writer.BeginSection(IndexFile::kVectorLengths);
+  writer.AppendArray(lengths);
+  writer.BeginSection(IndexFile::kVectorOffsets);
+  writer.AppendArray(offsets);
+  writer.BeginSection(IndexFile::kVectorIds);
+  for (const Document& doc : documents_) writer.AppendArray(doc.TF().ids());
+  writer.BeginSection(IndexFile::kTermCounts);
+  for (const Document& doc : documents_) {
+    writer.AppendArray(doc.termCounts().values());
+  }
+  writer.BeginSection(IndexFile::kTF);
+  for (const Document& doc : documents_) writer.AppendArray(doc.TF().values());
+  writer.BeginSection(IndexFile::kTFNormalized);
+  for (const Document& doc : documents_) {
+    writer.AppendArray(doc.TFNormalized().values());
+  }
+  writer.BeginSection(IndexFile::kTermPositions);
+  for (const Document& doc : documents_) {
+    writer.AppendArray(doc.termIndices().values());
   }
-  std::cout << std::endl;
-  std::cout << std::string(80, '-') << std::endl;
 
-  for (int i = 0; i < n; ++i) {
-    std::cout << std::setw(10) << "Doc " << i + 1 << ": ";
-    for (int j = 0; j < n; ++j) {
-      std::cout << std::setw(12) << std::fixed << std::setprecision(6)
-                << similarityMatrix_[i][j];
+  IndexFile::Header header{};
+  header.documentCount = documents_.size();
+  header.termCount = dictionary.size();
+  header.corpusVersion = version();
+  header.flags = context_->stemmed() ? IndexFile::kStemmed : 0;
+  if (context_->frozenVocabulary()) {
+    header.flags |= IndexFile::kFrozenVocabulary;
+  }
+  header.weighting = static_cast<uint32_t>(context_->weighting().scheme);
+  header.bm25K1 = context_->weighting().k1;
+  header.bm25B = context_->weighting().b;
+  // Approximate and reduced-precision lists are not stored, so a loaded
+  // index never passes them off as exact. Lists still stored in the index
+  // the corpus was loaded from are written back as they are.
+  bool exactTopK = mode_ == Mode::kTopK && !approximate_ &&
+                   precision_ == StoragePrecision::kDouble;
+  bool stored = mode_ == Mode::kNone && storedNeighbours_;
+  if (exactTopK || stored) {
+    header.flags |= IndexFile::kHasNeighbours;
+    header.topK = stored ? index_->topK() : topK_;
+    header.threshold = stored ? index_->threshold() : threshold_;
+    offsets.assign(1, 0);
+    std::vector<uint32_t> neighbourDocuments;
+    std::vector<double> similarities;
+    for (size_t i = 0; i < documents_.size(); ++i) {
+      if (stored) {
+        IndexFile::NeighbourList list = index_->Neighbours(i);
+        neighbourDocuments.insert(neighbourDocuments.end(),
+                                  list.documents.begin(),
+                                  list.documents.end());
+        similarities.insert(similarities.end(), list.similarities.begin(),
+                            list.similarities.end());
+      } else {
+        for (const Neighbour& neighbour : neighbours_[i]) {
+          neighbourDocuments.push_back(neighbour.document);
+          similarities.push_back(neighbour.similarity);
+        }
+      }
+      offsets.push_back(neighbourDocuments.size());
     }
-    std::cout << std::endl;
+    writer.BeginSection(IndexFile::kNeighbourOffsets);
+    writer.AppendArray(offsets);
+    writer.BeginSection(IndexFile::kNeighbourDocuments);
+    writer.AppendArray(neighbourDocuments);
+    writer.BeginSection(IndexFile::kNeighbourSimilarities);
+    writer.AppendArray(similarities);
   }
+
+  strings.clear();
+  stopWords().ForEach([&](std::string_view word) { strings.push_back(word); });
+  writer.WriteStrings(IndexFile::kStopWords, strings);
+  strings.clear();
+  std::vector<std::string_view> lemmas;
+  lemmatizationMap().ForEach(
+      [&](std::string_view word, std::string_view lemma) {
+        strings.push_back(word);
+        lemmas.push_back(lemma);
+      });
+  writer.WriteStrings(IndexFile::kLemmaWords, strings);
+  writer.WriteStrings(IndexFile::kLemmas, lemmas);
+  writer.Finish(header);
 }
 
 /**
- * @brief Overloaded output operator for DocumentManager
- * @param os Output stream
- * @param dm DocumentManager object
- * @return Reference to the output stream
+ * @brief Add one document to the corpus
+ * @param document Document file name
  */
-std::ostream& operator<<(std::ostream& os, const DocumentManager& dm) {
-  os << "\n=============================== TABLES OF TERMS "
-        "================================\n";
-  for (const Document& doc : dm.documents()) {
-    os << "\n=========================== " << doc.documentName()
-       << " ==========================\n\n";
-
-    os << std::left << std::setw(30) << "Term" << std::right << std::setw(12)
-       << "TF" << std::setw(12) << "IDF" << std::setw(12) << "TFIDF" 
-       << std::setw(15) << "Index" << "\n";
-    os << std::string(90, '-') << "\n";
-
-    const auto& tf_map = doc.TF();
-    const auto& tfNorm_map = doc.TFNormalized();
-    const auto& idf_map = dm.IDF();
-    const auto& termIndices_map = doc.termIndices();
-
-    for (const std::string& term : dm.allWordsInCorpus()) {
-      double tf = 0.0;
-      auto it_tf = tf_map.find(term);
-      if (it_tf != tf_map.end()) {
-        tf = it_tf->second;
-      }
+void DocumentManager::AddDocument(const std::string& document) {
+  AddDocuments({document});
+}
 
-      double idf = 0.0;
-      auto it_idf = idf_map.find(term);
-      if (it_idf != idf_map.end()) {
-        idf = it_idf->second;
-      }
+/**
+ * @brief Add documents to the corpus, updating the document frequencies
+ *        incrementally. If a recommendation was made, only what the new
+ *        documents change is recomputed: their weights, their rows and
+ *        columns of the similarity matrix, or their neighbour lists plus
+ *        their entry in the lists of existing documents. Log TF weights do
+ *        not depend on the IDF, so existing documents are never reweighted
+ *        and the IDF itself is recomputed lazily (see IDF()). Under schemes
+ *        that use the IDF every weight changes with the corpus, so every
+ *        document is reweighted and the recommendation recomputed, as is a
+ *        sparse product (see RecommendSpGemm). New matrix cells come from
+ *        the row kernel, which sums in term ID order, while a rebuild runs
+ *        the blocked kernel, whose dense subspace is summed first and
+ *        chosen from the current corpus; the two agree within 1e-12 (see
+ *        incrementalBench), not bit for bit. Top-K lists still stored in
+ *        a loaded index count as a recommendation unless another one was
+ *        made (see SettleStoredNeighbours)
+ * @param documents Document file names, appended in order
+ */
+void DocumentManager::AddDocuments(const std::vector<std::string>& documents) {
+  SettleStoredNeighbours();
+  size_t first = documents_.size();
+  LoadDocuments(documents);
+  {
+    auto scope = stats_.Measure("count document frequencies");
+    for (size_t d = first; d < documents_.size(); ++d) {
+      context_->AddDocumentTerms(documents_[d].terms(),
+                                 documents_[d].termTokenCount());
+    }
+  }
+  if (mode_ == Mode::kNone || first == documents_.size()) {
+    UpdateCounters();
+    return;
+  }
+  if (mode_ == Mode::kProduct || context_->weighting().UsesCorpus()) {
+    RecalculateRecommendations();
+    return;
+  }
+
+  SimilarityEngine engine = BuildEngine();
+  auto scope = stats_.Measure("update recommendations");
+  size_t n = documents_.size();
+  std::vector<std::vector<double>> scores(pool_.size());
 
-      double tfNorm = 0.0;
-      auto it_tfn = tfNorm_map.find(term);
-      if (it_tfn != tfNorm_map.end()) {
-        tfNorm = it_tfn->second;
+  if (mode_ == Mode::kMatrix) {
+    for (std::vector<double>& row : similarityMatrix_) row.resize(n, 0.0);
+    similarityMatrix_.resize(n, std::vector<double>(n, 0.0));
+    // Each new document owns its row and its cells in the existing rows, so
+    // no cell is written twice.
+    pool_.ParallelFor(n - first, [&](size_t i, size_t worker) {
+      size_t d = first + i;
+      engine.AccumulateRow(d, 0, scores[worker]);
+      for (size_t j = 0; j < n; ++j) {
+        similarityMatrix_[d][j] = scores[worker][j];
+        if (j < first) similarityMatrix_[j][d] = scores[worker][j];
       }
+    });
+    UpdateCounters();
+    return;
+  }
 
-      std::pair<int, int> termIndex = std::make_pair(-1, -1);
-      auto it_idx = termIndices_map.find(term);
-      if (it_idx != termIndices_map.end()) {
-        termIndex = it_idx->second;
+  // Candidates the new documents offer to the lists of existing documents,
+  // gathered in parallel and merged serially.
+  neighbours_.resize(n);
+  std::vector<std::vector<Neighbour>> offers(n - first);
+  std::vector<SimilarityEngine::RowBuffer> buffers(pool_.size());
+  pool_.ParallelFor(n - first, [&](size_t i, size_t worker) {
+    size_t d = first + i;
+    neighbours_[d] = engine.TopK(d, topK_, threshold_, buffers[worker]);
+    engine.AccumulateRow(d, 0, scores[worker]);
+    for (size_t j = 0; j < first; ++j) {
+      if (scores[worker][j] > threshold_) {
+        offers[i].push_back({static_cast<uint32_t>(j), scores[worker][j]});
       }
+    }
+  });
+  for (size_t i = 0; i < offers.size(); ++i) {
+    for (const Neighbour& offer : offers[i]) {
+      OfferNeighbour(neighbours_[offer.document],
+                     {static_cast<uint32_t>(first + i), offer.similarity},
+                     topK_);
+    }
+  }
+  UpdateCounters();
+}
 
-      os << std::left << std::setw(30) << term << std::right << std::setw(12)
-         << std::fixed << std::setprecision(6) << tf << std::setw(12) << idf
-         << std::setw(12) << tfNorm;
-      
-      if (termIndex.first == -1) {
-        os << std::setw(15) << "N/A";
-      } else {
-        std::ostringstream indexStr;
-        indexStr << termIndex.first << ", " << termIndex.second;
-        os << std::setw(15) << indexStr.str();
+/**
+ * @brief Remove a document from the corpus, updating the document
+ *        frequencies incrementally. The documents after it move one position
+ *        down. Its row and column are dropped from the similarity matrix; in
+ *        top-K mode only the lists that contained it are recomputed, the
+ *        others are just renumbered. Under schemes that use the IDF, or
+ *        after RecommendSpGemm, the recommendation is recomputed, as in
+ *        AddDocuments, which also takes the top-K lists of a loaded index
+ * @param index Index of the document to remove
+ */
+void DocumentManager::RemoveDocument(size_t index) {
+  if (index >= documents_.size()) {
+    std::cerr << "Error: no document with index " << index << std::endl;
+    exit(1);
+  }
+  SettleStoredNeighbours();
+  // Counted documents are removed by the term IDs of their vectors, which
+  // documents loaded from an index have instead of terms.
+  const Document& doc = documents_[index];
+  if (index < counted_) {
+    const MappableArray<uint32_t>& ids = doc.termCounts().ids();
+    context_->RemoveDocumentTerms(ArrayView<uint32_t>(ids.data(), ids.size()),
+                                  doc.termTokenCount());
+  } else {
+    context_->RemoveDocumentTerms(doc.terms(), doc.termTokenCount());
+  }
+  documents_.erase(documents_.begin() + index);
+  if (index < counted_) --counted_;
+  if (index < weighted_) --weighted_;
+  if (mode_ == Mode::kProduct ||
+      (mode_ != Mode::kNone && context_->weighting().UsesCorpus())) {
+    RecalculateRecommendations();
+    return;
+  }
+
+  if (mode_ == Mode::kMatrix) {
+    similarityMatrix_.erase(similarityMatrix_.begin() + index);
+    for (std::vector<double>& row : similarityMatrix_) {
+      row.erase(row.begin() + index);
+    }
+  } else if (mode_ == Mode::kTopK) {
+    neighbours_.erase(neighbours_.begin() + index);
+    std::vector<uint32_t> affected;
+    for (size_t i = 0; i < neighbours_.size(); ++i) {
+      bool contained = false;
+      for (Neighbour& neighbour : neighbours_[i]) {
+        if (neighbour.document == index) contained = true;
+        if (neighbour.document > index) --neighbour.document;
       }
-      
-      os << "\n";
+      if (contained) affected.push_back(static_cast<uint32_t>(i));
     }
+    if (!affected.empty()) {
+      SimilarityEngine engine = BuildEngine();
+      auto scope = stats_.Measure("update recommendations");
+      std::vector<SimilarityEngine::RowBuffer> buffers(pool_.size());
+      pool_.ParallelFor(affected.size(), [&](size_t i, size_t worker) {
+        neighbours_[affected[i]] =
+            engine.TopK(affected[i], topK_, threshold_, buffers[worker]);
+      });
+    }
+  }
+  UpdateCounters();
+}
 
-    os << "\n";
+/**
+ * @brief Recompute the last recommendation over the whole corpus after a
+ *        change that reweighted every document, or any change under a
+ *        sparse product. Approximate top-K lists are replaced by exact ones
+ */
+void DocumentManager::RecalculateRecommendations() {
+  if (mode_ == Mode::kMatrix) {
+    CalculateCosineSimilarity();
+    UpdateCounters();
+  } else if (mode_ == Mode::kProduct) {
+    CalculateProduct();
+    UpdateCounters();
+  } else {
+    approximate_ = false;
+    CalculateTopK();
   }
-  dm.PrintSimilarityMatrix();
+}
+
+/**
+ * @brief Print the cosine similarity matrix to the console
+ */
+void DocumentManager::PrintSimilarityMatrix() const {
+  ResultWriter(std::cout).WriteSimilarityMatrix(*this);
+}
+
+/**
+ * @brief Print the top-K neighbour list of every document to the console
+ */
+void DocumentManager::PrintNeighbours() const {
+  ResultWriter(std::cout).WriteNeighbours(*this);
+}
+
+/**
+ * @brief Overloaded output operator for DocumentManager
+ * @param os Output stream
+ * @param dm DocumentManager object
+ * @return Reference to the output stream
+ */
+std::ostream& operator<<(std::ostream& os, const DocumentManager& dm) {
+  ResultWriter(os).Write(dm);
   return os;
-}
\ No newline at end of file
+}
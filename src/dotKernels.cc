@@ -0,0 +1,433 @@
+#include "../include/dotKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DOT_KERNELS_X86 1
+#endif
+
+namespace {
+
+using DenseDotFunction = double (*)(const double *, const double *, size_t);
+using DenseDotFloatFunction = float (*)(const float *, const float *, size_t);
+using DenseDotInt16Function = int64_t (*)(const int16_t *, const int16_t *,
+                                          size_t);
+using DenseDotInt8Function = int64_t (*)(const int8_t *, const int8_t *,
+                                         size_t);
+using SparseDotFunction = double (*)(const uint32_t *, const double *, size_t,
+                                     const uint32_t *, const double *, size_t);
+
+/**
+ * @brief Scalar dense dot product
+ */
+double DenseDotScalar(const double *a, const double *b, size_t n) {
+  double sum = 0.0;
+  for (size_t i = 0; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+/**
+ * @brief Scalar dense dot product in float
+ */
+float DenseDotFloatScalar(const float *a, const float *b, size_t n) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+/**
+ * @brief Scalar dense dot product of 16-bit integers, summed exactly
+ */
+int64_t DenseDotInt16Scalar(const int16_t *a, const int16_t *b, size_t n) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < n; ++i) sum += static_cast<int32_t>(a[i]) * b[i];
+  return sum;
+}
+
+/**
+ * @brief Scalar dense dot product of 8-bit integers, summed exactly
+ */
+int64_t DenseDotInt8Scalar(const int8_t *a, const int8_t *b, size_t n) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < n; ++i) sum += static_cast<int32_t>(a[i]) * b[i];
+  return sum;
+}
+
+/**
+ * @brief Sorted merge of two sparse vectors from positions i and j, adding
+ *        the products of shared IDs to sum in ID order
+ */
+double MergeDot(const uint32_t *idsA, const double *valuesA, size_t sizeA,
+                const uint32_t *idsB, const double *valuesB, size_t sizeB,
+                size_t i, size_t j, double sum) {
+  while (i < sizeA && j < sizeB) {
+    if (idsA[i] < idsB[j]) {
+      ++i;
+    } else if (idsB[j] < idsA[i]) {
+      ++j;
+    } else {
+      sum += valuesA[i++] * valuesB[j++];
+    }
+  }
+  return sum;
+}
+
+/**
+ * @brief Scalar sorted-merge sparse dot product
+ */
+double SparseDotScalar(const uint32_t *idsA, const double *valuesA,
+                       size_t sizeA, const uint32_t *idsB,
+                       const double *valuesB, size_t sizeB) {
+  return MergeDot(idsA, valuesA, sizeA, idsB, valuesB, sizeB, 0, 0, 0.0);
+}
+
+#ifdef DOT_KERNELS_X86
+
+/**
+ * @brief AVX2 dense dot product, two 4-lane accumulators
+ */
+__attribute__((target("avx2"))) double DenseDotAvx2(const double *a,
+                                                    const double *b,
+                                                    size_t n) {
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = _mm256_add_pd(
+        sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                             _mm256_loadu_pd(b + i + 4)));
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, _mm256_add_pd(sum0, sum1));
+  double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+/**
+ * @brief AVX2 dense dot product in float, two 8-lane accumulators
+ */
+__attribute__((target("avx2"))) float DenseDotFloatAvx2(const float *a,
+                                                        const float *b,
+                                                        size_t n) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  if (i + 8 <= n) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    i += 8;
+  }
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, _mm256_add_ps(sum0, sum1));
+  float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+              ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+  for (; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+/**
+ * @brief AVX-512 dense dot product, two 8-lane accumulators
+ */
+__attribute__((target("avx512f"))) double DenseDotAvx512(const double *a,
+                                                         const double *b,
+                                                         size_t n) {
+  __m512d sum0 = _mm512_setzero_pd();
+  __m512d sum1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm512_add_pd(
+        sum0, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    sum1 = _mm512_add_pd(sum1, _mm512_mul_pd(_mm512_loadu_pd(a + i + 8),
+                                             _mm512_loadu_pd(b + i + 8)));
+  }
+  alignas(64) double lanes[8];
+  _mm512_store_pd(lanes, _mm512_add_pd(sum0, sum1));
+  double sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+               ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+  for (; i < n; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+/**
+ * @brief AVX2 dense dot product of 16-bit integers. Adjacent products are
+ *        paired in 32 bits by madd, which is exact unless both pairs are
+ *        -32768 * -32768, and widened to 64-bit lanes
+ */
+__attribute__((target("avx2"))) int64_t DenseDotInt16Avx2(const int16_t *a,
+                                                          const int16_t *b,
+                                                          size_t n) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i pairs = _mm256_madd_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(pairs)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(pairs, 1)));
+  }
+  alignas(32) int64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sum);
+  int64_t total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < n; ++i) total += static_cast<int32_t>(a[i]) * b[i];
+  return total;
+}
+
+/**
+ * @brief AVX2 dense dot product of 8-bit integers, widened to 16 bits and
+ *        paired by madd into 32-bit lanes, which cannot overflow below 2^20
+ *        elements
+ */
+__attribute__((target("avx2"))) int64_t DenseDotInt8Avx2(const int8_t *a,
+                                                         const int8_t *b,
+                                                         size_t n) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i wideA = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+    __m256i wideB = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(wideA, wideB));
+  }
+  alignas(32) int32_t lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sum);
+  int64_t total = 0;
+  for (int32_t lane : lanes) total += lane;
+  for (; i < n; ++i) total += static_cast<int32_t>(a[i]) * b[i];
+  return total;
+}
+
+/**
+ * @brief AVX-512 dense dot product in float, two 16-lane accumulators. The
+ *        tail is read with masked loads
+ */
+__attribute__((target("avx512f"))) float DenseDotFloatAvx512(const float *a,
+                                                             const float *b,
+                                                             size_t n) {
+  __m512 sum0 = _mm512_setzero_ps();
+  __m512 sum1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    sum0 = _mm512_add_ps(
+        sum0, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    sum1 = _mm512_add_ps(sum1, _mm512_mul_ps(_mm512_loadu_ps(a + i + 16),
+                                             _mm512_loadu_ps(b + i + 16)));
+  }
+  for (; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? 0xFFFF : (1u << (n - i)) - 1;
+    sum0 = _mm512_add_ps(sum0,
+                         _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                       _mm512_maskz_loadu_ps(mask, b + i)));
+  }
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, _mm512_add_ps(sum0, sum1));
+  float sum = 0.0f;
+  for (float lane : lanes) sum += lane;
+  return sum;
+}
+
+/**
+ * @brief AVX2 sparse dot product. Blocks of 8 IDs of each list are compared
+ *        all-against-all with 8 rotations; only the matches touch the values.
+ *        Matches are consumed in ascending ID order, so the sum is identical
+ *        to SparseDotScalar
+ */
+__attribute__((target("avx2"))) double SparseDotAvx2(
+    const uint32_t *idsA, const double *valuesA, size_t sizeA,
+    const uint32_t *idsB, const double *valuesB, size_t sizeB) {
+  const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  double sum = 0.0;
+  size_t i = 0, j = 0;
+  while (i + 8 <= sizeA && j + 8 <= sizeB) {
+    __m256i blockA =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idsA + i));
+    __m256i blockB =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idsB + j));
+    __m256i matches = _mm256_setzero_si256();
+    __m256i rotated = blockB;
+    for (int r = 0; r < 8; ++r) {
+      matches = _mm256_or_si256(matches, _mm256_cmpeq_epi32(blockA, rotated));
+      rotated = _mm256_permutevar8x32_epi32(rotated, rotate);
+    }
+    unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_ps(_mm256_castsi256_ps(matches)));
+    while (mask != 0) {
+      int lane = __builtin_ctz(mask);
+      mask &= mask - 1;
+      __m256i probe = _mm256_set1_epi32(static_cast<int>(idsA[i + lane]));
+      int partner = __builtin_ctz(static_cast<unsigned>(_mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpeq_epi32(probe, blockB)))));
+      sum += valuesA[i + lane] * valuesB[j + partner];
+    }
+    uint32_t lastA = idsA[i + 7];
+    uint32_t lastB = idsB[j + 7];
+    if (lastA <= lastB) i += 8;
+    if (lastB <= lastA) j += 8;
+  }
+  return MergeDot(idsA, valuesA, sizeA, idsB, valuesB, sizeB, i, j, sum);
+}
+
+#endif
+
+/**
+ * @brief Kernels selected for the active SIMD level
+ */
+struct Dispatch {
+  SimdLevel level;
+  DenseDotFunction dense;
+  DenseDotFloatFunction denseFloat;
+  DenseDotInt16Function denseInt16;
+  DenseDotInt8Function denseInt8;
+  SparseDotFunction sparse;
+};
+
+Dispatch MakeDispatch(SimdLevel level) {
+#ifdef DOT_KERNELS_X86
+  // The sparse kernel is ID-compare bound; its AVX2 version is used at the
+  // AVX-512 level as well, like the integer dense kernels.
+  switch (level) {
+    case SimdLevel::kAvx512:
+      return {level, DenseDotAvx512, DenseDotFloatAvx512, DenseDotInt16Avx2,
+              DenseDotInt8Avx2, SparseDotAvx2};
+    case SimdLevel::kAvx2:
+      return {level, DenseDotAvx2, DenseDotFloatAvx2, DenseDotInt16Avx2,
+              DenseDotInt8Avx2, SparseDotAvx2};
+    case SimdLevel::kScalar:
+      break;
+  }
+#endif
+  return {SimdLevel::kScalar, DenseDotScalar, DenseDotFloatScalar,
+          DenseDotInt16Scalar, DenseDotInt8Scalar, SparseDotScalar};
+}
+
+Dispatch &ActiveDispatch() {
+  static Dispatch dispatch = MakeDispatch(DetectSimdLevel());
+  return dispatch;
+}
+
+}  // namespace
+
+/**
+ * @brief Detect the best SIMD level supported by the CPU
+ * @return Detected level
+ */
+SimdLevel DetectSimdLevel() {
+#ifdef DOT_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SimdLevel::kAvx512;
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::kAvx2;
+#endif
+  return SimdLevel::kScalar;
+}
+
+/**
+ * @brief Getter for the SIMD level used by the kernels
+ * @return Active level
+ */
+SimdLevel ActiveSimdLevel() { return ActiveDispatch().level; }
+
+/**
+ * @brief Select the kernels of a SIMD level. Levels above the detected one
+ *        are clamped to it. Not thread-safe: call before running kernels
+ * @param level Requested level
+ */
+void SetSimdLevel(SimdLevel level) {
+  if (static_cast<int>(level) > static_cast<int>(DetectSimdLevel())) {
+    level = DetectSimdLevel();
+  }
+  ActiveDispatch() = MakeDispatch(level);
+}
+
+/**
+ * @brief Printable name of a SIMD level
+ * @param level SIMD level
+ * @return Name of the level
+ */
+const char *SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kAvx512:
+      return "avx512";
+    case SimdLevel::kAvx2:
+      return "avx2";
+    case SimdLevel::kScalar:
+      break;
+  }
+  return "scalar";
+}
+
+/**
+ * @brief Dot product of two dense vectors with the active kernel
+ * @param a First vector
+ * @param b Second vector
+ * @param n Number of elements of each vector
+ * @return Dot product
+ */
+double DenseDot(const double *a, const double *b, size_t n) {
+  return ActiveDispatch().dense(a, b, n);
+}
+
+/**
+ * @brief Dot product of two dense float vectors with the active kernel
+ * @param a First vector
+ * @param b Second vector
+ * @param n Number of elements of each vector
+ * @return Dot product, accumulated in float
+ */
+float DenseDot(const float *a, const float *b, size_t n) {
+  return ActiveDispatch().denseFloat(a, b, n);
+}
+
+/**
+ * @brief Dot product of two dense vectors of 16-bit integers with the
+ *        active kernel
+ * @param a First vector
+ * @param b Second vector
+ * @param n Number of elements of each vector
+ * @return Exact dot product
+ */
+int64_t DenseDot(const int16_t *a, const int16_t *b, size_t n) {
+  return ActiveDispatch().denseInt16(a, b, n);
+}
+
+/**
+ * @brief Dot product of two dense vectors of 8-bit integers with the active
+ *        kernel
+ * @param a First vector
+ * @param b Second vector
+ * @param n Number of elements of each vector, below 2^20
+ * @return Exact dot product
+ */
+int64_t DenseDot(const int8_t *a, const int8_t *b, size_t n) {
+  return ActiveDispatch().denseInt8(a, b, n);
+}
+
+/**
+ * @brief Dot product of two sparse vectors given as sorted ID arrays and
+ *        their values, with the active kernel. Products are summed in ID
+ *        order at every level
+ * @return Dot product
+ */
+double SparseDot(const uint32_t *idsA, const double *valuesA, size_t sizeA,
+                 const uint32_t *idsB, const double *valuesB, size_t sizeB) {
+  return ActiveDispatch().sparse(idsA, valuesA, sizeA, idsB, valuesB, sizeB);
+}
+
+/**
+ * @brief Dot product of two sparse vectors with the active kernel
+ * @param a First vector
+ * @param b Second vector
+ * @return Dot product
+ */
+double SparseDot(const SparseVector<double> &a, const SparseVector<double> &b) {
+  return SparseDot(a.ids().data(), a.values().data(), a.size(),
+                   b.ids().data(), b.values().data(), b.size());
+}
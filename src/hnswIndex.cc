@@ -0,0 +1,399 @@
+#include "../include/hnswIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <queue>
+#include <random>
+
+#include "../include/dotKernels.h"
+
+namespace {
+
+/**
+ * @brief Order of scored documents: more similar first, ties by document
+ */
+bool MoreSimilar(const std::pair<float, uint32_t> &a,
+                 const std::pair<float, uint32_t> &b) {
+  if (a.first != b.first) return a.first > b.first;
+  return a.second < b.second;
+}
+
+}  // namespace
+
+/**
+ * @brief Constructor for HnswIndex. Documents are inserted one at a time in
+ *        corpus order, each on a random number of layers, so the same
+ *        corpus and seed always give the same graph
+ * @param vectors Normalized document vectors; they must outlive the index
+ * @param vocabularySize Number of term IDs the vectors use
+ * @param parameters Links per document, search breadths and seed
+ */
+HnswIndex::HnswIndex(const std::vector<const SparseVector<double> *> &vectors,
+                     size_t vocabularySize, const AnnParameters &parameters)
+    : vectors_(vectors),
+      vocabularySize_(vocabularySize),
+      parameters_(parameters) {
+  if (parameters_.links < 2 || parameters_.buildBreadth == 0) {
+    std::cerr << "Error: HNSW needs at least 2 links per document and a "
+                 "positive build breadth"
+              << std::endl;
+    exit(1);
+  }
+  size_t n = vectors_.size();
+  offsets_.assign(1, 0);
+  for (const SparseVector<double> *vector : vectors_) {
+    for (size_t i = 0; i < vector->size(); ++i) {
+      entries_.push_back({vector->ids()[i],
+                          static_cast<float>(vector->values()[i])});
+    }
+    offsets_.push_back(entries_.size());
+  }
+  layer0Capacity_ = Capacity(0);
+  layer0_.assign(n * (layer0Capacity_ + 1), 0);
+  upper_.resize(n);
+
+  // Layer of each document: geometric with ratio 1 / links.
+  std::mt19937_64 random(parameters_.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  double scale = 1.0 / std::log(static_cast<double>(parameters_.links));
+  QueryBuffer buffer;
+  std::vector<float> other(vocabularySize_, 0.0f);
+  for (uint32_t d = 0; d < n; ++d) {
+    double u = std::max(uniform(random), 1e-300);
+    auto layer = static_cast<size_t>(-std::log(u) * scale);
+    Insert(d, layer, buffer, other);
+  }
+}
+
+/**
+ * @brief Maximum number of links of a document on a layer: twice the links
+ *        on layer 0, which every search ends on
+ */
+size_t HnswIndex::Capacity(size_t layer) const {
+  return layer == 0 ? 2 * parameters_.links : parameters_.links;
+}
+
+/**
+ * @brief Links of a document on a layer: their count, then the slots
+ */
+uint32_t *HnswIndex::Links(uint32_t document, size_t layer) {
+  if (layer == 0) return layer0_.data() + document * (layer0Capacity_ + 1);
+  return upper_[document].data() + (layer - 1) * (parameters_.links + 1);
+}
+
+const uint32_t *HnswIndex::Links(uint32_t document, size_t layer) const {
+  return const_cast<HnswIndex *>(this)->Links(document, layer);
+}
+
+/**
+ * @brief Dot product of a scattered query with a document, reading only the
+ *        entries of the document
+ * @param dense Query weights indexed by term ID
+ * @param document Document index
+ */
+float HnswIndex::Dot(const std::vector<float> &dense,
+                     uint32_t document) const {
+  float sum = 0.0f;
+  for (size_t e = offsets_[document]; e < offsets_[document + 1]; ++e) {
+    sum += dense[entries_[e].id] * entries_[e].weight;
+  }
+  return sum;
+}
+
+/**
+ * @brief Write the weights of a vector into a zeroed dense array; terms
+ *        outside the indexed vocabulary are left out, as no document has
+ *        them
+ */
+void HnswIndex::Scatter(const SparseVector<double> &vector,
+                        std::vector<float> &dense) const {
+  dense.resize(vocabularySize_, 0.0f);
+  for (size_t i = 0; i < vector.size(); ++i) {
+    if (vector.ids()[i] < vocabularySize_) {
+      dense[vector.ids()[i]] = static_cast<float>(vector.values()[i]);
+    }
+  }
+}
+
+/**
+ * @brief Zero again the entries Scatter wrote
+ */
+void HnswIndex::Clear(const SparseVector<double> &vector,
+                      std::vector<float> &dense) const {
+  for (uint32_t id : vector.ids()) {
+    if (id < vocabularySize_) dense[id] = 0.0f;
+  }
+}
+
+/**
+ * @brief Write the packed vector of an indexed document into a zeroed
+ *        dense array
+ */
+void HnswIndex::Scatter(uint32_t document, std::vector<float> &dense) const {
+  dense.resize(vocabularySize_, 0.0f);
+  for (size_t e = offsets_[document]; e < offsets_[document + 1]; ++e) {
+    dense[entries_[e].id] = entries_[e].weight;
+  }
+}
+
+/**
+ * @brief Zero again the entries Scatter wrote for a document
+ */
+void HnswIndex::Clear(uint32_t document, std::vector<float> &dense) const {
+  for (size_t e = offsets_[document]; e < offsets_[document + 1]; ++e) {
+    dense[entries_[e].id] = 0.0f;
+  }
+}
+
+/**
+ * @brief Greedy walk on a layer: move to the most similar linked document
+ *        while it improves
+ * @param buffer Query buffers, with the query scattered
+ * @param start Document to start from
+ * @param layer Layer to walk on
+ * @return Document where no link improves the similarity
+ */
+uint32_t HnswIndex::Descend(QueryBuffer &buffer, uint32_t start,
+                            size_t layer) const {
+  uint32_t current = start;
+  float best = Dot(buffer.dense, current);
+  ++buffer.evaluated;
+  for (bool moved = true; moved;) {
+    moved = false;
+    const uint32_t *links = Links(current, layer);
+    for (uint32_t l = 1; l <= links[0]; ++l) {
+      float similarity = Dot(buffer.dense, links[l]);
+      ++buffer.evaluated;
+      if (similarity > best) {
+        best = similarity;
+        current = links[l];
+        moved = true;
+      }
+    }
+  }
+  return current;
+}
+
+/**
+ * @brief Best-first search of a layer, keeping the `breadth` most similar
+ *        documents found
+ * @param buffer Query buffers, with the query scattered. On return,
+ *        buffer.results holds the documents found, most similar first
+ * @param start Document to start from
+ * @param breadth Number of documents kept
+ * @param layer Layer to search
+ */
+void HnswIndex::SearchLayer(QueryBuffer &buffer, uint32_t start,
+                            size_t breadth, size_t layer) const {
+  if (buffer.visited.size() != vectors_.size() || ++buffer.stamp == 0) {
+    buffer.visited.assign(vectors_.size(), 0);
+    buffer.stamp = 1;
+  }
+  // Candidates to expand, most similar on top; results, least similar on
+  // top so the worst one is dropped first.
+  auto lessSimilar = [](const Scored &a, const Scored &b) {
+    return MoreSimilar(b, a);
+  };
+  std::vector<Scored> &candidates = buffer.candidates;
+  std::vector<Scored> &results = buffer.results;
+  candidates.clear();
+  results.clear();
+
+  Scored first{Dot(buffer.dense, start), start};
+  ++buffer.evaluated;
+  buffer.visited[start] = buffer.stamp;
+  candidates.push_back(first);
+  results.push_back(first);
+  while (!candidates.empty()) {
+    std::pop_heap(candidates.begin(), candidates.end(), lessSimilar);
+    Scored current = candidates.back();
+    candidates.pop_back();
+    if (results.size() >= breadth && MoreSimilar(results.front(), current)) {
+      break;
+    }
+    const uint32_t *links = Links(current.second, layer);
+    for (uint32_t l = 1; l <= links[0]; ++l) {
+      uint32_t next = links[l];
+      if (buffer.visited[next] == buffer.stamp) continue;
+      buffer.visited[next] = buffer.stamp;
+      Scored scored{Dot(buffer.dense, next), next};
+      ++buffer.evaluated;
+      if (results.size() < breadth) {
+        results.push_back(scored);
+        std::push_heap(results.begin(), results.end(), MoreSimilar);
+      } else if (MoreSimilar(scored, results.front())) {
+        std::pop_heap(results.begin(), results.end(), MoreSimilar);
+        results.back() = scored;
+        std::push_heap(results.begin(), results.end(), MoreSimilar);
+      } else {
+        continue;
+      }
+      candidates.push_back(scored);
+      std::push_heap(candidates.begin(), candidates.end(), lessSimilar);
+    }
+  }
+  std::sort(results.begin(), results.end(), MoreSimilar);
+}
+
+/**
+ * @brief Choose the links of a document among candidates, most similar
+ *        first, skipping any candidate more similar to an already chosen
+ *        link than to the document: its region is reached through that
+ *        link, and links spread in several directions keep the graph
+ *        navigable across clusters. Free slots are then filled with the
+ *        skipped candidates
+ * @param candidates Candidates and their similarity to the document
+ * @param count Number of links to choose
+ * @param other Zeroed dense scratch array
+ * @return Chosen documents
+ */
+std::vector<uint32_t> HnswIndex::SelectNeighbours(
+    std::vector<Scored> candidates, size_t count,
+    std::vector<float> &other) const {
+  std::sort(candidates.begin(), candidates.end(), MoreSimilar);
+  std::vector<uint32_t> chosen;
+  std::vector<uint32_t> skipped;
+  for (const Scored &candidate : candidates) {
+    if (chosen.size() == count) break;
+    Scatter(candidate.second, other);
+    bool diverse = true;
+    for (uint32_t link : chosen) {
+      if (Dot(other, link) > candidate.first) {
+        diverse = false;
+        break;
+      }
+    }
+    Clear(candidate.second, other);
+    (diverse ? chosen : skipped).push_back(candidate.second);
+  }
+  for (size_t s = 0; s < skipped.size() && chosen.size() < count; ++s) {
+    chosen.push_back(skipped[s]);
+  }
+  return chosen;
+}
+
+/**
+ * @brief Add a link, and if the document has too many links on the layer,
+ *        keep only the most similar ones
+ * @param from Document the link starts from
+ * @param to Linked document
+ * @param layer Layer of the link
+ * @param other Zeroed dense scratch array
+ */
+void HnswIndex::Link(uint32_t from, uint32_t to, size_t layer,
+                     std::vector<float> &other) {
+  uint32_t *links = Links(from, layer);
+  size_t capacity = Capacity(layer);
+  if (links[0] < capacity) {
+    links[++links[0]] = to;
+    return;
+  }
+  Scatter(from, other);
+  std::vector<Scored> scored;
+  scored.reserve(capacity + 1);
+  for (uint32_t l = 1; l <= links[0]; ++l) {
+    scored.emplace_back(Dot(other, links[l]), links[l]);
+  }
+  scored.emplace_back(Dot(other, to), to);
+  Clear(from, other);
+  std::sort(scored.begin(), scored.end(), MoreSimilar);
+  for (size_t l = 0; l < capacity; ++l) links[l + 1] = scored[l].second;
+}
+
+/**
+ * @brief Insert a document: walk down from the entry point to its top
+ *        layer, then on each of its layers link it to the documents a
+ *        search of that layer finds, and them back to it
+ * @param document Document index
+ * @param layer Top layer of the document
+ * @param buffer Search buffers
+ * @param other Zeroed dense scratch array
+ */
+void HnswIndex::Insert(uint32_t document, size_t layer, QueryBuffer &buffer,
+                       std::vector<float> &other) {
+  upper_[document].assign(layer * (parameters_.links + 1), 0);
+  if (document == 0) {
+    entry_ = 0;
+    topLayer_ = layer;
+    return;
+  }
+  Scatter(document, buffer.dense);
+  uint32_t current = entry_;
+  for (size_t l = topLayer_; l > layer; --l) {
+    current = Descend(buffer, current, l);
+  }
+  for (size_t l = std::min(layer, topLayer_) + 1; l-- > 0;) {
+    SearchLayer(buffer, current, parameters_.buildBreadth, l);
+    current = buffer.results.front().second;
+    std::vector<uint32_t> chosen =
+        SelectNeighbours(buffer.results, parameters_.links, other);
+    uint32_t *links = Links(document, l);
+    links[0] = static_cast<uint32_t>(chosen.size());
+    std::copy(chosen.begin(), chosen.end(), links + 1);
+    for (uint32_t neighbour : chosen) Link(neighbour, document, l, other);
+  }
+  Clear(document, buffer.dense);
+  if (layer > topLayer_) {
+    entry_ = document;
+    topLayer_ = layer;
+  }
+}
+
+/**
+ * @brief Find approximately the k indexed documents most similar to an
+ *        indexed document
+ * @param document Index of the query document
+ * @param k Maximum number of neighbours to return
+ * @param threshold Only documents with similarity strictly above it are kept
+ * @param buffer Scratch buffers, reusable across calls
+ * @return Neighbours sorted by decreasing similarity (ties by document index)
+ */
+std::vector<Neighbour> HnswIndex::TopK(size_t document, size_t k,
+                                       double threshold,
+                                       QueryBuffer &buffer) const {
+  return TopK(*vectors_[document], k, threshold, buffer, document);
+}
+
+/**
+ * @brief Find approximately the k indexed documents most similar to a query
+ *        vector: descend the layers greedily, then search layer 0 keeping
+ *        the searchBreadth (at least k + 1) best documents
+ * @param vector Normalized query vector
+ * @param k Maximum number of neighbours to return
+ * @param threshold Only documents with similarity strictly above it are kept
+ * @param buffer Scratch buffers, reusable across calls. After the call,
+ *        buffer.evaluated holds the number of documents scored
+ * @param exclude Document left out of the result (SIZE_MAX for none)
+ * @return Neighbours sorted by decreasing similarity (ties by document index)
+ */
+std::vector<Neighbour> HnswIndex::TopK(const SparseVector<double> &vector,
+                                       size_t k, double threshold,
+                                       QueryBuffer &buffer,
+                                       size_t exclude) const {
+  buffer.evaluated = 0;
+  if (k == 0 || vectors_.empty()) return {};
+  Scatter(vector, buffer.dense);
+  uint32_t current = entry_;
+  for (size_t l = topLayer_; l > 0; --l) {
+    current = Descend(buffer, current, l);
+  }
+  SearchLayer(buffer, current, std::max(parameters_.searchBreadth, k + 1), 0);
+  Clear(vector, buffer.dense);
+
+  std::vector<Neighbour> result;
+  for (const Scored &found : buffer.results) {
+    if (result.size() == k) break;
+    if (found.second == exclude) continue;
+    double similarity = SparseDot(vector, *vectors_[found.second]);
+    if (similarity > threshold) result.push_back({found.second, similarity});
+  }
+  std::sort(result.begin(), result.end(),
+            [](const Neighbour &a, const Neighbour &b) {
+              if (a.similarity != b.similarity) {
+                return a.similarity > b.similarity;
+              }
+              return a.document < b.document;
+            });
+  return result;
+}
@@ -0,0 +1,289 @@
+#include "../include/indexFile.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "../include/stringTable.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'R', 'S', 'C', 'B', 'I', 'D', 'X', '\n'};
+constexpr uint64_t kAlignment = 64;
+
+// First occurrences are stored as the pairs documents keep them in, so they
+// are viewed without conversion.
+static_assert(sizeof(std::pair<int32_t, int32_t>) == 2 * sizeof(int32_t),
+              "term positions must be stored as two packed int32");
+
+/**
+ * @brief Report a malformed index file and exit
+ * @param path Path to the index file
+ * @param reason What is wrong with it
+ */
+[[noreturn]] void InvalidIndex(const std::string &path, const char *reason) {
+  std::cerr << "Error: Invalid index file '" << path << "': " << reason
+            << std::endl;
+  exit(1);
+}
+
+}  // namespace
+
+/**
+ * @brief Constructor for IndexFile. Maps the file and validates its header,
+ *        checksum and section layout, exiting with an error if any of them
+ *        is wrong. Nothing else is read until it is used
+ * @param path Path to the index file
+ */
+IndexFile::IndexFile(const std::string &path) : file_(path) {
+  if (!file_.is_open()) {
+    std::cerr << "Error: Cannot open index file '" << path << "'." << std::endl;
+    exit(1);
+  }
+  if (file_.size() < sizeof(Header)) InvalidIndex(path, "truncated header");
+  header_ = reinterpret_cast<const Header *>(file_.data());
+  Validate(path);
+}
+
+/**
+ * @brief Check everything later accesses rely on, so that a corrupt or
+ *        foreign file is rejected instead of read out of bounds
+ * @param path Path to the index file, used in error messages
+ */
+void IndexFile::Validate(const std::string &path) const {
+  const Header &header = *header_;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    InvalidIndex(path, "not an index file");
+  }
+  if (header.formatVersion != kFormatVersion) {
+    InvalidIndex(path, "unsupported format version");
+  }
+  if (header.fileSize != file_.size()) InvalidIndex(path, "truncated file");
+  if (header.weighting > static_cast<uint32_t>(WeightingScheme::kBM25)) {
+    InvalidIndex(path, "unknown weighting scheme");
+  }
+  std::string_view payload = file_.view().substr(sizeof(Header));
+  if (HashString(payload) != header.checksum) {
+    InvalidIndex(path, "checksum mismatch");
+  }
+  for (int s = 0; s < kSectionCount; ++s) {
+    if (header.offsets[s] % kAlignment != 0 ||
+        header.offsets[s] < sizeof(Header) ||
+        header.sizes[s] > header.fileSize - header.offsets[s]) {
+      InvalidIndex(path, "section out of bounds");
+    }
+  }
+
+  for (Section section : {kTerms, kDocumentNames, kStopWords, kLemmaWords,
+                          kLemmas}) {
+    uint64_t bytes = header.sizes[section];
+    const char *start = file_.data() + header.offsets[section];
+    uint64_t count = 0;
+    if (bytes >= sizeof(count)) std::memcpy(&count, start, sizeof(count));
+    uint64_t words = bytes / sizeof(uint64_t);
+    if (words < 2 || count > words - 2) {
+      InvalidIndex(path, "malformed string list");
+    }
+    const uint64_t *offsets =
+        reinterpret_cast<const uint64_t *>(start) + 1;
+    uint64_t chars = bytes - (count + 2) * sizeof(uint64_t);
+    for (uint64_t i = 0; i < count; ++i) {
+      if (offsets[i] > offsets[i + 1]) {
+        InvalidIndex(path, "malformed string list");
+      }
+    }
+    if (offsets[0] != 0 || offsets[count] > chars) {
+      InvalidIndex(path, "malformed string list");
+    }
+  }
+  size_t documents = header.documentCount;
+  size_t terms = header.termCount;
+  if (Strings(kTerms).size() != terms ||
+      Strings(kDocumentNames).size() != documents ||
+      Strings(kLemmaWords).size() != Strings(kLemmas).size() ||
+      Array<int32_t>(kDocumentFrequency).size() != terms ||
+      Array<double>(kIDF).size() != terms ||
+      Array<double>(kVectorLengths).size() != documents) {
+    InvalidIndex(path, "section sizes do not match");
+  }
+
+  ArrayView<uint64_t> vectorOffsets = Array<uint64_t>(kVectorOffsets);
+  ArrayView<uint32_t> ids = Array<uint32_t>(kVectorIds);
+  if (vectorOffsets.size() != documents + 1 || vectorOffsets[0] != 0 ||
+      vectorOffsets[documents] != ids.size() ||
+      Array<uint32_t>(kTermCounts).size() != ids.size() ||
+      Array<double>(kTF).size() != ids.size() ||
+      Array<double>(kTFNormalized).size() != ids.size() ||
+      Array<std::pair<int32_t, int32_t>>(kTermPositions).size() !=
+          ids.size()) {
+    InvalidIndex(path, "malformed document vectors");
+  }
+  for (size_t d = 0; d < documents; ++d) {
+    if (vectorOffsets[d] > vectorOffsets[d + 1]) {
+      InvalidIndex(path, "malformed document vectors");
+    }
+    for (uint64_t i = vectorOffsets[d]; i < vectorOffsets[d + 1]; ++i) {
+      if (ids[i] >= terms || (i > vectorOffsets[d] && ids[i] <= ids[i - 1])) {
+        InvalidIndex(path, "malformed document vectors");
+      }
+    }
+  }
+
+  if (!hasNeighbours()) return;
+  ArrayView<uint64_t> neighbourOffsets = Array<uint64_t>(kNeighbourOffsets);
+  ArrayView<uint32_t> neighbours = Array<uint32_t>(kNeighbourDocuments);
+  if (neighbourOffsets.size() != documents + 1 || neighbourOffsets[0] != 0 ||
+      neighbourOffsets[documents] != neighbours.size() ||
+      Array<double>(kNeighbourSimilarities).size() != neighbours.size()) {
+    InvalidIndex(path, "malformed neighbour lists");
+  }
+  for (size_t d = 0; d < documents; ++d) {
+    if (neighbourOffsets[d] > neighbourOffsets[d + 1]) {
+      InvalidIndex(path, "malformed neighbour lists");
+    }
+  }
+  for (uint32_t document : neighbours) {
+    if (document >= documents) InvalidIndex(path, "malformed neighbour lists");
+  }
+}
+
+/**
+ * @brief View of a string-list section
+ * @param section Section to view
+ * @return Strings of the section, as views into the mapping
+ */
+StringListView IndexFile::Strings(Section section) const {
+  const char *start = file_.data() + header_->offsets[section];
+  uint64_t count;
+  std::memcpy(&count, start, sizeof(count));
+  const uint64_t *offsets = reinterpret_cast<const uint64_t *>(start) + 1;
+  return StringListView(offsets,
+                        start + (count + 2) * sizeof(uint64_t),
+                        count);
+}
+
+/**
+ * @brief View of the stored sparse vector of a document
+ * @param document Index of the document
+ * @return Term IDs and their weights, as views into the mapping
+ */
+IndexFile::Vector IndexFile::DocumentVector(size_t document) const {
+  ArrayView<uint64_t> offsets = Array<uint64_t>(kVectorOffsets);
+  size_t begin = offsets[document];
+  size_t size = offsets[document + 1] - begin;
+  return {ArrayView<uint32_t>(Array<uint32_t>(kVectorIds).data() + begin, size),
+          ArrayView<uint32_t>(Array<uint32_t>(kTermCounts).data() + begin,
+                              size),
+          ArrayView<double>(Array<double>(kTF).data() + begin, size),
+          ArrayView<double>(Array<double>(kTFNormalized).data() + begin, size),
+          ArrayView<std::pair<int32_t, int32_t>>(
+              Array<std::pair<int32_t, int32_t>>(kTermPositions).data() +
+                  begin,
+              size),
+          Array<double>(kVectorLengths)[document]};
+}
+
+/**
+ * @brief View of the stored neighbour list of a document
+ * @param document Index of the document
+ * @return Neighbours sorted by decreasing similarity; empty if the index
+ *         holds no neighbour lists
+ */
+IndexFile::NeighbourList IndexFile::Neighbours(size_t document) const {
+  if (!hasNeighbours()) return {};
+  ArrayView<uint64_t> offsets = Array<uint64_t>(kNeighbourOffsets);
+  size_t begin = offsets[document];
+  size_t size = offsets[document + 1] - begin;
+  return {ArrayView<uint32_t>(
+              Array<uint32_t>(kNeighbourDocuments).data() + begin, size),
+          ArrayView<double>(
+              Array<double>(kNeighbourSimilarities).data() + begin, size)};
+}
+
+/**
+ * @brief Constructor for IndexWriter. Creates the file and reserves room for
+ *        the header
+ * @param path Path to the index file
+ */
+IndexWriter::IndexWriter(const std::string &path)
+    : path_(path), stream_(path, std::ios::binary | std::ios::trunc) {
+  if (!stream_.is_open()) {
+    std::cerr << "Error: Cannot create index file '" << path << "'."
+              << std::endl;
+    exit(1);
+  }
+  IndexFile::Header blank{};
+  Append(&blank, sizeof(blank));
+}
+
+/**
+ * @brief Start a section, padding the file to the section alignment. Each
+ *        section is written once; sections left out are empty
+ * @param section Section to start
+ */
+void IndexWriter::BeginSection(IndexFile::Section section) {
+  EndSection();
+  static const char kPadding[kAlignment] = {};
+  Append(kPadding, (kAlignment - position_ % kAlignment) % kAlignment);
+  current_ = section;
+  offsets_[section] = position_;
+}
+
+/**
+ * @brief Append bytes to the current section
+ * @param data Bytes to write
+ * @param bytes Number of bytes
+ */
+void IndexWriter::Append(const void *data, size_t bytes) {
+  stream_.write(static_cast<const char *>(data),
+                static_cast<std::streamsize>(bytes));
+  position_ += bytes;
+}
+
+/**
+ * @brief Close the current section, if any, recording its size
+ */
+void IndexWriter::EndSection() {
+  if (current_ >= 0) sizes_[current_] = position_ - offsets_[current_];
+  current_ = -1;
+}
+
+/**
+ * @brief Finish the file: complete the header with the section table, the
+ *        file size and the checksum of the payload, and write it in place
+ * @param header Header with the corpus fields (counts, flags, top-K
+ *        parameters) set
+ */
+void IndexWriter::Finish(IndexFile::Header header) {
+  EndSection();
+  // Empty sections point at the end of the header, which is always valid.
+  for (int s = 0; s < IndexFile::kSectionCount; ++s) {
+    if (offsets_[s] == 0) {
+      offsets_[s] = (sizeof(IndexFile::Header) + kAlignment - 1) /
+                    kAlignment * kAlignment;
+    }
+  }
+  stream_.close();
+  if (!stream_) {
+    std::cerr << "Error: Cannot write index file '" << path_ << "'."
+              << std::endl;
+    exit(1);
+  }
+
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.formatVersion = IndexFile::kFormatVersion;
+  header.fileSize = position_;
+  std::memcpy(header.offsets, offsets_, sizeof(offsets_));
+  std::memcpy(header.sizes, sizes_, sizeof(sizes_));
+  {
+    MappedFile written(path_);
+    header.checksum =
+        HashString(written.view().substr(sizeof(IndexFile::Header)));
+  }
+  std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!file) {
+    std::cerr << "Error: Cannot write index file '" << path_ << "'."
+              << std::endl;
+    exit(1);
+  }
+}
@@ -1,6 +1,67 @@
 #include "../include/documentManager.h"
+#include "../include/recommendationServer.h"
+#include "../include/resultWriter.h"
+#include "../include/shardedCorpus.h"
 #include "../include/tools.h"
 
+namespace {
+
+/**
+ * @brief Print the pipeline statistics to standard error, as --stats asks
+ * @param stats Stages and counters of the run
+ * @param format Report format, or kNone for no report
+ */
+void PrintStats(const PipelineStats& stats, StatsFormat format) {
+  if (format == StatsFormat::kText) {
+    stats.Print(std::cerr);
+  } else if (format == StatsFormat::kJson) {
+    stats.PrintJson(std::cerr);
+  }
+}
+
+/**
+ * @brief Print the recall of the HNSW top-K lists against the exact ones
+ * @param report Evaluation made by DocumentManager::EvaluateRecall
+ * @param parameters Parameters of the evaluated graph
+ */
+void PrintRecall(const RecallReport& report, const AnnParameters& parameters) {
+  double queries = std::max<size_t>(report.queries, 1);
+  std::cerr << "HNSW recall@" << report.k << " (links " << parameters.links
+            << ", build ef " << parameters.buildBreadth << ", ef "
+            << parameters.searchBreadth << ") over " << report.queries
+            << " documents: " << std::fixed << std::setprecision(4)
+            << report.recall << "\n  documents scored per query: "
+            << std::setprecision(1) << report.scored
+            << "\n  exact ms per query: " << std::setprecision(4)
+            << report.exactSeconds * 1e3 / queries
+            << "\n  HNSW ms per query: "
+            << report.approximateSeconds * 1e3 / queries
+            << "\n  HNSW build ms: " << report.buildSeconds * 1e3 << std::endl;
+}
+
+/**
+ * @brief Print the accuracy of a reduced storage precision against double
+ * @param report Evaluation made by DocumentManager::EvaluatePrecision
+ */
+void PrintPrecision(const PrecisionReport& report) {
+  double queries = std::max<size_t>(report.queries, 1);
+  const char* name = StoragePrecisionName(report.precision);
+  std::cerr << "Precision " << name << " against double over "
+            << report.queries << " documents:\n  max absolute error: "
+            << std::scientific << std::setprecision(3) << report.maxError
+            << "\n  mean absolute error: " << report.meanError
+            << "\n  top-" << report.k << " overlap: " << std::fixed
+            << std::setprecision(4) << report.overlap
+            << "\n  posting weight bytes: " << report.weightBytes
+            << " (double: " << report.exactWeightBytes << ")"
+            << "\n  double ms per query: "
+            << report.exactSeconds * 1e3 / queries << "\n  " << name
+            << " ms per query: " << report.reducedSeconds * 1e3 / queries
+            << std::endl;
+}
+
+}  // namespace
+
 /**
  * @brief Main function
  * @param argc Argument count
@@ -9,24 +70,137 @@
  */
 int main(const int argc, char* argv[]) {
   CommandLineArgs args = CheckArguments(argc, argv);
+  if (!args.compileLemmasFile.empty()) {
+    LemmaTable lemmas = LoadLemmatizationRules(args.lemmatizationFile);
+    lemmas.SaveBinary(args.compileLemmasFile);
+    std::cout << "Saved " << lemmas.size() << " words and "
+              << lemmas.lemmaCount() << " lemmas to "
+              << args.compileLemmasFile << std::endl;
+    return 0;
+  }
 
-  std::vector<std::string> documentFiles = args.textFiles;
-  std::string stopWordsFile = args.stopWordsFile;
-  std::string lemmatizationFile = args.lemmatizationFile;
-
-  std::cout << "=============================== INPUT ARGUMENTS "
-               "================================\n"
-            << std::endl;
-  std::cout << "•Documents:\n";
-  for (const std::string& file : documentFiles) {
-    std::cout << "  - " << file << std::endl;
+  // In server mode and with machine-readable formats standard output
+  // carries the responses or results only.
+  bool table = args.output.format == OutputFormat::kTable;
+  std::ostream& log = args.serve || !table ? std::cerr : std::cout;
+  log << "=============================== INPUT ARGUMENTS "
+         "================================\n"
+      << std::endl;
+  bool selectsVocabulary =
+      args.vocabulary.Prunes() || args.vocabulary.hashBits > 0;
+  std::unique_ptr<DocumentManager> manager;
+  if (!args.loadIndexFile.empty()) {
+    log << "•Index File: " << args.loadIndexFile << std::endl;
+    manager = std::make_unique<DocumentManager>(args.loadIndexFile,
+                                                args.threads);
+    log << "•Documents:\n";
+    for (const Document& doc : manager->documents()) {
+      log << "  - " << doc.documentName() << std::endl;
+    }
+  } else {
+    log << "•Documents:\n";
+    for (const std::string& file : args.textFiles) {
+      log << "  - " << file << std::endl;
+    }
+    log << std::endl;
+    log << "•Stop Words File: " << args.stopWordsFile << std::endl;
+    log << "•Lemmatization File: " << args.lemmatizationFile << std::endl;
+    if (args.weighting.scheme != WeightingScheme::kLogTF) {
+      log << "•Weighting: " << WeightingSchemeName(args.weighting.scheme);
+      if (args.weighting.scheme == WeightingScheme::kBM25) {
+        log << " (k1 " << args.weighting.k1 << ", b " << args.weighting.b
+            << ")";
+      }
+      log << std::endl;
+    }
+    if (args.precision != StoragePrecision::kDouble) {
+      log << "•Precision: " << StoragePrecisionName(args.precision)
+          << std::endl;
+    }
+    if (args.spGemm) {
+      log << "•SpGEMM: "
+          << SpGemmAccumulatorName(args.product.accumulator)
+          << " accumulator" << (args.sparseMatrix ? ", sparse result" : "")
+          << std::endl;
+    }
+    if (args.shards.documents > 0) {
+      // Sharded mode streams the top-K lists as every row shard is done,
+      // without the term tables, which would need every document vector.
+      ShardedCorpus corpus(args.textFiles, args.stopWordsFile,
+                           args.lemmatizationFile, args.shards, args.threads,
+                           args.stem, args.weighting, args.vocabulary);
+      log << "•Shards: " << corpus.shardCount() << " of up to "
+          << args.shards.documents << " documents" << std::endl;
+      if (selectsVocabulary) corpus.vocabularyReport().Print(log);
+      ResultWriter writer(std::cout, args.output);
+      writer.BeginNeighbourLists(corpus.size(),
+                                 corpus.context()->vocabulary().size());
+      corpus.RecommendTopK(
+          args.topK, args.threshold,
+          [&](size_t document, const std::vector<Neighbour>& neighbours) {
+            writer.WriteNeighbourList(document, corpus.names(), neighbours);
+          },
+          args.precision);
+      writer.Flush();
+      if (table) std::cout << std::endl;
+      PrintStats(corpus.stats(), args.stats);
+      return 0;
+    }
+    manager = std::make_unique<DocumentManager>(
+        args.textFiles, args.stopWordsFile, args.lemmatizationFile,
+        args.threads, args.stem, args.deduplication, args.weighting,
+        args.vocabulary);
+    if (selectsVocabulary) manager->vocabularyReport().Print(log);
+    if (args.deduplication.enabled) manager->duplicates().Print(log);
   }
-  std::cout << std::endl;
-  std::cout << "•Stop Words File: " << stopWordsFile << std::endl;
-  std::cout << "•Lemmatization File: " << lemmatizationFile << std::endl;
 
-  DocumentManager dm(documentFiles, stopWordsFile, lemmatizationFile);
-  dm.Recommend();
-  std::cout << dm << std::endl;
+  DocumentManager& dm = *manager;
+  dm.SetStoragePrecision(args.precision);
+  if (args.serve) {
+    RecommendationServer server(dm, args.topK > 0 ? args.topK : 10,
+                                args.threshold, args.threads);
+    if (!args.buildIndexFile.empty()) {
+      dm.SaveIndex(args.buildIndexFile);
+    }
+    PrintStats(dm.stats(), args.stats);
+    if (args.socketFile.empty()) {
+      server.ServeStdin();
+    } else {
+      log << "•Serving on: " << args.socketFile << std::endl;
+      server.ServeSocket(args.socketFile);
+    }
+    return 0;
+  }
+  if (args.recallQueries > 0) {
+    PrintRecall(dm.EvaluateRecall(args.topK, args.threshold, args.ann,
+                                  {args.ann.searchBreadth},
+                                  args.recallQueries)
+                    .front(),
+                args.ann);
+  }
+  if (args.precisionQueries > 0) {
+    PrintPrecision(dm.EvaluatePrecision(args.topK, args.threshold,
+                                        args.precision,
+                                        args.precisionQueries));
+  }
+  if (args.approximate) {
+    dm.RecommendApproximate(args.topK, args.threshold, args.ann);
+  } else if (args.topK > 0) {
+    dm.RecommendTopK(args.topK, args.threshold);
+  } else if (args.spGemm) {
+    args.product.threshold = args.threshold;
+    dm.RecommendSpGemm(args.product, args.sparseMatrix);
+  } else {
+    dm.Recommend();
+  }
+  if (!args.buildIndexFile.empty()) {
+    dm.SaveIndex(args.buildIndexFile);
+  }
+  {
+    auto scope = dm.stats().Measure("write results");
+    ResultWriter(std::cout, args.output).Write(dm);
+    if (table) std::cout << std::endl;
+  }
+  PrintStats(dm.stats(), args.stats);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "../include/mappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructor for MappedFile. Maps the whole file read-only; on
+ *        failure is_open() returns false
+ * @param path Path to the file
+ */
+MappedFile::MappedFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return;
+  }
+  size_ = static_cast<size_t>(info.st_size);
+  if (size_ > 0) {
+    void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      size_ = 0;
+      return;
+    }
+    ::madvise(mapping, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(mapping);
+  }
+  ::close(fd);
+  open_ = true;
+}
+
+/**
+ * @brief Destructor for MappedFile. Unmaps the file
+ */
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<char *>(data_), size_);
+  }
+}
@@ -0,0 +1,255 @@
+#include "../include/nearDuplicates.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+#include "../include/stringTable.h"
+
+namespace {
+
+/**
+ * @brief Mix a 64-bit value into a well-distributed hash (splitmix64)
+ */
+uint64_t Mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Rows per LSH band for a threshold: the most rows whose banding
+ *        S-curve, (1 / bands)^(1 / rows), rises a margin below the threshold,
+ *        so pairs at the threshold are nearly always candidates
+ * @param hashes MinHash values per document
+ * @param threshold Jaccard threshold
+ * @return Rows per band, a divisor of hashes
+ */
+size_t BandRows(size_t hashes, double threshold) {
+  size_t best = 1;
+  for (size_t rows = 1; rows <= hashes; ++rows) {
+    if (hashes % rows != 0) continue;
+    double bands = static_cast<double>(hashes / rows);
+    if (std::pow(1.0 / bands, 1.0 / static_cast<double>(rows)) <=
+        0.9 * threshold) {
+      best = rows;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief MinHash signature of a document over its shingles: runs of
+ *        `shingle` consecutive normalized terms, skipping removed stop
+ *        words. A document shorter than a shingle is one shingle
+ * @param doc Normalized document
+ * @param options Shingle length, number of hashes and seed
+ * @param signature Output, options.hashes minimum hash values
+ * @return Whether the document has any term
+ */
+bool Sign(const Document &doc, const DeduplicationOptions &options,
+          uint32_t *signature) {
+  std::vector<uint64_t> termHashes;
+  termHashes.reserve(doc.terms().size());
+  for (std::string_view term : doc.terms()) {
+    termHashes.push_back(HashString(term));
+  }
+  std::vector<uint64_t> window;
+  for (uint32_t token : doc.tokens()) {
+    if (token != Document::kBlankToken) window.push_back(termHashes[token]);
+  }
+  if (window.empty()) return false;
+
+  std::vector<uint64_t> seeds(options.hashes);
+  for (size_t i = 0; i < seeds.size(); ++i) {
+    seeds[i] = Mix(options.seed + i);
+  }
+  std::fill(signature, signature + options.hashes, UINT32_MAX);
+  size_t length = std::min(options.shingle, window.size());
+  for (size_t start = 0; start + length <= window.size(); ++start) {
+    uint64_t shingle = 0;
+    for (size_t i = start; i < start + length; ++i) {
+      shingle = Mix(shingle ^ window[i]);
+    }
+    for (size_t i = 0; i < options.hashes; ++i) {
+      uint64_t value = (shingle ^ seeds[i]) * 0xff51afd7ed558ccdULL;
+      auto hash = static_cast<uint32_t>(value >> 32);
+      signature[i] = std::min(signature[i], hash);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Union-find over documents, each root being the smallest index of
+ *        its set
+ */
+class DisjointSets {
+ public:
+  explicit DisjointSets(size_t n) : parent_(n) {
+    std::iota(parent_.begin(), parent_.end(), 0u);
+  }
+  uint32_t Find(uint32_t x) {
+    while (parent_[x] != x) {
+      parent_[x] = parent_[parent_[x]];
+      x = parent_[x];
+    }
+    return x;
+  }
+  void Unite(uint32_t a, uint32_t b) {
+    a = Find(a);
+    b = Find(b);
+    if (a != b) parent_[std::max(a, b)] = std::min(a, b);
+  }
+
+ private:
+  std::vector<uint32_t> parent_;
+};
+
+}  // namespace
+
+/**
+ * @brief Number of documents that are near duplicates of an earlier one
+ */
+size_t DuplicateClusters::Duplicates() const {
+  size_t duplicates = 0;
+  for (size_t d = 0; d < representative.size(); ++d) {
+    duplicates += representative[d] != d;
+  }
+  return duplicates;
+}
+
+/**
+ * @brief Number of clusters with more than one document
+ */
+size_t DuplicateClusters::Clusters() const {
+  std::vector<bool> shared(representative.size(), false);
+  size_t clusters = 0;
+  for (size_t d = 0; d < representative.size(); ++d) {
+    if (representative[d] == d || shared[representative[d]]) continue;
+    shared[representative[d]] = true;
+    ++clusters;
+  }
+  return clusters;
+}
+
+/**
+ * @brief Print the clusters with more than one document: every member with
+ *        its estimated Jaccard similarity to the representative, listed
+ *        first. Documents in no cluster are left out
+ * @param os Output stream
+ */
+void DuplicateClusters::Print(std::ostream &os) const {
+  os << "\n================================ NEAR-DUPLICATES "
+        "===============================\n\n";
+  os << "Clusters: " << Clusters() << ", near duplicates: " << Duplicates()
+     << (collapsed ? " (collapsed into their representative)" : "")
+     << "\n\n";
+  if (Duplicates() == 0) return;
+  std::vector<std::vector<uint32_t>> members(representative.size());
+  for (size_t d = 0; d < representative.size(); ++d) {
+    members[representative[d]].push_back(static_cast<uint32_t>(d));
+  }
+  os << std::left << std::setw(10) << "Cluster" << std::setw(60)
+     << "Document" << std::right << std::setw(10) << "Jaccard" << "\n"
+     << std::string(80, '-') << "\n";
+  size_t cluster = 0;
+  for (const std::vector<uint32_t> &group : members) {
+    if (group.size() < 2) continue;
+    ++cluster;
+    for (uint32_t d : group) {
+      os << std::left << std::setw(10) << cluster << std::setw(60) << names[d]
+         << std::right << std::fixed << std::setprecision(4) << std::setw(10)
+         << similarity[d] << "\n";
+    }
+  }
+  os << std::flush;
+}
+
+/**
+ * @brief Cluster near-duplicate documents. Every document gets a MinHash
+ *        signature over its shingles; the signatures are split in bands and
+ *        documents with an identical band become candidates, so only pairs
+ *        likely to be above the threshold are compared. Candidates whose
+ *        estimated Jaccard similarity reaches the threshold are merged, and
+ *        clusters are the connected components. Signatures and bands are
+ *        computed in parallel
+ * @param documents Normalized documents
+ * @param options Threshold, shingle length, hashes, rows per band and seed
+ * @param pool Worker threads
+ * @return Cluster of every document
+ */
+DuplicateClusters FindNearDuplicates(const std::vector<Document> &documents,
+                                     const DeduplicationOptions &options,
+                                     ThreadPool &pool) {
+  size_t n = documents.size();
+  size_t hashes = std::max<size_t>(options.hashes, 1);
+  DeduplicationOptions settings = options;
+  settings.hashes = hashes;
+  settings.shingle = std::max<size_t>(options.shingle, 1);
+  size_t rows = options.rows != 0 && hashes % options.rows == 0
+                    ? options.rows
+                    : BandRows(hashes, options.threshold);
+  size_t bands = hashes / rows;
+
+  std::vector<uint32_t> signatures(n * hashes);
+  std::vector<char> hasTerms(n);
+  pool.ParallelFor(n, [&](size_t d, size_t) {
+    hasTerms[d] = Sign(documents[d], settings, &signatures[d * hashes]);
+  });
+
+  // Documents sorted by the hash of each band, so equal bands are adjacent.
+  std::vector<std::vector<std::pair<uint64_t, uint32_t>>> buckets(bands);
+  pool.ParallelFor(bands, [&](size_t b, size_t) {
+    std::vector<std::pair<uint64_t, uint32_t>> &bucket = buckets[b];
+    for (uint32_t d = 0; d < n; ++d) {
+      if (!hasTerms[d]) continue;
+      uint64_t key = b;
+      const uint32_t *band = &signatures[d * hashes + b * rows];
+      for (size_t r = 0; r < rows; ++r) key = Mix(key ^ band[r]);
+      bucket.emplace_back(key, d);
+    }
+    std::sort(bucket.begin(), bucket.end());
+  });
+
+  auto jaccard = [&](uint32_t a, uint32_t b) {
+    const uint32_t *x = &signatures[a * hashes];
+    const uint32_t *y = &signatures[b * hashes];
+    size_t equal = 0;
+    for (size_t i = 0; i < hashes; ++i) equal += x[i] == y[i];
+    return static_cast<double>(equal) / hashes;
+  };
+  DisjointSets sets(n);
+  for (const auto &bucket : buckets) {
+    for (size_t first = 0; first < bucket.size();) {
+      size_t last = first + 1;
+      uint64_t key = bucket[first].first;
+      while (last < bucket.size() && bucket[last].first == key) ++last;
+      for (size_t i = first + 1; i < last; ++i) {
+        for (size_t j = first; j < i; ++j) {
+          uint32_t a = bucket[j].second;
+          uint32_t b = bucket[i].second;
+          if (sets.Find(a) == sets.Find(b)) break;
+          if (jaccard(a, b) >= options.threshold) {
+            sets.Unite(a, b);
+            break;
+          }
+        }
+      }
+      first = last;
+    }
+  }
+
+  DuplicateClusters clusters;
+  clusters.representative.resize(n);
+  clusters.similarity.resize(n);
+  for (uint32_t d = 0; d < n; ++d) {
+    clusters.names.push_back(documents[d].documentName());
+    uint32_t root = sets.Find(d);
+    clusters.representative[d] = root;
+    clusters.similarity[d] = root == d ? 1.0 : jaccard(d, root);
+  }
+  return clusters;
+}
@@ -0,0 +1,191 @@
+#include "../include/normalizer.h"
+
+#include <cctype>
+
+namespace {
+
+/**
+ * @brief Make the token writable: copy it into the buffer unless an earlier
+ *        stage already left it there
+ * @param token Token, repointed to the buffer and no longer tagged
+ * @param buffer Scratch buffer
+ * @return The buffer, holding the token
+ */
+std::string &Writable(Token &token, std::string &buffer) {
+  std::string_view text = token.text;
+  const char *begin = buffer.data();
+  if (text.data() >= begin && text.data() <= begin + buffer.size()) {
+    size_t offset = static_cast<size_t>(text.data() - begin);
+    buffer.erase(0, offset);
+    buffer.resize(text.size());
+  } else {
+    buffer.assign(text.data(), text.size());
+  }
+  token.text = buffer;
+  token.lemma = Token::kNoLemma;
+  return buffer;
+}
+
+bool EndsWith(std::string_view token, std::string_view suffix) {
+  return token.size() >= suffix.size() &&
+         token.compare(token.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+/**
+ * @brief Remove every non-alphanumeric character of the token
+ * @return kDrop if nothing is left, kKeep otherwise
+ */
+NormalizationStage::Result CleanStage::Apply(Token &token,
+                                             std::string &buffer) const {
+  size_t clean = 0;
+  while (clean < token.text.size() &&
+         std::isalnum(static_cast<unsigned char>(token.text[clean]))) {
+    ++clean;
+  }
+  if (clean < token.text.size()) {
+    std::string &text = Writable(token, buffer);
+    size_t kept = clean;
+    for (size_t i = clean; i < text.size(); ++i) {
+      if (std::isalnum(static_cast<unsigned char>(text[i]))) {
+        text[kept++] = text[i];
+      }
+    }
+    text.resize(kept);
+    token.text = text;
+  }
+  return token.text.empty() ? Result::kDrop : Result::kKeep;
+}
+
+/**
+ * @brief Convert the token to lowercase
+ * @return Always kKeep
+ */
+NormalizationStage::Result LowercaseStage::Apply(Token &token,
+                                                 std::string &buffer) const {
+  for (size_t i = 0; i < token.text.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(token.text[i]);
+    if (std::tolower(c) != c) {
+      std::string &text = Writable(token, buffer);
+      for (size_t j = i; j < text.size(); ++j) {
+        text[j] = static_cast<char>(
+            std::tolower(static_cast<unsigned char>(text[j])));
+      }
+      token.text = text;
+      break;
+    }
+  }
+  return Result::kKeep;
+}
+
+/**
+ * @brief Replace the token by its lemma. The token then views the lemma
+ *        stored in the table and carries its lemma ID
+ * @return kBlank for an empty lemma, kKeep otherwise
+ */
+NormalizationStage::Result LemmatizeStage::Apply(Token &token,
+                                                 std::string &) const {
+  uint32_t lemma = lemmas_.Find(token.text);
+  if (lemma != LemmaTable::kNotFound) {
+    token.text = lemmas_.Lemma(lemma);
+    token.lemma = lemma;
+  }
+  return token.text.empty() ? Result::kBlank : Result::kKeep;
+}
+
+/**
+ * @brief Constructor for StopWordStage
+ * @param stopWords Stop-word table, must outlive the stage
+ * @param lemmas Lemma table whose lemmas are classified up front, or nullptr
+ */
+StopWordStage::StopWordStage(const StopWordTable &stopWords,
+                             const LemmaTable *lemmas)
+    : stopWords_(stopWords) {
+  if (lemmas == nullptr) return;
+  stopLemmas_.resize(lemmas->lemmaCount());
+  for (uint32_t id = 0; id < lemmas->lemmaCount(); ++id) {
+    stopLemmas_[id] = stopWords_.Contains(lemmas->Lemma(id));
+  }
+}
+
+/**
+ * @brief Blank the token if it is a stop word
+ * @return kBlank for stop words, kKeep otherwise
+ */
+NormalizationStage::Result StopWordStage::Apply(Token &token,
+                                                std::string &) const {
+  bool stop = token.lemma < stopLemmas_.size()
+                  ? stopLemmas_[token.lemma]
+                  : stopWords_.Contains(token.text);
+  return stop ? Result::kBlank : Result::kKeep;
+}
+
+/**
+ * @brief Apply the S-stemmer rules: "ies" -> "y" (not after e or a),
+ *        "es" -> "e" (not after a, e or o), "s" -> "" (not after u or s)
+ * @return Always kKeep
+ */
+NormalizationStage::Result StemStage::Apply(Token &token,
+                                            std::string &buffer) const {
+  std::string_view text = token.text;
+  if (EndsWith(text, "ies") && !EndsWith(text, "eies") &&
+      !EndsWith(text, "aies")) {
+    std::string &stemmed = Writable(token, buffer);
+    stemmed.replace(stemmed.size() - 3, 3, "y");
+    token.text = stemmed;
+  } else if ((EndsWith(text, "es") && !EndsWith(text, "aes") &&
+              !EndsWith(text, "ees") && !EndsWith(text, "oes")) ||
+             (EndsWith(text, "s") && !EndsWith(text, "us") &&
+              !EndsWith(text, "ss"))) {
+    token.text.remove_suffix(1);
+    token.lemma = Token::kNoLemma;
+  }
+  return token.text.empty() ? Result::kBlank : Result::kKeep;
+}
+
+/**
+ * @brief Build the default pipeline, in the historical order: clean,
+ *        lowercase, lemmatize, stop-word filter and optionally stemming
+ * @param lemmas Lemma table, frozen, must outlive the normalizer
+ * @param stopWords Stop-word table, must outlive the normalizer
+ * @param stem Whether to append the stemming stage
+ * @return The pipeline
+ */
+Normalizer Normalizer::Default(const LemmaTable &lemmas,
+                               const StopWordTable &stopWords, bool stem) {
+  Normalizer normalizer;
+  normalizer.AddStage(std::make_unique<CleanStage>())
+      .AddStage(std::make_unique<LowercaseStage>())
+      .AddStage(std::make_unique<LemmatizeStage>(lemmas))
+      .AddStage(std::make_unique<StopWordStage>(stopWords, &lemmas));
+  if (stem) normalizer.AddStage(std::make_unique<StemStage>());
+  return normalizer;
+}
+
+/**
+ * @brief Append a stage to the pipeline
+ * @param stage Stage to append
+ * @return Reference to the pipeline, for chaining
+ */
+Normalizer &Normalizer::AddStage(std::unique_ptr<NormalizationStage> stage) {
+  stages_.push_back(std::move(stage));
+  return *this;
+}
+
+/**
+ * @brief Run a token through every stage, stopping at the first stage that
+ *        drops or blanks it
+ * @param token Token to normalize; on kKeep its text views the normalized
+ *        term, which may live in buffer
+ * @param buffer Scratch buffer, reusable across tokens
+ * @return Outcome of the pipeline
+ */
+NormalizationStage::Result Normalizer::Normalize(Token &token,
+                                                 std::string &buffer) const {
+  for (const auto &stage : stages_) {
+    NormalizationStage::Result result = stage->Apply(token, buffer);
+    if (result != NormalizationStage::Result::kKeep) return result;
+  }
+  return NormalizationStage::Result::kKeep;
+}
@@ -0,0 +1,188 @@
+#include "../include/pipelineStats.h"
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+
+#include "../include/resultWriter.h"
+
+/**
+ * @brief Constructor for Scope. Reads the clocks and the heap at the start
+ *        of the stage
+ * @param stats Statistics the stage is recorded into
+ * @param name Stage name
+ */
+PipelineStats::Scope::Scope(PipelineStats &stats, std::string_view name)
+    : stats_(stats),
+      name_(name),
+      wallStart_(std::chrono::steady_clock::now()),
+      cpuStart_(CpuSeconds()),
+      heapStart_(HeapBytes()) {}
+
+/**
+ * @brief Destructor for Scope. Records the stage
+ */
+PipelineStats::Scope::~Scope() {
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - wallStart_)
+                    .count();
+  stats_.Record(name_, wall, CpuSeconds() - cpuStart_,
+                HeapBytes() - heapStart_);
+}
+
+/**
+ * @brief Add one run of a stage to its totals
+ * @param name Stage name
+ * @param wallSeconds Elapsed time
+ * @param cpuSeconds CPU time of the process
+ * @param heapBytes Change in heap bytes in use
+ */
+void PipelineStats::Record(std::string_view name, double wallSeconds,
+                           double cpuSeconds, int64_t heapBytes) {
+  auto stage = std::find_if(stages_.begin(), stages_.end(),
+                            [&](const Stage &s) { return s.name == name; });
+  if (stage == stages_.end()) {
+    stages_.push_back({std::string(name)});
+    stage = stages_.end() - 1;
+  }
+  ++stage->calls;
+  stage->wallSeconds += wallSeconds;
+  stage->cpuSeconds += cpuSeconds;
+  stage->heapBytes += heapBytes;
+}
+
+/**
+ * @brief Set a counter, adding it if it does not exist
+ * @param name Counter name
+ * @param value New value
+ */
+void PipelineStats::SetCounter(std::string_view name, uint64_t value) {
+  for (auto &counter : counters_) {
+    if (counter.first == name) {
+      counter.second = value;
+      return;
+    }
+  }
+  counters_.emplace_back(std::string(name), value);
+}
+
+/**
+ * @brief Getter for a counter
+ * @param name Counter name
+ * @return Its value, 0 if it was never set
+ */
+uint64_t PipelineStats::counter(std::string_view name) const {
+  for (const auto &counter : counters_) {
+    if (counter.first == name) return counter.second;
+  }
+  return 0;
+}
+
+/**
+ * @brief Forget every stage and counter
+ */
+void PipelineStats::Reset() {
+  stages_.clear();
+  counters_.clear();
+}
+
+/**
+ * @brief Print the stages and counters as tables
+ * @param os Output stream
+ */
+void PipelineStats::Print(std::ostream &os) const {
+  os << "\n================================== STATISTICS "
+        "==================================\n\n";
+  os << std::left << std::setw(36) << "Stage" << std::right << std::setw(8)
+     << "Calls" << std::setw(12) << "Wall ms" << std::setw(12) << "CPU ms"
+     << std::setw(12) << "Heap MB" << "\n";
+  os << std::string(80, '-') << "\n";
+  Stage total{"total"};
+  for (const Stage &stage : stages_) {
+    os << std::left << std::setw(36) << stage.name << std::right
+       << std::setw(8) << stage.calls << std::fixed << std::setprecision(3)
+       << std::setw(12) << stage.wallSeconds * 1e3 << std::setw(12)
+       << stage.cpuSeconds * 1e3 << std::setw(12) << stage.heapBytes / 1e6
+       << "\n";
+    total.wallSeconds += stage.wallSeconds;
+    total.cpuSeconds += stage.cpuSeconds;
+    total.heapBytes += stage.heapBytes;
+  }
+  os << std::string(80, '-') << "\n";
+  os << std::left << std::setw(44) << total.name << std::right << std::fixed
+     << std::setprecision(3) << std::setw(12) << total.wallSeconds * 1e3
+     << std::setw(12) << total.cpuSeconds * 1e3 << std::setw(12)
+     << total.heapBytes / 1e6 << "\n\n";
+  for (const auto &counter : counters_) {
+    os << std::left << std::setw(36) << counter.first << std::right
+       << std::setw(20) << counter.second << "\n";
+  }
+  os << std::left << std::setw(36) << "peakResidentBytes" << std::right
+     << std::setw(20) << PeakResidentBytes() << std::endl;
+}
+
+/**
+ * @brief Print the stages and counters as one JSON object:
+ *        {"stages":[{"name":...,"calls":...,"wallSeconds":...,
+ *        "cpuSeconds":...,"heapBytes":...}],"counters":{"documents":...}}
+ * @param os Output stream
+ */
+void PipelineStats::PrintJson(std::ostream &os) const {
+  std::string json = "{\"stages\":[";
+  char number[32];
+  for (size_t s = 0; s < stages_.size(); ++s) {
+    const Stage &stage = stages_[s];
+    json += s == 0 ? "{\"name\":" : ",{\"name\":";
+    AppendJsonString(stage.name, json);
+    json += ",\"calls\":" + std::to_string(stage.calls);
+    std::snprintf(number, sizeof(number), "%.6f", stage.wallSeconds);
+    json += std::string(",\"wallSeconds\":") + number;
+    std::snprintf(number, sizeof(number), "%.6f", stage.cpuSeconds);
+    json += std::string(",\"cpuSeconds\":") + number;
+    json += ",\"heapBytes\":" + std::to_string(stage.heapBytes) + "}";
+  }
+  json += "],\"counters\":{";
+  for (const auto &counter : counters_) {
+    AppendJsonString(counter.first, json);
+    json += ":" + std::to_string(counter.second) + ",";
+  }
+  json += "\"peakResidentBytes\":" + std::to_string(PeakResidentBytes());
+  json += "}}";
+  os << json << std::endl;
+}
+
+/**
+ * @brief CPU time used so far by the process, every thread included
+ */
+double PipelineStats::CpuSeconds() {
+  timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) + now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Bytes currently in use by malloc, including blocks it maps
+ *        directly; 0 where the C library cannot report it
+ */
+int64_t PipelineStats::HeapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  return static_cast<int64_t>(info.uordblks + info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Largest resident set size the process has had
+ */
+uint64_t PipelineStats::PeakResidentBytes() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes on Linux.
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
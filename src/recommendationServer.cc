@@ -0,0 +1,520 @@
+#include "../include/recommendationServer.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+#include "../include/resultWriter.h"
+
+namespace {
+
+/**
+ * @brief Value of a field of a request. Only strings and numbers are used;
+ *        raw keeps the field text as written, to echo the request ID
+ */
+struct JsonValue {
+  enum class Kind { kString, kNumber, kLiteral };
+  Kind kind;
+  std::string text;
+  double number = 0.0;
+  std::string_view raw;
+};
+
+/**
+ * @brief Minimal parser for the flat JSON objects of the protocol
+ */
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view input) : input_(input) {}
+
+  /**
+   * @brief Parse a whole line holding one object with scalar values
+   * @param fields Output, (name, value) pairs in order
+   * @return Empty string on success, otherwise what is wrong
+   */
+  std::string ParseObject(
+      std::vector<std::pair<std::string, JsonValue>> &fields) {
+    SkipSpace();
+    if (!Consume('{')) return "expected a JSON object";
+    SkipSpace();
+    if (Consume('}')) return Finish();
+    while (true) {
+      std::string name;
+      SkipSpace();
+      if (!ParseString(name)) return "expected a field name";
+      SkipSpace();
+      if (!Consume(':')) return "expected ':' after a field name";
+      SkipSpace();
+      JsonValue value;
+      std::string error = ParseValue(value);
+      if (!error.empty()) return error;
+      fields.emplace_back(std::move(name), std::move(value));
+      SkipSpace();
+      if (Consume('}')) return Finish();
+      if (!Consume(',')) return "expected ',' or '}'";
+    }
+  }
+
+ private:
+  std::string_view input_;
+  size_t pos_ = 0;
+
+  void SkipSpace() {
+    while (pos_ < input_.size() &&
+           (input_[pos_] == ' ' || input_[pos_] == '\t' ||
+            input_[pos_] == '\r' || input_[pos_] == '\n')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(char c) {
+    if (pos_ < input_.size() && input_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  std::string Finish() {
+    SkipSpace();
+    return pos_ == input_.size() ? "" : "unexpected text after the object";
+  }
+
+  std::string ParseValue(JsonValue &value) {
+    size_t start = pos_;
+    if (pos_ < input_.size() && input_[pos_] == '"') {
+      if (!ParseString(value.text)) return "malformed string";
+      value.kind = JsonValue::Kind::kString;
+    } else if (pos_ < input_.size() &&
+               (input_[pos_] == '-' ||
+                (input_[pos_] >= '0' && input_[pos_] <= '9'))) {
+      size_t end = pos_;
+      while (end < input_.size() &&
+             std::strchr("+-.eE0123456789", input_[end]) != nullptr) {
+        ++end;
+      }
+      std::string number(input_.substr(pos_, end - pos_));
+      char *parsed = nullptr;
+      value.number = std::strtod(number.c_str(), &parsed);
+      if (*parsed != '\0') return "malformed number";
+      value.kind = JsonValue::Kind::kNumber;
+      pos_ = end;
+    } else {
+      for (std::string_view literal : {"true", "false", "null"}) {
+        if (input_.substr(pos_, literal.size()) == literal) {
+          pos_ += literal.size();
+          value.kind = JsonValue::Kind::kLiteral;
+          value.raw = input_.substr(start, pos_ - start);
+          return "";
+        }
+      }
+      return "unsupported value (only strings, numbers and literals)";
+    }
+    value.raw = input_.substr(start, pos_ - start);
+    return "";
+  }
+
+  /**
+   * @brief Parse a string, decoding escapes (\uXXXX to UTF-8)
+   */
+  bool ParseString(std::string &out) {
+    if (!Consume('"')) return false;
+    while (pos_ < input_.size()) {
+      char c = input_[pos_++];
+      if (c == '"') return true;
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ >= input_.size()) return false;
+      char escape = input_[pos_++];
+      switch (escape) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t code = 0;
+          if (!ParseHex(code)) return false;
+          if (code >= 0xD800 && code < 0xDC00) {
+            uint32_t low = 0;
+            if (!Consume('\\') || !Consume('u') || !ParseHex(low) ||
+                low < 0xDC00 || low >= 0xE000) {
+              return false;
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          AppendUtf8(code, out);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  bool ParseHex(uint32_t &code) {
+    if (pos_ + 4 > input_.size()) return false;
+    for (int i = 0; i < 4; ++i) {
+      char c = input_[pos_++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= static_cast<uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        code |= static_cast<uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        code |= static_cast<uint32_t>(c - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code, std::string &out) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+};
+
+/**
+ * @brief Error response to a request
+ */
+std::string ErrorResponse(std::string_view id, std::string_view message) {
+  std::string response = "{\"id\":";
+  response += id;
+  response += ",\"error\":";
+  AppendJsonString(message, response);
+  response += '}';
+  return response;
+}
+
+/**
+ * @brief Write as much of a buffer as a file descriptor accepts: all of it
+ *        if the descriptor blocks, until it would block otherwise. What was
+ *        written is removed from the buffer
+ * @param fd File descriptor
+ * @param data Buffer to write
+ * @return Whether the descriptor is still writable (no error other than
+ *         would-block)
+ */
+bool WriteAvailable(int fd, std::string &data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t written = ::write(fd, data.data() + done, data.size() - done);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return false;
+    }
+    done += static_cast<size_t>(written);
+  }
+  data.erase(0, done);
+  return true;
+}
+
+/**
+ * @brief Make a file descriptor non-blocking
+ * @return Whether it succeeded
+ */
+bool SetNonBlocking(int fd) {
+  int flags = ::fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+}  // namespace
+
+/**
+ * @brief Constructor for RecommendationServer. Weights the corpus if needed
+ *        and indexes it once; the corpus must not change while serving
+ * @param manager Corpus to recommend from
+ * @param k Default number of recommendations per request
+ * @param threshold Default similarity threshold
+ * @param threads Number of worker threads answering a batch (0 means one per
+ *        hardware thread)
+ */
+RecommendationServer::RecommendationServer(DocumentManager &manager, size_t k,
+                                           double threshold, size_t threads)
+    : manager_(manager),
+      engine_(manager.BuildEngine()),
+      k_(k),
+      threshold_(threshold),
+      pool_(threads),
+      buffers_(pool_.size()) {}
+
+/**
+ * @brief Answer one request line
+ * @param request JSON request
+ * @param buffer Scratch buffers of the calling worker
+ * @return JSON response, without the trailing newline
+ */
+std::string RecommendationServer::Answer(
+    std::string_view request, SimilarityEngine::RowBuffer &buffer) const {
+  std::vector<std::pair<std::string, JsonValue>> fields;
+  std::string error = JsonParser(request).ParseObject(fields);
+  if (!error.empty()) return ErrorResponse("null", error);
+
+  std::string_view id = "null";
+  const JsonValue *text = nullptr;
+  const JsonValue *document = nullptr;
+  size_t k = k_;
+  double threshold = threshold_;
+  for (const auto &field : fields) {
+    const JsonValue &value = field.second;
+    bool number = value.kind == JsonValue::Kind::kNumber;
+    if (field.first == "id") {
+      id = value.raw;
+    } else if (field.first == "text" &&
+               value.kind == JsonValue::Kind::kString) {
+      text = &value;
+    } else if (field.first == "document" && number) {
+      document = &value;
+    } else if (field.first == "k" && number && value.number >= 0 &&
+               value.number == static_cast<double>(
+                                   static_cast<size_t>(value.number))) {
+      k = static_cast<size_t>(value.number);
+    } else if (field.first == "threshold" && number) {
+      threshold = value.number;
+    } else {
+      return ErrorResponse(id, "invalid field '" + field.first + "'");
+    }
+  }
+  if ((text == nullptr) == (document == nullptr)) {
+    return ErrorResponse(id, "exactly one of 'text' and 'document' is needed");
+  }
+
+  std::vector<Neighbour> neighbours;
+  if (text != nullptr) {
+    Document query("query", text->text, manager_.context());
+    query.Normalize();
+    neighbours = engine_.TopK(query.QueryVector(), k, threshold, buffer);
+  } else {
+    double index = document->number;
+    if (!(index >= 1 && index <= static_cast<double>(engine_.size())) ||
+        index != static_cast<double>(static_cast<size_t>(index))) {
+      return ErrorResponse(id, "no such document");
+    }
+    neighbours = engine_.TopK(static_cast<size_t>(index) - 1, k, threshold,
+                              buffer);
+  }
+
+  std::string response = "{\"id\":";
+  response += id;
+  response += ",\"results\":[";
+  for (size_t rank = 0; rank < neighbours.size(); ++rank) {
+    const Neighbour &neighbour = neighbours[rank];
+    if (rank > 0) response += ',';
+    response += "{\"document\":" + std::to_string(neighbour.document + 1) +
+                ",\"name\":";
+    AppendJsonString(manager_.documents()[neighbour.document].documentName(),
+                     response);
+    char similarity[32];
+    std::snprintf(similarity, sizeof(similarity), "%.6f",
+                  neighbour.similarity);
+    response += ",\"similarity\":";
+    response += similarity;
+    response += '}';
+  }
+  response += "]}";
+  return response;
+}
+
+/**
+ * @brief Answer requests read from standard input on standard output, until
+ *        the input ends
+ */
+void RecommendationServer::ServeStdin() {
+  std::vector<Client> clients(1);
+  clients[0].input = STDIN_FILENO;
+  clients[0].output = STDOUT_FILENO;
+  Serve(-1, clients);
+}
+
+/**
+ * @brief Answer requests from any number of clients connected to a Unix
+ *        domain socket. Runs until the process is stopped
+ * @param path Path of the socket; an existing file there is replaced
+ */
+void RecommendationServer::ServeSocket(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Error: socket path too long: " << path << std::endl;
+    exit(1);
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ::unlink(path.c_str());
+  if (listener < 0 ||
+      ::bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+      ::listen(listener, SOMAXCONN) != 0) {
+    std::cerr << "Error: cannot listen on socket " << path << ": "
+              << std::strerror(errno) << std::endl;
+    exit(1);
+  }
+  std::vector<Client> clients;
+  Serve(listener, clients);
+  ::close(listener);
+}
+
+/**
+ * @brief Event loop: wait until some client has data or can take more of
+ *        its responses, read everything available, answer all complete
+ *        lines as one batch and write what each client accepts. Standard
+ *        output blocks, so only socket clients, whose input and output are
+ *        the same descriptor, keep unsent responses
+ * @param listener Listening socket, or -1 to serve only the given clients
+ * @param clients Connected clients; with no listener the loop ends when
+ *        they are all closed
+ */
+void RecommendationServer::Serve(int listener, std::vector<Client> &clients) {
+  // A client closing its end must not kill the server.
+  std::signal(SIGPIPE, SIG_IGN);
+  std::vector<char> chunk(64 * 1024);
+  while (listener >= 0 || !clients.empty()) {
+    std::vector<pollfd> fds;
+    for (const Client &client : clients) {
+      short events = 0;
+      if (!client.closed && client.unsent.size() < kMaxUnsentBytes) {
+        events |= POLLIN;
+      }
+      if (!client.unsent.empty()) events |= POLLOUT;
+      fds.push_back({client.input, events, 0});
+    }
+    if (listener >= 0) fds.push_back({listener, POLLIN, 0});
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "Error: poll failed: " << std::strerror(errno) << std::endl;
+      exit(1);
+    }
+
+    std::vector<Request> requests;
+    for (size_t c = 0; c < clients.size(); ++c) {
+      Client &client = clients[c];
+      if (fds[c].revents == 0) continue;
+      if (!client.unsent.empty() &&
+          !WriteAvailable(client.output, client.unsent)) {
+        client.closed = true;
+        client.unsent.clear();
+      }
+      if (client.closed || !(fds[c].events & POLLIN)) continue;
+      ssize_t bytes = ::read(client.input, chunk.data(), chunk.size());
+      if (bytes < 0 && (errno == EINTR || errno == EAGAIN ||
+                        errno == EWOULDBLOCK)) {
+        continue;
+      }
+      if (bytes <= 0) {
+        client.closed = true;
+        // A last request without a newline is still answered.
+        if (!client.pending.empty() && !client.discarding) {
+          requests.push_back({c, client.pending});
+        }
+        client.pending.clear();
+        continue;
+      }
+      client.pending.append(chunk.data(), static_cast<size_t>(bytes));
+      size_t start = 0;
+      size_t end;
+      while ((end = client.pending.find('\n', start)) != std::string::npos) {
+        std::string_view line(client.pending.data() + start, end - start);
+        if (client.discarding) {
+          // The end of an overlong line, already answered.
+          client.discarding = false;
+        } else if (line.size() > kMaxRequestBytes) {
+          requests.push_back({c, "", true});
+        } else if (line.find_first_not_of(" \t\r") != std::string_view::npos) {
+          requests.push_back({c, std::string(line)});
+        }
+        start = end + 1;
+      }
+      client.pending.erase(0, start);
+      // Without a newline in sight, stop buffering: answer now and drop
+      // the line as it keeps arriving.
+      if (client.pending.size() > kMaxRequestBytes) {
+        if (!client.discarding) requests.push_back({c, "", true});
+        client.discarding = true;
+        client.pending.clear();
+      }
+    }
+    if (listener >= 0 && (fds.back().revents & POLLIN)) {
+      int connection = ::accept(listener, nullptr, nullptr);
+      if (connection >= 0 && SetNonBlocking(connection)) {
+        clients.push_back(Client{connection, connection, "", "", false,
+                                 false});
+      } else if (connection >= 0) {
+        ::close(connection);
+      }
+    }
+
+    AnswerBatch(clients, requests);
+    for (size_t c = clients.size(); c-- > 0;) {
+      if (!clients[c].closed || !clients[c].unsent.empty()) continue;
+      if (listener >= 0) ::close(clients[c].input);
+      clients.erase(clients.begin() + c);
+    }
+  }
+}
+
+/**
+ * @brief Answer a batch of requests in parallel and queue every response
+ *        for the client that asked, in request order, writing as much as
+ *        each client accepts now
+ * @param clients Connected clients
+ * @param requests Request lines, in arrival order per client
+ */
+void RecommendationServer::AnswerBatch(std::vector<Client> &clients,
+                                       const std::vector<Request> &requests) {
+  if (requests.empty()) return;
+  std::vector<std::string> responses(requests.size());
+  pool_.ParallelFor(requests.size(), [&](size_t i, size_t worker) {
+    if (requests[i].overlong) {
+      responses[i] = ErrorResponse(
+          "null", "request line longer than " +
+                      std::to_string(kMaxRequestBytes) + " bytes");
+    } else {
+      responses[i] = Answer(requests[i].text, buffers_[worker]);
+    }
+    responses[i] += '\n';
+  });
+
+  std::vector<std::string> output(clients.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    output[requests[i].client] += responses[i];
+  }
+  for (size_t c = 0; c < clients.size(); ++c) {
+    if (output[c].empty()) continue;
+    Client &client = clients[c];
+    client.unsent += output[c];
+    if (!WriteAvailable(client.output, client.unsent)) {
+      client.closed = true;
+      client.unsent.clear();
+    }
+  }
+}
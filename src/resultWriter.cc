@@ -0,0 +1,718 @@
+#include "../include/resultWriter.h"
+
+#include <charconv>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+constexpr char kBinaryMagic[8] = {'R', 'S', 'C', 'B', 'O', 'U', 'T', '\n'};
+constexpr uint32_t kBinaryVersion = 1;
+constexpr uint32_t kBinaryNeighbours = 1;
+constexpr uint32_t kBinaryTerms = 2;
+
+}  // namespace
+
+/**
+ * @brief Look up an output format by its command line name
+ * @param name One of table, csv, tsv, jsonl and binary
+ * @param format Output, the format named
+ * @return Whether the name is known
+ */
+bool ParseOutputFormat(std::string_view name, OutputFormat &format) {
+  if (name == "table") {
+    format = OutputFormat::kTable;
+  } else if (name == "csv") {
+    format = OutputFormat::kCsv;
+  } else if (name == "tsv") {
+    format = OutputFormat::kTsv;
+  } else if (name == "jsonl") {
+    format = OutputFormat::kJsonLines;
+  } else if (name == "binary") {
+    format = OutputFormat::kBinary;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Append a string to a JSON document, quoted and escaped
+ * @param text Text to append
+ * @param out JSON document
+ */
+void AppendJsonString(std::string_view text, std::string &out) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          static const char kHex[] = "0123456789abcdef";
+          out += "\\u00";
+          out += kHex[(c >> 4) & 0xf];
+          out += kHex[c & 0xf];
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+/**
+ * @brief Constructor for ResultWriter
+ * @param os Stream the results are written to
+ * @param options Format and filters of the output
+ */
+ResultWriter::ResultWriter(std::ostream &os, OutputOptions options)
+    : os_(os), options_(options) {
+  buffer_.reserve(kBufferSize);
+}
+
+/**
+ * @brief Destructor for ResultWriter. Writes out what is still buffered
+ */
+ResultWriter::~ResultWriter() { Flush(); }
+
+/**
+ * @brief Write the term tables (unless similaritiesOnly) and the
+ *        similarities of a corpus in the configured format
+ * @param dm Corpus, after Recommend or RecommendTopK
+ */
+void ResultWriter::Write(const DocumentManager &dm) {
+  switch (options_.format) {
+    case OutputFormat::kTable:
+      if (!options_.similaritiesOnly) WriteTermTables(dm);
+      if (!dm.neighbours().empty()) {
+        WriteNeighbours(dm);
+      } else if (!dm.sparseSimilarities().empty()) {
+        WriteSparseSimilarities(dm);
+      } else {
+        WriteSimilarityMatrix(dm);
+      }
+      break;
+    case OutputFormat::kCsv:
+    case OutputFormat::kTsv:
+      WriteDelimited(dm);
+      break;
+    case OutputFormat::kJsonLines:
+      WriteJsonLines(dm);
+      break;
+    case OutputFormat::kBinary:
+      WriteBinary(dm);
+      break;
+  }
+  Flush();
+}
+
+/**
+ * @brief Write the term table of every document in the table layout: TF,
+ *        IDF, normalized TF and first occurrence of every corpus term (or of
+ *        the document terms with nonZeroOnly), in alphabetical order
+ * @param dm Corpus
+ */
+void ResultWriter::WriteTermTables(const DocumentManager &dm) {
+  Append("\n=============================== TABLES OF TERMS "
+         "================================\n");
+  const MappableArray<double> &idf = dm.IDF();
+  const TermDictionary &dictionary = dm.allWordsInCorpus();
+  for (const Document &doc : dm.documents()) {
+    Append("\n=========================== ");
+    Append(doc.documentName());
+    Append(" ==========================\n\n");
+    AppendPadded("Term", 30, true);
+    AppendPadded("TF", 12);
+    AppendPadded("IDF", 12);
+    AppendPadded("TFIDF", 12);
+    AppendPadded("Index", 15);
+    Append('\n');
+    Append(std::string(90, '-'));
+    Append('\n');
+
+    ForEachTerm(dm, doc, [&](uint32_t id, uint32_t position) {
+      bool present = position != kAbsent;
+      AppendPadded(dictionary.Label(id, label_), 30, true);
+      AppendFixed(present ? doc.TF().values()[position] : 0.0, 12);
+      AppendFixed(idf[id], 12);
+      AppendFixed(present ? doc.TFNormalized().values()[position] : 0.0, 12);
+      if (present) {
+        std::pair<int, int> index = doc.termIndices().values()[position];
+        std::string text = std::to_string(index.first) + ", " +
+                           std::to_string(index.second);
+        AppendPadded(text, 15);
+      } else {
+        AppendPadded("N/A", 15);
+      }
+      Append('\n');
+    });
+    Append('\n');
+  }
+}
+
+/**
+ * @brief Write the cosine similarity matrix in the table layout
+ * @param dm Corpus, after Recommend
+ */
+void ResultWriter::WriteSimilarityMatrix(const DocumentManager &dm) {
+  const std::vector<std::vector<double>> &matrix = dm.similarityMatrix();
+  size_t n = matrix.size();
+  Append("\n=========================== COSINE SIMILARITY MATRIX "
+         "===========================\n\n");
+  AppendPadded(" ", 10);
+  for (size_t i = 0; i < n; ++i) {
+    AppendPadded("Doc ", 11);
+    AppendInteger(static_cast<long long>(i + 1));
+  }
+  Append('\n');
+  Append(std::string(80, '-'));
+  Append('\n');
+  for (size_t i = 0; i < n; ++i) {
+    AppendPadded("Doc ", 10);
+    AppendInteger(static_cast<long long>(i + 1));
+    Append(": ");
+    for (size_t j = 0; j < n; ++j) AppendFixed(matrix[i][j], 12);
+    Append('\n');
+  }
+}
+
+/**
+ * @brief Write the stored entries of the sparse similarity matrix in the
+ *        table layout: one block per document, with its entries in document
+ *        order
+ * @param dm Corpus, after RecommendSpGemm with a sparse result
+ */
+void ResultWriter::WriteSparseSimilarities(const DocumentManager &dm) {
+  Append("\n=========================== SPARSE SIMILARITY MATRIX "
+         "===========================\n\n");
+  for (size_t i = 0; i < dm.sparseSimilarities().rows(); ++i) {
+    AppendNeighbourBlock(i, Similarities(dm, i), [&dm](size_t document) {
+      return dm.documents()[document].documentName();
+    });
+  }
+}
+
+/**
+ * @brief Write the top-K neighbour list of every document in the table
+ *        layout
+ * @param dm Corpus, after RecommendTopK
+ */
+void ResultWriter::WriteNeighbours(const DocumentManager &dm) {
+  const std::vector<std::vector<Neighbour>> &neighbours = dm.neighbours();
+  Append("\n============================ TOP-K RECOMMENDATIONS "
+         "=============================\n\n");
+  for (size_t i = 0; i < neighbours.size(); ++i) {
+    AppendNeighbourBlock(i, neighbours[i], [&dm](size_t document) {
+      return dm.documents()[document].documentName();
+    });
+  }
+}
+
+/**
+ * @brief Start streaming top-K lists: write what precedes the first list in
+ *        the configured format (the table banner, the CSV or TSV header of
+ *        the similarities section, or the binary header without terms)
+ * @param documents Number of documents that will be written
+ * @param terms Number of terms in the corpus vocabulary
+ */
+void ResultWriter::BeginNeighbourLists(size_t documents, size_t terms) {
+  switch (options_.format) {
+    case OutputFormat::kTable:
+      Append("\n============================ TOP-K RECOMMENDATIONS "
+             "=============================\n\n");
+      break;
+    case OutputFormat::kCsv:
+      Append("document,neighbour,similarity\n");
+      break;
+    case OutputFormat::kTsv:
+      Append("document\tneighbour\tsimilarity\n");
+      break;
+    case OutputFormat::kJsonLines:
+      break;
+    case OutputFormat::kBinary:
+      Append(std::string_view(kBinaryMagic, sizeof(kBinaryMagic)));
+      AppendRaw(kBinaryVersion);
+      AppendRaw(kBinaryNeighbours);
+      AppendRaw(static_cast<uint64_t>(documents));
+      AppendRaw(static_cast<uint64_t>(terms));
+      break;
+  }
+}
+
+/**
+ * @brief Write the top-K list of one document, after BeginNeighbourLists,
+ *        as Write would for a manager without term tables
+ * @param document Index of the document, from 0
+ * @param names Names of every document of the corpus
+ * @param neighbours Its neighbours, by decreasing similarity
+ */
+void ResultWriter::WriteNeighbourList(
+    size_t document, const std::vector<std::string> &names,
+    const std::vector<Neighbour> &neighbours) {
+  switch (options_.format) {
+    case OutputFormat::kTable:
+      AppendNeighbourBlock(document, neighbours,
+                           [&names](size_t d) { return names[d]; });
+      break;
+    case OutputFormat::kCsv:
+    case OutputFormat::kTsv: {
+      char separator = options_.format == OutputFormat::kCsv ? ',' : '\t';
+      for (const Neighbour &neighbour : neighbours) {
+        AppendInteger(static_cast<long long>(document + 1));
+        Append(separator);
+        AppendInteger(static_cast<long long>(neighbour.document + 1));
+        Append(separator);
+        AppendFixed(neighbour.similarity);
+        Append('\n');
+      }
+      break;
+    }
+    case OutputFormat::kJsonLines: {
+      std::string name;
+      AppendJsonString(names[document], name);
+      Append("{\"document\":");
+      AppendInteger(static_cast<long long>(document + 1));
+      Append(",\"name\":");
+      Append(name);
+      Append(",\"similarities\":[");
+      bool first = true;
+      for (const Neighbour &neighbour : neighbours) {
+        Append(first ? "{\"document\":" : ",{\"document\":");
+        first = false;
+        AppendInteger(static_cast<long long>(neighbour.document + 1));
+        Append(",\"similarity\":");
+        AppendFixed(neighbour.similarity);
+        Append('}');
+      }
+      Append("]}\n");
+      break;
+    }
+    case OutputFormat::kBinary:
+      AppendRaw(static_cast<uint32_t>(names[document].size()));
+      Append(names[document]);
+      AppendRaw(static_cast<uint32_t>(neighbours.size()));
+      for (const Neighbour &neighbour : neighbours) {
+        AppendRaw(neighbour.document);
+        AppendRaw(neighbour.similarity);
+      }
+      break;
+  }
+}
+
+/**
+ * @brief Append the table-layout block of one top-K list: the document and
+ *        its ranked neighbours with their similarities and names
+ * @param document Index of the document
+ * @param neighbours Its neighbours
+ * @param name Returns the name of a document given its index
+ */
+template <typename Name>
+void ResultWriter::AppendNeighbourBlock(
+    size_t document, const std::vector<Neighbour> &neighbours, Name name) {
+  Append("Doc ");
+  AppendInteger(static_cast<long long>(document + 1));
+  Append(" (");
+  Append(name(document));
+  Append("):\n");
+  if (neighbours.empty()) {
+    AppendPadded("-", 8);
+    Append('\n');
+  }
+  for (size_t rank = 0; rank < neighbours.size(); ++rank) {
+    const Neighbour &neighbour = neighbours[rank];
+    AppendInteger(static_cast<long long>(rank + 1), 6);
+    Append(". ");
+    AppendPadded("Doc " + std::to_string(neighbour.document + 1), 10, true);
+    AppendFixed(neighbour.similarity, 12);
+    Append("   ");
+    Append(name(neighbour.document));
+    Append('\n');
+  }
+  Append('\n');
+}
+
+/**
+ * @brief Write CSV or TSV output: a terms section with the header
+ *        document,term,tf,idf,tfidf,row,column and a similarities section
+ *        with the header document,neighbour,similarity. Documents are
+ *        numbered from 1; row and column are empty for absent terms
+ * @param dm Corpus
+ */
+void ResultWriter::WriteDelimited(const DocumentManager &dm) {
+  char separator = options_.format == OutputFormat::kCsv ? ',' : '\t';
+  auto header = [&](std::initializer_list<const char *> names) {
+    bool first = true;
+    for (const char *name : names) {
+      if (!first) Append(separator);
+      Append(name);
+      first = false;
+    }
+    Append('\n');
+  };
+
+  const std::vector<Document> &documents = dm.documents();
+  if (!options_.similaritiesOnly) {
+    const MappableArray<double> &idf = dm.IDF();
+    const TermDictionary &dictionary = dm.allWordsInCorpus();
+    header({"document", "term", "tf", "idf", "tfidf", "row", "column"});
+    for (size_t d = 0; d < documents.size(); ++d) {
+      const Document &doc = documents[d];
+      ForEachTerm(dm, doc, [&](uint32_t id, uint32_t position) {
+        bool present = position != kAbsent;
+        AppendInteger(static_cast<long long>(d + 1));
+        Append(separator);
+        AppendField(dictionary.Label(id, label_));
+        Append(separator);
+        AppendFixed(present ? doc.TF().values()[position] : 0.0);
+        Append(separator);
+        AppendFixed(idf[id]);
+        Append(separator);
+        AppendFixed(present ? doc.TFNormalized().values()[position] : 0.0);
+        Append(separator);
+        if (present) {
+          std::pair<int, int> index = doc.termIndices().values()[position];
+          AppendInteger(index.first);
+          Append(separator);
+          AppendInteger(index.second);
+        } else {
+          Append(separator);
+        }
+        Append('\n');
+      });
+    }
+    Append('\n');
+  }
+
+  header({"document", "neighbour", "similarity"});
+  for (size_t d = 0; d < documents.size(); ++d) {
+    for (const Neighbour &neighbour : Similarities(dm, d)) {
+      AppendInteger(static_cast<long long>(d + 1));
+      Append(separator);
+      AppendInteger(static_cast<long long>(neighbour.document + 1));
+      Append(separator);
+      AppendFixed(neighbour.similarity);
+      Append('\n');
+    }
+  }
+}
+
+/**
+ * @brief Write JSON Lines output, one object per document:
+ *        {"document":1,"name":"...","terms":[{"term":"...","tf":...,
+ *        "idf":...,"tfidf":...,"row":0,"column":4},...],
+ *        "similarities":[{"document":2,"similarity":...},...]}
+ *        Documents are numbered from 1; row and column are null for absent
+ *        terms, and "terms" is left out with similaritiesOnly
+ * @param dm Corpus
+ */
+void ResultWriter::WriteJsonLines(const DocumentManager &dm) {
+  const std::vector<Document> &documents = dm.documents();
+  const MappableArray<double> &idf = dm.IDF();
+  const TermDictionary &dictionary = dm.allWordsInCorpus();
+  std::string text;
+  for (size_t d = 0; d < documents.size(); ++d) {
+    const Document &doc = documents[d];
+    Append("{\"document\":");
+    AppendInteger(static_cast<long long>(d + 1));
+    Append(",\"name\":");
+    text.clear();
+    AppendJsonString(doc.documentName(), text);
+    Append(text);
+    if (!options_.similaritiesOnly) {
+      Append(",\"terms\":[");
+      bool first = true;
+      ForEachTerm(dm, doc, [&](uint32_t id, uint32_t position) {
+        bool present = position != kAbsent;
+        Append(first ? "{\"term\":" : ",{\"term\":");
+        first = false;
+        text.clear();
+        AppendJsonString(dictionary.Label(id, label_), text);
+        Append(text);
+        Append(",\"tf\":");
+        AppendFixed(present ? doc.TF().values()[position] : 0.0);
+        Append(",\"idf\":");
+        AppendFixed(idf[id]);
+        Append(",\"tfidf\":");
+        AppendFixed(present ? doc.TFNormalized().values()[position] : 0.0);
+        if (present) {
+          std::pair<int, int> index = doc.termIndices().values()[position];
+          Append(",\"row\":");
+          AppendInteger(index.first);
+          Append(",\"column\":");
+          AppendInteger(index.second);
+          Append('}');
+        } else {
+          Append(",\"row\":null,\"column\":null}");
+        }
+      });
+      Append(']');
+    }
+    Append(",\"similarities\":[");
+    bool first = true;
+    for (const Neighbour &neighbour : Similarities(dm, d)) {
+      Append(first ? "{\"document\":" : ",{\"document\":");
+      first = false;
+      AppendInteger(static_cast<long long>(neighbour.document + 1));
+      Append(",\"similarity\":");
+      AppendFixed(neighbour.similarity);
+      Append('}');
+    }
+    Append("]}\n");
+  }
+}
+
+/**
+ * @brief Write the compact binary layout, in native byte order and without
+ *        padding:
+ *
+ *   char[8] "RSCBOUT\n", uint32 version, uint32 flags (1: similarities are
+ *   top-K lists, 2: terms are included), uint64 document count, uint64 term
+ *   count; with terms, for every term ID: uint32 length, the characters,
+ *   int32 DF, double IDF; then for every document: uint32 name length, the
+ *   name, with terms uint32 count and per term (uint32 ID, double TF,
+ *   double normalized TF, int32 row, int32 column), and uint32 count and
+ *   per similarity (uint32 document, double similarity).
+ *
+ * Only the terms a document contains are written, in term ID order, and
+ * documents are numbered from 0.
+ * @param dm Corpus
+ */
+void ResultWriter::WriteBinary(const DocumentManager &dm) {
+  const std::vector<Document> &documents = dm.documents();
+  const TermDictionary &dictionary = dm.allWordsInCorpus();
+  bool terms = !options_.similaritiesOnly;
+  uint32_t flags = (dm.neighbours().empty() ? 0 : kBinaryNeighbours) |
+                   (terms ? kBinaryTerms : 0);
+  Append(std::string_view(kBinaryMagic, sizeof(kBinaryMagic)));
+  AppendRaw(kBinaryVersion);
+  AppendRaw(flags);
+  AppendRaw(static_cast<uint64_t>(documents.size()));
+  AppendRaw(static_cast<uint64_t>(dictionary.size()));
+  if (terms) {
+    const MappableArray<double> &idf = dm.IDF();
+    const MappableArray<int> &documentFrequency = dm.documentsOccurrences();
+    for (uint32_t id = 0; id < dictionary.size(); ++id) {
+      std::string_view term = dictionary.Label(id, label_);
+      AppendRaw(static_cast<uint32_t>(term.size()));
+      Append(term);
+      AppendRaw(static_cast<int32_t>(documentFrequency[id]));
+      AppendRaw(idf[id]);
+    }
+  }
+  for (size_t d = 0; d < documents.size(); ++d) {
+    const Document &doc = documents[d];
+    std::string name = doc.documentName();
+    AppendRaw(static_cast<uint32_t>(name.size()));
+    Append(name);
+    if (terms) {
+      const MappableArray<uint32_t> &ids = doc.TF().ids();
+      AppendRaw(static_cast<uint32_t>(ids.size()));
+      for (size_t p = 0; p < ids.size(); ++p) {
+        std::pair<int, int> index = doc.termIndices().values()[p];
+        AppendRaw(ids[p]);
+        AppendRaw(doc.TF().values()[p]);
+        AppendRaw(doc.TFNormalized().values()[p]);
+        AppendRaw(static_cast<int32_t>(index.first));
+        AppendRaw(static_cast<int32_t>(index.second));
+      }
+    }
+    std::vector<Neighbour> similarities = Similarities(dm, d);
+    AppendRaw(static_cast<uint32_t>(similarities.size()));
+    for (const Neighbour &neighbour : similarities) {
+      AppendRaw(neighbour.document);
+      AppendRaw(neighbour.similarity);
+    }
+  }
+}
+
+/**
+ * @brief Call row(id, position) for every term to write for a document:
+ *        every term in the corpus (skipping the unused terms of removed
+ *        documents), or only the document terms with nonZeroOnly, in
+ *        alphabetical order. position is the index of the term in the
+ *        document vectors, or kAbsent
+ * @param dm Corpus
+ * @param doc Document
+ * @param row Called once per term
+ */
+template <typename Row>
+void ResultWriter::ForEachTerm(const DocumentManager &dm, const Document &doc,
+                               Row row) {
+  const TermDictionary &dictionary = dm.allWordsInCorpus();
+  if (sortedIds_.size() != dictionary.size()) {
+    sortedIds_ = dictionary.SortedIds();
+    alphabeticalRank_.assign(sortedIds_.size(), 0);
+    for (size_t rank = 0; rank < sortedIds_.size(); ++rank) {
+      alphabeticalRank_[sortedIds_[rank]] = static_cast<uint32_t>(rank);
+    }
+    positions_.assign(sortedIds_.size(), kAbsent);
+  }
+
+  const MappableArray<uint32_t> &ids = doc.TF().ids();
+  if (options_.nonZeroOnly) {
+    std::vector<uint32_t> order(ids.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return alphabeticalRank_[ids[a]] < alphabeticalRank_[ids[b]];
+    });
+    for (uint32_t position : order) row(ids[position], position);
+    return;
+  }
+  for (size_t p = 0; p < ids.size(); ++p) {
+    positions_[ids[p]] = static_cast<uint32_t>(p);
+  }
+  const MappableArray<int> &documentFrequency = dm.documentsOccurrences();
+  for (uint32_t id : sortedIds_) {
+    // Terms of removed documents stay in the dictionary, unused.
+    if (documentFrequency[id] == 0) continue;
+    row(id, positions_[id]);
+  }
+  for (uint32_t id : ids) positions_[id] = kAbsent;
+}
+
+/**
+ * @brief Similarities of a document to write: its top-K list, its stored
+ *        entries of the sparse matrix, or its row of the matrix (only the
+ *        non-zero entries with nonZeroOnly)
+ * @param dm Corpus
+ * @param document Index of the document
+ * @return Documents and similarities, in list or document order
+ */
+std::vector<Neighbour> ResultWriter::Similarities(const DocumentManager &dm,
+                                                  size_t document) const {
+  if (!dm.neighbours().empty()) return dm.neighbours()[document];
+  std::vector<Neighbour> row;
+  const CsrMatrix &sparse = dm.sparseSimilarities();
+  if (!sparse.empty()) {
+    for (size_t p = sparse.offsets()[document];
+         p < sparse.offsets()[document + 1]; ++p) {
+      row.push_back({sparse.indices()[p], sparse.values()[p]});
+    }
+    return row;
+  }
+  if (dm.similarityMatrix().empty()) return row;
+  const std::vector<double> &similarities = dm.similarityMatrix()[document];
+  for (size_t j = 0; j < similarities.size(); ++j) {
+    if (options_.nonZeroOnly && similarities[j] == 0.0) continue;
+    row.push_back({static_cast<uint32_t>(j), similarities[j]});
+  }
+  return row;
+}
+
+/**
+ * @brief Hand the buffered output to the stream
+ */
+void ResultWriter::Flush() {
+  if (buffer_.empty()) return;
+  os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+}
+
+/**
+ * @brief Append text to the buffer, flushing it first when it is full
+ * @param text Text to append
+ */
+void ResultWriter::Append(std::string_view text) {
+  if (buffer_.size() + text.size() > kBufferSize) Flush();
+  buffer_.append(text);
+}
+
+/**
+ * @brief Append a character to the buffer
+ * @param c Character to append
+ */
+void ResultWriter::Append(char c) {
+  if (buffer_.size() == kBufferSize) Flush();
+  buffer_ += c;
+}
+
+/**
+ * @brief Append an integer, right-aligned in a field
+ * @param value Integer to append
+ * @param width Minimum width, padded with spaces on the left
+ */
+void ResultWriter::AppendInteger(long long value, size_t width) {
+  char digits[24];
+  std::to_chars_result result =
+      std::to_chars(digits, digits + sizeof(digits), value);
+  AppendPadded(std::string_view(digits, result.ptr - digits), width);
+}
+
+/**
+ * @brief Append a real number with six decimals, like std::fixed with
+ *        std::setprecision(6), right-aligned in a field
+ * @param value Number to append
+ * @param width Minimum width, padded with spaces on the left
+ */
+void ResultWriter::AppendFixed(double value, size_t width) {
+  // Enough for the largest double in fixed notation.
+  char digits[328];
+  std::to_chars_result result = std::to_chars(
+      digits, digits + sizeof(digits), value, std::chars_format::fixed, 6);
+  AppendPadded(std::string_view(digits, result.ptr - digits), width);
+}
+
+/**
+ * @brief Append text padded with spaces to a minimum width, like std::setw
+ * @param text Text to append
+ * @param width Minimum width
+ * @param left Whether to align the text left (pad on the right)
+ */
+void ResultWriter::AppendPadded(std::string_view text, size_t width,
+                                bool left) {
+  size_t padding = width > text.size() ? width - text.size() : 0;
+  if (buffer_.size() + text.size() + padding > kBufferSize) Flush();
+  if (!left) buffer_.append(padding, ' ');
+  buffer_.append(text);
+  if (left) buffer_.append(padding, ' ');
+}
+
+/**
+ * @brief Append a text field of a CSV or TSV record. CSV fields holding a
+ *        separator, quote or line break are quoted (RFC 4180); in TSV,
+ *        tabs, line breaks and backslashes are escaped with a backslash
+ * @param text Field text
+ */
+void ResultWriter::AppendField(std::string_view text) {
+  if (options_.format == OutputFormat::kCsv) {
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+      Append(text);
+      return;
+    }
+    Append('"');
+    for (char c : text) {
+      if (c == '"') Append('"');
+      Append(c);
+    }
+    Append('"');
+    return;
+  }
+  if (text.find_first_of("\t\r\n\\") == std::string_view::npos) {
+    Append(text);
+    return;
+  }
+  for (char c : text) {
+    switch (c) {
+      case '\t': Append("\\t"); break;
+      case '\r': Append("\\r"); break;
+      case '\n': Append("\\n"); break;
+      case '\\': Append("\\\\"); break;
+      default: Append(c);
+    }
+  }
+}
+
+/**
+ * @brief Append the bytes of a value, in native byte order
+ * @param value Value to append
+ */
+template <typename T>
+void ResultWriter::AppendRaw(const T &value) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  Append(std::string_view(bytes, sizeof(T)));
+}
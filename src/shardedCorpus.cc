@@ -0,0 +1,418 @@
+#include "../include/shardedCorpus.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+#include "../include/mappedFile.h"
+
+namespace {
+
+constexpr char kShardMagic[8] = {'R', 'S', 'C', 'S', 'H', 'R', 'D', '\n'};
+constexpr uint32_t kShardVersion = 1;
+
+/**
+ * @brief Header of a shard file. It is followed by uint64 offsets[documents
+ *        + 1] into the entries, uint32 ids[entries], padding to 8 bytes and
+ *        double weights[entries]: the normalized vector of document d is
+ *        entries [offsets[d], offsets[d + 1])
+ */
+struct ShardHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t documents;
+  uint64_t entries;
+};
+
+/**
+ * @brief Round a size up to a multiple of 8 bytes
+ */
+size_t Align8(size_t size) { return (size + 7) & ~size_t{7}; }
+
+[[noreturn]] void InvalidShard(const std::string &path,
+                               const char *reason) {
+  std::cerr << "Error: Invalid shard file '" << path << "': " << reason
+            << std::endl;
+  exit(1);
+}
+
+/**
+ * @brief Merge two neighbour lists sorted by decreasing similarity (ties by
+ *        document index), keeping the k best
+ * @param a First list
+ * @param b Second list
+ * @param k Maximum number of neighbours
+ * @return Merged list
+ */
+std::vector<Neighbour> MergeNeighbours(const std::vector<Neighbour> &a,
+                                       const std::vector<Neighbour> &b,
+                                       size_t k) {
+  auto better = [](const Neighbour &x, const Neighbour &y) {
+    if (x.similarity != y.similarity) return x.similarity > y.similarity;
+    return x.document < y.document;
+  };
+  std::vector<Neighbour> merged;
+  merged.reserve(a.size() + b.size());
+  std::merge(a.begin(), a.end(), b.begin(), b.end(),
+             std::back_inserter(merged), better);
+  if (merged.size() > k) merged.resize(k);
+  return merged;
+}
+
+}  // namespace
+
+/**
+ * @brief Constructor for ShardedCorpus. Runs both passes over the
+ *        documents: document frequencies, then weighting and spilling the
+ *        vectors to the shard files
+ * @param documents Document file names
+ * @param stopWordsFile File name containing stop words
+ * @param lemmatizationFile File name containing lemmatization rules
+ * @param options Documents per shard and directory of the shard files
+ * @param threads Number of worker threads (0 means one per hardware thread)
+ * @param stem Whether to stem terms after the stop-word filter
+ * @param weighting Weighting scheme of the document vectors
+ * @param vocabulary Feature selection or hashing of the vocabulary
+ */
+ShardedCorpus::ShardedCorpus(const std::vector<std::string> &documents,
+                             const std::string &stopWordsFile,
+                             const std::string &lemmatizationFile,
+                             const ShardOptions &options, size_t threads,
+                             bool stem, const WeightingOptions &weighting,
+                             const VocabularyOptions &vocabulary)
+    : names_(documents),
+      shardSize_(std::max<size_t>(options.documents, 1)),
+      directory_(options.directory),
+      pool_(threads) {
+  StopWordTable stopWords;
+  {
+    auto scope = stats_.Measure("load stop words");
+    stopWords = LoadStopWords(stopWordsFile);
+  }
+  LemmaTable lemmas;
+  {
+    auto scope = stats_.Measure("load lemmatization rules");
+    lemmas = LoadLemmatizationRules(lemmatizationFile);
+  }
+  {
+    auto scope = stats_.Measure("build corpus context");
+    context_ = std::make_shared<CorpusContext>(
+        std::move(stopWords), std::move(lemmas), stem, weighting,
+        vocabulary);
+  }
+
+  if (directory_.empty()) {
+    char pattern[] = "/tmp/recommender-shards-XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+      std::cerr << "Error: Cannot create a directory for the shard files"
+                << std::endl;
+      exit(1);
+    }
+    directory_ = pattern;
+    temporaryDirectory_ = true;
+  }
+  for (size_t first = 0; first < names_.size(); first += shardSize_) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/shard-%05zu.bin", shards_.size());
+    shards_.push_back({directory_ + name, first,
+                       std::min(shardSize_, names_.size() - first)});
+  }
+
+  stats_.SetCounter("documents", names_.size());
+  stats_.SetCounter("shards", shards_.size());
+  CountDocumentFrequencies();
+  stats_.SetCounter("vocabularyTerms", context_->vocabulary().size());
+  WriteShards();
+}
+
+/**
+ * @brief Destructor for ShardedCorpus. Removes the shard files, and their
+ *        directory when it was created for them
+ */
+ShardedCorpus::~ShardedCorpus() {
+  for (const Shard &shard : shards_) std::remove(shard.path.c_str());
+  if (temporaryDirectory_) rmdir(directory_.c_str());
+}
+
+/**
+ * @brief Read and normalize a range of documents, in parallel
+ * @param first Index of the first document
+ * @param count Number of documents
+ * @return Normalized documents
+ */
+std::vector<Document> ShardedCorpus::LoadShard(size_t first, size_t count) {
+  std::vector<std::unique_ptr<Document>> loaded(count);
+  for (size_t start = 0; start < count; start += Document::kLoadBatch) {
+    size_t batch = std::min(Document::kLoadBatch, count - start);
+    {
+      auto scope = stats_.Measure("read documents");
+      pool_.ParallelFor(batch, [&](size_t i, size_t) {
+        loaded[start + i] =
+            std::make_unique<Document>(names_[first + start + i], context_);
+      });
+    }
+    {
+      auto scope = stats_.Measure("normalize documents");
+      pool_.ParallelFor(batch, [&](size_t i, size_t) {
+        loaded[start + i]->Normalize();
+      });
+    }
+  }
+  std::vector<Document> documents;
+  documents.reserve(count);
+  for (std::unique_ptr<Document> &doc : loaded) {
+    documents.push_back(std::move(*doc));
+  }
+  return documents;
+}
+
+/**
+ * @brief First pass: count the number of documents each term appears in,
+ *        one shard at a time, and build the vocabulary from the counts.
+ *        Only the distinct terms and their counts stay in memory. A hashed
+ *        vocabulary counts the buckets directly
+ */
+void ShardedCorpus::CountDocumentFrequencies() {
+  bool hashed = context_->vocabularyOptions().hashBits > 0;
+  TermDictionary terms;
+  std::vector<int> frequency;
+  uint64_t inputBytes = 0;
+  uint64_t tokens = 0;
+  uint64_t termTokens = 0;
+  if (hashed) context_->BuildVocabulary({}, 0, 0);
+  for (const Shard &shard : shards_) {
+    std::vector<Document> documents = LoadShard(shard.first, shard.documents);
+    auto scope = stats_.Measure("count document frequencies");
+    for (const Document &doc : documents) {
+      inputBytes += doc.textSize();
+      tokens += doc.tokenCount();
+      termTokens += doc.termTokenCount();
+      if (hashed) {
+        context_->AddDocumentTerms(doc.terms(), doc.termTokenCount());
+        continue;
+      }
+      for (std::string_view term : doc.terms()) {
+        uint32_t id = terms.Insert(term);
+        if (id == frequency.size()) frequency.push_back(0);
+        ++frequency[id];
+      }
+    }
+  }
+
+  auto scope = stats_.Measure("build vocabulary");
+  if (hashed) {
+    const MappableArray<int> &buckets = context_->documentFrequency();
+    report_.buckets = buckets.size();
+    report_.keptTerms = static_cast<uint64_t>(
+        std::count_if(buckets.begin(), buckets.end(),
+                      [](int documents) { return documents > 0; }));
+  } else {
+    std::vector<std::pair<std::string_view, int>> counts;
+    counts.reserve(terms.size());
+    for (uint32_t id = 0; id < terms.size(); ++id) {
+      counts.emplace_back(terms.Term(id), frequency[id]);
+    }
+    std::sort(counts.begin(), counts.end());
+    context_->BuildVocabulary(counts, names_.size(), termTokens);
+    report_.terms = counts.size();
+    report_.keptTerms = context_->vocabulary().size();
+  }
+  context_->CalculateIDF();
+  stats_.SetCounter("inputBytes", inputBytes);
+  stats_.SetCounter("tokens", tokens);
+}
+
+/**
+ * @brief Second pass: read and normalize every shard again, weight its
+ *        documents against the final vocabulary and spill their normalized
+ *        vectors to the shard file. The distinct terms of every document
+ *        are counted against the term IDs it keeps for the report
+ */
+void ShardedCorpus::WriteShards() {
+  uint64_t entries = 0;
+  uint64_t bytes = 0;
+  for (const Shard &shard : shards_) {
+    std::vector<Document> documents = LoadShard(shard.first, shard.documents);
+    {
+      auto scope = stats_.Measure("calculate weights");
+      pool_.ParallelFor(documents.size(), [&](size_t i, size_t) {
+        Document &doc = documents[i];
+        doc.CalculateTermCounts();
+        doc.ReleaseWorkingMemory();
+        doc.CalculateWeights();
+      });
+    }
+    auto scope = stats_.Measure("write shards");
+    WriteShard(shard, documents);
+    for (const Document &doc : documents) {
+      entries += doc.TF().size();
+      report_.entries += doc.terms().size();
+    }
+  }
+  report_.keptEntries = entries;
+  const VocabularyOptions &options = context_->vocabularyOptions();
+  if (options.Prunes()) {
+    stats_.SetCounter("eliminatedTerms", report_.terms - report_.keptTerms);
+  }
+  if (options.Prunes() || options.hashBits > 0) {
+    stats_.SetCounter("eliminatedEntries",
+                      report_.entries - report_.keptEntries);
+  }
+  for (const Shard &shard : shards_) {
+    bytes += MappedFile(shard.path).size();
+  }
+  stats_.SetCounter("nonZeroEntries", entries);
+  stats_.SetCounter("shardBytes", bytes);
+}
+
+/**
+ * @brief Write the normalized vectors of the documents of a shard to its
+ *        file
+ * @param shard Shard to write
+ * @param documents Its documents, weighted
+ */
+void ShardedCorpus::WriteShard(const Shard &shard,
+                               const std::vector<Document> &documents) {
+  std::vector<uint64_t> offsets(1, 0);
+  for (const Document &doc : documents) {
+    offsets.push_back(offsets.back() + doc.TFNormalized().size());
+  }
+  ShardHeader header{};
+  std::memcpy(header.magic, kShardMagic, sizeof(kShardMagic));
+  header.version = kShardVersion;
+  header.documents = documents.size();
+  header.entries = offsets.back();
+
+  std::ofstream file(shard.path, std::ios::binary | std::ios::trunc);
+  auto write = [&file](const void *data, size_t size) {
+    file.write(static_cast<const char *>(data),
+               static_cast<std::streamsize>(size));
+  };
+  write(&header, sizeof(header));
+  write(offsets.data(), offsets.size() * sizeof(uint64_t));
+  for (const Document &doc : documents) {
+    const MappableArray<uint32_t> &ids = doc.TFNormalized().ids();
+    write(ids.data(), ids.size() * sizeof(uint32_t));
+  }
+  size_t idBytes = header.entries * sizeof(uint32_t);
+  const char padding[8] = {};
+  write(padding, Align8(idBytes) - idBytes);
+  for (const Document &doc : documents) {
+    const MappableArray<double> &weights = doc.TFNormalized().values();
+    write(weights.data(), weights.size() * sizeof(double));
+  }
+  if (!file) {
+    std::cerr << "Error: Cannot write shard file '" << shard.path << "'"
+              << std::endl;
+    exit(1);
+  }
+}
+
+/**
+ * @brief Read the normalized vectors of a shard back from its file
+ * @param shard Shard to read
+ * @return Vector of every document of the shard, in document order
+ */
+std::vector<SparseVector<double>> ShardedCorpus::ReadShard(
+    const Shard &shard) {
+  auto scope = stats_.Measure("read shards");
+  MappedFile file(shard.path);
+  if (!file.is_open()) InvalidShard(shard.path, "cannot open");
+  if (file.size() < sizeof(ShardHeader)) InvalidShard(shard.path, "truncated");
+  ShardHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, kShardMagic, sizeof(kShardMagic)) != 0 ||
+      header.version != kShardVersion) {
+    InvalidShard(shard.path, "unknown format");
+  }
+  if (header.documents != shard.documents) {
+    InvalidShard(shard.path, "wrong number of documents");
+  }
+  size_t offsetsAt = sizeof(ShardHeader);
+  size_t idsAt = offsetsAt + (header.documents + 1) * sizeof(uint64_t);
+  size_t weightsAt = Align8(idsAt + header.entries * sizeof(uint32_t));
+  if (file.size() != weightsAt + header.entries * sizeof(double)) {
+    InvalidShard(shard.path, "truncated");
+  }
+  const auto *offsets =
+      reinterpret_cast<const uint64_t *>(file.data() + offsetsAt);
+  const auto *ids = reinterpret_cast<const uint32_t *>(file.data() + idsAt);
+  const auto *weights =
+      reinterpret_cast<const double *>(file.data() + weightsAt);
+
+  std::vector<SparseVector<double>> vectors(header.documents);
+  size_t vocabulary = context_->vocabulary().size();
+  for (size_t d = 0; d < header.documents; ++d) {
+    if (offsets[d] > offsets[d + 1] || offsets[d + 1] > header.entries) {
+      InvalidShard(shard.path, "bad offsets");
+    }
+    vectors[d].Reserve(offsets[d + 1] - offsets[d]);
+    for (uint64_t e = offsets[d]; e < offsets[d + 1]; ++e) {
+      if (ids[e] >= vocabulary) InvalidShard(shard.path, "bad term ID");
+      vectors[d].PushBack(ids[e], weights[e]);
+    }
+  }
+  return vectors;
+}
+
+/**
+ * @brief Top-K recommendations of every document, streamed to a sink one
+ *        row shard at a time. Each row shard is scored against every column
+ *        shard with the similarity engine, and the per-shard lists are
+ *        merged; a document's k best overall are among the k best of each
+ *        shard, so the result is that of the engine over the whole corpus
+ * @param k Maximum number of neighbours per document
+ * @param threshold Only neighbours with similarity strictly above it are kept
+ * @param sink Receives the list of every document, in document order
+ * @param precision Precision the shard engines store the weights in
+ */
+void ShardedCorpus::RecommendTopK(size_t k, double threshold,
+                                  const NeighbourSink &sink,
+                                  StoragePrecision precision) {
+  size_t vocabulary = context_->vocabulary().size();
+  uint64_t similarityEntries = 0;
+  std::vector<SimilarityEngine::RowBuffer> buffers(pool_.size());
+  for (const Shard &rowShard : shards_) {
+    std::vector<SparseVector<double>> rows = ReadShard(rowShard);
+    std::vector<std::vector<Neighbour>> lists(rows.size());
+    for (const Shard &columnShard : shards_) {
+      bool diagonal = &columnShard == &rowShard;
+      std::vector<SparseVector<double>> loaded;
+      if (!diagonal) loaded = ReadShard(columnShard);
+      const std::vector<SparseVector<double>> &columns =
+          diagonal ? rows : loaded;
+
+      std::vector<const SparseVector<double> *> vectors;
+      vectors.reserve(columns.size());
+      for (const SparseVector<double> &vector : columns) {
+        vectors.push_back(&vector);
+      }
+      std::optional<SimilarityEngine> engine;
+      {
+        auto scope = stats_.Measure("build similarity index");
+        engine.emplace(vectors, vocabulary, precision);
+      }
+      auto scope = stats_.Measure("top-K neighbours");
+      pool_.ParallelFor(rows.size(), [&](size_t i, size_t worker) {
+        std::vector<Neighbour> found =
+            engine->TopK(rows[i], k, threshold, buffers[worker],
+                         diagonal ? i : SIZE_MAX);
+        for (Neighbour &neighbour : found) {
+          neighbour.document += static_cast<uint32_t>(columnShard.first);
+        }
+        lists[i] = MergeNeighbours(lists[i], found, k);
+      });
+    }
+    for (size_t i = 0; i < lists.size(); ++i) {
+      similarityEntries += lists[i].size();
+      sink(rowShard.first + i, lists[i]);
+    }
+  }
+  stats_.SetCounter("similarityEntries", similarityEntries);
+}
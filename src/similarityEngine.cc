@@ -0,0 +1,767 @@
+#include "../include/similarityEngine.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <type_traits>
+
+namespace {
+
+// Documents per block never exceed this, which bounds the tile buffers.
+constexpr size_t kMaxBlockDocuments = 256;
+// Terms in at least this fraction of the documents form the dense subspace,
+// capped to the kMaxDenseTerms most frequent ones. Small corpora get none.
+constexpr double kDenseMinFraction = 0.25;
+constexpr size_t kMaxDenseTerms = 256;
+constexpr size_t kDenseMinDocuments = 64;
+
+/**
+ * @brief Default byte budget of a block: a quarter of the L2 cache, so the
+ *        two blocks of a tile plus its score buffer stay resident in L2
+ * @return Budget in bytes
+ */
+size_t DefaultBlockBytes() {
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (l2 <= 0) l2 = 1 << 20;
+  return static_cast<size_t>(l2) / 4;
+}
+
+/**
+ * @brief Per-document quantization step of weights stored as W: integer
+ *        types spread the weights of a document over their whole range, so
+ *        its largest weight is stored as the largest integer. Floating
+ *        types store the weights as they are (step 1)
+ * @param vector Normalized document vector
+ * @return Weight represented by one unit of a stored weight
+ */
+template <typename W>
+double QuantizationStep(const SparseVector<double> &vector) {
+  if constexpr (!std::is_integral_v<W>) {
+    return 1.0;
+  } else {
+    double largest = 0.0;
+    for (double value : vector.values()) largest = std::max(largest, value);
+    if (largest == 0.0) return 1.0;
+    return largest / std::numeric_limits<W>::max();
+  }
+}
+
+/**
+ * @brief Store a weight as W: rounded for floating types, quantized to the
+ *        nearest multiple of the document's step for integer ones, so the
+ *        product of two stored weights times both steps approximates the
+ *        product of the weights
+ * @param weight Normalized weight
+ * @param step Quantization step of the document (see QuantizationStep)
+ */
+template <typename W>
+W EncodeWeight(double weight, double step) {
+  if constexpr (!std::is_integral_v<W>) {
+    return static_cast<W>(weight);
+  } else {
+    double levels = std::numeric_limits<W>::max();
+    return static_cast<W>(std::lround(std::min(weight / step, levels)));
+  }
+}
+
+/**
+ * @brief Call a function with a value of the type the weights of a storage
+ *        precision are stored as, so it can instantiate its kernels for it
+ * @param precision Storage precision
+ * @param function Generic function taking the type as a tag value
+ * @return Whatever the function returns
+ */
+template <typename Function>
+auto WithStoredWeight(StoragePrecision precision, Function &&function) {
+  switch (precision) {
+    case StoragePrecision::kFloat:
+      return function(float{});
+    case StoragePrecision::kInt16:
+      return function(int16_t{});
+    case StoragePrecision::kInt8:
+      return function(int8_t{});
+    case StoragePrecision::kDouble:
+      break;
+  }
+  return function(double{});
+}
+
+/**
+ * @brief Dense dot product of two rows of stored weights with the SIMD
+ *        kernels, in the type scores of W are accumulated in. Integer
+ *        products are summed exactly before the conversion
+ */
+template <typename W>
+auto DenseScore(const W *a, const W *b, size_t n) {
+  if constexpr (std::is_integral_v<W>) {
+    return static_cast<float>(DenseDot(a, b, n));
+  } else {
+    return DenseDot(a, b, n);
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Parse the name of a storage precision
+ * @param name double, float, int16 or int8
+ * @param precision Set to the precision on success
+ * @return Whether the name is known
+ */
+bool ParseStoragePrecision(const std::string &name,
+                           StoragePrecision &precision) {
+  if (name == "double") {
+    precision = StoragePrecision::kDouble;
+  } else if (name == "float") {
+    precision = StoragePrecision::kFloat;
+  } else if (name == "int16") {
+    precision = StoragePrecision::kInt16;
+  } else if (name == "int8") {
+    precision = StoragePrecision::kInt8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Name of a storage precision, as ParseStoragePrecision accepts it
+ */
+const char *StoragePrecisionName(StoragePrecision precision) {
+  switch (precision) {
+    case StoragePrecision::kDouble:
+      return "double";
+    case StoragePrecision::kFloat:
+      return "float";
+    case StoragePrecision::kInt16:
+      return "int16";
+    case StoragePrecision::kInt8:
+      return "int8";
+  }
+  return "";
+}
+
+/**
+ * @brief Constructor for SimilarityEngine
+ * @param vectors Normalized sparse vector of every document, in document order
+ * @param vocabularySize Number of terms in the corpus dictionary
+ * @param precision Precision the posting weights are stored in
+ */
+SimilarityEngine::SimilarityEngine(
+    const std::vector<const SparseVector<double> *> &vectors,
+    size_t vocabularySize, StoragePrecision precision)
+    : vectors_(vectors), precision_(precision) {
+  BuildIndex(vocabularySize);
+  SelectDenseTerms(vocabularySize);
+}
+
+/**
+ * @brief Build the inverted index in CSR layout: the postings of term t live
+ *        at [offsets_[t], offsets_[t + 1]) of the posting arrays, sorted by
+ *        document
+ * @param vocabularySize Number of terms in the corpus dictionary
+ */
+void SimilarityEngine::BuildIndex(size_t vocabularySize) {
+  offsets_.assign(vocabularySize + 1, 0);
+  for (const SparseVector<double> *vector : vectors_) {
+    for (uint32_t id : vector->ids()) {
+      ++offsets_[id + 1];
+    }
+  }
+  for (size_t t = 0; t < vocabularySize; ++t) {
+    offsets_[t + 1] += offsets_[t];
+  }
+
+  size_t total = offsets_[vocabularySize];
+  postingDocuments_.resize(total);
+  bool exact = precision_ == StoragePrecision::kDouble;
+  if (exact) postingWeights_.resize(total);
+  if (exact || precision_ == StoragePrecision::kFloat) {
+    approximateWeights_.resize(total);
+  }
+  if (precision_ == StoragePrecision::kInt16) int16Weights_.resize(total);
+  if (precision_ == StoragePrecision::kInt8) int8Weights_.resize(total);
+  bool quantized = !int16Weights_.empty() || !int8Weights_.empty();
+  if (quantized) steps_.resize(vectors_.size());
+  std::vector<size_t> next(offsets_.begin(), offsets_.end() - 1);
+  for (size_t d = 0; d < vectors_.size(); ++d) {
+    const SparseVector<double> &vector = *vectors_[d];
+    if (!int16Weights_.empty()) {
+      steps_[d] = QuantizationStep<int16_t>(vector);
+    } else if (!int8Weights_.empty()) {
+      steps_[d] = QuantizationStep<int8_t>(vector);
+    }
+    for (size_t k = 0; k < vector.size(); ++k) {
+      size_t p = next[vector.ids()[k]]++;
+      double weight = vector.values()[k];
+      postingDocuments_[p] = static_cast<uint32_t>(d);
+      if (exact) postingWeights_[p] = weight;
+      if (!approximateWeights_.empty()) {
+        approximateWeights_[p] = static_cast<float>(weight);
+      }
+      if (!int16Weights_.empty()) {
+        int16Weights_[p] = EncodeWeight<int16_t>(weight, steps_[d]);
+      }
+      if (!int8Weights_.empty()) {
+        int8Weights_[p] = EncodeWeight<int8_t>(weight, steps_[d]);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Posting weights stored as W, parallel to postingDocuments_
+ */
+template <>
+const double *SimilarityEngine::Weights<double>() const {
+  return postingWeights_.data();
+}
+
+template <>
+const float *SimilarityEngine::Weights<float>() const {
+  return approximateWeights_.data();
+}
+
+template <>
+const int16_t *SimilarityEngine::Weights<int16_t>() const {
+  return int16Weights_.data();
+}
+
+template <>
+const int8_t *SimilarityEngine::Weights<int8_t>() const {
+  return int8Weights_.data();
+}
+
+/**
+ * @brief Bytes taken by the posting weights of the engine, in every
+ *        precision it keeps them in
+ * @return Size of the weight arrays in bytes
+ */
+size_t SimilarityEngine::weightBytes() const {
+  return postingWeights_.size() * sizeof(double) +
+         approximateWeights_.size() * sizeof(float) +
+         int16Weights_.size() * sizeof(int16_t) +
+         int8Weights_.size() * sizeof(int8_t);
+}
+
+/**
+ * @brief Choose the dense subspace of the blocked kernel: the most frequent
+ *        terms, whose posting lists would make the sparse outer products
+ *        quadratic. Their weights are packed densely and scored with the
+ *        SIMD dense dot product instead
+ * @param vocabularySize Number of terms in the corpus dictionary
+ */
+void SimilarityEngine::SelectDenseTerms(size_t vocabularySize) {
+  denseTerms_.clear();
+  denseSlot_.assign(vocabularySize, -1);
+  if (vectors_.size() < kDenseMinDocuments) return;
+
+  size_t minFrequency = static_cast<size_t>(
+      std::ceil(kDenseMinFraction * static_cast<double>(vectors_.size())));
+  auto frequency = [this](uint32_t t) { return offsets_[t + 1] - offsets_[t]; };
+  for (uint32_t t = 0; t < vocabularySize; ++t) {
+    if (frequency(t) >= minFrequency) denseTerms_.push_back(t);
+  }
+  if (denseTerms_.size() > kMaxDenseTerms) {
+    std::nth_element(denseTerms_.begin(),
+                     denseTerms_.begin() + kMaxDenseTerms, denseTerms_.end(),
+                     [&frequency](uint32_t a, uint32_t b) {
+                       return frequency(a) != frequency(b)
+                                  ? frequency(a) > frequency(b)
+                                  : a < b;
+                     });
+    denseTerms_.resize(kMaxDenseTerms);
+  }
+  std::sort(denseTerms_.begin(), denseTerms_.end());
+  for (size_t slot = 0; slot < denseTerms_.size(); ++slot) {
+    denseSlot_[denseTerms_[slot]] = static_cast<int32_t>(slot);
+  }
+}
+
+/**
+ * @brief Accumulate the dot products of one document against every document
+ *        with index >= first. Terms are visited in ID order, so each score is
+ *        summed in the same order as a sorted pairwise merge. Reduced
+ *        precisions multiply the stored weights in float
+ * @param document Index of the query document
+ * @param first First document index to score
+ * @param scores Output, resized to size(); entries [first, size()) are
+ *        overwritten and the rest are left untouched
+ */
+void SimilarityEngine::AccumulateRow(size_t document, size_t first,
+                                     std::vector<double> &scores) const {
+  WithStoredWeight(precision_, [&](auto tag) {
+    AccumulateRowAs<decltype(tag)>(document, first, scores);
+  });
+}
+
+/**
+ * @brief AccumulateRow over the posting weights stored as W
+ */
+template <typename W>
+void SimilarityEngine::AccumulateRowAs(size_t document, size_t first,
+                                       std::vector<double> &scores) const {
+  scores.resize(vectors_.size());
+  std::fill(scores.begin() + first, scores.end(), 0.0);
+
+  const W *weights = Weights<W>();
+  const SparseVector<double> &vector = *vectors_[document];
+  double step = QuantizationStep<W>(vector);
+  for (size_t k = 0; k < vector.size(); ++k) {
+    uint32_t id = vector.ids()[k];
+    Score<W> weight = EncodeWeight<W>(vector.values()[k], step);
+    auto documents = postingDocuments_.begin();
+    size_t begin = std::lower_bound(documents + offsets_[id],
+                                    documents + offsets_[id + 1], first) -
+                   documents;
+    for (size_t p = begin; p < offsets_[id + 1]; ++p) {
+      scores[postingDocuments_[p]] += weight * weights[p];
+    }
+  }
+  if constexpr (std::is_integral_v<W>) {
+    for (size_t j = first; j < scores.size(); ++j) {
+      scores[j] *= step * steps_[j];
+    }
+  }
+}
+
+/**
+ * @brief Compute the full N x N similarity matrix. Only the upper triangle
+ *        (j >= i) is accumulated; the lower triangle is mirrored from it
+ * @return Dense similarity matrix
+ */
+std::vector<std::vector<double>> SimilarityEngine::ComputeMatrix() const {
+  size_t n = vectors_.size();
+  std::vector<std::vector<double>> matrix(n, std::vector<double>(n, 0.0));
+  std::vector<double> scores;
+  for (size_t i = 0; i < n; ++i) {
+    AccumulateRow(i, i, scores);
+    for (size_t j = i; j < n; ++j) {
+      matrix[i][j] = scores[j];
+      matrix[j][i] = scores[j];
+    }
+  }
+  return matrix;
+}
+
+/**
+ * @brief Find the k documents most similar to a given one. The row is
+ *        streamed through a bounded min-heap, so only k candidates are kept
+ * @param document Index of the query document (excluded from the result)
+ * @param k Maximum number of neighbours to return
+ * @param threshold Only documents with similarity strictly above it are kept
+ * @param buffer Scratch buffers, reusable across calls
+ * @return Neighbours sorted by decreasing similarity (ties by document index)
+ */
+std::vector<Neighbour> SimilarityEngine::TopK(size_t document, size_t k,
+                                              double threshold,
+                                              RowBuffer &buffer) const {
+  return TopK(*vectors_[document], k, threshold, buffer, document);
+}
+
+/**
+ * @brief Find the k indexed documents most similar to a query vector that
+ *        is not necessarily indexed
+ * @param vector Normalized query vector, over the indexed vocabulary
+ * @param k Maximum number of neighbours to return
+ * @param threshold Only documents with similarity strictly above it are kept
+ * @param buffer Scratch buffers, reusable across calls
+ * @param exclude Document left out of the result (SIZE_MAX for none)
+ * @return Neighbours sorted by decreasing similarity (ties by document index)
+ */
+std::vector<Neighbour> SimilarityEngine::TopK(
+    const SparseVector<double> &vector, size_t k, double threshold,
+    RowBuffer &buffer, size_t exclude) const {
+  buffer.scores.resize(vectors_.size(), 0.0f);
+  if (k == 0) return {};
+  if (precision_ == StoragePrecision::kDouble) {
+    return ExactTopK(vector, k, threshold, buffer, exclude);
+  }
+  return WithStoredWeight(precision_, [&](auto tag) {
+    return ReducedTopK<decltype(tag)>(vector, k, threshold, buffer, exclude);
+  });
+}
+
+/**
+ * @brief Accumulate the scores of a query vector against every indexed
+ *        document from the posting weights stored as W, in float, and list
+ *        the documents with a non-zero score
+ * @param vector Normalized query vector, encoded as W on the fly
+ * @param buffer Scores (zero on entry, in units of the quantization steps
+ *        on return) and the list of touched documents
+ * @return Quantization step of the query vector
+ */
+template <typename W>
+double SimilarityEngine::ScatterScores(const SparseVector<double> &vector,
+                                       RowBuffer &buffer) const {
+  std::vector<float> &scores = buffer.scores;
+  std::vector<uint32_t> &touched = buffer.touched;
+  const W *weights = Weights<W>();
+  double step = QuantizationStep<W>(vector);
+  size_t work = 0;
+  for (uint32_t id : vector.ids()) work += offsets_[id + 1] - offsets_[id];
+  // When most documents are touched anyway, scan all scores instead of
+  // tracking the touched ones; zero scores are skipped the same way.
+  bool scanAll = work >= vectors_.size() / 2;
+  for (size_t t = 0; t < vector.size(); ++t) {
+    uint32_t id = vector.ids()[t];
+    float weight = EncodeWeight<W>(vector.values()[t], step);
+    if (weight == 0.0f) continue;
+    if (scanAll) {
+      for (size_t p = offsets_[id]; p < offsets_[id + 1]; ++p) {
+        scores[postingDocuments_[p]] += weight * weights[p];
+      }
+      continue;
+    }
+    for (size_t p = offsets_[id]; p < offsets_[id + 1]; ++p) {
+      uint32_t document = postingDocuments_[p];
+      if (weights[p] == 0) continue;
+      if (scores[document] == 0.0f) touched.push_back(document);
+      scores[document] += weight * weights[p];
+    }
+  }
+  if (scanAll) {
+    touched.clear();
+    for (size_t d = 0; d < scores.size(); ++d) {
+      if (scores[d] != 0.0f) touched.push_back(static_cast<uint32_t>(d));
+    }
+  }
+  return step;
+}
+
+/**
+ * @brief TopK of a double engine: candidates are selected from float
+ *        scores, and only those that can be in the result are rescored
+ *        exactly with SparseDot
+ */
+std::vector<Neighbour> SimilarityEngine::ExactTopK(
+    const SparseVector<double> &vector, size_t k, double threshold,
+    RowBuffer &buffer, size_t exclude) const {
+  std::vector<float> &scores = buffer.scores;
+  std::vector<uint32_t> &touched = buffer.touched;
+
+  // Pass 1: approximate scores in float, which halves the bytes streamed
+  // per posting and the size of the accumulator. Every term is non-negative
+  // and adds at most a few float roundings (2^-24) of itself, so with scores
+  // at most 1 the error stays far below kApproximation.
+  constexpr double kApproximation = 1e-4;
+  ScatterScores<float>(vector, buffer);
+
+  // Pass 2: the k-th best approximate score bounds the exact k-th best, so
+  // only documents within twice the error of it can be in the result.
+  std::priority_queue<double, std::vector<double>, std::greater<double>> best;
+  for (uint32_t candidate : touched) {
+    if (candidate == exclude) continue;
+    best.push(scores[candidate]);
+    if (best.size() > k) best.pop();
+  }
+  double cutoff = threshold - kApproximation;
+  if (best.size() == k) {
+    cutoff = std::max(cutoff, best.top() - 2 * kApproximation);
+  }
+
+  // Pass 3: exact scores of the surviving candidates, summed in term ID
+  // order like the row kernels.
+  // Min-heap on "better than": the top is the worst neighbour kept so far.
+  auto better = [](const Neighbour &a, const Neighbour &b) {
+    if (a.similarity != b.similarity) return a.similarity > b.similarity;
+    return a.document < b.document;
+  };
+  std::priority_queue<Neighbour, std::vector<Neighbour>, decltype(better)>
+      heap(better);
+  for (uint32_t candidate : touched) {
+    double approximate = scores[candidate];
+    scores[candidate] = 0.0;
+    if (candidate == exclude || approximate < cutoff) continue;
+    double similarity = SparseDot(vector, *vectors_[candidate]);
+    if (!(similarity > threshold)) continue;
+    Neighbour neighbour{candidate, similarity};
+    if (heap.size() < k) {
+      heap.push(neighbour);
+    } else if (better(neighbour, heap.top())) {
+      heap.pop();
+      heap.push(neighbour);
+    }
+  }
+  touched.clear();
+
+  std::vector<Neighbour> result(heap.size());
+  for (size_t i = result.size(); i > 0; --i) {
+    result[i - 1] = heap.top();
+    heap.pop();
+  }
+  return result;
+}
+
+/**
+ * @brief TopK of a reduced-precision engine: the scores accumulated from
+ *        the stored weights are the similarities, so no candidate is
+ *        rescored and the double vectors are never read
+ */
+template <typename W>
+std::vector<Neighbour> SimilarityEngine::ReducedTopK(
+    const SparseVector<double> &vector, size_t k, double threshold,
+    RowBuffer &buffer, size_t exclude) const {
+  std::vector<float> &scores = buffer.scores;
+  std::vector<uint32_t> &touched = buffer.touched;
+  double step = ScatterScores<W>(vector, buffer);
+
+  auto better = [](const Neighbour &a, const Neighbour &b) {
+    if (a.similarity != b.similarity) return a.similarity > b.similarity;
+    return a.document < b.document;
+  };
+  std::priority_queue<Neighbour, std::vector<Neighbour>, decltype(better)>
+      heap(better);
+  for (uint32_t candidate : touched) {
+    double similarity = scores[candidate];
+    if constexpr (std::is_integral_v<W>) {
+      similarity *= step * steps_[candidate];
+    }
+    scores[candidate] = 0.0f;
+    if (candidate == exclude || !(similarity > threshold)) continue;
+    Neighbour neighbour{candidate, similarity};
+    if (heap.size() < k) {
+      heap.push(neighbour);
+    } else if (better(neighbour, heap.top())) {
+      heap.pop();
+      heap.push(neighbour);
+    }
+  }
+  touched.clear();
+
+  std::vector<Neighbour> result(heap.size());
+  for (size_t i = result.size(); i > 0; --i) {
+    result[i - 1] = heap.top();
+    heap.pop();
+  }
+  return result;
+}
+
+/**
+ * @brief Compute the full N x N similarity matrix with the parallel blocked
+ *        kernel. Each tile fills its cells and their mirrored cells, and no
+ *        two tiles share a cell, so tiles write the matrix without locking
+ * @param pool Thread pool running the tiles
+ * @return Dense similarity matrix. Without a dense subspace it is identical
+ *         to ComputeMatrix(); with one, scores may differ in the last bits
+ */
+std::vector<std::vector<double>> SimilarityEngine::ComputeMatrix(
+    ThreadPool &pool) const {
+  size_t n = vectors_.size();
+  std::vector<std::vector<double>> matrix(n, std::vector<double>(n, 0.0));
+  ForEachTile(pool, [&matrix](const Tile &tile, size_t) {
+    for (size_t i = tile.rowBegin; i < tile.rowEnd; ++i) {
+      size_t first = std::max(i, tile.columnBegin);
+      for (size_t j = first; j < tile.columnEnd; ++j) {
+        matrix[i][j] = tile.Score(i, j);
+        matrix[j][i] = matrix[i][j];
+      }
+    }
+  });
+  return matrix;
+}
+
+/**
+ * @brief Cache-blocked all-pairs kernel. Documents are split into contiguous
+ *        blocks whose postings fit in blockBytes, and the upper triangle of
+ *        block pairs is handed out as tiles to the pool, which schedules them
+ *        dynamically across threads. Every score is the dense-subspace dot
+ *        product plus the sparse terms summed in ID order; the result does
+ *        not depend on the number of threads. Blocks hold the weights in the
+ *        storage precision, so reduced precisions fit more documents per
+ *        block and report float tiles
+ * @param pool Thread pool running the tiles
+ * @param sink Called once per tile with its scores and the worker running it;
+ *        tiles are reported concurrently from different workers
+ * @param blockBytes Byte budget of a block, 0 to derive it from the L2 size
+ */
+void SimilarityEngine::ForEachTile(
+    ThreadPool &pool,
+    const std::function<void(const Tile &tile, size_t worker)> &sink,
+    size_t blockBytes) const {
+  WithStoredWeight(precision_, [&](auto tag) {
+    ForEachTileAs<decltype(tag)>(pool, sink, blockBytes);
+  });
+}
+
+/**
+ * @brief ForEachTile over blocks of weights stored as W
+ */
+template <typename W>
+void SimilarityEngine::ForEachTileAs(
+    ThreadPool &pool,
+    const std::function<void(const Tile &tile, size_t worker)> &sink,
+    size_t blockBytes) const {
+  std::vector<Block<W>> blocks = PartitionBlocks<W>(blockBytes);
+  pool.ParallelFor(blocks.size(),
+                   [&](size_t b, size_t) { BuildBlock(blocks[b]); });
+
+  std::vector<std::pair<size_t, size_t>> tiles;
+  for (size_t r = 0; r < blocks.size(); ++r) {
+    for (size_t c = r; c < blocks.size(); ++c) {
+      tiles.emplace_back(r, c);
+    }
+  }
+
+  std::vector<std::vector<Score<W>>> buffers(pool.size());
+  pool.ParallelFor(tiles.size(), [&](size_t t, size_t worker) {
+    const Block<W> &rows = blocks[tiles[t].first];
+    const Block<W> &columns = blocks[tiles[t].second];
+    ComputeTile(rows, columns, buffers[worker]);
+    Tile tile{rows.begin, rows.end, columns.begin, columns.end, nullptr,
+              nullptr};
+    if constexpr (std::is_same_v<Score<W>, double>) {
+      tile.scores = buffers[worker].data();
+    } else {
+      tile.floatScores = buffers[worker].data();
+    }
+    sink(tile, worker);
+  });
+}
+
+/**
+ * @brief Split the documents into contiguous blocks of at most blockBytes of
+ *        postings and at most kMaxBlockDocuments documents
+ * @param blockBytes Byte budget of a block, 0 to derive it from the L2 size
+ * @return Blocks with their document ranges set and empty indexes
+ */
+template <typename W>
+std::vector<SimilarityEngine::Block<W>> SimilarityEngine::PartitionBlocks(
+    size_t blockBytes) const {
+  if (blockBytes == 0) blockBytes = DefaultBlockBytes();
+  size_t entryBytes = 2 * sizeof(uint32_t) + sizeof(W);
+  size_t denseBytes = denseTerms_.size() * sizeof(W);
+
+  std::vector<Block<W>> blocks;
+  size_t begin = 0;
+  size_t bytes = 0;
+  for (size_t d = 0; d < vectors_.size(); ++d) {
+    size_t documentBytes = vectors_[d]->size() * entryBytes + denseBytes;
+    if (d > begin && (bytes + documentBytes > blockBytes ||
+                      d - begin == kMaxBlockDocuments)) {
+      blocks.push_back({begin, d, {}, {}, {}, {}, {}});
+      begin = d;
+      bytes = 0;
+    }
+    bytes += documentBytes;
+  }
+  if (begin < vectors_.size()) {
+    blocks.push_back({begin, vectors_.size(), {}, {}, {}, {}, {}});
+  }
+  return blocks;
+}
+
+/**
+ * @brief Build the local inverted index of a block and pack its dense
+ *        subspace, encoding the weights as W. Postings of each term stay
+ *        sorted by document
+ * @param block Block to index
+ */
+template <typename W>
+void SimilarityEngine::BuildBlock(Block<W> &block) const {
+  struct Entry {
+    uint32_t term;
+    uint32_t document;
+    W weight;
+  };
+  size_t width = denseTerms_.size();
+  block.dense.assign((block.end - block.begin) * width, W{});
+  std::vector<Entry> entries;
+  for (size_t d = block.begin; d < block.end; ++d) {
+    const SparseVector<double> &vector = *vectors_[d];
+    for (size_t k = 0; k < vector.size(); ++k) {
+      W weight = EncodeWeight<W>(vector.values()[k],
+                                 steps_.empty() ? 1.0 : steps_[d]);
+      int32_t slot = denseSlot_[vector.ids()[k]];
+      if (slot >= 0) {
+        block.dense[(d - block.begin) * width + slot] = weight;
+      } else {
+        entries.push_back(
+            {vector.ids()[k], static_cast<uint32_t>(d), weight});
+      }
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry &a, const Entry &b) { return a.term < b.term; });
+
+  block.documents.reserve(entries.size());
+  block.weights.reserve(entries.size());
+  for (size_t e = 0; e < entries.size(); ++e) {
+    if (e == 0 || entries[e].term != entries[e - 1].term) {
+      block.terms.push_back(entries[e].term);
+      block.offsets.push_back(static_cast<uint32_t>(e));
+    }
+    block.documents.push_back(entries[e].document);
+    block.weights.push_back(entries[e].weight);
+  }
+  block.offsets.push_back(static_cast<uint32_t>(entries.size()));
+}
+
+/**
+ * @brief Score every row document of a tile against the column block. The
+ *        dense subspace is scored first with the SIMD dense dot product; then
+ *        the sorted term lists of both blocks are merged and, for every
+ *        shared term, the outer product of its two posting lists is added to
+ *        the tile in term ID order. Quantized scores are scaled by the steps of
+ *        both documents last
+ * @param rows Row block, indexed
+ * @param columns Column block, indexed
+ * @param scores Output, row-major (rows x columns) buffer
+ */
+template <typename W>
+void SimilarityEngine::ComputeTile(const Block<W> &rows,
+                                   const Block<W> &columns,
+                                   std::vector<Score<W>> &scores) const {
+  size_t width = columns.end - columns.begin;
+  scores.assign((rows.end - rows.begin) * width, 0);
+  bool diagonal = rows.begin == columns.begin;
+
+  size_t denseWidth = denseTerms_.size();
+  if (denseWidth > 0) {
+    for (size_t i = rows.begin; i < rows.end; ++i) {
+      const W *rowDense = rows.dense.data() + (i - rows.begin) * denseWidth;
+      Score<W> *cells = scores.data() + (i - rows.begin) * width;
+      size_t first = diagonal ? i : columns.begin;
+      for (size_t j = first; j < columns.end; ++j) {
+        cells[j - columns.begin] = DenseScore(
+            rowDense, columns.dense.data() + (j - columns.begin) * denseWidth,
+            denseWidth);
+      }
+    }
+  }
+
+  size_t r = 0, c = 0;
+  while (r < rows.terms.size() && c < columns.terms.size()) {
+    if (rows.terms[r] < columns.terms[c]) {
+      ++r;
+    } else if (columns.terms[c] < rows.terms[r]) {
+      ++c;
+    } else {
+      for (uint32_t p = rows.offsets[r]; p < rows.offsets[r + 1]; ++p) {
+        Score<W> weight = rows.weights[p];
+        Score<W> *cells =
+            scores.data() + (rows.documents[p] - rows.begin) * width;
+        // On diagonal tiles both lists are the same, and postings are sorted
+        // by document, so starting at p keeps only column >= row.
+        uint32_t q = diagonal ? p : columns.offsets[c];
+        for (; q < columns.offsets[c + 1]; ++q) {
+          cells[columns.documents[q] - columns.begin] +=
+              weight * columns.weights[q];
+        }
+      }
+      ++r;
+      ++c;
+    }
+  }
+  if constexpr (std::is_integral_v<W>) {
+    for (size_t i = rows.begin; i < rows.end; ++i) {
+      Score<W> *cells = scores.data() + (i - rows.begin) * width;
+      for (size_t j = columns.begin; j < columns.end; ++j) {
+        cells[j - columns.begin] *= steps_[i] * steps_[j];
+      }
+    }
+  }
+}
@@ -0,0 +1,325 @@
+#include "../include/sparseMatrix.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+// Rows of the left operand handed to a worker at a time.
+constexpr size_t kRowsPerTask = 64;
+// Under kAuto a row uses the hash accumulator when its products number less
+// than the output width divided by this.
+constexpr size_t kHashWidthRatio = 16;
+// The dense accumulator scans its whole array instead of sorting the touched
+// columns when more than this fraction of them are touched.
+constexpr size_t kDenseScanRatio = 8;
+constexpr uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max();
+
+/**
+ * @brief Output entries of a chunk of rows, gathered before their final
+ *        position in the product is known
+ */
+struct RowChunk {
+  std::vector<uint32_t> indices;
+  std::vector<double> values;
+};
+
+/**
+ * @brief Accumulator indexed directly by column, as wide as the output. The
+ *        touched columns are remembered so it is cleared in O(touched)
+ */
+class DenseAccumulator {
+ public:
+  void Resize(size_t columns) {
+    if (values_.size() == columns) return;
+    values_.assign(columns, 0.0);
+    present_.assign(columns, 0);
+  }
+
+  void Add(uint32_t column, double value) {
+    if (present_[column]) {
+      values_[column] += value;
+      return;
+    }
+    present_[column] = 1;
+    values_[column] = value;
+    touched_.push_back(column);
+  }
+
+  /**
+   * @brief Append the entries above threshold to chunk in column order and
+   *        clear the accumulator
+   * @return Number of entries appended
+   */
+  size_t Gather(double threshold, RowChunk &chunk) {
+    size_t before = chunk.indices.size();
+    if (touched_.size() * kDenseScanRatio > values_.size()) {
+      for (uint32_t c = 0; c < values_.size(); ++c) {
+        if (!present_[c]) continue;
+        present_[c] = 0;
+        if (values_[c] > threshold) {
+          chunk.indices.push_back(c);
+          chunk.values.push_back(values_[c]);
+        }
+      }
+    } else {
+      std::sort(touched_.begin(), touched_.end());
+      for (uint32_t c : touched_) {
+        present_[c] = 0;
+        if (values_[c] > threshold) {
+          chunk.indices.push_back(c);
+          chunk.values.push_back(values_[c]);
+        }
+      }
+    }
+    touched_.clear();
+    return chunk.indices.size() - before;
+  }
+
+ private:
+  std::vector<double> values_;
+  std::vector<uint8_t> present_;
+  std::vector<uint32_t> touched_;
+};
+
+/**
+ * @brief Open-addressing hash accumulator with linear probing, sized per row
+ *        to twice the number of its products
+ */
+class HashAccumulator {
+ public:
+  void Reserve(size_t products) {
+    size_t capacity = 16;
+    while (capacity < 2 * products) capacity <<= 1;
+    if (keys_.size() < capacity) {
+      keys_.assign(capacity, kEmptySlot);
+      values_.resize(capacity);
+    }
+    mask_ = capacity - 1;
+  }
+
+  void Add(uint32_t column, double value) {
+    size_t slot = (column * 2654435761u) & mask_;
+    while (keys_[slot] != column) {
+      if (keys_[slot] == kEmptySlot) {
+        keys_[slot] = column;
+        values_[slot] = value;
+        used_.push_back(slot);
+        return;
+      }
+      slot = (slot + 1) & mask_;
+    }
+    values_[slot] += value;
+  }
+
+  /**
+   * @brief Append the entries above threshold to chunk in column order and
+   *        clear the accumulator
+   * @return Number of entries appended
+   */
+  size_t Gather(double threshold, RowChunk &chunk) {
+    entries_.clear();
+    for (size_t slot : used_) {
+      if (values_[slot] > threshold) {
+        entries_.emplace_back(keys_[slot], values_[slot]);
+      }
+      keys_[slot] = kEmptySlot;
+    }
+    used_.clear();
+    std::sort(entries_.begin(), entries_.end());
+    for (const auto &[column, value] : entries_) {
+      chunk.indices.push_back(column);
+      chunk.values.push_back(value);
+    }
+    return entries_.size();
+  }
+
+ private:
+  std::vector<uint32_t> keys_;
+  std::vector<double> values_;
+  std::vector<size_t> used_;
+  std::vector<std::pair<uint32_t, double>> entries_;
+  size_t mask_ = 0;
+};
+
+}  // namespace
+
+CsrMatrix::CsrMatrix(size_t columns, std::vector<size_t> offsets,
+                     std::vector<uint32_t> indices, std::vector<double> values)
+    : columns_(columns),
+      offsets_(std::move(offsets)),
+      indices_(std::move(indices)),
+      values_(std::move(values)) {}
+
+/**
+ * @brief Assemble sparse vectors as the rows of a matrix
+ * @param rows One vector per row, with IDs below columns
+ * @param columns Number of columns
+ * @return Matrix with the vectors as rows
+ */
+CsrMatrix CsrMatrix::FromRows(
+    const std::vector<const SparseVector<double> *> &rows, size_t columns) {
+  std::vector<size_t> offsets(rows.size() + 1, 0);
+  for (size_t r = 0; r < rows.size(); ++r) {
+    offsets[r + 1] = offsets[r] + rows[r]->size();
+  }
+  std::vector<uint32_t> indices;
+  std::vector<double> values;
+  indices.reserve(offsets.back());
+  values.reserve(offsets.back());
+  for (const SparseVector<double> *row : rows) {
+    indices.insert(indices.end(), row->ids().begin(), row->ids().end());
+    values.insert(values.end(), row->values().begin(), row->values().end());
+  }
+  return CsrMatrix(columns, std::move(offsets), std::move(indices),
+                   std::move(values));
+}
+
+/**
+ * @brief Transpose by a counting sort over the columns. Rows are visited in
+ *        order, so the rows of the transpose come out sorted
+ * @return Transposed matrix, i.e. this matrix in CSC layout
+ */
+CsrMatrix CsrMatrix::Transpose() const {
+  std::vector<size_t> offsets(columns_ + 1, 0);
+  for (uint32_t c : indices_) ++offsets[c + 1];
+  for (size_t c = 0; c < columns_; ++c) offsets[c + 1] += offsets[c];
+
+  std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+  std::vector<uint32_t> indices(nonZeros());
+  std::vector<double> values(nonZeros());
+  for (size_t r = 0; r < rows(); ++r) {
+    for (size_t p = offsets_[r]; p < offsets_[r + 1]; ++p) {
+      size_t q = next[indices_[p]]++;
+      indices[q] = static_cast<uint32_t>(r);
+      values[q] = values_[p];
+    }
+  }
+  return CsrMatrix(rows(), std::move(offsets), std::move(indices),
+                   std::move(values));
+}
+
+/**
+ * @brief Expand to a dense matrix, with zeros where no entry is stored
+ * @return rows() x columns() matrix
+ */
+std::vector<std::vector<double>> CsrMatrix::ToDense() const {
+  std::vector<std::vector<double>> dense(rows(),
+                                         std::vector<double>(columns_, 0.0));
+  for (size_t r = 0; r < rows(); ++r) {
+    for (size_t p = offsets_[r]; p < offsets_[r + 1]; ++p) {
+      dense[r][indices_[p]] = values_[p];
+    }
+  }
+  return dense;
+}
+
+/**
+ * @brief Parse an accumulator name ("auto", "dense" or "hash")
+ * @param name Name given on the command line
+ * @param accumulator Set to the parsed accumulator
+ * @return Whether the name is known
+ */
+bool ParseSpGemmAccumulator(const std::string &name,
+                            SpGemmAccumulator &accumulator) {
+  if (name == "auto") {
+    accumulator = SpGemmAccumulator::kAuto;
+  } else if (name == "dense") {
+    accumulator = SpGemmAccumulator::kDense;
+  } else if (name == "hash") {
+    accumulator = SpGemmAccumulator::kHash;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Name of an accumulator, as ParseSpGemmAccumulator accepts it
+ */
+const char *SpGemmAccumulatorName(SpGemmAccumulator accumulator) {
+  switch (accumulator) {
+    case SpGemmAccumulator::kAuto:
+      return "auto";
+    case SpGemmAccumulator::kDense:
+      return "dense";
+    case SpGemmAccumulator::kHash:
+      return "hash";
+  }
+  return "";
+}
+
+/**
+ * @brief Row-parallel Gustavson product A * B. Row i of the product sums
+ *        a_ik * b_kj over the entries of row i of A in column order, so
+ *        every entry is summed in the same order as a serial row-by-row
+ *        product. Chunks of rows are computed into per-chunk buffers, then
+ *        copied into place once the row offsets are known
+ * @param a Left operand
+ * @param b Right operand, with as many rows as a has columns
+ * @param pool Workers computing the chunks
+ * @param options Accumulator and pruning threshold
+ * @return Product with rows sorted by column
+ */
+CsrMatrix SpGemm(const CsrMatrix &a, const CsrMatrix &b, ThreadPool &pool,
+                 const SpGemmOptions &options) {
+  if (a.columns() != b.rows()) {
+    std::cerr << "Error: cannot multiply a " << a.rows() << " x "
+              << a.columns() << " matrix by a " << b.rows() << " x "
+              << b.columns() << " matrix" << std::endl;
+    exit(1);
+  }
+
+  size_t chunks = (a.rows() + kRowsPerTask - 1) / kRowsPerTask;
+  std::vector<RowChunk> output(chunks);
+  std::vector<size_t> offsets(a.rows() + 1, 0);
+  std::vector<DenseAccumulator> dense(pool.size());
+  std::vector<HashAccumulator> hash(pool.size());
+
+  pool.ParallelFor(chunks, [&](size_t chunk, size_t worker) {
+    size_t end = std::min(a.rows(), (chunk + 1) * kRowsPerTask);
+    for (size_t i = chunk * kRowsPerTask; i < end; ++i) {
+      size_t products = 0;
+      for (size_t p = a.offsets()[i]; p < a.offsets()[i + 1]; ++p) {
+        uint32_t k = a.indices()[p];
+        products += b.offsets()[k + 1] - b.offsets()[k];
+      }
+      bool useHash = options.accumulator == SpGemmAccumulator::kHash ||
+                     (options.accumulator == SpGemmAccumulator::kAuto &&
+                      products * kHashWidthRatio < b.columns());
+
+      auto accumulate = [&](auto &accumulator) {
+        for (size_t p = a.offsets()[i]; p < a.offsets()[i + 1]; ++p) {
+          uint32_t k = a.indices()[p];
+          double weight = a.values()[p];
+          for (size_t q = b.offsets()[k]; q < b.offsets()[k + 1]; ++q) {
+            accumulator.Add(b.indices()[q], weight * b.values()[q]);
+          }
+        }
+        offsets[i + 1] = accumulator.Gather(options.threshold, output[chunk]);
+      };
+      if (useHash) {
+        hash[worker].Reserve(products);
+        accumulate(hash[worker]);
+      } else {
+        dense[worker].Resize(b.columns());
+        accumulate(dense[worker]);
+      }
+    }
+  });
+
+  for (size_t i = 0; i < a.rows(); ++i) offsets[i + 1] += offsets[i];
+  std::vector<uint32_t> indices(offsets.back());
+  std::vector<double> values(offsets.back());
+  pool.ParallelFor(chunks, [&](size_t chunk, size_t) {
+    size_t at = offsets[chunk * kRowsPerTask];
+    std::copy(output[chunk].indices.begin(), output[chunk].indices.end(),
+              indices.begin() + at);
+    std::copy(output[chunk].values.begin(), output[chunk].values.end(),
+              values.begin() + at);
+    output[chunk] = RowChunk();
+  });
+  return CsrMatrix(b.columns(), std::move(offsets), std::move(indices),
+                   std::move(values));
+}
@@ -0,0 +1,301 @@
+#include "../include/stringTable.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr char kLemmaMagic[8] = {'R', 'S', 'C', 'L', 'E', 'M', 'M', '\n'};
+constexpr uint32_t kLemmaVersion = 1;
+
+/**
+ * @brief Header of a binary lemma file. It is followed by the hash slots of
+ *        the word table, the position of every lemma among the word keys
+ *        and the word keys themselves, each section in the in-memory
+ *        layout of the table
+ */
+struct LemmaFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t slots;
+  uint64_t words;
+  uint64_t lemmas;
+  uint64_t keyBytes;
+};
+
+}  // namespace
+
+/**
+ * @brief Hash a string, reading it eight bytes at a time
+ * @param text String to hash
+ * @return 64-bit hash
+ */
+uint64_t HashString(std::string_view text) {
+  const char *data = text.data();
+  size_t size = text.size();
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 32;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data + i, size - i);
+  hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+/**
+ * @brief Insert a key, or overwrite its value if it is already present
+ * @param key Key
+ * @param value Value, must not be kNotFound
+ */
+void StringTable::Insert(std::string_view key, uint32_t value) {
+  if ((size_ + 1) * 2 > slots_.size()) Grow();
+  uint32_t hash = static_cast<uint32_t>(HashString(key));
+  size_t index = Probe(key, hash);
+  Slot &slot = slots_.owned()[index];
+  if (slot.offset == kEmpty) {
+    std::vector<char> &keys = keys_.owned();
+    slot = {hash, static_cast<uint32_t>(keys.size()),
+            static_cast<uint32_t>(key.size()), value};
+    keys.insert(keys.end(), key.begin(), key.end());
+    ++size_;
+  } else {
+    slot.value = value;
+  }
+}
+
+/**
+ * @brief Look up a key, inserting it if absent with the number of keys
+ *        inserted before it as value
+ * @param key Key
+ * @return Its value
+ */
+uint32_t StringTable::Intern(std::string_view key) {
+  if ((size_ + 1) * 2 > slots_.size()) Grow();
+  uint32_t hash = static_cast<uint32_t>(HashString(key));
+  size_t index = Probe(key, hash);
+  if (slots_[index].offset != kEmpty) return slots_[index].value;
+  std::vector<char> &keys = keys_.owned();
+  auto value = static_cast<uint32_t>(size_);
+  slots_.owned()[index] = {hash, static_cast<uint32_t>(keys.size()),
+                           static_cast<uint32_t>(key.size()), value};
+  keys.insert(keys.end(), key.begin(), key.end());
+  ++size_;
+  return value;
+}
+
+/**
+ * @brief Make room for a number of keys, so inserting them does not rehash
+ * @param keys Expected number of keys
+ */
+void StringTable::Reserve(size_t keys) {
+  size_t slots = 16;
+  while (slots < keys * 2) slots *= 2;
+  if (slots > slots_.size()) Rehash(slots);
+}
+
+/**
+ * @brief Look up a key
+ * @param key Key
+ * @return Its value or kNotFound
+ */
+uint32_t StringTable::Find(std::string_view key) const {
+  if (size_ == 0) return kNotFound;
+  const Slot &slot =
+      slots_[Probe(key, static_cast<uint32_t>(HashString(key)))];
+  return slot.offset == kEmpty ? kNotFound : slot.value;
+}
+
+/**
+ * @brief Linear probing from the hash position until the key or an empty
+ *        slot is found. The table is never more than half full
+ * @return Index of the slot holding the key, or of the empty slot ending
+ *         its probe sequence
+ */
+size_t StringTable::Probe(std::string_view key, uint32_t hash) const {
+  size_t mask = slots_.size() - 1;
+  size_t index = hash & mask;
+  while (true) {
+    const Slot &slot = slots_[index];
+    if (slot.offset == kEmpty) return index;
+    if (slot.hash == hash && slot.length == key.size() &&
+        std::memcmp(keys_.data() + slot.offset, key.data(), key.size()) == 0) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+/**
+ * @brief Double the number of slots (power of two) and reinsert every key
+ */
+void StringTable::Grow() {
+  Rehash(slots_.size() == 0 ? 16 : slots_.size() * 2);
+}
+
+/**
+ * @brief Move every key to a table with a number of slots
+ * @param slotCount Power of two, more than twice the number of keys
+ */
+void StringTable::Rehash(size_t slotCount) {
+  std::vector<Slot> &slots = slots_.owned();
+  std::vector<Slot> old = std::move(slots);
+  slots.assign(slotCount, {0, kEmpty, 0, kNotFound});
+  size_t mask = slots.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.offset == kEmpty) continue;
+    size_t index = slot.hash & mask;
+    while (slots[index].offset != kEmpty) index = (index + 1) & mask;
+    slots[index] = slot;
+  }
+}
+
+/**
+ * @brief Map a word to a lemma, interning the lemma. A word inserted twice
+ *        keeps its last lemma
+ * @param word Word
+ * @param lemma Its lemma
+ */
+void LemmaTable::Insert(std::string_view word, std::string_view lemma) {
+  words_.Insert(word, lemmaIds_.Intern(lemma));
+}
+
+/**
+ * @brief Finish loading: map every lemma that is not a word of the table to
+ *        itself, which leaves lemmatization results unchanged, and point
+ *        every lemma at its word key so the interned copies can be freed.
+ *        No word can be inserted afterwards
+ */
+void LemmaTable::Freeze() {
+  lemmaIds_.ForEach([this](std::string_view lemma, uint32_t id) {
+    if (words_.Find(lemma) == kNotFound) words_.Insert(lemma, id);
+  });
+  std::vector<Span> &spans = spans_.owned();
+  spans.resize(lemmaIds_.size());
+  lemmaIds_.ForEach([&](std::string_view lemma, uint32_t id) {
+    const StringTable::Slot &slot = words_.slots_[words_.Probe(
+        lemma, static_cast<uint32_t>(HashString(lemma)))];
+    spans[id] = {slot.offset, slot.length};
+  });
+  lemmaIds_ = StringTable();
+}
+
+/**
+ * @brief Save a frozen table in the binary lemma format, in native byte
+ *        order, so later runs map it instead of parsing the JSON rules
+ * @param path Path of the file to write
+ */
+void LemmaTable::SaveBinary(const std::string &path) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot create lemma file '" << path << "'."
+              << std::endl;
+    exit(1);
+  }
+  LemmaFileHeader header{};
+  std::memcpy(header.magic, kLemmaMagic, sizeof(kLemmaMagic));
+  header.version = kLemmaVersion;
+  header.slots = words_.slots_.size();
+  header.words = words_.size_;
+  header.lemmas = spans_.size();
+  header.keyBytes = words_.keys_.size();
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(words_.slots_.data()),
+             header.slots * sizeof(StringTable::Slot));
+  file.write(reinterpret_cast<const char *>(spans_.data()),
+             header.lemmas * sizeof(Span));
+  file.write(words_.keys_.data(), header.keyBytes);
+  if (!file) {
+    std::cerr << "Error: Cannot write lemma file '" << path << "'."
+              << std::endl;
+    exit(1);
+  }
+}
+
+/**
+ * @brief Whether a file is in the binary lemma format
+ * @param file Mapped file
+ */
+bool LemmaTable::IsBinary(const MappedFile &file) {
+  return file.size() >= sizeof(kLemmaMagic) &&
+         std::memcmp(file.data(), kLemmaMagic, sizeof(kLemmaMagic)) == 0;
+}
+
+/**
+ * @brief Use a binary lemma file in place. The header, the section sizes
+ *        and, in one pass, every occupied slot and lemma span are checked,
+ *        so a truncated or corrupt file is rejected instead of making
+ *        lookups read out of bounds or probe forever; the tables are not
+ *        copied. The file must have been written by SaveBinary on a machine
+ *        with the same byte order
+ * @param file Mapped binary lemma file, kept alive by the table
+ * @param path Path of the file, for error messages
+ * @return Frozen table viewing the file
+ */
+LemmaTable LemmaTable::MapBinary(std::shared_ptr<const MappedFile> file,
+                                 const std::string &path) {
+  LemmaFileHeader header;
+  auto invalid = [&path](const char *reason) {
+    std::cerr << "Error: Invalid lemma file '" << path << "': " << reason
+              << std::endl;
+    exit(1);
+  };
+  if (file->size() < sizeof(header)) invalid("truncated header");
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (header.version != kLemmaVersion) invalid("unsupported version");
+  // A non-zero power of two of slots, at most half of them full, so every
+  // probe sequence reaches an empty slot.
+  if (header.slots == 0 || (header.slots & (header.slots - 1)) != 0 ||
+      header.words > header.slots / 2 || header.lemmas > header.words) {
+    invalid("inconsistent table sizes");
+  }
+  uint64_t slotBytes = 0;
+  uint64_t spanBytes = 0;
+  uint64_t expected = 0;
+  if (__builtin_mul_overflow(header.slots, sizeof(StringTable::Slot),
+                             &slotBytes) ||
+      __builtin_mul_overflow(header.lemmas, sizeof(Span), &spanBytes) ||
+      __builtin_add_overflow(sizeof(header), slotBytes, &expected) ||
+      __builtin_add_overflow(expected, spanBytes, &expected) ||
+      __builtin_add_overflow(expected, header.keyBytes, &expected) ||
+      file->size() != expected) {
+    invalid("size does not match its header");
+  }
+
+  const char *data = file->data() + sizeof(header);
+  const auto *slots = reinterpret_cast<const StringTable::Slot *>(data);
+  const auto *spans = reinterpret_cast<const Span *>(data + slotBytes);
+  auto inKeys = [&header](uint64_t offset, uint64_t length) {
+    return offset <= header.keyBytes && length <= header.keyBytes - offset;
+  };
+  uint64_t occupied = 0;
+  for (uint64_t i = 0; i < header.slots; ++i) {
+    const StringTable::Slot &slot = slots[i];
+    if (slot.offset == StringTable::kEmpty) continue;
+    ++occupied;
+    if (!inKeys(slot.offset, slot.length) || slot.value >= header.lemmas) {
+      invalid("word slot out of range");
+    }
+  }
+  if (occupied != header.words) invalid("word count does not match slots");
+  for (uint64_t id = 0; id < header.lemmas; ++id) {
+    if (!inKeys(spans[id].offset, spans[id].length)) {
+      invalid("lemma span out of range");
+    }
+  }
+
+  LemmaTable table;
+  table.words_.slots_.Map(slots, header.slots);
+  table.spans_.Map(spans, header.lemmas);
+  table.words_.keys_.Map(data + slotBytes + spanBytes, header.keyBytes);
+  table.words_.size_ = header.words;
+  table.file_ = std::move(file);
+  return table;
+}
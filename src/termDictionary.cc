@@ -0,0 +1,129 @@
+#include "../include/termDictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+#include "../include/stringTable.h"
+
+/**
+ * @brief Copy constructor. The index keys view the terms of their own
+ *        dictionary, so every term is copied, including those the other
+ *        dictionary only views, and the index is rebuilt over the copies
+ * @param other Dictionary to copy
+ */
+TermDictionary::TermDictionary(const TermDictionary &other)
+    : hashBits_(other.hashBits_) {
+  Reserve(other.terms_.size());
+  for (std::string_view term : other.terms_) Insert(term);
+}
+
+/**
+ * @brief Copy assignment, see the copy constructor
+ * @param other Dictionary to copy
+ * @return Reference to this dictionary
+ */
+TermDictionary &TermDictionary::operator=(const TermDictionary &other) {
+  if (this != &other) {
+    TermDictionary copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+/**
+ * @brief Hashed dictionary of 2^bits buckets, for the hashing trick
+ * @param bits Number of bits of the term IDs
+ * @return Empty dictionary that maps every term to its bucket
+ */
+TermDictionary TermDictionary::Hashed(unsigned bits) {
+  TermDictionary dictionary;
+  dictionary.hashBits_ = bits;
+  return dictionary;
+}
+
+/**
+ * @brief Insert a term, assigning it the next free ID if it is new. A
+ *        hashed dictionary only returns the bucket of the term
+ * @param term Term to insert
+ * @return ID of the term
+ */
+uint32_t TermDictionary::Insert(std::string_view term) {
+  if (hashBits_ > 0) return Id(term);
+  auto it = ids_.find(term);
+  if (it != ids_.end()) return it->second;
+  owned_.emplace_back(term);
+  return InsertView(owned_.back());
+}
+
+/**
+ * @brief Insert a term without copying it, such as a term of a mapped
+ *        index, which must outlive the dictionary. Not for hashed
+ *        dictionaries
+ * @param term Term to insert
+ * @return ID of the term; an existing term keeps its ID
+ */
+uint32_t TermDictionary::InsertView(std::string_view term) {
+  uint32_t id = static_cast<uint32_t>(terms_.size());
+  auto inserted = ids_.emplace(term, id);
+  if (!inserted.second) return inserted.first->second;
+  terms_.push_back(term);
+  return id;
+}
+
+/**
+ * @brief Make room for a number of terms, so inserting them does not
+ *        rehash the index
+ * @param terms Number of terms
+ */
+void TermDictionary::Reserve(size_t terms) {
+  terms_.reserve(terms);
+  ids_.reserve(terms);
+}
+
+/**
+ * @brief Look up the ID of a term
+ * @param term Term to look up
+ * @return ID of the term or kNotFound if it is not in the dictionary (a
+ *         hashed dictionary has every term)
+ */
+uint32_t TermDictionary::Id(std::string_view term) const {
+  if (hashBits_ > 0) {
+    return static_cast<uint32_t>(HashString(term) &
+                                 ((uint64_t{1} << hashBits_) - 1));
+  }
+  auto it = ids_.find(term);
+  return it == ids_.end() ? kNotFound : it->second;
+}
+
+/**
+ * @brief Printable name of a term ID: the term itself or, in a hashed
+ *        dictionary, the bucket as '#' and a fixed number of hex digits
+ * @param id Term ID
+ * @param buffer Holds the name of a bucket
+ * @return The name, valid until buffer or the dictionary changes
+ */
+std::string_view TermDictionary::Label(uint32_t id,
+                                       std::string &buffer) const {
+  if (hashBits_ == 0) return terms_[id];
+  char label[16];
+  int length = std::snprintf(label, sizeof(label), "#%0*x",
+                             static_cast<int>((hashBits_ + 3) / 4), id);
+  buffer.assign(label, static_cast<size_t>(length));
+  return buffer;
+}
+
+/**
+ * @brief Get all term IDs ordered alphabetically by their term (by bucket
+ *        in a hashed dictionary, the order of their labels)
+ * @return Vector of term IDs
+ */
+std::vector<uint32_t> TermDictionary::SortedIds() const {
+  std::vector<uint32_t> sorted(size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  if (hashBits_ > 0) return sorted;
+  std::sort(sorted.begin(), sorted.end(), [this](uint32_t a, uint32_t b) {
+    return terms_[a] < terms_[b];
+  });
+  return sorted;
+}
@@ -0,0 +1,91 @@
+#include "../include/threadPool.h"
+
+/**
+ * @brief Constructor for ThreadPool
+ * @param threads Total number of threads, including the calling thread. Zero
+ *        means one per hardware thread
+ */
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+  }
+  for (size_t worker = 1; worker < threads; ++worker) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, worker);
+  }
+}
+
+/**
+ * @brief Destructor for ThreadPool. Stops and joins every worker
+ */
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+/**
+ * @brief Run task(index, worker) for every index in [0, count). Indices are
+ *        handed out dynamically, so uneven tasks balance across threads.
+ *        Returns when every index has been processed
+ * @param count Number of indices
+ * @param task Function called with the index and the worker (0..size()-1)
+ */
+void ThreadPool::ParallelFor(
+    size_t count, const std::function<void(size_t index, size_t worker)> &task) {
+  if (workers_.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i) task(i, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    active_ = workers_.size();
+    ++generation_;
+  }
+  wake_.notify_all();
+  RunTasks(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return active_ == 0; });
+  task_ = nullptr;
+}
+
+/**
+ * @brief Main loop of a worker thread: wait for a new loop and take part in it
+ * @param worker Index of the worker
+ */
+void ThreadPool::WorkerLoop(size_t worker) {
+  size_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+    }
+    RunTasks(worker);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0) done_.notify_one();
+    }
+  }
+}
+
+/**
+ * @brief Claim and run indices of the current loop until none are left
+ * @param worker Index of the worker
+ */
+void ThreadPool::RunTasks(size_t worker) {
+  size_t index;
+  while ((index = next_.fetch_add(1)) < count_) {
+    (*task_)(index, worker);
+  }
+}
@@ -1,5 +1,16 @@
 #include "../include/tools.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+// -j accepts at most this many threads per hardware thread.
+constexpr size_t kThreadsPerHardwareThread = 4;
+
+}  // namespace
+
 /**
  * @brief This function prints an error message for incorrect arguments
  * and provides usage information before exiting the program
@@ -41,15 +52,210 @@ void HelpOutput() {
   std::cout << "  -s <stopWordsFile>    Path to file containing stop words\n";
   std::cout << "  -l <lemmatizationFile> Path to JSON file containing "
                "lemmatization rules\n";
+  std::cout << "  -k <count>            Keep only the <count> most similar "
+               "documents of each\n"
+               "                        document instead of the full "
+               "similarity matrix\n";
+  std::cout << "  -j <threads>          Number of worker threads (default 1, "
+               "0 uses every\n"
+               "                        hardware thread, at most 4 per "
+               "hardware thread)\n";
+  std::cout << "  --stem                Fold English plurals (S-stemmer) after "
+               "removing stop\n"
+               "                        words\n";
+  std::cout << "  -t <threshold>        With -k, --spgemm or --serve, only "
+               "keep neighbours or\n"
+               "                        entries with similarity above "
+               "<threshold> (default 0)\n";
+  std::cout << "  --build-index <file>  Also save the processed corpus to a "
+               "binary index file\n";
+  std::cout << "  --load-index <file>   Read the corpus from an index file "
+               "instead of -d, -s\n"
+               "                        and -l\n";
+  std::cout << "  --serve               Answer JSON-lines recommendation "
+               "requests on standard\n"
+               "                        input instead of printing tables "
+               "(-k and -t set the\n"
+               "                        defaults)\n";
+  std::cout << "  --socket <path>       Like --serve, on a Unix domain socket "
+               "at <path>\n";
+  std::cout << "  --format <format>     Output format: table (default), csv, "
+               "tsv, jsonl or binary\n";
+  std::cout << "  --nonzero             Only write the terms each document "
+               "contains and the\n"
+               "                        non-zero similarities\n";
+  std::cout << "  --similarities-only   Leave the term tables out of the "
+               "output\n";
+  std::cout << "  --ann                 With -k, find the neighbours in an "
+               "HNSW graph instead\n"
+               "                        of comparing every pair (faster on "
+               "large corpora, may\n"
+               "                        miss some)\n";
+  std::cout << "  --ann-links <count>   Links per document in the graph "
+               "(default 16)\n";
+  std::cout << "  --ann-build-ef <count> Documents kept by the searches that "
+               "build the graph\n"
+               "                        (default 100)\n";
+  std::cout << "  --ann-ef <count>      Documents kept by each query search "
+               "(default 64; more\n"
+               "                        raise recall and time)\n";
+  std::cout << "  --ann-recall <count>  With -k, print the recall of the HNSW "
+               "lists against the\n"
+               "                        exact ones over <count> documents, "
+               "and their times\n";
+  std::cout << "  --near-duplicates <threshold>\n"
+               "                        Report clusters of documents whose "
+               "shingles have at\n"
+               "                        least this Jaccard similarity "
+               "(MinHash estimate)\n";
+  std::cout << "  --collapse-duplicates Keep only the first document of each "
+               "near-duplicate\n"
+               "                        cluster (threshold 0.8 unless "
+               "--near-duplicates)\n";
+  std::cout << "  --shard-size <count>  With -k, stream the documents in "
+               "shards of <count>\n"
+               "                        documents and spill their vectors to "
+               "disk, for corpora\n"
+               "                        larger than memory (no term "
+               "tables)\n";
+  std::cout << "  --shard-dir <dir>     Directory of the shard files "
+               "(default: a temporary one)\n";
+  std::cout << "  --weighting <scheme>  Term weights: logtf (default, 1 + "
+               "log10 tf), tfidf,\n"
+               "                        augmented (augmented TF times IDF) "
+               "or bm25\n";
+  std::cout << "  --bm25-k1 <k1>        BM25 term-frequency saturation "
+               "(default 1.2)\n";
+  std::cout << "  --bm25-b <b>          BM25 length normalization, from 0 "
+               "to 1 (default 0.75)\n";
+  std::cout << "  --min-df <count>      Leave out of the vocabulary the terms "
+               "in fewer than\n"
+               "                        <count> documents\n";
+  std::cout << "  --max-df <fraction>   Leave out of the vocabulary the terms "
+               "in more than this\n"
+               "                        fraction of the documents\n";
+  std::cout << "  --max-terms <count>   Keep only the <count> terms in most "
+               "documents\n";
+  std::cout << "  --hash-bits <bits>    Hash terms into 2^<bits> buckets "
+               "instead of keeping a\n"
+               "                        vocabulary (1 to 24)\n";
+  std::cout << "  --precision <type>    Store the weights of the similarity "
+               "phase as double\n"
+               "                        (default), float, int16 or int8\n";
+  std::cout << "  --precision-report <count>\n"
+               "                        With -k, print the error and top-K "
+               "overlap of --precision\n"
+               "                        against double over <count> "
+               "documents\n";
+  std::cout << "  --spgemm <accumulator> Compute the similarity matrix as "
+               "a sparse product with a\n"
+               "                        dense, hash or auto (default) "
+               "accumulator per row\n";
+  std::cout << "  --sparse-matrix       With --spgemm, keep and write only "
+               "the entries above -t\n"
+               "                        instead of the full matrix\n";
+  std::cout << "  --compile-lemmas <file> Save the rules of -l in the binary "
+               "lemma format, which\n"
+               "                        -l then loads without parsing, and "
+               "exit\n";
+  std::cout << "  --stats[=json]        Print the time, CPU time and memory of "
+               "every stage and\n"
+               "                        the corpus counters to standard "
+               "error\n";
   std::cout << "\nEXAMPLES\n" << std::endl;
   std::cout << "  ./recommender-system -d doc1.txt doc2.txt doc3.txt -s "
                "stopwords.txt -l corpus-en.json\n";
+  std::cout << "  ./recommender-system -d doc1.txt doc2.txt doc3.txt -s "
+               "stopwords.txt -l corpus-en.json -k 2\n";
+  std::cout << "  ./recommender-system -d doc1.txt doc2.txt -s stopwords.txt "
+               "-l corpus-en.json -k 2\n"
+               "                       --build-index corpus.idx\n";
+  std::cout << "  ./recommender-system --load-index corpus.idx -k 2\n";
+  std::cout << "  ./recommender-system --load-index corpus.idx -k 5 --serve\n";
+  std::cout << "  ./recommender-system --load-index corpus.idx -k 5 --format "
+               "csv --nonzero\n";
+  std::cout << "  ./recommender-system -d doc1.txt doc2.txt -s stopwords.txt "
+               "-l corpus-en.json -k 2\n"
+               "                       --stats=json\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 10 --ann\n"
+               "                       --ann-ef 128 --ann-recall 500\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 5\n"
+               "                       --near-duplicates 0.7 "
+               "--collapse-duplicates\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 10\n"
+               "                       --shard-size 5000 --shard-dir "
+               "/var/tmp/shards\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 5\n"
+               "                       --weighting bm25 --bm25-k1 1.5 "
+               "--bm25-b 0.6\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 5\n"
+               "                       --min-df 2 --max-df 0.9 --max-terms "
+               "50000\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json -k 10\n"
+               "                       --precision int8 --precision-report "
+               "500\n";
+  std::cout << "  ./recommender-system -d doc*.txt -s stopwords.txt -l "
+               "corpus-en.json --spgemm hash\n"
+               "                       --sparse-matrix -t 0.2 --format "
+               "csv\n";
+  std::cout << "  ./recommender-system -l corpus-es.json --compile-lemmas "
+               "corpus-es.lemmas\n";
   std::cout << "\nFor more information, use: ./recommender-system --help\n";
   std::cout << "=============================================================="
             << std::endl;
   exit(0);
 }
 
+/**
+ * @brief Parse the integer value of a command line option, exiting with an
+ * error message if it is missing or not a non-negative integer
+ * @param option - Name of the option, used in the error message
+ * @param value - Text of the value, nullptr if it is missing
+ * @return The parsed value
+ */
+long ParseIntegerOption(const std::string& option, const char* value) {
+  if (value == nullptr) {
+    std::cerr << "Error: " << option << " option requires a value" << std::endl;
+    ErrorOutput();
+  }
+  char* end = nullptr;
+  long parsed = std::strtol(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || parsed < 0) {
+    std::cerr << "Error: Invalid value '" << value << "' for " << option
+              << " option" << std::endl;
+    ErrorOutput();
+  }
+  return parsed;
+}
+
+/**
+ * @brief Parse the real value of a command line option, exiting with an
+ * error message if it is missing or not a number
+ * @param option - Name of the option, used in the error message
+ * @param value - Text of the value, nullptr if it is missing
+ * @return The parsed value
+ */
+double ParseRealOption(const std::string& option, const char* value) {
+  if (value == nullptr) {
+    std::cerr << "Error: " << option << " option requires a value" << std::endl;
+    ErrorOutput();
+  }
+  char* end = nullptr;
+  double parsed = std::strtod(value, &end);
+  if (*value == '\0' || *end != '\0') {
+    std::cerr << "Error: Invalid value '" << value << "' for " << option
+              << " option" << std::endl;
+    ErrorOutput();
+  }
+  return parsed;
+}
+
 /**
  * @brief This function checks the command line arguments and ensures they
  * are valid for the program's execution.
@@ -74,11 +280,9 @@ CommandLineArgs CheckArguments(int argc, char* argv[]) {
     }
   }
 
-  if (argc < 7) {
-    ErrorOutput();
-  }
-
   bool hasDocuments = false, hasStopWords = false, hasLemmatization = false;
+  bool hasWeighting = false;
+  bool hasThreshold = false;
 
   for (int i = 1; i < argc; i++) {
     std::string currentArg = argv[i];
@@ -147,12 +351,315 @@ CommandLineArgs CheckArguments(int argc, char* argv[]) {
       }
       args.lemmatizationFile = lemmatizationFile;
       file.close();
+    } else if (currentArg == "-k") {
+      i++;
+      args.topK = ParseIntegerOption("-k", i < argc ? argv[i] : nullptr);
+      if (args.topK == 0) {
+        std::cerr << "Error: -k option requires a positive count" << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "-j") {
+      i++;
+      args.threads = ParseIntegerOption("-j", i < argc ? argv[i] : nullptr);
+      size_t limit = kThreadsPerHardwareThread *
+                     std::max(1u, std::thread::hardware_concurrency());
+      if (args.threads > limit) {
+        std::cerr << "Error: -j allows at most " << limit << " threads ("
+                  << kThreadsPerHardwareThread << " per hardware thread)"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--stem") {
+      args.stem = true;
+    } else if (currentArg == "-t") {
+      i++;
+      args.threshold = ParseRealOption("-t", i < argc ? argv[i] : nullptr);
+      hasThreshold = true;
+    } else if (currentArg == "--serve") {
+      args.serve = true;
+    } else if (currentArg == "--socket") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --socket option requires a path" << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      args.serve = true;
+      args.socketFile = argv[i];
+    } else if (currentArg == "--format") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --format option requires a format" << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      if (!ParseOutputFormat(argv[i], args.output.format)) {
+        std::cerr << "Error: Unknown output format '" << argv[i]
+                  << "' (expected table, csv, tsv, jsonl or binary)"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--nonzero") {
+      args.output.nonZeroOnly = true;
+    } else if (currentArg == "--similarities-only") {
+      args.output.similaritiesOnly = true;
+    } else if (currentArg == "--stats" || currentArg == "--stats=text") {
+      args.stats = StatsFormat::kText;
+    } else if (currentArg == "--stats=json") {
+      args.stats = StatsFormat::kJson;
+    } else if (currentArg == "--ann") {
+      args.approximate = true;
+    } else if (currentArg == "--ann-links") {
+      i++;
+      args.ann.links =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+    } else if (currentArg == "--ann-build-ef") {
+      i++;
+      args.ann.buildBreadth =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+    } else if (currentArg == "--ann-ef") {
+      i++;
+      args.ann.searchBreadth =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+    } else if (currentArg == "--ann-recall") {
+      i++;
+      args.recallQueries =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+    } else if (currentArg == "--near-duplicates") {
+      i++;
+      args.deduplication.enabled = true;
+      args.deduplication.threshold =
+          ParseRealOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.deduplication.threshold <= 0.0 ||
+          args.deduplication.threshold > 1.0) {
+        std::cerr << "Error: --near-duplicates threshold must be in (0, 1]"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--collapse-duplicates") {
+      args.deduplication.enabled = true;
+      args.deduplication.collapse = true;
+    } else if (currentArg == "--shard-size") {
+      i++;
+      args.shards.documents =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.shards.documents == 0) {
+        std::cerr << "Error: --shard-size option requires a positive count"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--shard-dir") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --shard-dir option requires a directory"
+                  << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      args.shards.directory = argv[i];
+    } else if (currentArg == "--precision") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --precision option requires a type" << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      if (!ParseStoragePrecision(argv[i], args.precision)) {
+        std::cerr << "Error: Unknown precision '" << argv[i]
+                  << "' (expected double, float, int16 or int8)" << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--precision-report") {
+      i++;
+      args.precisionQueries =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+    } else if (currentArg == "--spgemm") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --spgemm option requires an accumulator"
+                  << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      args.spGemm = true;
+      if (!ParseSpGemmAccumulator(argv[i], args.product.accumulator)) {
+        std::cerr << "Error: Unknown accumulator '" << argv[i]
+                  << "' (expected dense, hash or auto)" << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--sparse-matrix") {
+      args.sparseMatrix = true;
+    } else if (currentArg == "--weighting") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --weighting option requires a scheme"
+                  << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      hasWeighting = true;
+      if (!ParseWeightingScheme(argv[i], args.weighting.scheme)) {
+        std::cerr << "Error: Unknown weighting scheme '" << argv[i]
+                  << "' (expected logtf, tfidf, augmented or bm25)"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--bm25-k1") {
+      i++;
+      hasWeighting = true;
+      args.weighting.k1 =
+          ParseRealOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.weighting.k1 < 0.0) {
+        std::cerr << "Error: --bm25-k1 must not be negative" << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--bm25-b") {
+      i++;
+      hasWeighting = true;
+      args.weighting.b =
+          ParseRealOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.weighting.b < 0.0 || args.weighting.b > 1.0) {
+        std::cerr << "Error: --bm25-b must be in [0, 1]" << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--min-df") {
+      i++;
+      args.vocabulary.minDocumentFrequency = static_cast<int>(
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr));
+      if (args.vocabulary.minDocumentFrequency == 0) {
+        std::cerr << "Error: --min-df option requires a positive count"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--max-df") {
+      i++;
+      args.vocabulary.maxDocumentFraction =
+          ParseRealOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.vocabulary.maxDocumentFraction <= 0.0 ||
+          args.vocabulary.maxDocumentFraction > 1.0) {
+        std::cerr << "Error: --max-df fraction must be in (0, 1]"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--max-terms") {
+      i++;
+      args.vocabulary.maxTerms =
+          ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (args.vocabulary.maxTerms == 0) {
+        std::cerr << "Error: --max-terms option requires a positive count"
+                  << std::endl;
+        ErrorOutput();
+      }
+    } else if (currentArg == "--hash-bits") {
+      i++;
+      long bits = ParseIntegerOption(currentArg, i < argc ? argv[i] : nullptr);
+      if (bits < 1 || bits > 24) {
+        std::cerr << "Error: --hash-bits must be between 1 and 24"
+                  << std::endl;
+        ErrorOutput();
+      }
+      args.vocabulary.hashBits = static_cast<unsigned>(bits);
+    } else if (currentArg == "--compile-lemmas") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --compile-lemmas option requires a filename"
+                  << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      args.compileLemmasFile = argv[i];
+    } else if (currentArg == "--build-index" || currentArg == "--load-index") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: " << currentArg << " option requires a filename"
+                  << std::endl;
+        ErrorOutput();
+      }
+      i++;
+      if (currentArg == "--build-index") {
+        args.buildIndexFile = argv[i];
+      } else {
+        args.loadIndexFile = argv[i];
+      }
     } else {
       std::cerr << "Error: Unknown option '" << currentArg << "'" << std::endl;
       ErrorOutput();
     }
   }
 
+  if ((args.approximate || args.recallQueries > 0) && args.topK == 0) {
+    std::cerr << "Error: --ann and --ann-recall require -k" << std::endl;
+    ErrorOutput();
+  }
+  if (args.precisionQueries > 0 && args.topK == 0) {
+    std::cerr << "Error: --precision-report requires -k" << std::endl;
+    ErrorOutput();
+  }
+  if (hasThreshold && args.topK == 0 && !args.spGemm && !args.serve) {
+    std::cerr << "Error: -t requires -k, --spgemm, --serve or --socket"
+              << std::endl;
+    ErrorOutput();
+  }
+  if (args.sparseMatrix && !args.spGemm) {
+    std::cerr << "Error: --sparse-matrix requires --spgemm" << std::endl;
+    ErrorOutput();
+  }
+  if (args.spGemm && (args.topK > 0 || args.serve ||
+                      args.precision != StoragePrecision::kDouble)) {
+    std::cerr << "Error: --spgemm cannot be combined with -k, --serve, "
+                 "--socket or --precision"
+              << std::endl;
+    ErrorOutput();
+  }
+  if (args.ann.links < 2 || args.ann.buildBreadth == 0) {
+    std::cerr << "Error: --ann-links must be at least 2 and --ann-build-ef "
+                 "positive"
+              << std::endl;
+    ErrorOutput();
+  }
+
+  if (!args.compileLemmasFile.empty()) {
+    if (!hasLemmatization || argc != 5) {
+      std::cerr << "Error: --compile-lemmas takes only -l" << std::endl;
+      ErrorOutput();
+    }
+    return args;
+  }
+  bool selectsVocabulary =
+      args.vocabulary.Prunes() || args.vocabulary.hashBits > 0;
+  if (args.vocabulary.hashBits > 0 &&
+      (args.vocabulary.Prunes() || !args.buildIndexFile.empty())) {
+    std::cerr << "Error: --hash-bits cannot be combined with --min-df, "
+                 "--max-df, --max-terms or --build-index"
+              << std::endl;
+    ErrorOutput();
+  }
+  if (!args.shards.directory.empty() && args.shards.documents == 0) {
+    std::cerr << "Error: --shard-dir requires --shard-size" << std::endl;
+    ErrorOutput();
+  }
+  if (args.shards.documents > 0) {
+    if (args.topK == 0) {
+      std::cerr << "Error: --shard-size requires -k" << std::endl;
+      ErrorOutput();
+    }
+    if (!args.loadIndexFile.empty() || !args.buildIndexFile.empty() ||
+        args.serve || args.approximate || args.recallQueries > 0 ||
+        args.precisionQueries > 0 || args.deduplication.enabled) {
+      std::cerr << "Error: --shard-size cannot be combined with "
+                   "--load-index, --build-index, --serve, --socket, --ann, "
+                   "--ann-recall, --precision-report, --near-duplicates or "
+                   "--collapse-duplicates"
+                << std::endl;
+      ErrorOutput();
+    }
+  }
+
+  if (!args.loadIndexFile.empty()) {
+    if (hasDocuments || hasStopWords || hasLemmatization || args.stem ||
+        args.deduplication.enabled || !args.buildIndexFile.empty() ||
+        hasWeighting || selectsVocabulary) {
+      std::cerr << "Error: --load-index cannot be combined with -d, -s, -l, "
+                   "--stem, --near-duplicates, --collapse-duplicates, "
+                   "--build-index or the weighting and vocabulary options"
+                << std::endl;
+      ErrorOutput();
+    }
+    return args;
+  }
+
   if (!hasDocuments || !hasStopWords || !hasLemmatization) {
     std::cerr << "Error: Missing required options. All of -d, -s, and -l must "
                  "be specified."
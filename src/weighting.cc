@@ -0,0 +1,59 @@
+#include "../include/weighting.h"
+
+/**
+ * @brief Parse the name of a weighting scheme
+ * @param name logtf, tfidf, augmented or bm25
+ * @param scheme Set to the scheme on success
+ * @return Whether the name is known
+ */
+bool ParseWeightingScheme(const std::string &name, WeightingScheme &scheme) {
+  if (name == "logtf") {
+    scheme = WeightingScheme::kLogTF;
+  } else if (name == "tfidf") {
+    scheme = WeightingScheme::kTfIdf;
+  } else if (name == "augmented") {
+    scheme = WeightingScheme::kAugmented;
+  } else if (name == "bm25") {
+    scheme = WeightingScheme::kBM25;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Name of a weighting scheme, as ParseWeightingScheme accepts it
+ */
+const char *WeightingSchemeName(WeightingScheme scheme) {
+  switch (scheme) {
+    case WeightingScheme::kLogTF:
+      return "logtf";
+    case WeightingScheme::kTfIdf:
+      return "tfidf";
+    case WeightingScheme::kAugmented:
+      return "augmented";
+    case WeightingScheme::kBM25:
+      return "bm25";
+  }
+  return "";
+}
+
+/**
+ * @brief IDF of a term under a weighting scheme: log10(N / df), or the
+ *        BM25 IDF ln(1 + (N - df + 0.5) / (df + 0.5)), which stays positive
+ *        for terms in most documents. Terms in no document get 0
+ * @param scheme Weighting scheme
+ * @param documents Number of documents N
+ * @param documentFrequency Number of documents with the term
+ * @return IDF of the term
+ */
+double InverseDocumentFrequency(WeightingScheme scheme, size_t documents,
+                                int documentFrequency) {
+  if (documentFrequency <= 0) return 0.0;
+  double n = static_cast<double>(documents);
+  double df = static_cast<double>(documentFrequency);
+  if (scheme == WeightingScheme::kBM25) {
+    return std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+  }
+  return log10(n / df);
+}